@@ -2,14 +2,17 @@ from distutils.core import setup, Extension
 import sysconfig
 
 def main():
-    CFLAGS = ['-g', '-Wall', '-std=c99', '-fopenmp', '-mavx', '-mfma', '-pthread', '-O3']
+    # No -m flags: src/kernels.c builds every instruction set and picks one at import time
+    CFLAGS = ['-g', '-Wall', '-std=c99', '-fopenmp', '-pthread', '-O3']
     LDFLAGS = ['-fopenmp']
     setup(name="numc",
           version="0.0.1",
           description="numc matrix operations",
           ext_modules=[
             Extension("numc",
-                      sources=["src/numc.c", "src/matrix.c"],
+                      sources=["src/numc.c", "src/matrix.c", "src/kernels.c", "src/pool.c",
+                               "src/expr.c", "src/random.c", "src/parallel.c", "src/npy.c",
+                               "src/backing.c"],
                       extra_compile_args=CFLAGS,
                       extra_link_args=LDFLAGS,
                       language='c')
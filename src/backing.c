@@ -0,0 +1,170 @@
+/* madvise, mkstemp and strdup are not part of strict C99 */
+#define _DEFAULT_SOURCE
+
+#include "backing.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The mapping a file-backed matrix's data lives in */
+typedef struct backing {
+    void *base;
+    size_t len;
+    char *dir; // Directory results computed from the matrix get their scratch files in
+} backing;
+
+static size_t memory_budget = BACKING_DEFAULT_BUDGET;
+
+static void release_backing(void *owner) {
+    backing *store = owner;
+    munmap(store->base, store->len);
+    free(store->dir);
+    free(store);
+}
+
+/* Returns the mapping `mat`'s data lives in, or NULL if it is not file-backed */
+static backing *backing_of(matrix *mat) {
+    matrix *root = mat->parent == NULL ? mat : mat->parent;
+    return root->release == release_backing ? root->owner : NULL;
+}
+
+/*
+ * Opens the file for a new file-backed matrix: a scratch file that is deleted right away if
+ * `path` is a directory, else the file at `path`, created or truncated. Stores the directory
+ * the file is in to *dir. Returns the file descriptor, or -1 with errno set.
+ */
+static int open_backing(const char *path, char **dir) {
+    struct stat info;
+    int fd;
+    if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+      char *name = malloc(strlen(path) + sizeof("/numc-XXXXXX"));
+      *dir = strdup(path);
+      if (name == NULL || *dir == NULL) {
+        free(name);
+        free(*dir);
+        return -1;
+      }
+      sprintf(name, "%s/numc-XXXXXX", path);
+      fd = mkstemp(name);
+      if (fd >= 0) {
+        unlink(name);
+      }
+      free(name);
+    } else {
+      const char *slash = strrchr(path, '/');
+      *dir = slash == NULL ? strdup(".") : strndup(path, slash == path ? 1 : slash - path);
+      if (*dir == NULL) {
+        return -1;
+      }
+      fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0) {
+      free(*dir);
+    }
+    return fd;
+}
+
+/*
+ * Allocates a zero-initialized `rows` x `cols` matrix of type `type` whose data is a shared
+ * mapping of a file. If `path` is a directory the file is an anonymous scratch file in it, else
+ * it is the file at `path`, which is created or truncated and keeps the data after the matrix is
+ * gone. Return 0 upon success, -1 if `rows` or `cols` are invalid, -2 if allocation fails and
+ * -3 if the file cannot be created or mapped (errno says why).
+ */
+int allocate_matrix_backed(matrix **mat, int rows, int cols, dtype type, const char *path) {
+    if (rows <= 0 || cols <= 0) {
+      return -1;
+    }
+    backing *store = malloc(sizeof(*store));
+    if (store == NULL) {
+      return -2;
+    }
+    int fd = open_backing(path, &store->dir);
+    if (fd < 0) {
+      free(store);
+      return -3;
+    }
+    store->len = (size_t) rows * cols * dtype_size(type);
+    store->base = MAP_FAILED;
+    if (ftruncate(fd, store->len) == 0) {
+      store->base = mmap(NULL, store->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (store->base == MAP_FAILED) {
+      free(store->dir);
+      free(store);
+      return -3;
+    }
+    int err = allocate_matrix_external(mat, store->base, type, rows, cols, release_backing,
+                                       store);
+    if (err != 0) {
+      release_backing(store);
+    }
+    return err;
+}
+
+/*
+ * Allocates the result of an operation on `mat1` and `mat2` (which may be NULL). It gets a
+ * scratch file next to the first file-backed operand if there is one and the result is larger
+ * than the memory budget, and pooled memory otherwise. The data is not initialized.
+ * Return values are those of allocate_matrix_backed.
+ */
+int allocate_matrix_like(matrix **mat, int rows, int cols, dtype type, matrix *mat1,
+                         matrix *mat2) {
+    backing *store = backing_of(mat1);
+    if (store == NULL && mat2 != NULL) {
+      store = backing_of(mat2);
+    }
+    if (store != NULL && (size_t) rows * cols * dtype_size(type) > get_memory_budget()) {
+      return allocate_matrix_backed(mat, rows, cols, type, store->dir);
+    }
+    return allocate_matrix_typed(mat, rows, cols, type);
+}
+
+/* Returns whether `mat`'s data lives in a file (see allocate_matrix_backed) */
+int is_backed(matrix *mat) {
+    return backing_of(mat) != NULL;
+}
+
+/*
+ * Passes `advice` about the bytes from `begin` to `end` of file-backed `mat` to the kernel, and
+ * does nothing for other matrices. BACKING_DONTNEED only applies to pages that lie entirely in
+ * the range, so data next to it stays mapped.
+ */
+void backing_advise(matrix *mat, const void *begin, const void *end, backing_advice advice) {
+    backing *store = backing_of(mat);
+    if (store == NULL) {
+      return;
+    }
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t base = (uintptr_t) store->base;
+    uintptr_t start = (uintptr_t) begin < base ? base : (uintptr_t) begin;
+    uintptr_t stop = (uintptr_t) end > base + store->len ? base + store->len : (uintptr_t) end;
+    if (advice == BACKING_DONTNEED) {
+      start = (start + page - 1) / page * page;
+      stop = stop / page * page;
+    } else {
+      start = start / page * page;
+      stop = (stop + page - 1) / page * page;
+    }
+    if (start >= stop) {
+      return;
+    }
+    int flag = advice == BACKING_SEQUENTIAL ? MADV_SEQUENTIAL :
+               advice == BACKING_WILLNEED ? MADV_WILLNEED : MADV_DONTNEED;
+    madvise((void *) start, stop - start, flag);
+}
+
+/* Sets how many bytes of file-backed operands an operation may keep mapped in at a time */
+void set_memory_budget(size_t bytes) {
+    memory_budget = bytes;
+}
+
+size_t get_memory_budget(void) {
+    return memory_budget;
+}
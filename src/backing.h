@@ -0,0 +1,31 @@
+#ifndef BACKING_H
+#define BACKING_H
+
+#include "matrix.h"
+
+/*
+ * File-backed matrices. Their data is a shared mapping of a file instead of pooled memory, so
+ * matrices larger than RAM live in the page cache and on disk. Operations on them run in tiles
+ * of at most the memory budget: each tile's pages are prefetched before it runs and dropped
+ * from the process once it is done, which keeps the resident set bounded by the budget.
+ */
+
+/* Default number of bytes of file-backed operands an operation keeps mapped in at a time */
+#define BACKING_DEFAULT_BUDGET ((size_t) 1 << 28)
+
+/* What backing_advise tells the kernel about a range of a file-backed matrix */
+typedef enum backing_advice {
+    BACKING_SEQUENTIAL, // will be read in order, so read ahead aggressively
+    BACKING_WILLNEED, // will be used soon, start reading it in
+    BACKING_DONTNEED, // done with it for now, unmap its pages (the data stays in the file)
+} backing_advice;
+
+int allocate_matrix_backed(matrix **mat, int rows, int cols, dtype type, const char *path);
+int allocate_matrix_like(matrix **mat, int rows, int cols, dtype type, matrix *mat1,
+                         matrix *mat2);
+int is_backed(matrix *mat);
+void backing_advise(matrix *mat, const void *begin, const void *end, backing_advice advice);
+void set_memory_budget(size_t bytes);
+size_t get_memory_budget(void);
+
+#endif
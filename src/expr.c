@@ -0,0 +1,265 @@
+#include "expr.h"
+#include "kernels.h"
+#include "parallel.h"
+#include <stdlib.h>
+
+/* Rows are split into chunks of this many elements for multithreading, as in matrix.c */
+#define CHUNK_SIZE 8192
+/*
+ * Elements evaluated at a time. One buffer of this size per node (at most 32KB for
+ * EXPR_MAX_NODES nodes) keeps all intermediate values of a block in L1.
+ */
+#define EXPR_BLOCK 256
+
+/* One node of an expression after common subtrees have been merged */
+typedef struct expr_step {
+    expr_op op;
+    int lhs; // index of an earlier step
+    int rhs;
+    matrix *leaf;
+    double alpha;
+    double beta;
+} expr_step;
+
+static inline char *element(matrix *mat, int row, long col) {
+    return (char *) mat->data +
+           ((long) row * mat->row_stride + col * mat->col_stride) * (long) dtype_size(mat->dtype);
+}
+
+/*
+ * Makes `node` a leaf expression that reads `mat`. The leaf holds a reference to `mat`'s data,
+ * which must not change until the expression has been evaluated.
+ * Return 0 upon success and -2 if allocation fails.
+ */
+int expr_leaf(expr **node, matrix *mat) {
+    expr *leaf = malloc(sizeof(*leaf));
+    if (leaf == NULL) {
+      return -2;
+    }
+    if (allocate_matrix_view(&leaf->leaf, mat, 0, mat->rows, mat->cols, mat->row_stride,
+                             mat->col_stride) != 0) {
+      free(leaf);
+      return -2;
+    }
+    leaf->op = EXPR_LEAF;
+    leaf->rows = mat->rows;
+    leaf->cols = mat->cols;
+    leaf->dtype = mat->dtype;
+    leaf->ref_cnt = 1;
+    leaf->size = 1;
+    leaf->lhs = NULL;
+    leaf->rhs = NULL;
+    leaf->alpha = 0;
+    leaf->beta = 0;
+    *node = leaf;
+    return 0;
+}
+
+/*
+ * Makes `node` the expression `op` applied to `lhs` (and `rhs` for binary operators, else NULL).
+ * The new node holds its own references to its operands.
+ * Return 0 upon success, -1 if the operands' dimensions or types differ or the expression would
+ * have more than EXPR_MAX_NODES nodes, and -2 if allocation fails.
+ */
+int expr_apply(expr **node, expr_op op, expr *lhs, expr *rhs) {
+    int size = 1 + lhs->size + (rhs == NULL ? 0 : rhs->size);
+    if (size > EXPR_MAX_NODES) {
+      return -1;
+    }
+    if (rhs != NULL && (lhs->rows != rhs->rows || lhs->cols != rhs->cols ||
+                        lhs->dtype != rhs->dtype)) {
+      return -1;
+    }
+    expr *result = malloc(sizeof(*result));
+    if (result == NULL) {
+      return -2;
+    }
+    result->op = op;
+    result->rows = lhs->rows;
+    result->cols = lhs->cols;
+    result->dtype = lhs->dtype;
+    result->ref_cnt = 1;
+    result->size = size;
+    result->leaf = NULL;
+    result->lhs = lhs;
+    result->rhs = rhs;
+    result->alpha = 0;
+    result->beta = 0;
+    lhs->ref_cnt++;
+    if (rhs != NULL) {
+      rhs->ref_cnt++;
+    }
+    *node = result;
+    return 0;
+}
+
+/*
+ * Makes `node` the scalar expression `op` (EXPR_AFFINE, EXPR_DIV_SCALAR or EXPR_RDIV_SCALAR)
+ * applied to `lhs` with the scalars `alpha` and `beta`. The scalars live in the node itself,
+ * so no matrix is ever filled with them.
+ * Return 0 upon success, -1 if the expression would have more than EXPR_MAX_NODES nodes, and
+ * -2 if allocation fails.
+ */
+int expr_apply_scalar(expr **node, expr_op op, expr *lhs, double alpha, double beta) {
+    int err = expr_apply(node, op, lhs, NULL);
+    if (err != 0) {
+      return err;
+    }
+    (*node)->alpha = alpha;
+    (*node)->beta = beta;
+    return 0;
+}
+
+/* Drops one reference to `node`, freeing it and releasing its operands when none are left */
+void expr_release(expr *node) {
+    if (node == NULL) {
+      return;
+    }
+    node->ref_cnt--;
+    if (node->ref_cnt > 0) {
+      return;
+    }
+    deallocate_matrix(node->leaf);
+    expr_release(node->lhs);
+    expr_release(node->rhs);
+    free(node);
+}
+
+/*
+ * Appends `node` and its operands to `steps` in evaluation order, once each, and returns the
+ * index of `node`'s step. `seen[i]` is the node step i was made from.
+ */
+static int compile(expr *node, expr **seen, expr_step *steps, int *count) {
+    for (int i = 0; i < *count; i++) {
+      if (seen[i] == node) {
+        return i;
+      }
+    }
+    int lhs = node->lhs == NULL ? -1 : compile(node->lhs, seen, steps, count);
+    int rhs = node->rhs == NULL ? -1 : compile(node->rhs, seen, steps, count);
+    int index = (*count)++;
+    seen[index] = node;
+    steps[index].op = node->op;
+    steps[index].lhs = lhs;
+    steps[index].rhs = rhs;
+    steps[index].leaf = node->leaf;
+    steps[index].alpha = node->alpha;
+    steps[index].beta = node->beta;
+    return index;
+}
+
+/*
+ * Evaluates `n` consecutive elements of row `row` of the result, starting at column `col`,
+ * one EXPR_BLOCK at a time. Contiguous leaves are read in place, strided ones are gathered.
+ * The last step writes straight into a unit-stride result.
+ */
+static void eval_span(const kernel_table *kt, const expr_step *steps, int count,
+                      matrix *result, int row, long col, long n) {
+    /* double arrays so the buffers are aligned and large enough for any element type */
+    double buffers[EXPR_MAX_NODES][EXPR_BLOCK];
+    const void *values[EXPR_MAX_NODES];
+    for (long i = 0; i < n; i += EXPR_BLOCK) {
+      long len = n - i < EXPR_BLOCK ? n - i : EXPR_BLOCK;
+      char *dst = element(result, row, col + i);
+      for (int s = 0; s < count; s++) {
+        const expr_step *step = &steps[s];
+        void *out = s == count - 1 && result->col_stride == 1 ? (void *) dst : buffers[s];
+        switch (step->op) {
+          case EXPR_LEAF: {
+            const char *src = element(step->leaf, row, col + i);
+            long stride = step->leaf->col_stride;
+            if (stride == 1) {
+              values[s] = src;
+              continue;
+            }
+            /* A broadcast (stride 0) leaf repeats one value, which is already in its buffer */
+            if (stride != 0 || i == 0 || out != buffers[s]) {
+              kt->gather(out, src, stride, len);
+            }
+            break;
+          }
+          case EXPR_NEG:
+            kt->neg(out, values[step->lhs], len);
+            break;
+          case EXPR_ABS:
+            kt->abs(out, values[step->lhs], len);
+            break;
+          case EXPR_ADD:
+            kt->add(out, values[step->lhs], values[step->rhs], len);
+            break;
+          case EXPR_SUB:
+            kt->sub(out, values[step->lhs], values[step->rhs], len);
+            break;
+          case EXPR_MUL:
+            kt->mul(out, values[step->lhs], values[step->rhs], len);
+            break;
+          case EXPR_DIV:
+            kt->div(out, values[step->lhs], values[step->rhs], len);
+            break;
+          case EXPR_AFFINE:
+            kt->affine(out, values[step->lhs], step->alpha, step->beta, len);
+            break;
+          case EXPR_DIV_SCALAR:
+          case EXPR_RDIV_SCALAR:
+            kt->div_scalar(out, values[step->lhs], step->alpha, step->op == EXPR_RDIV_SCALAR,
+                           len);
+            break;
+        }
+        values[s] = out;
+      }
+      const void *value = values[count - 1];
+      if (value != dst) {
+        kt->scatter(dst, result->col_stride, value, len);
+      }
+    }
+}
+
+/* What each eval_units tile needs to evaluate its rows and chunks of an expression */
+typedef struct eval_ctx {
+    const kernel_table *kt;
+    const expr_step *steps;
+    int count;
+    matrix *result;
+    long cols;
+    long chunks;
+} eval_ctx;
+
+static void eval_units(void *arg, long begin, long end) {
+    eval_ctx *ctx = arg;
+    for (long unit = begin; unit < end; unit++) {
+      int row = unit / ctx->chunks;
+      long col = (unit % ctx->chunks) * CHUNK_SIZE;
+      long len = ctx->cols - col < CHUNK_SIZE ? ctx->cols - col : CHUNK_SIZE;
+      eval_span(ctx->kt, ctx->steps, ctx->count, ctx->result, row, col, len);
+    }
+}
+
+/*
+ * Store the value of the expression `node` to `result`, which must have the expression's
+ * dimensions and type and must not partially overlap any of its leaves.
+ * Return 0 upon success.
+ */
+int eval_expr(matrix *result, expr *node) {
+    expr *seen[EXPR_MAX_NODES];
+    expr_step steps[EXPR_MAX_NODES];
+    int count = 0;
+    compile(node, seen, steps, &count);
+    long rows = result->rows;
+    long cols = result->cols;
+    int contiguous = is_contiguous(result);
+    for (int s = 0; s < count; s++) {
+      if (steps[s].op == EXPR_LEAF && !is_contiguous(steps[s].leaf)) {
+        contiguous = 0;
+      }
+    }
+    if (contiguous) {
+      cols *= rows;
+      rows = 1;
+    }
+    long chunks = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    eval_ctx ctx = {kernels_for(result->dtype), steps, count, result, cols, chunks};
+    /* Each element costs about one element-wise operation per node */
+    int threads = threads_for(PARALLEL_ELEMENTWISE, rows * cols * count, rows * chunks);
+    parallel_for(threads, rows * chunks, eval_units, &ctx);
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include "matrix.h"
+
+/*
+ * Deferred element-wise expressions. A tree of EXPR_* nodes over leaf matrices is evaluated
+ * by eval_expr in a single pass: each block of the result is computed from the leaves while
+ * every intermediate value stays in a small per-thread buffer, so only the leaves are read
+ * from and only the result is written to memory.
+ */
+
+/* Most distinct nodes an expression may have; numc evaluates larger ones in steps */
+#define EXPR_MAX_NODES 16
+
+typedef enum expr_op {
+    EXPR_LEAF,
+    EXPR_NEG,
+    EXPR_ABS,
+    EXPR_ADD,
+    EXPR_SUB,
+    EXPR_MUL, // element-wise
+    EXPR_DIV,
+    EXPR_AFFINE, // alpha * lhs + beta
+    EXPR_DIV_SCALAR, // lhs / alpha
+    EXPR_RDIV_SCALAR, // alpha / lhs
+} expr_op;
+
+typedef struct expr {
+    expr_op op;
+    int rows;
+    int cols;
+    dtype dtype; // Type of the elements of the value, the same for every node of a tree
+    int ref_cnt; // How many expressions and numc objects refer to this node
+    int size; // Nodes in this tree, counting shared subtrees once per use
+    matrix *leaf; // EXPR_LEAF only: a view that keeps the operand's data alive
+    struct expr *lhs; // Operand of unary nodes, left operand of binary nodes
+    struct expr *rhs; // Right operand of binary nodes, else NULL
+    double alpha; // Scalar operands of EXPR_AFFINE and the scalar division nodes
+    double beta;
+} expr;
+
+int expr_leaf(expr **node, matrix *mat);
+int expr_apply(expr **node, expr_op op, expr *lhs, expr *rhs);
+int expr_apply_scalar(expr **node, expr_op op, expr *lhs, double alpha, double beta);
+void expr_release(expr *node);
+int eval_expr(matrix *result, expr *node);
+
+#endif
@@ -0,0 +1,389 @@
+#include "kernels.h"
+#include "random.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Include SSE intrinsics
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#include <x86intrin.h>
+#define KERNELS_X86
+#endif
+
+/*
+ * 4 x 4 tile transposes, dst[j * ldd + i] = src[i * lds + j] for i, j < 4, used by the
+ * transpose kernels through TRANSPOSE4. The SIMD ones shuffle whole rows in registers.
+ */
+static inline void transpose4_scalar_f64(double *dst, long ldd, const double *src, long lds) {
+    for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 4; j++) {
+        dst[j * ldd + i] = src[i * lds + j];
+      }
+    }
+}
+
+static inline void transpose4_scalar_f32(float *dst, long ldd, const float *src, long lds) {
+    for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 4; j++) {
+        dst[j * ldd + i] = src[i * lds + j];
+      }
+    }
+}
+
+#ifdef KERNELS_X86
+/* Four 2 x 2 transposes, one pair of rows and columns at a time */
+__attribute__((target("sse2")))
+static inline void transpose4_sse2_f64(double *dst, long ldd, const double *src, long lds) {
+    for (int i = 0; i < 4; i += 2) {
+      for (int j = 0; j < 4; j += 2) {
+        __m128d row0 = _mm_loadu_pd(src + i * lds + j);
+        __m128d row1 = _mm_loadu_pd(src + (i + 1) * lds + j);
+        _mm_storeu_pd(dst + j * ldd + i, _mm_unpacklo_pd(row0, row1));
+        _mm_storeu_pd(dst + (j + 1) * ldd + i, _mm_unpackhi_pd(row0, row1));
+      }
+    }
+}
+
+__attribute__((target("sse2")))
+static inline void transpose4_sse2_f32(float *dst, long ldd, const float *src, long lds) {
+    __m128 row0 = _mm_loadu_ps(src);
+    __m128 row1 = _mm_loadu_ps(src + lds);
+    __m128 row2 = _mm_loadu_ps(src + 2 * lds);
+    __m128 row3 = _mm_loadu_ps(src + 3 * lds);
+    _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+    _mm_storeu_ps(dst, row0);
+    _mm_storeu_ps(dst + ldd, row1);
+    _mm_storeu_ps(dst + 2 * ldd, row2);
+    _mm_storeu_ps(dst + 3 * ldd, row3);
+}
+
+/* Interleaves pairs of rows within each 128-bit lane, then swaps the lanes into place */
+__attribute__((target("avx2")))
+static inline void transpose4_avx2_f64(double *dst, long ldd, const double *src, long lds) {
+    __m256d row0 = _mm256_loadu_pd(src);
+    __m256d row1 = _mm256_loadu_pd(src + lds);
+    __m256d row2 = _mm256_loadu_pd(src + 2 * lds);
+    __m256d row3 = _mm256_loadu_pd(src + 3 * lds);
+    __m256d even01 = _mm256_unpacklo_pd(row0, row1);
+    __m256d odd01 = _mm256_unpackhi_pd(row0, row1);
+    __m256d even23 = _mm256_unpacklo_pd(row2, row3);
+    __m256d odd23 = _mm256_unpackhi_pd(row2, row3);
+    _mm256_storeu_pd(dst, _mm256_permute2f128_pd(even01, even23, 0x20));
+    _mm256_storeu_pd(dst + ldd, _mm256_permute2f128_pd(odd01, odd23, 0x20));
+    _mm256_storeu_pd(dst + 2 * ldd, _mm256_permute2f128_pd(even01, even23, 0x31));
+    _mm256_storeu_pd(dst + 3 * ldd, _mm256_permute2f128_pd(odd01, odd23, 0x31));
+}
+#endif
+
+/* Portable fallback: plain C, one element at a time */
+#define ISA scalar
+#define DTYPE f64
+#define ELEM double
+#define KERNEL_TARGET
+#define VEC double
+#define VLEN 1
+#define VLOADU(p) (*(p))
+#define VLOADA(p) (*(p))
+#define VSTOREU(p, v) (*(p) = (v))
+#define VSTOREA(p, v) (*(p) = (v))
+#define VSET1(x) (x)
+#define VZERO() 0.0
+#define VADD(a, b) ((a) + (b))
+#define VSUB(a, b) ((a) - (b))
+#define VMUL(a, b) ((a) * (b))
+#define VFMADD(a, b, c) ((a) * (b) + (c))
+#define VABS(a) fabs(a)
+#define VNEG(a) ((a) * -1)
+#define VMAX(a, b) ((a) > (b) ? (a) : (b))
+#define VMIN(a, b) ((a) < (b) ? (a) : (b))
+#define VDIV(a, b) ((a) / (b))
+#define VNAN(a) ((a) != (a) ? (a) : 0.0)
+#define TRANSPOSE4(dst, ldd, src, lds) transpose4_scalar_f64(dst, ldd, src, lds)
+#include "kernels_impl.h"
+
+#define ISA scalar
+#define DTYPE f32
+#define ELEM float
+#define KERNEL_TARGET
+#define VEC float
+#define VLEN 1
+#define VLOADU(p) (*(p))
+#define VLOADA(p) (*(p))
+#define VSTOREU(p, v) (*(p) = (v))
+#define VSTOREA(p, v) (*(p) = (v))
+#define VSET1(x) (x)
+#define VZERO() 0.0f
+#define VADD(a, b) ((a) + (b))
+#define VSUB(a, b) ((a) - (b))
+#define VMUL(a, b) ((a) * (b))
+#define VFMADD(a, b, c) ((a) * (b) + (c))
+#define VABS(a) fabsf(a)
+#define VNEG(a) ((a) * -1)
+#define VMAX(a, b) ((a) > (b) ? (a) : (b))
+#define VMIN(a, b) ((a) < (b) ? (a) : (b))
+#define VDIV(a, b) ((a) / (b))
+#define VNAN(a) ((a) != (a) ? (a) : 0.0f)
+#define TRANSPOSE4(dst, ldd, src, lds) transpose4_scalar_f32(dst, ldd, src, lds)
+#include "kernels_impl.h"
+
+#ifdef KERNELS_X86
+/* SSE2 is part of x86-64, so this is the baseline every 64-bit host can run */
+#define ISA sse2
+#define DTYPE f64
+#define ELEM double
+#define KERNEL_TARGET __attribute__((target("sse2")))
+#define VEC __m128d
+#define VLEN 2
+#define VLOADU(p) _mm_loadu_pd(p)
+#define VLOADA(p) _mm_load_pd(p)
+#define VSTOREU(p, v) _mm_storeu_pd(p, v)
+#define VSTOREA(p, v) _mm_store_pd(p, v)
+#define VSET1(x) _mm_set1_pd(x)
+#define VZERO() _mm_setzero_pd()
+#define VADD(a, b) _mm_add_pd(a, b)
+#define VSUB(a, b) _mm_sub_pd(a, b)
+#define VMUL(a, b) _mm_mul_pd(a, b)
+#define VFMADD(a, b, c) _mm_add_pd(_mm_mul_pd(a, b), c)
+#define VABS(a) _mm_andnot_pd(_mm_set1_pd(-0.0), a)
+#define VNEG(a) _mm_mul_pd(a, _mm_set1_pd(-1))
+#define VMAX(a, b) _mm_max_pd(a, b)
+#define VMIN(a, b) _mm_min_pd(a, b)
+#define VDIV(a, b) _mm_div_pd(a, b)
+#define VNAN(a) _mm_and_pd(_mm_cmpunord_pd(a, a), a)
+#define TRANSPOSE4(dst, ldd, src, lds) transpose4_sse2_f64(dst, ldd, src, lds)
+#include "kernels_impl.h"
+
+#define ISA sse2
+#define DTYPE f32
+#define ELEM float
+#define KERNEL_TARGET __attribute__((target("sse2")))
+#define VEC __m128
+#define VLEN 4
+#define VLOADU(p) _mm_loadu_ps(p)
+#define VLOADA(p) _mm_load_ps(p)
+#define VSTOREU(p, v) _mm_storeu_ps(p, v)
+#define VSTOREA(p, v) _mm_store_ps(p, v)
+#define VSET1(x) _mm_set1_ps(x)
+#define VZERO() _mm_setzero_ps()
+#define VADD(a, b) _mm_add_ps(a, b)
+#define VSUB(a, b) _mm_sub_ps(a, b)
+#define VMUL(a, b) _mm_mul_ps(a, b)
+#define VFMADD(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+#define VABS(a) _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define VNEG(a) _mm_mul_ps(a, _mm_set1_ps(-1))
+#define VMAX(a, b) _mm_max_ps(a, b)
+#define VMIN(a, b) _mm_min_ps(a, b)
+#define VDIV(a, b) _mm_div_ps(a, b)
+#define VNAN(a) _mm_and_ps(_mm_cmpunord_ps(a, a), a)
+#define TRANSPOSE4(dst, ldd, src, lds) transpose4_sse2_f32(dst, ldd, src, lds)
+#include "kernels_impl.h"
+
+#define ISA avx2
+#define DTYPE f64
+#define ELEM double
+#define KERNEL_TARGET __attribute__((target("avx2,fma")))
+#define VEC __m256d
+#define VLEN 4
+#define VLOADU(p) _mm256_loadu_pd(p)
+#define VLOADA(p) _mm256_load_pd(p)
+#define VSTOREU(p, v) _mm256_storeu_pd(p, v)
+#define VSTOREA(p, v) _mm256_store_pd(p, v)
+#define VSET1(x) _mm256_set1_pd(x)
+#define VZERO() _mm256_setzero_pd()
+#define VADD(a, b) _mm256_add_pd(a, b)
+#define VSUB(a, b) _mm256_sub_pd(a, b)
+#define VMUL(a, b) _mm256_mul_pd(a, b)
+#define VFMADD(a, b, c) _mm256_fmadd_pd(a, b, c)
+#define VABS(a) _mm256_andnot_pd(_mm256_set1_pd(-0.0), a)
+#define VNEG(a) _mm256_mul_pd(a, _mm256_set1_pd(-1))
+#define VMAX(a, b) _mm256_max_pd(a, b)
+#define VMIN(a, b) _mm256_min_pd(a, b)
+#define VDIV(a, b) _mm256_div_pd(a, b)
+#define VNAN(a) _mm256_and_pd(_mm256_cmp_pd(a, a, _CMP_UNORD_Q), a)
+#define TRANSPOSE4(dst, ldd, src, lds) transpose4_avx2_f64(dst, ldd, src, lds)
+#include "kernels_impl.h"
+
+/* 8 floats per register: twice the elements per instruction of the float64 kernels */
+#define ISA avx2
+#define DTYPE f32
+#define ELEM float
+#define KERNEL_TARGET __attribute__((target("avx2,fma")))
+#define VEC __m256
+#define VLEN 8
+#define VLOADU(p) _mm256_loadu_ps(p)
+#define VLOADA(p) _mm256_load_ps(p)
+#define VSTOREU(p, v) _mm256_storeu_ps(p, v)
+#define VSTOREA(p, v) _mm256_store_ps(p, v)
+#define VSET1(x) _mm256_set1_ps(x)
+#define VZERO() _mm256_setzero_ps()
+#define VADD(a, b) _mm256_add_ps(a, b)
+#define VSUB(a, b) _mm256_sub_ps(a, b)
+#define VMUL(a, b) _mm256_mul_ps(a, b)
+#define VFMADD(a, b, c) _mm256_fmadd_ps(a, b, c)
+#define VABS(a) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define VNEG(a) _mm256_mul_ps(a, _mm256_set1_ps(-1))
+#define VMAX(a, b) _mm256_max_ps(a, b)
+#define VMIN(a, b) _mm256_min_ps(a, b)
+#define VDIV(a, b) _mm256_div_ps(a, b)
+#define VNAN(a) _mm256_and_ps(_mm256_cmp_ps(a, a, _CMP_UNORD_Q), a)
+#define TRANSPOSE4(dst, ldd, src, lds) transpose4_sse2_f32(dst, ldd, src, lds)
+#include "kernels_impl.h"
+
+#define ISA avx512
+#define DTYPE f64
+#define ELEM double
+#define KERNEL_TARGET __attribute__((target("avx512f,avx2,fma")))
+#define VEC __m512d
+#define VLEN 8
+#define VLOADU(p) _mm512_loadu_pd(p)
+#define VLOADA(p) _mm512_load_pd(p)
+#define VSTOREU(p, v) _mm512_storeu_pd(p, v)
+#define VSTOREA(p, v) _mm512_store_pd(p, v)
+#define VSET1(x) _mm512_set1_pd(x)
+#define VZERO() _mm512_setzero_pd()
+#define VADD(a, b) _mm512_add_pd(a, b)
+#define VSUB(a, b) _mm512_sub_pd(a, b)
+#define VMUL(a, b) _mm512_mul_pd(a, b)
+#define VFMADD(a, b, c) _mm512_fmadd_pd(a, b, c)
+#define VABS(a) _mm512_abs_pd(a)
+#define VNEG(a) _mm512_mul_pd(a, _mm512_set1_pd(-1))
+#define VMAX(a, b) _mm512_max_pd(a, b)
+#define VMIN(a, b) _mm512_min_pd(a, b)
+#define VDIV(a, b) _mm512_div_pd(a, b)
+#define VNAN(a) _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(a, a, _CMP_UNORD_Q), a)
+#define TRANSPOSE4(dst, ldd, src, lds) transpose4_avx2_f64(dst, ldd, src, lds)
+#include "kernels_impl.h"
+
+#define ISA avx512
+#define DTYPE f32
+#define ELEM float
+#define KERNEL_TARGET __attribute__((target("avx512f,avx2,fma")))
+#define VEC __m512
+#define VLEN 16
+#define VLOADU(p) _mm512_loadu_ps(p)
+#define VLOADA(p) _mm512_load_ps(p)
+#define VSTOREU(p, v) _mm512_storeu_ps(p, v)
+#define VSTOREA(p, v) _mm512_store_ps(p, v)
+#define VSET1(x) _mm512_set1_ps(x)
+#define VZERO() _mm512_setzero_ps()
+#define VADD(a, b) _mm512_add_ps(a, b)
+#define VSUB(a, b) _mm512_sub_ps(a, b)
+#define VMUL(a, b) _mm512_mul_ps(a, b)
+#define VFMADD(a, b, c) _mm512_fmadd_ps(a, b, c)
+#define VABS(a) _mm512_abs_ps(a)
+#define VNEG(a) _mm512_mul_ps(a, _mm512_set1_ps(-1))
+#define VMAX(a, b) _mm512_max_ps(a, b)
+#define VMIN(a, b) _mm512_min_ps(a, b)
+#define VDIV(a, b) _mm512_div_ps(a, b)
+#define VNAN(a) _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a, a, _CMP_UNORD_Q), a)
+#define TRANSPOSE4(dst, ldd, src, lds) transpose4_sse2_f32(dst, ldd, src, lds)
+#include "kernels_impl.h"
+#endif
+
+/* All kernel tables, slowest first. f32_tables[i] is the float32 version of all_tables[i]. */
+static const kernel_table *all_tables[] = {
+    &table_scalar_f64,
+#ifdef KERNELS_X86
+    &table_sse2_f64,
+    &table_avx2_f64,
+    &table_avx512_f64,
+#endif
+};
+
+static const kernel_table *f32_tables[] = {
+    &table_scalar_f32,
+#ifdef KERNELS_X86
+    &table_sse2_f32,
+    &table_avx2_f32,
+    &table_avx512_f32,
+#endif
+};
+
+#define NUM_TABLES (int) (sizeof(all_tables) / sizeof(all_tables[0]))
+
+const kernel_table *kernels = &table_scalar_f64;
+const kernel_table *kernels_f32 = &table_scalar_f32;
+
+/* Returns the kernels of the selected instruction set for data of the given type */
+const kernel_table *kernels_for(dtype type) {
+    return type == DTYPE_FLOAT32 ? kernels_f32 : kernels;
+}
+
+/* Returns 1 if the running CPU (and OS) can execute the table with the given index */
+static int table_supported(int index) {
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    const char *name = all_tables[index]->name;
+    if (strcmp(name, "sse2") == 0) {
+      return __builtin_cpu_supports("sse2");
+    } else if (strcmp(name, "avx2") == 0) {
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    } else if (strcmp(name, "avx512") == 0) {
+      return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") &&
+             __builtin_cpu_supports("fma");
+    }
+#endif
+    return 1;
+}
+
+static int find_table(const char *name) {
+    for (int i = 0; i < NUM_TABLES; i++) {
+      if (strcmp(all_tables[i]->name, name) == 0) {
+        return i;
+      }
+    }
+    return -1;
+}
+
+/*
+ * Returns 1 if `name` is a kernel table this CPU can run, 0 if the CPU lacks the
+ * instructions and -1 if there is no such table.
+ */
+int kernels_supported(const char *name) {
+    int index = find_table(name);
+    if (index < 0) {
+      return -1;
+    }
+    return table_supported(index);
+}
+
+/*
+ * Makes `kernels` point at the table called `name`. Return 0 upon success, -1 if there is no
+ * such table and -2 if the CPU does not support it.
+ */
+int select_kernels(const char *name) {
+    int index = find_table(name);
+    if (index < 0) {
+      return -1;
+    }
+    if (!table_supported(index)) {
+      return -2;
+    }
+    kernels = all_tables[index];
+    kernels_f32 = f32_tables[index];
+    return 0;
+}
+
+/*
+ * Picks the fastest table the CPU supports, unless the NUMC_ISA environment variable names
+ * another one. Returns the select_kernels error if NUMC_ISA could not be honoured, in which
+ * case the fastest table is used.
+ */
+int init_kernels(void) {
+    for (int i = NUM_TABLES - 1; i >= 0; i--) {
+      if (table_supported(i)) {
+        kernels = all_tables[i];
+        kernels_f32 = f32_tables[i];
+        break;
+      }
+    }
+    const char *requested = getenv("NUMC_ISA");
+    if (requested != NULL && requested[0] != '\0') {
+      return select_kernels(requested);
+    }
+    return 0;
+}
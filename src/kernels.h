@@ -0,0 +1,102 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+
+/*
+ * The innermost loops of every matrix operation, compiled once per instruction set.
+ * matrix.c does the threading and blocking and calls through `kernels`, which points at
+ * the fastest table the running CPU supports (see init_kernels).
+ */
+
+/* Element types of matrix data. There is a kernel table for each. */
+typedef enum dtype {
+    DTYPE_FLOAT64, // double, the default
+    DTYPE_FLOAT32, // float
+} dtype;
+
+/* Reductions of the reduce kernels: sums of x, |x| and x^2, and the min, max and max of |x| */
+typedef enum reduce_op {
+    REDUCE_SUM,
+    REDUCE_SUM_ABS,
+    REDUCE_SUM_SQ,
+    REDUCE_MIN,
+    REDUCE_MAX,
+    REDUCE_MAX_ABS,
+} reduce_op;
+
+/* Rows in a GEMM micro-tile. The number of columns depends on the vector width. */
+#define GEMM_MR 6
+/* Widest GEMM micro-tile of any kernel table (AVX-512, float32: 2 x 16 elements) */
+#define GEMM_MAX_NR 32
+
+/*
+ * Every instruction set has one table per element type. Arrays are passed as void pointers to
+ * elements of that type, and strides and lengths count elements.
+ */
+typedef struct kernel_table {
+    const char *name;
+    int elem_size; // bytes per element
+    int gemm_nr; // columns in a GEMM micro-tile
+    void (*fill)(void *dst, double val, long n);
+    void (*abs)(void *dst, const void *src, long n);
+    void (*neg)(void *dst, const void *src, long n);
+    void (*add)(void *dst, const void *a, const void *b, long n);
+    void (*sub)(void *dst, const void *a, const void *b, long n);
+    /* Element-wise dst[i] = a[i] * b[i] and a[i] / b[i] */
+    void (*mul)(void *dst, const void *a, const void *b, long n);
+    void (*div)(void *dst, const void *a, const void *b, long n);
+    /* dst[i] = alpha * src[i] + beta, a plain product if beta is 0 and a plain sum if alpha is 1 */
+    void (*affine)(void *dst, const void *src, double alpha, double beta, long n);
+    /* dst[i] = src[i] / val, or val / src[i] if `reverse` is set */
+    void (*div_scalar)(void *dst, const void *src, double val, int reverse, long n);
+    /* Returns the sum of a[i] * b[i] over n elements */
+    double (*dot)(const void *a, const void *b, long n);
+    /*
+     * dst = alpha * x + beta * y over n elements, with one fused multiply-add per element where
+     * the instruction set has it. y is only read if beta is not 0, and dst may be x or y.
+     */
+    void (*axpby)(void *dst, double alpha, const void *x, double beta, const void *y, long n);
+    /* Values 2 * first, ..., 2 * (first + pairs) - 1 of a uniform stream (see random.h) */
+    void (*uniform)(void *dst, uint64_t first, long pairs, uint32_t k0, uint32_t k1, double low,
+                    double range);
+    /*
+     * Reduces n >= 1 elements with `op`. The partial results are always combined in the same
+     * order, so the result only depends on the elements.
+     */
+    double (*reduce)(reduce_op op, const void *src, long n);
+    /* acc[i] = op(acc[i], src[i]) for n elements, accumulating column-wise reductions */
+    void (*reduce_into)(reduce_op op, double *acc, const void *src, long n);
+    /* dst[i] = src[i * stride] */
+    void (*gather)(void *dst, const void *src, long stride, long n);
+    /* dst[i * stride] = src[i] */
+    void (*scatter)(void *dst, long stride, const void *src, long n);
+    /* dst[j * ldd + i] = src[i * lds + j] for an m x n block of src */
+    void (*transpose)(int m, int n, const void *src, long lds, void *dst, long ldd);
+    /* Pack blocks of A and panels of B for the GEMM kernels below (see matrix.c) */
+    void (*pack_a)(int mc, int kc, const void *a, long rsa, long csa, void *packed);
+    void (*pack_b)(int kc, int cols, const void *b, long rsb, long csb, void *packed);
+    /*
+     * Multiplies a packed GEMM_MR x kc panel by a packed kc x gemm_nr panel and stores the
+     * product to `c`, adding it to what is already there if `accumulate` is set.
+     */
+    void (*gemm_micro_kernel)(int kc, const void *a, const void *b, void *c, int ldc,
+                              int accumulate);
+    /* Runs the micro-kernel over an mc x nc block of C with row/column strides rsc/csc */
+    void (*gemm_macro_kernel)(int mc, int nc, int kc, const void *packed_a,
+                              const void *packed_b, void *c, long rsc, long csc, int accumulate);
+    /* C = A * B without packing, for small operands with contiguous rows of the given strides */
+    void (*gemm_small)(int m, int n, int k, const void *a, long lda, const void *b, long ldb,
+                       void *c, long ldc);
+} kernel_table;
+
+/* Kernels of the selected instruction set for float64 and float32 data */
+extern const kernel_table *kernels;
+extern const kernel_table *kernels_f32;
+
+const kernel_table *kernels_for(dtype type);
+int init_kernels(void);
+int select_kernels(const char *name);
+int kernels_supported(const char *name);
+
+#endif
@@ -0,0 +1,748 @@
+/*
+ * Kernel template. kernels.c includes this file once per instruction set and element type
+ * after defining:
+ *   ISA            instruction set, used in the generated names (scalar, sse2, avx2, avx512)
+ *   DTYPE          element type suffix for the generated names (f64, f32)
+ *   ELEM           element type (double, float)
+ *   KERNEL_TARGET  function attribute that enables the instruction set
+ *   VEC, VLEN      vector type and the number of elements it holds
+ *   VLOADU, VLOADA, VSTOREU, VSTOREA, VSET1, VZERO,
+ *   VADD, VSUB, VMUL, VDIV, VFMADD, VABS, VNEG, VMAX, VMIN
+ *   VNAN           lanes of a vector that are NaN, with the other lanes 0
+ *   TRANSPOSE4     4 x 4 tile transpose, see transpose4_* in kernels.c
+ * and gets a `KERNEL(table)` kernel_table built from them. All of these are #undef'd again at
+ * the end of this file.
+ */
+
+#define KERNEL_CAT_(name, isa, dtype) name##_##isa##_##dtype
+#define KERNEL_CAT(name, isa, dtype) KERNEL_CAT_(name, isa, dtype)
+#define KERNEL(name) KERNEL_CAT(name, ISA, DTYPE)
+#define KERNEL_STR_(isa) #isa
+#define KERNEL_STR(isa) KERNEL_STR_(isa)
+/* True if `p` is aligned to the vector width, so VLOADA/VSTOREA may be used on it */
+#define KERNEL_ALIGNED(p) ((((uintptr_t) (p)) & (VLEN * sizeof(ELEM) - 1)) == 0)
+
+KERNEL_TARGET static void KERNEL(fill)(void *dst_array, double val, long n) {
+    ELEM *dst = dst_array;
+    VEC fill_vector = VSET1((ELEM) val);
+    long i = 0;
+    if (KERNEL_ALIGNED(dst)) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREA(dst + i, fill_vector);
+      }
+    } else {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, fill_vector);
+      }
+    }
+    for (; i < n; i++) {
+      dst[i] = val;
+    }
+}
+
+/* Stores `pairs` blocks of the uniform stream for key (k0, k1), scaled to [low, low + range) */
+KERNEL_TARGET static void KERNEL(uniform)(void *dst_array, uint64_t first, long pairs, uint32_t k0,
+                                          uint32_t k1, double low, double range) {
+    ELEM *dst = dst_array;
+    #pragma omp simd
+    for (long p = 0; p < pairs; p++) {
+      double u0, u1;
+      uniform_pair(first + p, k0, k1, &u0, &u1);
+      dst[2 * p] = low + range * u0;
+      dst[2 * p + 1] = low + range * u1;
+    }
+}
+
+KERNEL_TARGET static void KERNEL(abs)(void *dst_array, const void *src_array, long n) {
+    ELEM *dst = dst_array;
+    const ELEM *src = src_array;
+    long i = 0;
+    if (KERNEL_ALIGNED(dst) && KERNEL_ALIGNED(src)) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREA(dst + i, VABS(VLOADA(src + i)));
+      }
+    } else {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VABS(VLOADU(src + i)));
+      }
+    }
+    for (; i < n; i++) {
+      dst[i] = fabs(src[i]);
+    }
+}
+
+KERNEL_TARGET static void KERNEL(neg)(void *dst_array, const void *src_array, long n) {
+    ELEM *dst = dst_array;
+    const ELEM *src = src_array;
+    long i = 0;
+    if (KERNEL_ALIGNED(dst) && KERNEL_ALIGNED(src)) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREA(dst + i, VNEG(VLOADA(src + i)));
+      }
+    } else {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VNEG(VLOADU(src + i)));
+      }
+    }
+    for (; i < n; i++) {
+      dst[i] = src[i] * -1;
+    }
+}
+
+KERNEL_TARGET static void KERNEL(add)(void *dst_array, const void *a_array, const void *b_array,
+                                      long n) {
+    ELEM *dst = dst_array;
+    const ELEM *a = a_array;
+    const ELEM *b = b_array;
+    long i = 0;
+    if (KERNEL_ALIGNED(dst) && KERNEL_ALIGNED(a) && KERNEL_ALIGNED(b)) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREA(dst + i, VADD(VLOADA(a + i), VLOADA(b + i)));
+      }
+    } else {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VADD(VLOADU(a + i), VLOADU(b + i)));
+      }
+    }
+    for (; i < n; i++) {
+      dst[i] = a[i] + b[i];
+    }
+}
+
+/*
+ * dst = alpha * src + beta. A beta of 0 is a plain product and an alpha of 1 a plain sum;
+ * anything else takes one fused multiply-add per element.
+ */
+KERNEL_TARGET static void KERNEL(affine)(void *dst_array, const void *src_array, double alpha,
+                                         double beta, long n) {
+    ELEM *dst = dst_array;
+    const ELEM *src = src_array;
+    ELEM a = alpha, b = beta;
+    VEC alpha_vector = VSET1(a);
+    VEC beta_vector = VSET1(b);
+    long i = 0;
+    if (beta == 0) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VMUL(VLOADU(src + i), alpha_vector));
+      }
+      for (; i < n; i++) {
+        dst[i] = src[i] * a;
+      }
+    } else if (alpha == 1) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VADD(VLOADU(src + i), beta_vector));
+      }
+      for (; i < n; i++) {
+        dst[i] = src[i] + b;
+      }
+    } else {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VFMADD(alpha_vector, VLOADU(src + i), beta_vector));
+      }
+      for (; i < n; i++) {
+        dst[i] = a * src[i] + b;
+      }
+    }
+}
+
+/* dst = src / val, or val / src if `reverse` is set */
+KERNEL_TARGET static void KERNEL(div_scalar)(void *dst_array, const void *src_array, double val,
+                                             int reverse, long n) {
+    ELEM *dst = dst_array;
+    const ELEM *src = src_array;
+    ELEM v = val;
+    VEC val_vector = VSET1(v);
+    long i = 0;
+    if (reverse) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VDIV(val_vector, VLOADU(src + i)));
+      }
+      for (; i < n; i++) {
+        dst[i] = v / src[i];
+      }
+    } else {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VDIV(VLOADU(src + i), val_vector));
+      }
+      for (; i < n; i++) {
+        dst[i] = src[i] / v;
+      }
+    }
+}
+
+/* Returns the dot product of n elements of a and b, summed in four vector accumulators */
+KERNEL_TARGET static double KERNEL(dot)(const void *a_array, const void *b_array, long n) {
+    const ELEM *a = a_array;
+    const ELEM *b = b_array;
+    VEC acc0 = VZERO(), acc1 = VZERO(), acc2 = VZERO(), acc3 = VZERO();
+    long i = 0;
+    for (; i + 4 * VLEN <= n; i += 4 * VLEN) {
+      acc0 = VFMADD(VLOADU(a + i), VLOADU(b + i), acc0);
+      acc1 = VFMADD(VLOADU(a + i + VLEN), VLOADU(b + i + VLEN), acc1);
+      acc2 = VFMADD(VLOADU(a + i + 2 * VLEN), VLOADU(b + i + 2 * VLEN), acc2);
+      acc3 = VFMADD(VLOADU(a + i + 3 * VLEN), VLOADU(b + i + 3 * VLEN), acc3);
+    }
+    for (; i + VLEN <= n; i += VLEN) {
+      acc0 = VFMADD(VLOADU(a + i), VLOADU(b + i), acc0);
+    }
+    ELEM lanes[VLEN];
+    VSTOREU(lanes, VADD(VADD(acc0, acc1), VADD(acc2, acc3)));
+    ELEM sum = 0;
+    for (int l = 0; l < VLEN; l++) {
+      sum += lanes[l];
+    }
+    for (; i < n; i++) {
+      sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+/* dst = alpha * x + beta * y for n elements. y is not read if beta is 0. */
+KERNEL_TARGET static void KERNEL(axpby)(void *dst_array, double alpha, const void *x_array,
+                                        double beta, const void *y_array, long n) {
+    ELEM *dst = dst_array;
+    const ELEM *x = x_array;
+    const ELEM *y = y_array;
+    ELEM a = alpha, b = beta;
+    VEC alpha_vector = VSET1(a);
+    VEC beta_vector = VSET1(b);
+    long i = 0;
+    if (beta == 0) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VMUL(alpha_vector, VLOADU(x + i)));
+      }
+      for (; i < n; i++) {
+        dst[i] = a * x[i];
+      }
+    } else if (beta == 1) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VFMADD(alpha_vector, VLOADU(x + i), VLOADU(y + i)));
+      }
+      for (; i < n; i++) {
+        dst[i] = a * x[i] + y[i];
+      }
+    } else {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VFMADD(alpha_vector, VLOADU(x + i), VMUL(beta_vector, VLOADU(y + i))));
+      }
+      for (; i < n; i++) {
+        dst[i] = a * x[i] + b * y[i];
+      }
+    }
+}
+
+KERNEL_TARGET static void KERNEL(sub)(void *dst_array, const void *a_array, const void *b_array,
+                                      long n) {
+    ELEM *dst = dst_array;
+    const ELEM *a = a_array;
+    const ELEM *b = b_array;
+    long i = 0;
+    if (KERNEL_ALIGNED(dst) && KERNEL_ALIGNED(a) && KERNEL_ALIGNED(b)) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREA(dst + i, VSUB(VLOADA(a + i), VLOADA(b + i)));
+      }
+    } else {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VSUB(VLOADU(a + i), VLOADU(b + i)));
+      }
+    }
+    for (; i < n; i++) {
+      dst[i] = a[i] - b[i];
+    }
+}
+
+KERNEL_TARGET static void KERNEL(mul)(void *dst_array, const void *a_array, const void *b_array,
+                                      long n) {
+    ELEM *dst = dst_array;
+    const ELEM *a = a_array;
+    const ELEM *b = b_array;
+    long i = 0;
+    if (KERNEL_ALIGNED(dst) && KERNEL_ALIGNED(a) && KERNEL_ALIGNED(b)) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREA(dst + i, VMUL(VLOADA(a + i), VLOADA(b + i)));
+      }
+    } else {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VMUL(VLOADU(a + i), VLOADU(b + i)));
+      }
+    }
+    for (; i < n; i++) {
+      dst[i] = a[i] * b[i];
+    }
+}
+
+KERNEL_TARGET static void KERNEL(div)(void *dst_array, const void *a_array, const void *b_array,
+                                      long n) {
+    ELEM *dst = dst_array;
+    const ELEM *a = a_array;
+    const ELEM *b = b_array;
+    long i = 0;
+    if (KERNEL_ALIGNED(dst) && KERNEL_ALIGNED(a) && KERNEL_ALIGNED(b)) {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREA(dst + i, VDIV(VLOADA(a + i), VLOADA(b + i)));
+      }
+    } else {
+      for (; i + VLEN <= n; i += VLEN) {
+        VSTOREU(dst + i, VDIV(VLOADU(a + i), VLOADU(b + i)));
+      }
+    }
+    for (; i < n; i++) {
+      dst[i] = a[i] / b[i];
+    }
+}
+
+/*
+ * Body of the reduce kernel for one op: four vector accumulators over the elements (the tail
+ * padded with `init`, which must not change the result), combined pairwise and then lane by lane.
+ * MAP is applied to every element before it is combined. TRACK folds each mapped vector into a
+ * flag per accumulator; for min and max it collects NaNs, which the vector min/max instructions
+ * would drop, and a NaN anywhere makes the result NaN.
+ */
+#define REDUCE_BODY(init, MAP, COMBINE, SCALAR_COMBINE, TRACK) \
+    { \
+      ELEM pad[VLEN]; \
+      VEC acc0 = VSET1(init), acc1 = acc0, acc2 = acc0, acc3 = acc0; \
+      VEC nan0 = VZERO(), nan1 = nan0, nan2 = nan0, nan3 = nan0; \
+      VEC x0, x1, x2, x3; \
+      long i = 0; \
+      for (; i + 4 * VLEN <= n; i += 4 * VLEN) { \
+        x0 = MAP(VLOADU(src + i)); \
+        x1 = MAP(VLOADU(src + i + VLEN)); \
+        x2 = MAP(VLOADU(src + i + 2 * VLEN)); \
+        x3 = MAP(VLOADU(src + i + 3 * VLEN)); \
+        acc0 = COMBINE(acc0, x0); \
+        acc1 = COMBINE(acc1, x1); \
+        acc2 = COMBINE(acc2, x2); \
+        acc3 = COMBINE(acc3, x3); \
+        nan0 = TRACK(nan0, x0); \
+        nan1 = TRACK(nan1, x1); \
+        nan2 = TRACK(nan2, x2); \
+        nan3 = TRACK(nan3, x3); \
+      } \
+      for (; i + VLEN <= n; i += VLEN) { \
+        x0 = MAP(VLOADU(src + i)); \
+        acc0 = COMBINE(acc0, x0); \
+        nan0 = TRACK(nan0, x0); \
+      } \
+      for (int l = 0; l < VLEN; l++) { \
+        pad[l] = i + l < n ? src[i + l] : (init); \
+      } \
+      x0 = MAP(VLOADU(pad)); \
+      acc0 = COMBINE(acc0, x0); \
+      nan0 = TRACK(nan0, x0); \
+      VSTOREU(pad, COMBINE(COMBINE(acc0, acc1), COMBINE(acc2, acc3))); \
+      double result = pad[0]; \
+      for (int l = 1; l < VLEN; l++) { \
+        result = SCALAR_COMBINE(result, pad[l]); \
+      } \
+      VSTOREU(pad, VADD(VADD(nan0, nan1), VADD(nan2, nan3))); \
+      for (int l = 0; l < VLEN; l++) { \
+        if (pad[l] != pad[l]) { \
+          return NAN; \
+        } \
+      } \
+      return result; \
+    }
+
+#define REDUCE_ID(x) (x)
+#define REDUCE_SQUARE(x) VMUL(x, x)
+#define REDUCE_SCALAR_ADD(a, b) ((a) + (b))
+#define REDUCE_SCALAR_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define REDUCE_SCALAR_MAX(a, b) ((a) > (b) ? (a) : (b))
+#define REDUCE_TRACK_NONE(flag, x) (flag)
+#define REDUCE_TRACK_NAN(flag, x) VADD(flag, VNAN(x))
+
+KERNEL_TARGET static double KERNEL(reduce)(reduce_op op, const void *src_array, long n) {
+    const ELEM *src = src_array;
+    switch (op) {
+      case REDUCE_SUM:
+        REDUCE_BODY(0, REDUCE_ID, VADD, REDUCE_SCALAR_ADD, REDUCE_TRACK_NONE)
+      case REDUCE_SUM_ABS:
+        REDUCE_BODY(0, VABS, VADD, REDUCE_SCALAR_ADD, REDUCE_TRACK_NONE)
+      case REDUCE_SUM_SQ:
+        REDUCE_BODY(0, REDUCE_SQUARE, VADD, REDUCE_SCALAR_ADD, REDUCE_TRACK_NONE)
+      case REDUCE_MIN:
+        REDUCE_BODY(INFINITY, REDUCE_ID, VMIN, REDUCE_SCALAR_MIN, REDUCE_TRACK_NAN)
+      case REDUCE_MAX:
+        REDUCE_BODY(-INFINITY, REDUCE_ID, VMAX, REDUCE_SCALAR_MAX, REDUCE_TRACK_NAN)
+      default:
+        REDUCE_BODY(0, VABS, VMAX, REDUCE_SCALAR_MAX, REDUCE_TRACK_NAN)
+    }
+}
+
+KERNEL_TARGET static void KERNEL(reduce_into)(reduce_op op, double *acc, const void *src_array,
+                                              long n) {
+    const ELEM *src = src_array;
+    switch (op) {
+      case REDUCE_SUM:
+        #pragma omp simd
+        for (long i = 0; i < n; i++) {
+          acc[i] += src[i];
+        }
+        break;
+      case REDUCE_SUM_ABS:
+        #pragma omp simd
+        for (long i = 0; i < n; i++) {
+          acc[i] += fabs(src[i]);
+        }
+        break;
+      case REDUCE_SUM_SQ:
+        #pragma omp simd
+        for (long i = 0; i < n; i++) {
+          acc[i] += (double) src[i] * src[i];
+        }
+        break;
+      case REDUCE_MIN:
+        #pragma omp simd
+        for (long i = 0; i < n; i++) {
+          acc[i] = src[i] < acc[i] || src[i] != src[i] ? src[i] : acc[i];
+        }
+        break;
+      case REDUCE_MAX:
+        #pragma omp simd
+        for (long i = 0; i < n; i++) {
+          acc[i] = src[i] > acc[i] || src[i] != src[i] ? src[i] : acc[i];
+        }
+        break;
+      case REDUCE_MAX_ABS:
+        #pragma omp simd
+        for (long i = 0; i < n; i++) {
+          acc[i] = fabs(src[i]) > acc[i] || src[i] != src[i] ? fabs(src[i]) : acc[i];
+        }
+        break;
+    }
+}
+
+#undef REDUCE_BODY
+#undef REDUCE_ID
+#undef REDUCE_SQUARE
+#undef REDUCE_SCALAR_ADD
+#undef REDUCE_SCALAR_MIN
+#undef REDUCE_SCALAR_MAX
+#undef REDUCE_TRACK_NONE
+#undef REDUCE_TRACK_NAN
+
+KERNEL_TARGET static void KERNEL(gather)(void *dst_array, const void *src_array, long stride,
+                                         long n) {
+    ELEM *dst = dst_array;
+    const ELEM *src = src_array;
+    for (long i = 0; i < n; i++) {
+      dst[i] = src[i * stride];
+    }
+}
+
+KERNEL_TARGET static void KERNEL(scatter)(void *dst_array, long stride, const void *src_array,
+                                          long n) {
+    ELEM *dst = dst_array;
+    const ELEM *src = src_array;
+    for (long i = 0; i < n; i++) {
+      dst[i * stride] = src[i];
+    }
+}
+
+/*
+ * dst[j * ldd + i] = src[i * lds + j] for the m x n block at `src`, 4 x 4 tiles at a time with
+ * the remaining rows and columns done element by element.
+ */
+KERNEL_TARGET static void KERNEL(transpose)(int m, int n, const void *src_array, long lds,
+                                            void *dst_array, long ldd) {
+    ELEM *dst = dst_array;
+    const ELEM *src = src_array;
+    int m4 = m & ~3;
+    int n4 = n & ~3;
+    for (int i = 0; i < m4; i += 4) {
+      for (int j = 0; j < n4; j += 4) {
+        TRANSPOSE4(dst + j * ldd + i, ldd, src + i * lds + j, lds);
+      }
+      for (int j = n4; j < n; j++) {
+        for (int r = i; r < i + 4; r++) {
+          dst[j * ldd + r] = src[r * lds + j];
+        }
+      }
+    }
+    for (int i = m4; i < m; i++) {
+      for (int j = 0; j < n; j++) {
+        dst[j * ldd + i] = src[i * lds + j];
+      }
+    }
+}
+
+/*
+ * Packs the mc x kc block of A at `a` as consecutive GEMM_MR-row panels, each stored column by
+ * column so the micro-kernel reads it sequentially. Rows past `mc` are padded with zeros.
+ */
+KERNEL_TARGET static void KERNEL(pack_a)(int mc, int kc, const void *a_block, long rsa, long csa,
+                                         void *packed_block) {
+    const ELEM *a = a_block;
+    ELEM *packed = packed_block;
+    for (int i = 0; i < mc; i += GEMM_MR) {
+      int rows = mc - i < GEMM_MR ? mc - i : GEMM_MR;
+      for (int k = 0; k < kc; k++) {
+        for (int r = 0; r < rows; r++) {
+          packed[r] = a[(i + r) * rsa + k * csa];
+        }
+        for (int r = rows; r < GEMM_MR; r++) {
+          packed[r] = 0;
+        }
+        packed += GEMM_MR;
+      }
+    }
+}
+
+/*
+ * Packs the kc x cols panel of B at `b` (cols <= gemm_nr) row by row, padding every row to
+ * gemm_nr elements with zeros.
+ */
+KERNEL_TARGET static void KERNEL(pack_b)(int kc, int cols, const void *b_panel, long rsb,
+                                         long csb, void *packed_panel) {
+    const ELEM *b = b_panel;
+    ELEM *packed = packed_panel;
+    for (int k = 0; k < kc; k++) {
+      const ELEM *src = b + k * rsb;
+      if (csb == 1) {
+        memcpy(packed, src, cols * sizeof(ELEM));
+      } else {
+        for (int c = 0; c < cols; c++) {
+          packed[c] = src[c * csb];
+        }
+      }
+      for (int c = cols; c < 2 * VLEN; c++) {
+        packed[c] = 0;
+      }
+      packed += 2 * VLEN;
+    }
+}
+
+/*
+ * GEMM_MR x (2 * VLEN) micro-kernel: twelve accumulators, two vectors of B and one broadcast
+ * element of A per step, which fits the 16 registers of SSE2/AVX2 and leaves AVX-512 room.
+ */
+#define GEMM_ROW(r) \
+    a_k = VSET1(a[r]); \
+    c##r##0 = VFMADD(a_k, b0, c##r##0); \
+    c##r##1 = VFMADD(a_k, b1, c##r##1);
+
+#define GEMM_STORE_ROW(r) \
+    if (accumulate) { \
+      c##r##0 = VADD(c##r##0, VLOADU(c + r * ldc)); \
+      c##r##1 = VADD(c##r##1, VLOADU(c + r * ldc + VLEN)); \
+    } \
+    VSTOREU(c + r * ldc, c##r##0); \
+    VSTOREU(c + r * ldc + VLEN, c##r##1);
+
+KERNEL_TARGET static void KERNEL(gemm_micro_kernel)(int kc, const void *a_panel,
+                                                    const void *b_panel, void *c_tile, int ldc,
+                                                    int accumulate) {
+    const ELEM *a = a_panel;
+    const ELEM *b = b_panel;
+    ELEM *c = c_tile;
+    VEC c00 = VZERO(), c01 = VZERO();
+    VEC c10 = VZERO(), c11 = VZERO();
+    VEC c20 = VZERO(), c21 = VZERO();
+    VEC c30 = VZERO(), c31 = VZERO();
+    VEC c40 = VZERO(), c41 = VZERO();
+    VEC c50 = VZERO(), c51 = VZERO();
+    for (int k = 0; k < kc; k++) {
+      VEC b0 = VLOADA(b);
+      VEC b1 = VLOADA(b + VLEN);
+      VEC a_k;
+      GEMM_ROW(0)
+      GEMM_ROW(1)
+      GEMM_ROW(2)
+      GEMM_ROW(3)
+      GEMM_ROW(4)
+      GEMM_ROW(5)
+      a += GEMM_MR;
+      b += 2 * VLEN;
+    }
+    GEMM_STORE_ROW(0)
+    GEMM_STORE_ROW(1)
+    GEMM_STORE_ROW(2)
+    GEMM_STORE_ROW(3)
+    GEMM_STORE_ROW(4)
+    GEMM_STORE_ROW(5)
+}
+
+#undef GEMM_ROW
+#undef GEMM_STORE_ROW
+
+/*
+ * Computes the mc x nc block of C at `c` from a packed block of A and a packed block of B.
+ * Partial tiles on the bottom and right edges, and every tile of a C whose columns are not
+ * adjacent (csc != 1), go through a scratch tile so the micro-kernel never writes outside of C.
+ */
+KERNEL_TARGET static void KERNEL(gemm_macro_kernel)(int mc, int nc, int kc, const void *a_block,
+                                                    const void *b_block, void *c_block, long rsc,
+                                                    long csc, int accumulate) {
+    const ELEM *packed_a = a_block;
+    const ELEM *packed_b = b_block;
+    ELEM *c = c_block;
+    int nr = 2 * VLEN;
+    ELEM edge[GEMM_MR * 2 * VLEN];
+    for (int j = 0; j < nc; j += nr) {
+      int cols = nc - j < nr ? nc - j : nr;
+      const ELEM *b_panel = packed_b + (size_t) j * kc;
+      for (int i = 0; i < mc; i += GEMM_MR) {
+        int rows = mc - i < GEMM_MR ? mc - i : GEMM_MR;
+        const ELEM *a_panel = packed_a + (size_t) i * kc;
+        ELEM *c_tile = c + i * rsc + j * csc;
+        if (rows == GEMM_MR && cols == nr && csc == 1) {
+          KERNEL(gemm_micro_kernel)(kc, a_panel, b_panel, c_tile, rsc, accumulate);
+        } else {
+          KERNEL(gemm_micro_kernel)(kc, a_panel, b_panel, edge, nr, 0);
+          for (int r = 0; r < rows; r++) {
+            for (int s = 0; s < cols; s++) {
+              if (accumulate) {
+                c_tile[r * rsc + s * csc] += edge[r * nr + s];
+              } else {
+                c_tile[r * rsc + s * csc] = edge[r * nr + s];
+              }
+            }
+          }
+        }
+      }
+    }
+}
+
+/*
+ * C = A * B for small operands whose rows are contiguous (`lda`, `ldb` and `ldc` are the row
+ * strides), without packing: each step broadcasts one element of A against a row segment of B
+ * loaded straight from memory, keeping a GEMM_MR x (2 * VLEN) tile of C in registers as the
+ * micro-kernel does. Batches of small products use it, since packing would cost as much as such
+ * a product itself.
+ */
+#define SMALL_ROW(r) \
+    a_p = VSET1(a[(i + r) * lda + p]); \
+    c##r##0 = VFMADD(a_p, b0, c##r##0); \
+    c##r##1 = VFMADD(a_p, b1, c##r##1);
+
+#define SMALL_STORE_ROW(r) \
+    VSTOREU(c + (i + r) * ldc + j, c##r##0); \
+    VSTOREU(c + (i + r) * ldc + j + VLEN, c##r##1);
+
+KERNEL_TARGET static void KERNEL(gemm_small)(int m, int n, int k, const void *a_array, long lda,
+                                             const void *b_array, long ldb, void *c_array,
+                                             long ldc) {
+    const ELEM *a = a_array;
+    const ELEM *b = b_array;
+    ELEM *c = c_array;
+    int j = 0;
+    for (; j + 2 * VLEN <= n; j += 2 * VLEN) {
+      int i = 0;
+      for (; i + GEMM_MR <= m; i += GEMM_MR) {
+        VEC c00 = VZERO(), c01 = VZERO();
+        VEC c10 = VZERO(), c11 = VZERO();
+        VEC c20 = VZERO(), c21 = VZERO();
+        VEC c30 = VZERO(), c31 = VZERO();
+        VEC c40 = VZERO(), c41 = VZERO();
+        VEC c50 = VZERO(), c51 = VZERO();
+        for (int p = 0; p < k; p++) {
+          VEC b0 = VLOADU(b + p * ldb + j);
+          VEC b1 = VLOADU(b + p * ldb + j + VLEN);
+          VEC a_p;
+          SMALL_ROW(0)
+          SMALL_ROW(1)
+          SMALL_ROW(2)
+          SMALL_ROW(3)
+          SMALL_ROW(4)
+          SMALL_ROW(5)
+        }
+        SMALL_STORE_ROW(0)
+        SMALL_STORE_ROW(1)
+        SMALL_STORE_ROW(2)
+        SMALL_STORE_ROW(3)
+        SMALL_STORE_ROW(4)
+        SMALL_STORE_ROW(5)
+      }
+      for (; i < m; i++) {
+        VEC c00 = VZERO(), c01 = VZERO();
+        for (int p = 0; p < k; p++) {
+          VEC b0 = VLOADU(b + p * ldb + j);
+          VEC b1 = VLOADU(b + p * ldb + j + VLEN);
+          VEC a_p;
+          SMALL_ROW(0)
+        }
+        SMALL_STORE_ROW(0)
+      }
+    }
+    /* Columns left over from the double-width strips: one vector, then one element at a time */
+    for (; j + VLEN <= n; j += VLEN) {
+      for (int i = 0; i < m; i++) {
+        VEC sum = VZERO();
+        for (int p = 0; p < k; p++) {
+          sum = VFMADD(VSET1(a[i * lda + p]), VLOADU(b + p * ldb + j), sum);
+        }
+        VSTOREU(c + i * ldc + j, sum);
+      }
+    }
+    for (; j < n; j++) {
+      for (int i = 0; i < m; i++) {
+        ELEM sum = 0;
+        for (int p = 0; p < k; p++) {
+          sum += a[i * lda + p] * b[p * ldb + j];
+        }
+        c[i * ldc + j] = sum;
+      }
+    }
+}
+
+#undef SMALL_ROW
+#undef SMALL_STORE_ROW
+
+static const kernel_table KERNEL(table) = {
+    .name = KERNEL_STR(ISA),
+    .elem_size = sizeof(ELEM),
+    .gemm_nr = 2 * VLEN,
+    .fill = KERNEL(fill),
+    .uniform = KERNEL(uniform),
+    .abs = KERNEL(abs),
+    .neg = KERNEL(neg),
+    .add = KERNEL(add),
+    .sub = KERNEL(sub),
+    .mul = KERNEL(mul),
+    .div = KERNEL(div),
+    .affine = KERNEL(affine),
+    .div_scalar = KERNEL(div_scalar),
+    .dot = KERNEL(dot),
+    .axpby = KERNEL(axpby),
+    .reduce = KERNEL(reduce),
+    .reduce_into = KERNEL(reduce_into),
+    .gather = KERNEL(gather),
+    .scatter = KERNEL(scatter),
+    .transpose = KERNEL(transpose),
+    .pack_a = KERNEL(pack_a),
+    .pack_b = KERNEL(pack_b),
+    .gemm_micro_kernel = KERNEL(gemm_micro_kernel),
+    .gemm_macro_kernel = KERNEL(gemm_macro_kernel),
+    .gemm_small = KERNEL(gemm_small),
+};
+
+#undef KERNEL_CAT_
+#undef KERNEL_CAT
+#undef KERNEL
+#undef KERNEL_STR_
+#undef KERNEL_STR
+#undef KERNEL_ALIGNED
+#undef ISA
+#undef DTYPE
+#undef ELEM
+#undef KERNEL_TARGET
+#undef VEC
+#undef VLEN
+#undef VLOADU
+#undef VLOADA
+#undef VSTOREU
+#undef VSTOREA
+#undef VSET1
+#undef VZERO
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VFMADD
+#undef VABS
+#undef VNEG
+#undef VMAX
+#undef VMIN
+#undef VDIV
+#undef VNAN
+#undef TRANSPOSE4
@@ -1,33 +1,36 @@
 #include "matrix.h"
+#include "backing.h"
+#include "kernels.h"
+#include "parallel.h"
+#include "pool.h"
+#include "random.h"
+#include <math.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <omp.h>
+#include <string.h>
 
-// Include SSE intrinsics
-#if defined(_MSC_VER)
-#include <intrin.h>
-#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
-#include <immintrin.h>
-#include <x86intrin.h>
-#endif
+/*
+ * Number of elements handed to a single kernel call by the element-wise operations. A multiple
+ * of every vector width, so each chunk after the first starts at the same alignment.
+ */
+#define CHUNK_SIZE 8192
 
+/* Strided operands are gathered into contiguous buffers of this many elements for the kernels */
+#define GATHER_BLOCK 512
 
-/* Generates a random double between low and high */
-double rand_double(double low, double high) {
-    double range = (high - low);
-    double div = RAND_MAX / range;
-    return low + (rand() / div);
+
+/* Returns the size in bytes of one element of the given type */
+size_t dtype_size(dtype type) {
+    return type == DTYPE_FLOAT32 ? sizeof(float) : sizeof(double);
 }
 
-/* Generates a random matrix */
-void rand_matrix(matrix *result, unsigned int seed, double low, double high) {
-    srand(seed);
-    for (int i = 0; i < result->rows; i++) {
-        for (int j = 0; j < result->cols; j++) {
-            set(result, i, j, rand_double(low, high));
-        }
-    }
+/*
+ * Returns the type of the result of an operation on data of types `type1` and `type2`: float64
+ * if either is float64, so mixing in single precision data never loses precision.
+ */
+dtype promote_dtype(dtype type1, dtype type2) {
+    return type1 == DTYPE_FLOAT32 && type2 == DTYPE_FLOAT32 ? DTYPE_FLOAT32 : DTYPE_FLOAT64;
 }
 
 /*
@@ -35,9 +38,11 @@ void rand_matrix(matrix *result, unsigned int seed, double low, double high) {
  * You may assume `row` and `col` are valid. Note that the matrix is in row-major order.
  */
 double get(matrix *mat, int row, int col) {
-    int columns = mat->cols;
-    int position = row * columns + col;
-    return mat->data[position];
+    long index = (long) row * mat->row_stride + (long) col * mat->col_stride;
+    if (mat->dtype == DTYPE_FLOAT32) {
+      return ((float *) mat->data)[index];
+    }
+    return ((double *) mat->data)[index];
 }
 
 /*
@@ -45,9 +50,83 @@ double get(matrix *mat, int row, int col) {
  * `col` are valid. Note that the matrix is in row-major order.
  */
 void set(matrix *mat, int row, int col, double val) {
-    int columns = mat->cols;
-    int position = row * columns + col;
-    mat->data[position] = val;
+    long index = (long) row * mat->row_stride + (long) col * mat->col_stride;
+    if (mat->dtype == DTYPE_FLOAT32) {
+      ((float *) mat->data)[index] = val;
+    } else {
+      ((double *) mat->data)[index] = val;
+    }
+}
+
+/* Returns a pointer to the element at the given row and column */
+static inline char *element(matrix *mat, int row, long col) {
+    return (char *) mat->data +
+           ((long) row * mat->row_stride + col * mat->col_stride) * (long) dtype_size(mat->dtype);
+}
+
+/* Stores the addresses of the first bytes of the lowest and highest elements of the matrix */
+static void extent(matrix *mat, char **low, char **high) {
+    long last_row = (long) (mat->rows - 1) * mat->row_stride;
+    long last_col = (long) (mat->cols - 1) * mat->col_stride;
+    long size = dtype_size(mat->dtype);
+    *low = (char *) mat->data + ((last_row < 0 ? last_row : 0) + (last_col < 0 ? last_col : 0)) * size;
+    *high = (char *) mat->data + ((last_row > 0 ? last_row : 0) + (last_col > 0 ? last_col : 0)) * size;
+}
+
+/*
+ * Returns 1 if writing `dst` element by element could overwrite elements of `src` before they
+ * are read, i.e. the two share memory and are not the very same view. Element-wise operations
+ * with such operands have to go through a temporary.
+ */
+int views_overlap(matrix *dst, matrix *src) {
+    matrix *dst_root = dst->parent == NULL ? dst : dst->parent;
+    matrix *src_root = src->parent == NULL ? src : src->parent;
+    if (dst_root != src_root) {
+      return 0;
+    }
+    if (dst->data == src->data && dst->rows == src->rows && dst->cols == src->cols &&
+        dst->row_stride == src->row_stride && dst->col_stride == src->col_stride) {
+      return 0;
+    }
+    char *dst_low, *dst_high, *src_low, *src_high;
+    extent(dst, &dst_low, &dst_high);
+    extent(src, &src_low, &src_high);
+    return dst_low <= src_high && src_low <= dst_high;
+}
+
+/* Returns 1 if the matrix's elements are laid out back to back in row-major order */
+int is_contiguous(matrix *mat) {
+    return mat->col_stride == 1 && (mat->row_stride == mat->cols || mat->rows == 1);
+}
+
+/*
+ * Allocates the matrix struct and a pooled, 64-byte aligned data array for allocate_matrix and
+ * friends. The data array holds elements of type `type` and is zeroed if `zero` is set.
+ */
+static int allocate_matrix_data(matrix **mat, int rows, int cols, dtype type, int zero) {
+    if (rows <= 0 || cols <= 0) {
+      return -1;
+    }
+    matrix* matrix = malloc(sizeof(*matrix));
+    if (matrix == NULL) {
+      return -2;
+    }
+    matrix->data = pool_alloc((size_t) rows * cols * dtype_size(type), zero);
+    if (matrix->data == NULL) {
+      free(matrix);
+      return -2;
+    }
+    matrix->dtype = type;
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->row_stride = cols;
+    matrix->col_stride = 1;
+    matrix->parent = NULL;
+    matrix->ref_cnt = 1;
+    matrix->release = NULL;
+    matrix->owner = NULL;
+    *mat = matrix;
+    return 0;
 }
 
 /*
@@ -60,28 +139,52 @@ void set(matrix *mat, int row, int col, double val) {
  * Return 0 upon success.
  */
 int allocate_matrix(matrix **mat, int rows, int cols) {
+    return allocate_matrix_data(mat, rows, cols, DTYPE_FLOAT64, 1);
+}
+
+/*
+ * Same as allocate_matrix, but leaves the entries uninitialized. Use it for results that are
+ * about to be overwritten, so recycled pool blocks are not cleared for nothing.
+ */
+int allocate_matrix_uninitialized(matrix **mat, int rows, int cols) {
+    return allocate_matrix_data(mat, rows, cols, DTYPE_FLOAT64, 0);
+}
+
+/* Same as allocate_matrix_uninitialized, but for elements of type `type` */
+int allocate_matrix_typed(matrix **mat, int rows, int cols, dtype type) {
+    return allocate_matrix_data(mat, rows, cols, type, 0);
+}
+
+/*
+ * Allocates a matrix struct around `rows` * `cols` elements of type `type` at `data` that belong
+ * to someone else, such as an exported Python buffer. Instead of returning `data` to the pool,
+ * deallocate_matrix calls `release(owner)` once the matrix and all its slices are gone.
+ * Return -1 if `rows` or `cols` are invalid, -2 if the struct cannot be allocated and 0 upon
+ * success. `release` is not called on failure.
+ */
+int allocate_matrix_external(matrix **mat, void *data, dtype type, int rows, int cols,
+                             void (*release)(void *owner), void *owner) {
     if (rows <= 0 || cols <= 0) {
       return -1;
     }
-    int size = rows * cols;
-    matrix* matrix = malloc(size * sizeof(*matrix));
+    matrix* matrix = malloc(sizeof(*matrix));
     if (matrix == NULL) {
       return -2;
     }
-    matrix->data = (double*) calloc(rows * cols, sizeof(double));
-    if (matrix->data == NULL) {
-      return -2;
-    }
+    matrix->data = data;
+    matrix->dtype = type;
     matrix->rows = rows;
     matrix->cols = cols;
+    matrix->row_stride = cols;
+    matrix->col_stride = 1;
     matrix->parent = NULL;
     matrix->ref_cnt = 1;
+    matrix->release = release;
+    matrix->owner = owner;
     *mat = matrix;
     return 0;
 }
 
-
-
 /*
  * You need to make sure that you only free `mat->data` if `mat` is not a slice and has no existing slices,
  * or that you free `mat->parent->data` if `mat` is the last existing slice of its parent matrix and its parent
@@ -91,9 +194,13 @@ void deallocate_matrix(matrix *mat) {
     if (mat == NULL) {
       return;
     } else if (mat->parent == NULL) {
-        mat->ref_cnt --;
-        if (mat->ref_cnt == 0) {
-          free(mat->data);
+        /* Slices may be created and dropped on several threads, so ref_cnt is atomic */
+        if (__atomic_sub_fetch(&mat->ref_cnt, 1, __ATOMIC_ACQ_REL) == 0) {
+          if (mat->release != NULL) {
+            mat->release(mat->owner);
+          } else {
+            pool_free(mat->data, (size_t) mat->rows * mat->cols * dtype_size(mat->dtype));
+          }
           free(mat);
         }
     } else {
@@ -115,38 +222,397 @@ void deallocate_matrix(matrix *mat) {
  * there is no need to allocate space for matrix data.
  */
 int allocate_matrix_ref(matrix **mat, matrix *from, int offset, int rows, int cols) {
+    return allocate_matrix_view(mat, from, offset, rows, cols, cols, 1);
+}
+
+/*
+ * Like allocate_matrix_ref, but the slice can be any strided 2-D view of `from`'s data: element
+ * (i, j) of the slice is `from->data[offset + i * row_stride + j * col_stride]`. Strides may be
+ * negative. Slices of slices refer to the matrix that owns the data, so the `parent` of a slice
+ * is never a slice itself.
+ * Return -1 if `rows` or `cols` are invalid, -2 if allocating the struct fails and 0 upon success.
+ */
+int allocate_matrix_view(matrix **mat, matrix *from, long offset, int rows, int cols,
+                         int row_stride, int col_stride) {
     if (rows <= 0 || cols <= 0) {
       return -1;
     }
-    int size = rows * cols;
-    matrix* matrix = malloc(size * sizeof(*matrix));
+    matrix* matrix = malloc(sizeof(*matrix));
     if (matrix == NULL) {
       return -2;
     }
-    matrix->data = from->data + offset;
+    struct matrix *root = from->parent == NULL ? from : from->parent;
+    matrix->data = (char *) from->data + offset * (long) dtype_size(from->dtype);
+    matrix->dtype = from->dtype;
     matrix->rows = rows;
     matrix->cols = cols;
-    matrix->parent = from;
-    from->ref_cnt ++;
+    matrix->row_stride = row_stride;
+    matrix->col_stride = col_stride;
+    matrix->parent = root;
+    matrix->ref_cnt = 1;
+    matrix->release = NULL;
+    matrix->owner = NULL;
+    __atomic_add_fetch(&root->ref_cnt, 1, __ATOMIC_RELAXED);
     *mat = matrix;
     return 0;
-  }
+}
+
+/*
+ * Takes an extra reference to the data `mat` refers to and returns the matrix that owns it; pass
+ * that to deallocate_matrix to drop the reference again. Until then the data stays alive and
+ * counts as shared, even if `mat` and all its slices are deallocated. numc holds one on each
+ * operand while a kernel runs without the GIL.
+ */
+matrix *retain_matrix(matrix *mat) {
+    struct matrix *root = mat->parent == NULL ? mat : mat->parent;
+    __atomic_add_fetch(&root->ref_cnt, 1, __ATOMIC_RELAXED);
+    return root;
+}
+
+/*
+ * Passes `advice` about the elements of `mat` from (row1, col1) to (row2, col2) in row-major
+ * order on to backing_advise. Only matrices whose rows are laid out in order are advised; for
+ * others, such as transposed views, the range would cover most of the matrix.
+ */
+static void advise_range(matrix *mat, int row1, long col1, int row2, long col2,
+                         backing_advice advice) {
+    if (mat == NULL || mat->row_stride < 0 || mat->col_stride < 0 || mat->col_stride > 1) {
+      return;
+    }
+    backing_advise(mat, element(mat, row1, col1),
+                   element(mat, row2, col2) + dtype_size(mat->dtype), advice);
+}
+
+/* advise_range for units [begin, end) of an operation split into row chunks (see stream_for) */
+static void advise_units(matrix *mat, long cols, long chunks, long begin, long end,
+                         backing_advice advice) {
+    long last_col = ((end - 1) % chunks + 1) * CHUNK_SIZE;
+    advise_range(mat, begin / chunks, (begin % chunks) * CHUNK_SIZE, (end - 1) / chunks,
+                 (last_col < cols ? last_col : cols) - 1, advice);
+}
+
+/* The units of one tile of stream_for, numbered from the tile's first unit */
+typedef struct stream_ctx {
+    void (*fn)(void *, long, long);
+    void *arg;
+    long first;
+} stream_ctx;
+
+static void stream_units(void *arg, long begin, long end) {
+    stream_ctx *ctx = arg;
+    ctx->fn(ctx->arg, ctx->first + begin, ctx->first + end);
+}
+
+/*
+ * parallel_for for operations split into row chunks: unit u covers CHUNK_SIZE elements of row
+ * u / chunks of `cols`-element rows in each of the `count` operands. operands[0] is written
+ * and may be NULL, the others are read. If any operand is file-backed the units run in tiles
+ * that cover at most half the memory budget of operand data, the next tile being prefetched
+ * while one runs and the pages of a tile dropped once it is done, so whatever the operands'
+ * size only about the budget stays resident.
+ */
+static void stream_for(int threads, long units, void (*fn)(void *, long, long), void *arg,
+                       matrix **operands, int count, long cols, long chunks) {
+    size_t unit_bytes = 0;
+    int backed = 0;
+    for (int i = 0; i < count; i++) {
+      if (operands[i] != NULL) {
+        unit_bytes += CHUNK_SIZE * dtype_size(operands[i]->dtype);
+        backed |= is_backed(operands[i]);
+      }
+    }
+    if (!backed) {
+      parallel_for(threads, units, fn, arg);
+      return;
+    }
+    long tile = get_memory_budget() / 2 / unit_bytes;
+    tile = tile < 1 ? 1 : tile;
+    for (int i = 1; i < count; i++) {
+      advise_units(operands[i], cols, chunks, 0, units, BACKING_SEQUENTIAL);
+    }
+    for (long first = 0; first < units; first += tile) {
+      long last = units - first < tile ? units : first + tile;
+      for (int i = 1; i < count && last < units; i++) {
+        advise_units(operands[i], cols, chunks, last, units - last < tile ? units : last + tile,
+                     BACKING_WILLNEED);
+      }
+      stream_ctx ctx = {fn, arg, first};
+      parallel_for(threads, last - first, stream_units, &ctx);
+      for (int i = 0; i < count; i++) {
+        advise_units(operands[i], cols, chunks, first, last, BACKING_DONTNEED);
+      }
+    }
+}
+
+/* Scalar kernels map_matrix can run instead of a unary or binary one */
+typedef enum map_scalar {
+    MAP_NONE,
+    MAP_AFFINE, // alpha * x + beta
+    MAP_DIV, // x / alpha
+    MAP_RDIV, // alpha / x
+    MAP_AXPBY, // alpha * x + beta * y, the one scalar kernel with two operands
+} map_scalar;
+
+/*
+ * Operands of one map_matrix call, split into row chunks that map_units tiles work on. The
+ * kernel is `unary`, `binary` or, if both are NULL, the scalar kernel `scalar` with `alpha` and
+ * `beta`.
+ */
+typedef struct map_ctx {
+    const kernel_table *kt;
+    void (*unary)(void *, const void *, long);
+    void (*binary)(void *, const void *, const void *, long);
+    map_scalar scalar;
+    double alpha;
+    double beta;
+    int sum_sign; // 1 or -1 if `binary` computes a + sum_sign * b, else 0
+    matrix *result;
+    matrix *mat1;
+    matrix *mat2;
+    long cols;
+    long chunks;
+} map_ctx;
+
+/* Runs the kernel of `ctx` on n contiguous elements; `b` is NULL unless it has two operands */
+static inline void map_kernel(const map_ctx *ctx, void *dst, const void *a, const void *b,
+                              long n) {
+    if (ctx->binary != NULL) {
+      ctx->binary(dst, a, b, n);
+    } else if (ctx->unary != NULL) {
+      ctx->unary(dst, a, n);
+    } else if (ctx->scalar == MAP_AFFINE) {
+      ctx->kt->affine(dst, a, ctx->alpha, ctx->beta, n);
+    } else if (ctx->scalar == MAP_AXPBY) {
+      ctx->kt->axpby(dst, ctx->alpha, a, ctx->beta, b, n);
+    } else {
+      ctx->kt->div_scalar(dst, a, ctx->alpha, ctx->scalar == MAP_RDIV, n);
+    }
+}
+
+/*
+ * Runs the element-wise kernel of `ctx` over `n` elements whose operands may be strided.
+ * Strided operands are gathered into contiguous blocks first and a strided result is scattered
+ * back, so the kernels themselves only ever see unit-stride arrays. `b` is NULL for unary and
+ * single-operand scalar kernels. Strides count elements of the kernel table's type.
+ */
+static void map_span(const map_ctx *ctx, char *dst, long dst_stride, const char *a,
+                     long a_stride, const char *b, long b_stride, long n) {
+    if (dst_stride == 1 && a_stride == 1 && (b == NULL || b_stride == 1)) {
+      map_kernel(ctx, dst, a, b, n);
+      return;
+    }
+    if (ctx->sum_sign != 0 && (a_stride == 0 || b_stride == 0)) {
+      /* A sum with a broadcast column is the other operand shifted by one value (in a register) */
+      const char *broadcast = a_stride == 0 ? a : b;
+      double val = ctx->result->dtype == DTYPE_FLOAT32 ? *(const float *) broadcast :
+                                                         *(const double *) broadcast;
+      map_ctx shift = {.kt = ctx->kt, .scalar = MAP_AFFINE, .result = ctx->result};
+      shift.alpha = a_stride == 0 ? ctx->sum_sign : 1;
+      shift.beta = a_stride == 0 ? val : ctx->sum_sign * val;
+      if (a_stride == 0) {
+        map_span(&shift, dst, dst_stride, b, b_stride, NULL, 0, n);
+      } else {
+        map_span(&shift, dst, dst_stride, a, a_stride, NULL, 0, n);
+      }
+      return;
+    }
+    const kernel_table *kt = ctx->kt;
+    /* double arrays so the blocks are aligned and large enough for any element type */
+    double dst_block[GATHER_BLOCK];
+    double a_block[GATHER_BLOCK];
+    double b_block[GATHER_BLOCK];
+    long size = kt->elem_size;
+    for (long i = 0; i < n; i += GATHER_BLOCK) {
+      long len = n - i < GATHER_BLOCK ? n - i : GATHER_BLOCK;
+      const void *a_span = a + i * a_stride * size;
+      const void *b_span = b == NULL ? NULL : b + i * b_stride * size;
+      void *dst_span = dst_stride == 1 ? dst + i * size : (void *) dst_block;
+      /* A broadcast (stride 0) operand is the same value throughout, so its block is filled once */
+      if (a_stride != 1) {
+        if (a_stride != 0 || i == 0) {
+          kt->gather(a_block, a_span, a_stride, len);
+        }
+        a_span = a_block;
+      }
+      if (b != NULL && b_stride != 1) {
+        if (b_stride != 0 || i == 0) {
+          kt->gather(b_block, b_span, b_stride, len);
+        }
+        b_span = b_block;
+      }
+      map_kernel(ctx, dst_span, a_span, b_span, len);
+      if (dst_stride != 1) {
+        kt->scatter(dst + i * dst_stride * size, dst_stride, dst_block, len);
+      }
+    }
+}
+
+/*
+ * Makes `*copy` a new contiguous matrix of type `type` holding the values of `mat`, or sets it
+ * to NULL and does nothing if `mat` already has that type. Operands of mixed-type operations
+ * are converted this way. Return 0 upon success and -2 if allocation fails.
+ */
+static int convert_operand(matrix **copy, matrix *mat, dtype type) {
+    *copy = NULL;
+    if (mat == NULL || mat->dtype == type) {
+      return 0;
+    }
+    if (allocate_matrix_typed(copy, mat->rows, mat->cols, type) != 0) {
+      return -2;
+    }
+    copy_matrix(*copy, mat);
+    return 0;
+}
+
+/*
+ * Stores to *rows and *cols the shape of the NumPy-style broadcast of a rows1 x cols1 and a
+ * rows2 x cols2 operand: each dimension must either match or be 1 in one of them.
+ * Return 0 upon success and -1 if the shapes are incompatible.
+ */
+int broadcast_dims(int rows1, int cols1, int rows2, int cols2, int *rows, int *cols) {
+    if ((rows1 != rows2 && rows1 != 1 && rows2 != 1) ||
+        (cols1 != cols2 && cols1 != 1 && cols2 != 1)) {
+      return -1;
+    }
+    *rows = rows1 == 1 ? rows2 : rows1;
+    *cols = cols1 == 1 ? cols2 : cols1;
+    return 0;
+}
+
+/*
+ * Makes `*view` a rows x cols view of `mat` that repeats a single row or column of it with a
+ * stride of 0, so the repeated elements are never copied. Sets it to NULL instead if `mat`
+ * already has that shape. Return 0 upon success, -1 if `mat` cannot be broadcast to the shape
+ * and -2 if allocation fails.
+ */
+int broadcast_view(matrix **view, matrix *mat, int rows, int cols) {
+    *view = NULL;
+    if (mat->rows == rows && mat->cols == cols) {
+      return 0;
+    }
+    if ((mat->rows != rows && mat->rows != 1) || (mat->cols != cols && mat->cols != 1)) {
+      return -1;
+    }
+    return allocate_matrix_view(view, mat, 0, rows, cols, mat->rows == 1 ? 0 : mat->row_stride,
+                                mat->cols == 1 ? 0 : mat->col_stride);
+}
+
+static void map_units(void *arg, long begin, long end) {
+    map_ctx *ctx = arg;
+    matrix *mat1 = ctx->mat1;
+    matrix *mat2 = ctx->mat2;
+    for (long unit = begin; unit < end; unit++) {
+      int row = unit / ctx->chunks;
+      long col = (unit % ctx->chunks) * CHUNK_SIZE;
+      long len = ctx->cols - col < CHUNK_SIZE ? ctx->cols - col : CHUNK_SIZE;
+      map_span(ctx, element(ctx->result, row, col), ctx->result->col_stride,
+               element(mat1, row, col), mat1->col_stride,
+               mat2 == NULL ? NULL : element(mat2, row, col), mat2 == NULL ? 0 : mat2->col_stride,
+               len);
+    }
+}
+
+/*
+ * Applies the element-wise kernel of `ctx` (see map_ctx; its other fields are filled in here)
+ * for result's type to every element of `result`. Operands of another type are converted
+ * first. Contiguous operands are processed as one flat array; otherwise the work is split into
+ * row chunks so each kernel call sees a single row (or part of one). `mat2` is NULL for unary
+ * and single-operand scalar kernels. Operands with a single row or column are broadcast to result's shape
+ * (see broadcast_view). Return 0 upon success, -1 if an operand cannot be broadcast and -2 if
+ * allocation fails.
+ */
+static int map_matrix(map_ctx ctx, matrix *result, matrix *mat1, matrix *mat2) {
+    matrix *converted1, *converted2, *broadcast1 = NULL, *broadcast2 = NULL;
+    if (convert_operand(&converted1, mat1, result->dtype) != 0) {
+      return -2;
+    }
+    if (convert_operand(&converted2, mat2, result->dtype) != 0) {
+      deallocate_matrix(converted1);
+      return -2;
+    }
+    if (converted1 != NULL) {
+      mat1 = converted1;
+    }
+    if (converted2 != NULL) {
+      mat2 = converted2;
+    }
+    int err = broadcast_view(&broadcast1, mat1, result->rows, result->cols);
+    if (err == 0 && mat2 != NULL) {
+      err = broadcast_view(&broadcast2, mat2, result->rows, result->cols);
+    }
+    if (err == 0) {
+      mat1 = broadcast1 != NULL ? broadcast1 : mat1;
+      mat2 = broadcast2 != NULL ? broadcast2 : mat2;
+      long rows = result->rows;
+      long cols = result->cols;
+      if (is_contiguous(result) && is_contiguous(mat1) &&
+          (mat2 == NULL || is_contiguous(mat2))) {
+        cols *= rows;
+        rows = 1;
+      }
+      long chunks = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+      ctx.kt = kernels_for(result->dtype);
+      ctx.result = result;
+      ctx.mat1 = mat1;
+      ctx.mat2 = mat2;
+      ctx.cols = cols;
+      ctx.chunks = chunks;
+      int threads = threads_for(PARALLEL_ELEMENTWISE, rows * cols, rows * chunks);
+      matrix *operands[] = {result, mat1, mat2};
+      stream_for(threads, rows * chunks, map_units, &ctx, operands, mat2 == NULL ? 2 : 3, cols,
+                 chunks);
+    }
+    deallocate_matrix(broadcast1);
+    deallocate_matrix(broadcast2);
+    deallocate_matrix(converted1);
+    deallocate_matrix(converted2);
+    return err;
+}
+
+typedef struct fill_ctx {
+    const kernel_table *kt;
+    matrix *mat;
+    double val;
+    long cols;
+    long chunks;
+} fill_ctx;
+
+static void fill_units(void *arg, long begin, long end) {
+    fill_ctx *ctx = arg;
+    const kernel_table *kt = ctx->kt;
+    matrix *mat = ctx->mat;
+    double val = ctx->val;
+    for (long unit = begin; unit < end; unit++) {
+      int row = unit / ctx->chunks;
+      long col = (unit % ctx->chunks) * CHUNK_SIZE;
+      long len = ctx->cols - col < CHUNK_SIZE ? ctx->cols - col : CHUNK_SIZE;
+      if (mat->col_stride == 1) {
+        kt->fill(element(mat, row, col), val, len);
+      } else {
+        double block[GATHER_BLOCK];
+        for (long i = 0; i < len; i += GATHER_BLOCK) {
+          long n = len - i < GATHER_BLOCK ? len - i : GATHER_BLOCK;
+          kt->fill(block, val, n);
+          kt->scatter(element(mat, row, col + i), mat->col_stride, block, n);
+        }
+      }
+    }
+}
 
 /*
  * set all entries in mat to val. Note that the matrix is in row-major order.
  */
 void fill_matrix(matrix *mat, double val) {
-    int size = mat->rows * mat->cols;
-    double* array = mat->data;
-    __m256d fill_vector =  _mm256_set1_pd (val);
-    #pragma omp parallel for
-    for (int i = 0; i < size / 4 * 4; i += 4) {
-       _mm256_storeu_pd (array + i, fill_vector);
-    }
-    // tail case when size is not mulitple of 4
-    for (int i = size / 4 * 4; i < size; i++) {
-      array[i] = val;
+    long rows = mat->rows;
+    long cols = mat->cols;
+    if (is_contiguous(mat)) {
+      cols *= rows;
+      rows = 1;
     }
+    long chunks = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    fill_ctx ctx = {kernels_for(mat->dtype), mat, val, cols, chunks};
+    int threads = threads_for(PARALLEL_ELEMENTWISE, rows * cols, rows * chunks);
+    stream_for(threads, rows * chunks, fill_units, &ctx, &mat, 1, cols, chunks);
 }
 
 /*
@@ -155,22 +621,7 @@ void fill_matrix(matrix *mat, double val) {
  * Note that the matrix is in row-major order.
  */
 int abs_matrix(matrix *result, matrix *mat) {
-    int size = result->rows * result->cols;
-    double* resultArray = result->data;
-    double* matArray = mat->data;
-    __m256d mask = _mm256_set1_pd (-1);
-    #pragma omp parallel for
-    for (int i = 0; i < size / 4 * 4; i += 4) {
-       __m256d vector_matArray = _mm256_loadu_pd (matArray + i);
-       __m256d negation = _mm256_mul_pd (vector_matArray , mask);
-       __m256d abs_vector = _mm256_max_pd (negation, vector_matArray);
-       _mm256_storeu_pd (resultArray + i, abs_vector);
-    }
-    // tail case when size is not multiple of 4
-    for (int i = size / 4 * 4; i < size; i++) {
-       resultArray[i] = fabs(matArray[i]);
-    }
-    return 0;
+    return map_matrix((map_ctx) {.unary = kernels_for(result->dtype)->abs}, result, mat, NULL);
 }
 
 /*
@@ -179,177 +630,1567 @@ int abs_matrix(matrix *result, matrix *mat) {
  * Note that the matrix is in row-major order.
  */
 int neg_matrix(matrix *result, matrix *mat) {
-    int size = result->rows * result->cols;
-    double* resultArray = result->data;
-    double* matArray = mat->data;
-    __m256d negation = _mm256_set1_pd(-1);
-    #pragma omp parallel for
-    for (int i = 0; i < size / 4 * 4; i += 4) {
-      __m256d vector = _mm256_loadu_pd (matArray + i);
-      __m256d negated_vector = _mm256_mul_pd (negation, vector);
-      _mm256_storeu_pd (resultArray + i, negated_vector);
-    }
-    // handle tail case
-    for (int i = size / 4 * 4; i < size; i++) {
-      resultArray[i] = matArray[i] * -1;
-    }
-    return 0;
+    return map_matrix((map_ctx) {.unary = kernels_for(result->dtype)->neg}, result, mat, NULL);
 }
 
 /*
  * Store the result of adding mat1 and mat2 to `result`.
- * Return 0 upon success.
- * You may assume `mat1` and `mat2` have the same dimensions.
+ * Return 0 upon success, -1 if the operands cannot be broadcast to result's shape (see
+ * broadcast_dims) and -2 if allocation fails.
  * Note that the matrix is in row-major order.
  */
 int add_matrix(matrix *result, matrix *mat1, matrix *mat2) {
-    int size = result->rows * result->cols;
-    double* resultArray = result->data;
-    double* mat1Array = mat1->data;
-    double* mat2Array = mat2->data;
-    #pragma omp parallel for
-    for (int i = 0; i < size / 4 * 4; i += 4) {
-      __m256d vector_mat1Array = _mm256_loadu_pd (mat1Array + i);
-      __m256d vector_mat2Array = _mm256_loadu_pd (mat2Array + i);
-      __m256d vector_answer = _mm256_add_pd (vector_mat1Array, vector_mat2Array);
-      _mm256_storeu_pd (resultArray + i, vector_answer);
-    }
-    for (int i = size / 4 * 4; i < size; i++) {
-      resultArray[i] = mat1Array[i] + mat2Array[i];
-    }
-    return 0;
+    return map_matrix((map_ctx) {.binary = kernels_for(result->dtype)->add, .sum_sign = 1},
+                      result, mat1, mat2);
 }
 
 /*
  *
  * Store the result of subtracting mat2 from mat1 to `result`.
- * Return 0 upon success.
- * You may assume `mat1` and `mat2` have the same dimensions.
+ * Return 0 upon success, -1 if the operands cannot be broadcast to result's shape (see
+ * broadcast_dims) and -2 if allocation fails.
  * Note that the matrix is in row-major order.
  */
 int sub_matrix(matrix *result, matrix *mat1, matrix *mat2) {
-    int size = result->rows * result->cols;
-    double* resultArray = result->data;
-    double* mat1Array = mat1->data;
-    double* mat2Array = mat2->data;
-    #pragma omp parallel for
-    for (int i = 0; i < size / 4 * 4; i += 4) {
-      __m256d vector_mat1Array = _mm256_loadu_pd (mat1Array + i);
-      __m256d vector_mat2Array = _mm256_loadu_pd (mat2Array + i);
-      __m256d vector_answer = _mm256_sub_pd (vector_mat1Array, vector_mat2Array);
-      _mm256_storeu_pd (resultArray + i, vector_answer);
-    }
-    for (int i = size / 4 * 4; i < size; i++) {
-      resultArray[i] = mat1Array[i] - mat2Array[i];
+    return map_matrix((map_ctx) {.binary = kernels_for(result->dtype)->sub, .sum_sign = -1},
+                      result, mat1, mat2);
+}
+
+/*
+ * Store the element-wise product of mat1 and mat2 to `result`, which may be either operand.
+ * Return 0 upon success, -1 if the operands cannot be broadcast to result's shape and -2 if
+ * allocation fails.
+ */
+int multiply_matrix(matrix *result, matrix *mat1, matrix *mat2) {
+    return map_matrix((map_ctx) {.binary = kernels_for(result->dtype)->mul}, result, mat1, mat2);
+}
+
+/*
+ * Store the element-wise quotient mat1 / mat2 to `result`, which may be either operand.
+ * Return 0 upon success, -1 if the operands cannot be broadcast to result's shape and -2 if
+ * allocation fails.
+ */
+int divide_matrix(matrix *result, matrix *mat1, matrix *mat2) {
+    return map_matrix((map_ctx) {.binary = kernels_for(result->dtype)->div}, result, mat1, mat2);
+}
+
+/*
+ * Store alpha * x + beta * y to `result` in one pass, with a fused multiply-add per element
+ * where the CPU has one. `result` may be x or y, so y = alpha * x + y (axpy) needs no
+ * temporary. Return 0 upon success, -1 if the operands cannot be broadcast to result's shape
+ * and -2 if allocation fails.
+ */
+int axpby_matrix(matrix *result, double alpha, matrix *x, double beta, matrix *y) {
+    return map_matrix((map_ctx) {.scalar = MAP_AXPBY, .alpha = alpha, .beta = beta}, result, x,
+                      y);
+}
+
+/*
+ * Store alpha * mat + beta, element-wise, to `result`. `result` may be `mat` itself.
+ * Return 0 upon success and -2 if allocation fails.
+ */
+int affine_matrix(matrix *result, matrix *mat, double alpha, double beta) {
+    return map_matrix((map_ctx) {.scalar = MAP_AFFINE, .alpha = alpha, .beta = beta}, result,
+                      mat, NULL);
+}
+
+/*
+ * Store mat / val, or val / mat if `reverse` is set, element-wise to `result`. `result` may be
+ * `mat` itself. Return 0 upon success and -2 if allocation fails.
+ */
+int div_scalar_matrix(matrix *result, matrix *mat, double val, int reverse) {
+    return map_matrix((map_ctx) {.scalar = reverse ? MAP_RDIV : MAP_DIV, .alpha = val}, result,
+                      mat, NULL);
+}
+
+/* Square tiles the transpose is split into for threading, and swapped through when in place */
+#define TRANSPOSE_TILE 256
+#define TRANSPOSE_SWAP_TILE 64
+/* Blocks at most this large on each side go straight to the transpose kernel */
+#define TRANSPOSE_LEAF 32
+
+/*
+ * dst = src^T for the m x n block at `src`, halving its longer side until both fit
+ * TRANSPOSE_LEAF. Every level of the cache sees blocks small enough for it without tuning for
+ * any of them. Splits are kept at multiples of 4 rows or columns for the 4 x 4 tiles.
+ */
+static void transpose_block(const kernel_table *kt, int m, int n, const char *src, long lds,
+                            char *dst, long ldd) {
+    if (m <= TRANSPOSE_LEAF && n <= TRANSPOSE_LEAF) {
+      kt->transpose(m, n, src, lds, dst, ldd);
+      return;
+    }
+    long size = kt->elem_size;
+    if (m >= n) {
+      int half = (m / 2 + 3) & ~3;
+      transpose_block(kt, half, n, src, lds, dst, ldd);
+      transpose_block(kt, m - half, n, src + half * lds * size, lds, dst + half * size, ldd);
+    } else {
+      int half = (n / 2 + 3) & ~3;
+      transpose_block(kt, m, half, src, lds, dst, ldd);
+      transpose_block(kt, m, n - half, src + half * size, lds, dst + half * ldd * size, ldd);
     }
-    return 0;
 }
 
-void transpose(matrix *dst, matrix *src) {
-    for (int x = 0; x < src->rows; x++) {
-        for (int y = 0; y < src->cols; y++) {
-            double value = get(src, x, y);
-            set(dst, y, x, value);
-        }
+/* Tiles of one transpose; `tiles` is the number of tiles per row of mat */
+typedef struct transpose_ctx {
+    const kernel_table *kt;
+    matrix *result;
+    matrix *mat;
+    long tiles;
+} transpose_ctx;
+
+static void transpose_tiles(void *arg, long begin, long end) {
+    transpose_ctx *ctx = arg;
+    matrix *mat = ctx->mat;
+    for (long unit = begin; unit < end; unit++) {
+      int row = unit / ctx->tiles * TRANSPOSE_TILE;
+      int col = unit % ctx->tiles * TRANSPOSE_TILE;
+      int m = mat->rows - row < TRANSPOSE_TILE ? mat->rows - row : TRANSPOSE_TILE;
+      int n = mat->cols - col < TRANSPOSE_TILE ? mat->cols - col : TRANSPOSE_TILE;
+      transpose_block(ctx->kt, m, n, element(mat, row, col), mat->row_stride,
+                      element(ctx->result, col, row), ctx->result->row_stride);
     }
 }
 
 /*
- * Store the result of multiplying mat1 and mat2 to `result`.
- * Return 0 upon success.
- * Remember that matrix multiplication is not the same as multiplying individual elements.
- * You may assume `mat1`'s number of columns is equal to `mat2`'s number of rows.
- * Note that the matrix is in row-major order.
+ * Swaps tile (i, j) of the square matrix ctx->mat with the transpose of tile (j, i) for i < j,
+ * and transposes diagonal tiles, each through a buffer of one tile.
  */
-int mul_matrix(matrix *result, matrix *mat1, matrix *mat2) {
-    matrix *mat2_transposed = NULL;
-    allocate_matrix(&mat2_transposed, mat2->cols, mat2->rows);
-    transpose(mat2_transposed, mat2);
-    #pragma omp parallel for
-    for (int row = 0; row < result->rows; row ++) {
-      int k = row * mat1->cols;
-      int i = 0;
-      for (int col = 0; col < result->cols; col ++) {
-        __m256d value = _mm256_set1_pd(0);
-        double resultArray[4];
-        for (int j = 0; j < mat1->cols / 4 * 4; j += 4) {
-          __m256d mat1_vector = _mm256_loadu_pd (mat1->data + (j + k));
-          __m256d mat2_vector = _mm256_loadu_pd (mat2_transposed->data + (j + i));
-          __m256d  multipled_vector = _mm256_mul_pd (mat1_vector, mat2_vector);
-          value = _mm256_add_pd (value, multipled_vector);
-        }
-        _mm256_storeu_pd (resultArray, value);
-         // Handle tail case
-        for (int j = mat1->cols / 4 * 4; j < mat1->cols; j++) {
-          resultArray[0] += get(mat1, row, j) * get(mat2_transposed, col, j);
-        }
-        double finalResult = resultArray[0] + resultArray[1] + resultArray[2] + resultArray[3];
-        set(result, row, col, finalResult);
-        i += mat2_transposed->cols;
+static void transpose_swap_tiles(void *arg, long begin, long end) {
+    transpose_ctx *ctx = arg;
+    const kernel_table *kt = ctx->kt;
+    matrix *mat = ctx->mat;
+    long size = kt->elem_size;
+    long ld = mat->row_stride;
+    double buffer[TRANSPOSE_SWAP_TILE * TRANSPOSE_SWAP_TILE];
+    for (long unit = begin; unit < end; unit++) {
+      int row = unit / ctx->tiles * TRANSPOSE_SWAP_TILE;
+      int col = unit % ctx->tiles * TRANSPOSE_SWAP_TILE;
+      if (row > col) {
+        continue;
+      }
+      int m = mat->rows - row < TRANSPOSE_SWAP_TILE ? mat->rows - row : TRANSPOSE_SWAP_TILE;
+      int n = mat->cols - col < TRANSPOSE_SWAP_TILE ? mat->cols - col : TRANSPOSE_SWAP_TILE;
+      char *upper = element(mat, row, col);
+      char *lower = element(mat, col, row);
+      /* buffer = upper^T (n x m), upper = lower^T, lower = buffer */
+      kt->transpose(m, n, upper, ld, buffer, m);
+      if (row != col) {
+        kt->transpose(n, m, lower, ld, upper, ld);
+      }
+      for (int i = 0; i < n; i++) {
+        memcpy(lower + i * ld * size, (char *) buffer + (long) i * m * size, m * size);
       }
     }
-    deallocate_matrix(mat2_transposed);
-    return 0;
 }
 
-void set_to_identity_matrix(matrix *result) {
-   int size = result->rows * result->cols;
-   int slide = result->cols + 1;
-   for (int i = 0; i < size; i++) {
-     if (i % slide == 0) {
-       result->data[i] = 1;
-     } else {
-       result->data[i] = 0;
-     }
-   }
- }
+/*
+ * Like copy_matrix(result, mat^T) for operands of the same type with unit column strides, by
+ * blocks of TRANSPOSE_TILE x TRANSPOSE_TILE elements on all threads. `result` and `mat` must
+ * not overlap unless they are the very same square matrix, which is then transposed in place.
+ */
+static void transpose_blocks(matrix *result, matrix *mat) {
+    int inplace = result->data == mat->data;
+    int tile = inplace ? TRANSPOSE_SWAP_TILE : TRANSPOSE_TILE;
+    long tiles = (mat->cols + tile - 1) / tile;
+    long units = (mat->rows + tile - 1) / tile * tiles;
+    transpose_ctx ctx = {kernels_for(mat->dtype), result, mat, tiles};
+    int threads = threads_for(PARALLEL_ELEMENTWISE, (long) mat->rows * mat->cols, units);
+    parallel_for(threads, units, inplace ? transpose_swap_tiles : transpose_tiles, &ctx);
+}
 
-/* copy data from mat matrix and put it in result matrix */
- void copy_matrix(matrix *result, matrix *mat) {
-   int size = mat->rows * mat->cols;
-   for (int i = 0; i < size; i++) {
-     result->data[i] = mat->data[i];
-   }
- }
+/* mat with its rows and columns swapped, sharing mat's data like sub_block */
+static matrix transposed_view(matrix *mat) {
+    matrix view = *mat;
+    view.rows = mat->cols;
+    view.cols = mat->rows;
+    view.row_stride = mat->col_stride;
+    view.col_stride = mat->row_stride;
+    view.parent = mat->parent == NULL ? mat : mat->parent;
+    return view;
+}
 
 /*
-  * Store the result of raising mat to the (pow)th power to `result`.
-  * Return 0 upon success.
-  * Remember that pow is defined with matrix multiplication, not element-wise multiplication.
-  * You may assume `mat` is a square matrix and `pow` is a non-negative integer.
-  * Note that the matrix is in row-major order.
-*/
-int pow_matrix(matrix *result, matrix *mat, int pow) {
-    if (pow == 0) {
-      set_to_identity_matrix(result);
-    } else if (pow == 1) {
-      copy_matrix(result, mat);
+ * Store the transpose of `mat` to `result`, which must be mat->cols x mat->rows. `result` may be
+ * `mat` itself if it is square, which transposes it in place; otherwise overlapping operands go
+ * through a copy. Return 0 upon success and -2 if allocation fails.
+ */
+int transpose_matrix(matrix *result, matrix *mat) {
+    int same = result->data == mat->data && result->row_stride == mat->row_stride &&
+               result->col_stride == mat->col_stride;
+    int blocked = result->dtype == mat->dtype && result->col_stride == 1 && mat->col_stride == 1;
+    if (same && blocked) {
+      transpose_blocks(mat, mat);
+      return 0;
     }
-    matrix *mat_helper = NULL;
-    allocate_matrix(&mat_helper, mat->rows, mat->cols);
-    copy_matrix(mat_helper, mat);
-    matrix *identity_matrix = NULL;
-    allocate_matrix(&identity_matrix, mat->rows, mat->cols);
-    set_to_identity_matrix(identity_matrix);
-    matrix *identity_matrix_helper = NULL;
-    allocate_matrix(&identity_matrix_helper, mat->rows, mat->cols);
-    set_to_identity_matrix(identity_matrix_helper);
-    while (pow > 1) {
-      if (pow % 2 == 0) {
-        mul_matrix(result, mat_helper, mat_helper);
-        copy_matrix(mat_helper, result);
-        pow = pow / 2;
-      } else {
-        mul_matrix(identity_matrix, identity_matrix_helper, mat_helper);
-        copy_matrix(identity_matrix_helper, identity_matrix);
-        mul_matrix(result, mat_helper, mat_helper);
-        copy_matrix(mat_helper, result);
-        pow = (pow - 1) / 2;
+    if (same || views_overlap(result, mat)) {
+      matrix *copy;
+      if (allocate_matrix_typed(&copy, mat->rows, mat->cols, mat->dtype) != 0) {
+        return -2;
       }
+      copy_matrix(copy, mat);
+      int err = transpose_matrix(result, copy);
+      deallocate_matrix(copy);
+      return err;
+    }
+    if (blocked) {
+      transpose_blocks(result, mat);
+    } else {
+      matrix view = transposed_view(mat);
+      copy_matrix(result, &view);
     }
-    mul_matrix(result, mat_helper, identity_matrix);
-    deallocate_matrix(mat_helper);
-    deallocate_matrix(identity_matrix);
-    deallocate_matrix(identity_matrix_helper);
     return 0;
 }
+
+/*
+ * Blocking parameters for the packed GEMM below. The micro-kernel keeps a GEMM_MR x nr tile
+ * of the result in registers (nr = kernel_table.gemm_nr). A GEMM_KC x nr panel of mat2 stays
+ * in L1, a GEMM_MC x GEMM_KC block of mat1 (240KB of doubles) stays in L2 and a GEMM_KC x
+ * GEMM_NC block of mat2 (8MB of doubles) is shared by all threads from L3. float32 blocks take
+ * half the space.
+ */
+#define GEMM_MC 120
+#define GEMM_KC 256
+#define GEMM_NC 4096
+
+/* Takes a 64-byte aligned scratch buffer of `count` elements from the pool, or NULL on failure */
+static void *alloc_pack_buffer(const kernel_table *kt, size_t count) {
+    return pool_alloc(count * kt->elem_size, 0);
+}
+
+static void free_pack_buffer(const kernel_table *kt, void *buffer, size_t count) {
+    pool_free(buffer, count * kt->elem_size);
+}
+
+/*
+ * One kc x nc block of a GEMM: its operands, the packed panels of B shared by every tile, and
+ * whether any tile failed to get scratch space for its blocks of A.
+ */
+typedef struct gemm_ctx {
+    const kernel_table *kt;
+    int m, nc, kc;
+    const char *a;
+    long rsa, csa;
+    const char *b;
+    long rsb, csb;
+    char *c;
+    long rsc, csc;
+    int accumulate;
+    char *packed_b;
+    int failed;
+} gemm_ctx;
+
+/* Packs nr-column panels [begin, end) of the current block of B */
+static void pack_b_panels(void *arg, long begin, long end) {
+    gemm_ctx *ctx = arg;
+    const kernel_table *kt = ctx->kt;
+    int nr = kt->gemm_nr;
+    long size = kt->elem_size;
+    for (long p = begin; p < end; p++) {
+      int j = p * nr;
+      int cols = ctx->nc - j < nr ? ctx->nc - j : nr;
+      kt->pack_b(ctx->kc, cols, ctx->b + j * ctx->csb * size, ctx->rsb, ctx->csb,
+                 ctx->packed_b + (size_t) p * ctx->kc * nr * size);
+    }
+}
+
+/*
+ * Packs the kc x nc block of B in `ctx` into ctx->packed_b as consecutive nr-column panels,
+ * each stored row by row. Columns past `nc` are padded with zeros. Uses up to `threads`
+ * threads.
+ */
+static void pack_b(gemm_ctx *ctx, int threads) {
+    int nr = ctx->kt->gemm_nr;
+    int panels = (ctx->nc + nr - 1) / nr;
+    parallel_for(threads, panels, pack_b_panels, ctx);
+}
+
+/* Packs and multiplies GEMM_MC-row blocks [begin, end) of A with the packed block of B */
+static void gemm_blocks(void *arg, long begin, long end) {
+    gemm_ctx *ctx = arg;
+    const kernel_table *kt = ctx->kt;
+    long size = kt->elem_size;
+    void *packed_a = alloc_pack_buffer(kt, (size_t) GEMM_MC * ctx->kc);
+    if (packed_a == NULL) {
+      __atomic_store_n(&ctx->failed, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    for (long block = begin; block < end; block++) {
+      int ic = block * GEMM_MC;
+      int mc = ctx->m - ic < GEMM_MC ? ctx->m - ic : GEMM_MC;
+      kt->pack_a(mc, ctx->kc, ctx->a + ic * ctx->rsa * size, ctx->rsa, ctx->csa, packed_a);
+      kt->gemm_macro_kernel(mc, ctx->nc, ctx->kc, packed_a, ctx->packed_b,
+                            ctx->c + ic * ctx->rsc * size, ctx->rsc, ctx->csc, ctx->accumulate);
+    }
+    free_pack_buffer(kt, packed_a, (size_t) GEMM_MC * ctx->kc);
+}
+
+/* Elements of scratch space a product with a k x n matrix B packs B's blocks into */
+static size_t gemm_workspace_count(const kernel_table *kt, int n, int k) {
+    int nr = kt->gemm_nr;
+    int nc_max = n < GEMM_NC ? n : GEMM_NC;
+    int kc_max = k < GEMM_KC ? k : GEMM_KC;
+    return (size_t) ((nc_max + nr - 1) / nr) * nr * kc_max;
+}
+
+/*
+ * C = A * B for an m x k matrix A, a k x n matrix B and an m x n matrix C of the kernel table's
+ * type, each given by a pointer to its first element and its row and column strides. Blocks of
+ * B are packed once into `workspace` (gemm_workspace_count(kt, n, k) elements from
+ * alloc_pack_buffer) and shared by all threads, which each pack and multiply their own row
+ * blocks of A. If `workspace` is NULL it is taken from the pool for this call. With
+ * `accumulate` set, C += A * B instead. Returns -2 if scratch space could not be allocated.
+ */
+static int gemm(const kernel_table *kt, int m, int n, int k, const char *a, long rsa, long csa,
+                const char *b, long rsb, long csb, char *c, long rsc, long csc, char *workspace,
+                int accumulate) {
+    long size = kt->elem_size;
+    size_t packed_b_count = gemm_workspace_count(kt, n, k);
+    char *packed_b = workspace != NULL ? workspace : alloc_pack_buffer(kt, packed_b_count);
+    if (packed_b == NULL) {
+      return -2;
+    }
+    long blocks = (m + GEMM_MC - 1) / GEMM_MC;
+    int threads = threads_for(PARALLEL_GEMM, (long) m * n * k, blocks);
+    gemm_ctx ctx = {kt, m, 0, 0, NULL, rsa, csa, NULL, rsb, csb, NULL, rsc, csc, 0, packed_b, 0};
+    for (int jc = 0; jc < n && !ctx.failed; jc += GEMM_NC) {
+      int nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+      for (int pc = 0; pc < k; pc += GEMM_KC) {
+        ctx.nc = nc;
+        ctx.kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+        ctx.a = a + pc * csa * size;
+        ctx.b = b + (pc * rsb + jc * csb) * size;
+        ctx.c = c + jc * csc * size;
+        ctx.accumulate = accumulate || pc > 0;
+        pack_b(&ctx, threads);
+        /* Row blocks are the tiles, so idle threads steal whole blocks of A */
+        parallel_for(threads, blocks, gemm_blocks, &ctx);
+        if (ctx.failed) {
+          break;
+        }
+      }
+    }
+    if (workspace == NULL) {
+      free_pack_buffer(kt, packed_b, packed_b_count);
+    }
+    return ctx.failed ? -2 : 0;
+}
+
+/* result = mat1 * mat2 for operands of result's type, packing into `workspace` (or NULL) */
+static int multiply(matrix *result, matrix *mat1, matrix *mat2, char *workspace) {
+    return gemm(kernels_for(result->dtype), mat1->rows, mat2->cols, mat1->cols,
+                mat1->data, mat1->row_stride, mat1->col_stride,
+                mat2->data, mat2->row_stride, mat2->col_stride,
+                result->data, result->row_stride, result->col_stride, workspace, 0);
+}
+
+static matmul_algorithm matmul_mode = MATMUL_AUTO;
+static int strassen_cutoff = STRASSEN_DEFAULT_CUTOFF;
+
+/*
+ * Selects how products are computed. MATMUL_CLASSIC always uses the blocked GEMM above,
+ * MATMUL_STRASSEN uses Strassen-Winograd for every product whose dimensions all reach the
+ * cutoff, and MATMUL_AUTO (the default) uses it only for the repeated square products of
+ * pow_matrix, where at least one level of recursion applies.
+ */
+void set_matmul_algorithm(matmul_algorithm algorithm) {
+    matmul_mode = algorithm;
+}
+
+matmul_algorithm get_matmul_algorithm(void) {
+    return matmul_mode;
+}
+
+/* Sets the smallest dimension Strassen-Winograd still splits; smaller products use GEMM */
+void set_strassen_cutoff(int cutoff) {
+    strassen_cutoff = cutoff < 2 ? 2 : cutoff;
+}
+
+int get_strassen_cutoff(void) {
+    return strassen_cutoff;
+}
+
+/*
+ * A rows x cols block of `mat` starting at (row, col). It shares mat's data without taking a
+ * reference, so it lives on the stack and must not be passed to deallocate_matrix.
+ */
+static matrix sub_block(matrix *mat, int row, int col, int rows, int cols) {
+    matrix block = *mat;
+    block.data = element(mat, row, col);
+    block.rows = rows;
+    block.cols = cols;
+    block.parent = mat->parent == NULL ? mat : mat->parent;
+    return block;
+}
+
+/*
+ * result = mat1 * mat2 by Strassen-Winograd recursion: 7 half-size products and 15 additions
+ * per level instead of 8 products, until a dimension falls below the cutoff. The schedule
+ * (Boyer, Dumas, Pernet and Zhou, "Memory efficient scheduling of Strassen-Winograd's matrix
+ * multiplication algorithm", 2009) keeps partial results in result's own quadrants, so each
+ * level only needs three half-size temporaries. Odd rows, columns and inner dimensions are
+ * peeled off and handled by GEMM. The operands must have result's type and must not share
+ * memory with it.
+ *
+ * Error bound: with L levels of recursion and n0 = n / 2^L the size of the GEMM leaves,
+ * ||C - C'|| <= ((n / n0)^log2(18) * (n0^2 + 6 n0) - 6 n) u ||A|| ||B|| to first order in the
+ * unit roundoff u, for the max norm (Higham, Accuracy and Stability of Numerical Algorithms,
+ * Theorem 23.3). Unlike the classic bound |C - C'| <= n u |A| |B| this is only normwise, so
+ * small entries of the product may lose relative accuracy. Return -2 if allocation fails.
+ */
+static int strassen(matrix *result, matrix *mat1, matrix *mat2) {
+    int m = mat1->rows;
+    int k = mat1->cols;
+    int n = mat2->cols;
+    if (m < strassen_cutoff || k < strassen_cutoff || n < strassen_cutoff) {
+      return multiply(result, mat1, mat2, NULL);
+    }
+    int mh = m / 2, kh = k / 2, nh = n / 2;
+    matrix a11 = sub_block(mat1, 0, 0, mh, kh), a12 = sub_block(mat1, 0, kh, mh, kh);
+    matrix a21 = sub_block(mat1, mh, 0, mh, kh), a22 = sub_block(mat1, mh, kh, mh, kh);
+    matrix b11 = sub_block(mat2, 0, 0, kh, nh), b12 = sub_block(mat2, 0, nh, kh, nh);
+    matrix b21 = sub_block(mat2, kh, 0, kh, nh), b22 = sub_block(mat2, kh, nh, kh, nh);
+    matrix c11 = sub_block(result, 0, 0, mh, nh), c12 = sub_block(result, 0, nh, mh, nh);
+    matrix c21 = sub_block(result, mh, 0, mh, nh), c22 = sub_block(result, mh, nh, mh, nh);
+    matrix *x = NULL, *y = NULL, *z = NULL;
+    int failed = allocate_matrix_typed(&x, mh, kh, result->dtype) != 0 ||
+                 allocate_matrix_typed(&y, kh, nh, result->dtype) != 0 ||
+                 allocate_matrix_typed(&z, mh, nh, result->dtype) != 0;
+    if (!failed) {
+      sub_matrix(x, &a11, &a21); // S3
+      sub_matrix(y, &b22, &b12); // T3
+      failed |= strassen(&c21, x, y); // P7
+      add_matrix(x, &a21, &a22); // S1
+      sub_matrix(y, &b12, &b11); // T1
+      failed |= strassen(&c22, x, y); // P5
+      sub_matrix(x, x, &a11); // S2
+      sub_matrix(y, &b22, y); // T2
+      failed |= strassen(&c12, x, y); // P6
+      sub_matrix(x, &a12, x); // S4
+      sub_matrix(y, y, &b21); // T4
+      failed |= strassen(&c11, x, &b22); // P3
+      failed |= strassen(z, &a11, &b11); // P1
+      add_matrix(&c12, z, &c12); // U2 = P1 + P6
+      add_matrix(&c21, &c12, &c21); // U3 = U2 + P7
+      add_matrix(&c12, &c12, &c22); // U4 = U2 + P5
+      add_matrix(&c22, &c21, &c22); // U7 = U3 + P5, the final C22
+      add_matrix(&c12, &c12, &c11); // U5 = U4 + P3, the final C12
+      failed |= strassen(&c11, &a22, y); // P4
+      sub_matrix(&c21, &c21, &c11); // U6 = U3 - P4, the final C21
+      failed |= strassen(&c11, &a12, &b21); // P2
+      add_matrix(&c11, z, &c11); // U1 = P1 + P2, the final C11
+    }
+    deallocate_matrix(x);
+    deallocate_matrix(y);
+    deallocate_matrix(z);
+    if (failed) {
+      return -2;
+    }
+    const kernel_table *kt = kernels_for(result->dtype);
+    if (k % 2 == 1) {
+      /* The last column of mat1 times the last row of mat2 is still missing from the even part */
+      failed |= gemm(kt, 2 * mh, 2 * nh, 1, element(mat1, 0, k - 1), mat1->row_stride,
+                     mat1->col_stride, element(mat2, k - 1, 0), mat2->row_stride,
+                     mat2->col_stride, result->data, result->row_stride, result->col_stride,
+                     NULL, 1);
+    }
+    if (n % 2 == 1) {
+      matrix last_col = sub_block(result, 0, n - 1, m, 1);
+      matrix b_col = sub_block(mat2, 0, n - 1, k, 1);
+      failed |= multiply(&last_col, mat1, &b_col, NULL);
+    }
+    if (m % 2 == 1) {
+      matrix last_row = sub_block(result, m - 1, 0, 1, 2 * nh);
+      matrix a_row = sub_block(mat1, m - 1, 0, 1, k);
+      matrix b_cols = sub_block(mat2, 0, 0, k, 2 * nh);
+      failed |= multiply(&last_row, &a_row, &b_cols, NULL);
+    }
+    return failed ? -2 : 0;
+}
+
+/*
+ * Products with a vector operand are memory bound: every element of the matrix operand is used
+ * once, so packing it would only add traffic. They stream it through the dot and axpby kernels
+ * instead. A GEMV tile is GEMV_ROWS rows of A. A GEVM splits B into row blocks of at least
+ * GEVM_MIN_ROWS rows whose partial results are added in block order, using at most
+ * GEVM_PARTIAL_COUNT elements of scratch space.
+ */
+#define GEMV_ROWS 64
+#define GEVM_MIN_ROWS 256
+#define GEVM_MAX_BLOCKS 16
+#define GEVM_PARTIAL_COUNT (1L << 22)
+
+/*
+ * Returns the elements of the row or column vector `vec` as a contiguous array: its own data if
+ * they already are, else a pool buffer they are gathered into, which is also stored to `*copy`
+ * to be freed with free_pack_buffer. Returns NULL if allocation fails.
+ */
+static const char *vector_data(const kernel_table *kt, matrix *vec, void **copy) {
+    long n = (long) vec->rows * vec->cols;
+    long stride = vec->rows == 1 ? vec->col_stride : vec->row_stride;
+    *copy = NULL;
+    if (stride == 1 || n == 1) {
+      return vec->data;
+    }
+    *copy = alloc_pack_buffer(kt, n);
+    if (*copy != NULL) {
+      kt->gather(*copy, vec->data, stride, n);
+    }
+    return *copy;
+}
+
+/* Operands of a vector-shaped product; `vec` is the vector operand made contiguous */
+typedef struct vector_ctx {
+    const kernel_table *kt;
+    matrix *result;
+    matrix *mat1;
+    matrix *mat2;
+    const char *vec;
+    long chunks;
+    int blocks;
+    char *partials;
+} vector_ctx;
+
+/* y = A x for GEMV_ROWS-row tiles [begin, end) of A, one dot product per row */
+static void gemv_rows(void *arg, long begin, long end) {
+    vector_ctx *ctx = arg;
+    matrix *mat1 = ctx->mat1;
+    for (long tile = begin; tile < end; tile++) {
+      int first = tile * GEMV_ROWS;
+      int last = first + GEMV_ROWS < mat1->rows ? first + GEMV_ROWS : mat1->rows;
+      for (int row = first; row < last; row++) {
+        set(ctx->result, row, 0, ctx->kt->dot(element(mat1, row, 0), ctx->vec, mat1->cols));
+      }
+    }
+}
+
+/* result = mat1 * mat2 for an N x 1 mat2 and a mat1 with contiguous rows */
+static int gemv(matrix *result, matrix *mat1, matrix *mat2) {
+    const kernel_table *kt = kernels_for(result->dtype);
+    void *copy;
+    const char *x = vector_data(kt, mat2, &copy);
+    if (x == NULL) {
+      return -2;
+    }
+    long tiles = (mat1->rows + GEMV_ROWS - 1) / GEMV_ROWS;
+    vector_ctx ctx = {kt, result, mat1, mat2, x, 0, 0, NULL};
+    int threads = threads_for(PARALLEL_ELEMENTWISE, (long) mat1->rows * mat1->cols, tiles);
+    parallel_for(threads, tiles, gemv_rows, &ctx);
+    free_pack_buffer(kt, copy, mat2->rows);
+    return 0;
+}
+
+/* Partial sums of x^T B over each unit's row block and CHUNK_SIZE columns of B */
+static void gevm_blocks(void *arg, long begin, long end) {
+    vector_ctx *ctx = arg;
+    const kernel_table *kt = ctx->kt;
+    matrix *mat2 = ctx->mat2;
+    long cols = mat2->cols;
+    long size = kt->elem_size;
+    for (long unit = begin; unit < end; unit++) {
+      int block = unit / ctx->chunks;
+      long col = (unit % ctx->chunks) * CHUNK_SIZE;
+      long len = cols - col < CHUNK_SIZE ? cols - col : CHUNK_SIZE;
+      int first = (long) block * mat2->rows / ctx->blocks;
+      int last = (long) (block + 1) * mat2->rows / ctx->blocks;
+      char *partial = ctx->partials + ((long) block * cols + col) * size;
+      for (int row = first; row < last; row++) {
+        double x = get(ctx->mat1, 0, row);
+        kt->axpby(partial, x, element(mat2, row, col), row == first ? 0 : 1, partial, len);
+      }
+    }
+}
+
+/* result = mat1 * mat2 for a 1 x N mat1 and a mat2 with contiguous rows */
+static int gevm(matrix *result, matrix *mat1, matrix *mat2) {
+    const kernel_table *kt = kernels_for(result->dtype);
+    long rows = mat2->rows;
+    long cols = mat2->cols;
+    long size = kt->elem_size;
+    int blocks = rows / GEVM_MIN_ROWS;
+    blocks = blocks > GEVM_MAX_BLOCKS ? GEVM_MAX_BLOCKS : blocks;
+    if (blocks * cols > GEVM_PARTIAL_COUNT) {
+      blocks = GEVM_PARTIAL_COUNT / cols;
+    }
+    blocks = blocks < 1 ? 1 : blocks;
+    char *partials = alloc_pack_buffer(kt, (size_t) blocks * cols);
+    if (partials == NULL) {
+      return -2;
+    }
+    long chunks = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    vector_ctx ctx = {kt, result, mat1, mat2, NULL, chunks, blocks, partials};
+    int threads = threads_for(PARALLEL_ELEMENTWISE, rows * cols, blocks * chunks);
+    parallel_for(threads, blocks * chunks, gevm_blocks, &ctx);
+    for (int block = 1; block < blocks; block++) {
+      kt->add(partials, partials, partials + block * cols * size, cols);
+    }
+    if (result->col_stride == 1) {
+      memcpy(result->data, partials, cols * size);
+    } else {
+      kt->scatter(result->data, result->col_stride, partials, cols);
+    }
+    free_pack_buffer(kt, partials, (size_t) blocks * cols);
+    return 0;
+}
+
+/* Rows [begin, end) of the outer product, each a scaled copy of the row vector */
+static void ger_rows(void *arg, long begin, long end) {
+    vector_ctx *ctx = arg;
+    matrix *result = ctx->result;
+    for (long row = begin; row < end; row++) {
+      ctx->kt->axpby(element(result, row, 0), get(ctx->mat1, row, 0), ctx->vec, 0, NULL,
+                     result->cols);
+    }
+}
+
+/* result = mat1 * mat2 for an N x 1 mat1, a 1 x M mat2 and a result with contiguous rows */
+static int ger(matrix *result, matrix *mat1, matrix *mat2) {
+    const kernel_table *kt = kernels_for(result->dtype);
+    void *copy;
+    const char *y = vector_data(kt, mat2, &copy);
+    if (y == NULL) {
+      return -2;
+    }
+    vector_ctx ctx = {kt, result, mat1, mat2, y, 0, 0, NULL};
+    int threads = threads_for(PARALLEL_ELEMENTWISE, (long) result->rows * result->cols,
+                              result->rows);
+    parallel_for(threads, result->rows, ger_rows, &ctx);
+    free_pack_buffer(kt, copy, mat2->cols);
+    return 0;
+}
+
+/*
+ * Computes a product with the selected algorithm; `square_power` is set for pow's products.
+ * Matrix-vector, vector-matrix and outer products take the vector paths above whatever the
+ * algorithm.
+ */
+static int product(matrix *result, matrix *mat1, matrix *mat2, char *workspace, int square_power) {
+    if (mat2->cols == 1 && mat1->col_stride == 1) {
+      return gemv(result, mat1, mat2);
+    }
+    if (mat1->rows == 1 && mat2->col_stride == 1) {
+      return gevm(result, mat1, mat2);
+    }
+    if (mat2->cols == 1 && mat1->row_stride == 1) {
+      /* A^T x for a transposed view A^T is (x^T A)^T */
+      matrix x = transposed_view(mat2);
+      matrix a = transposed_view(mat1);
+      matrix y = transposed_view(result);
+      return gevm(&y, &x, &a);
+    }
+    if (mat1->cols == 1 && result->col_stride == 1) {
+      return ger(result, mat1, mat2);
+    }
+    if (matmul_mode == MATMUL_STRASSEN || (matmul_mode == MATMUL_AUTO && square_power)) {
+      int cutoff = strassen_cutoff;
+      if (mat1->rows >= cutoff && mat1->cols >= cutoff && mat2->cols >= cutoff) {
+        return strassen(result, mat1, mat2);
+      }
+    }
+    return multiply(result, mat1, mat2, workspace);
+}
+
+/*
+ * Out-of-core product for file-backed operands that do not fit in the memory budget. The
+ * result is computed in mb x nb blocks, each as a sum of products of mb x kb blocks of mat1
+ * and kb x nb blocks of mat2 (accumulated by the GEMM itself), with the block sizes chosen so
+ * that one block of each operand fits in the budget. Blocks of mat1 stream through for each
+ * nb-column panel of mat2: the next one is prefetched while one is multiplied and each is
+ * dropped from memory once used, as is each finished block of the result.
+ */
+static int backed_product(matrix *result, matrix *mat1, matrix *mat2) {
+    const kernel_table *kt = kernels_for(result->dtype);
+    long budget = get_memory_budget() / kt->elem_size;
+    int m = result->rows, n = result->cols, k = mat1->cols;
+    long side = (long) sqrt(budget / 4.0);
+    side = side < GEMM_MC ? GEMM_MC : side;
+    int kb = k < side ? k : side;
+    int nb = n < side ? n : side;
+    long rows = (budget - (long) kb * nb) / (kb + nb);
+    int mb = rows < 1 ? 1 : rows > m ? m : rows;
+    for (int j = 0; j < n; j += nb) {
+      int nj = n - j < nb ? n - j : nb;
+      for (int i = 0; i < m; i += mb) {
+        int mi = m - i < mb ? m - i : mb;
+        if (i + mi < m) {
+          int next = m - i - mi < mb ? m - i - mi : mb;
+          advise_range(mat1, i + mi, 0, i + mi + next - 1, k - 1, BACKING_WILLNEED);
+        }
+        matrix c = sub_block(result, i, j, mi, nj);
+        for (int p = 0; p < k; p += kb) {
+          int kp = k - p < kb ? k - p : kb;
+          matrix a = sub_block(mat1, i, p, mi, kp);
+          matrix b = sub_block(mat2, p, j, kp, nj);
+          int err = p == 0 ? product(&c, &a, &b, NULL, 0) :
+                    gemm(kt, mi, nj, kp, a.data, a.row_stride, a.col_stride, b.data, b.row_stride,
+                         b.col_stride, c.data, c.row_stride, c.col_stride, NULL, 1);
+          if (err != 0) {
+            return err;
+          }
+        }
+        advise_range(mat1, i, 0, i + mi - 1, k - 1, BACKING_DONTNEED);
+        advise_range(result, i, j, i + mi - 1, j + nj - 1, BACKING_DONTNEED);
+      }
+      advise_range(mat2, 0, j, k - 1, j + nj - 1, BACKING_DONTNEED);
+    }
+    return 0;
+}
+
+/*
+ * Store the result of multiplying mat1 and mat2 to `result`.
+ * Return 0 upon success.
+ * Remember that matrix multiplication is not the same as multiplying individual elements.
+ * You may assume `mat1`'s number of columns is equal to `mat2`'s number of rows.
+ * Note that the matrix is in row-major order.
+ * The product is computed in result's type; operands of another type are converted first.
+ * Return -2 if allocation fails.
+ */
+int mul_matrix(matrix *result, matrix *mat1, matrix *mat2) {
+    matrix *converted1, *converted2;
+    if (convert_operand(&converted1, mat1, result->dtype) != 0) {
+      return -2;
+    }
+    if (convert_operand(&converted2, mat2, result->dtype) != 0) {
+      deallocate_matrix(converted1);
+      return -2;
+    }
+    if (converted1 != NULL) {
+      mat1 = converted1;
+    }
+    if (converted2 != NULL) {
+      mat2 = converted2;
+    }
+    size_t size = dtype_size(result->dtype);
+    size_t bytes = ((size_t) mat1->rows * mat1->cols + (size_t) mat2->rows * mat2->cols +
+                    (size_t) result->rows * result->cols) * size;
+    int backed = is_backed(result) || is_backed(mat1) || is_backed(mat2);
+    int gemm_result = backed && bytes > get_memory_budget() ?
+                      backed_product(result, mat1, mat2) : product(result, mat1, mat2, NULL, 0);
+    deallocate_matrix(converted1);
+    deallocate_matrix(converted2);
+    return gemm_result;
+}
+
+/* Products with at most this many multiply-adds use the unpacked gemm_small kernel */
+#define SMALL_GEMM_WORK (64 * 64 * 64)
+
+/* One batch_mul_matrix call, split into tiles of consecutive products */
+typedef struct batch_ctx {
+    matrix **results;
+    matrix **mats1;
+    matrix **mats2;
+    int failed;
+} batch_ctx;
+
+static void batch_products(void *arg, long begin, long end) {
+    batch_ctx *ctx = arg;
+    for (long i = begin; i < end; i++) {
+      matrix *result = ctx->results[i];
+      matrix *mat1 = ctx->mats1[i];
+      matrix *mat2 = ctx->mats2[i];
+      int small = (long) mat1->rows * mat1->cols * mat2->cols <= SMALL_GEMM_WORK &&
+                  mat1->dtype == result->dtype && mat2->dtype == result->dtype &&
+                  result->col_stride == 1 && mat1->col_stride == 1 && mat2->col_stride == 1;
+      if (small) {
+        kernels_for(result->dtype)->gemm_small(mat1->rows, mat2->cols, mat1->cols, mat1->data,
+                                               mat1->row_stride, mat2->data, mat2->row_stride,
+                                               result->data, result->row_stride);
+      } else if (mul_matrix(result, mat1, mat2) != 0) {
+        __atomic_store_n(&ctx->failed, 1, __ATOMIC_RELAXED);
+      }
+    }
+}
+
+/*
+ * Stores mats1[i] * mats2[i] to results[i] for each of the `count` products, which must have
+ * matching dimensions. Threads split the batch rather than each product, and small products
+ * with contiguous rows skip packing altogether. Return 0 upon success and -2 if allocation
+ * fails.
+ */
+int batch_mul_matrix(matrix **results, matrix **mats1, matrix **mats2, int count) {
+    long work = 0;
+    for (int i = 0; i < count; i++) {
+      work += (long) mats1[i]->rows * mats1[i]->cols * mats2[i]->cols;
+    }
+    batch_ctx ctx = {results, mats1, mats2, 0};
+    parallel_for(threads_for(PARALLEL_GEMM, work, count), count, batch_products, &ctx);
+    return ctx.failed ? -2 : 0;
+}
+
+void set_to_identity_matrix(matrix *result) {
+   fill_matrix(result, 0);
+   for (int i = 0; i < result->rows && i < result->cols; i++) {
+     set(result, i, i, 1);
+   }
+ }
+
+/* Converts n elements of type `src_type` to `dst_type`, both given with their strides */
+static void convert_span(char *dst, long dst_stride, dtype dst_type, const char *src,
+                         long src_stride, long n) {
+    if (dst_type == DTYPE_FLOAT64) {
+      double *d = (double *) dst;
+      const float *f = (const float *) src;
+      for (long i = 0; i < n; i++) {
+        d[i * dst_stride] = f[i * src_stride];
+      }
+    } else {
+      float *f = (float *) dst;
+      const double *d = (const double *) src;
+      for (long i = 0; i < n; i++) {
+        f[i * dst_stride] = d[i * src_stride];
+      }
+    }
+}
+
+/* Operands of one copy_matrix call, split into row chunks like those of map_matrix */
+typedef struct copy_ctx {
+    matrix *result;
+    matrix *mat;
+    long cols;
+    long chunks;
+} copy_ctx;
+
+static void copy_units(void *arg, long begin, long end) {
+    copy_ctx *ctx = arg;
+    matrix *result = ctx->result;
+    matrix *mat = ctx->mat;
+    for (long unit = begin; unit < end; unit++) {
+      int row = unit / ctx->chunks;
+      long col = (unit % ctx->chunks) * CHUNK_SIZE;
+      long len = ctx->cols - col < CHUNK_SIZE ? ctx->cols - col : CHUNK_SIZE;
+      if (result->dtype != mat->dtype) {
+        convert_span(element(result, row, col), result->col_stride, result->dtype,
+                     element(mat, row, col), mat->col_stride, len);
+      } else if (result->col_stride == 1 && mat->col_stride == 1) {
+        memcpy(element(result, row, col), element(mat, row, col), len * dtype_size(mat->dtype));
+      } else {
+        for (long j = col; j < col + len; j++) {
+          set(result, row, j, get(mat, row, j));
+        }
+      }
+    }
+}
+
+/*
+ * copy data from mat matrix and put it in result matrix, converting it to result's type.
+ * A transposed view of a matrix (unit row stride) is copied with the blocked transpose;
+ * anything else is copied in row chunks spread over threads.
+ */
+ void copy_matrix(matrix *result, matrix *mat) {
+   if (result->dtype == mat->dtype && mat->row_stride == 1 && mat->col_stride != 1 &&
+       result->col_stride == 1 && mat->rows > 1) {
+     matrix view = transposed_view(mat);
+     transpose_blocks(result, &view);
+     return;
+   }
+   long rows = mat->rows;
+   long cols = mat->cols;
+   if (is_contiguous(result) && is_contiguous(mat)) {
+     cols *= rows;
+     rows = 1;
+   }
+   long chunks = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+   copy_ctx ctx = {result, mat, cols, chunks};
+   int threads = threads_for(PARALLEL_ELEMENTWISE, rows * cols, rows * chunks);
+   matrix *operands[] = {result, mat};
+   stream_for(threads, rows * chunks, copy_units, &ctx, operands, 2, cols, chunks);
+ }
+
+typedef struct random_ctx {
+    matrix *result;
+    unsigned int seed;
+    double a, b;
+    int normal;
+    long cols;
+    long chunks;
+} random_ctx;
+
+static void random_units(void *arg, long begin, long end) {
+    random_ctx *ctx = arg;
+    matrix *result = ctx->result;
+    unsigned int seed = ctx->seed;
+    double a = ctx->a;
+    double b = ctx->b;
+    long cols = ctx->cols;
+    int direct = result->dtype == DTYPE_FLOAT64 && result->col_stride == 1;
+    for (long unit = begin; unit < end; unit++) {
+      int row = unit / ctx->chunks;
+      long col = (unit % ctx->chunks) * CHUNK_SIZE;
+      long len = cols - col < CHUNK_SIZE ? cols - col : CHUNK_SIZE;
+      double block[GATHER_BLOCK];
+      for (long i = 0; i < len; i += GATHER_BLOCK) {
+        long n = len - i < GATHER_BLOCK ? len - i : GATHER_BLOCK;
+        char *dst = element(result, row, col + i);
+        double *out = direct ? (double *) dst : block;
+        uint64_t start = (uint64_t) row * cols + col + i;
+        if (ctx->normal) {
+          random_normal(out, seed, start, n, a, b);
+        } else {
+          random_uniform(out, seed, start, n, a, b);
+        }
+        if (direct) {
+          continue;
+        } else if (result->dtype == DTYPE_FLOAT64) {
+          kernels->scatter(dst, result->col_stride, block, n);
+        } else {
+          convert_span(dst, result->col_stride, DTYPE_FLOAT32, (char *) block, 1, n);
+        }
+      }
+    }
+}
+
+/*
+ * Fills `result` from a counter-based random stream: element (i, j) gets value i * cols + j of
+ * the stream for `seed`, so the values depend on neither the number of threads nor result's
+ * strides or type. Uniform values lie in [a, b); normal ones have mean a and deviation b.
+ */
+static void fill_random(matrix *result, unsigned int seed, double a, double b, int normal) {
+    long rows = result->rows;
+    long cols = result->cols;
+    if (is_contiguous(result)) {
+      cols *= rows;
+      rows = 1;
+    }
+    long chunks = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    random_ctx ctx = {result, seed, a, b, normal, cols, chunks};
+    int threads = threads_for(PARALLEL_RANDOM, rows * cols, rows * chunks);
+    parallel_for(threads, rows * chunks, random_units, &ctx);
+}
+
+/* Fills `result` with values drawn uniformly from [low, high) */
+void rand_matrix(matrix *result, unsigned int seed, double low, double high) {
+    fill_random(result, seed, low, high, 0);
+}
+
+/* Fills `result` with normally distributed values of the given mean and standard deviation */
+void randn_matrix(matrix *result, unsigned int seed, double mean, double std) {
+    fill_random(result, seed, mean, std, 1);
+}
+
+/*
+ * Reductions. Every reduction is split into the same units for any number of threads, each
+ * unit leaves its partial result in its own slot, and the partials are combined in unit order
+ * afterwards, so results only depend on the matrix and not on the thread count or on which
+ * thread ran which unit.
+ */
+
+/* Most bytes of column partials a reduction along axis 0 keeps, and most row blocks it uses */
+#define REDUCE_PARTIAL_BYTES ((size_t) 1 << 25)
+#define REDUCE_ROW_BLOCKS 32
+
+/*
+ * Combines two partial results of `op`, `a` covering the elements before those of `b`. A NaN
+ * partial of min or max stays NaN, whichever side it is on.
+ */
+static double reduce_combine(reduce_op op, double a, double b) {
+    switch (op) {
+      case REDUCE_MIN:
+        return b < a || b != b ? b : a;
+      case REDUCE_MAX:
+      case REDUCE_MAX_ABS:
+        return b > a || b != b ? b : a;
+      default:
+        return a + b;
+    }
+}
+
+/* Reduces n >= 1 elements of the kernel table's type that lie `stride` elements apart */
+static double reduce_span(const kernel_table *kt, reduce_op op, const char *src, long stride,
+                          long n) {
+    if (stride == 1) {
+      return kt->reduce(op, src, n);
+    }
+    double block[GATHER_BLOCK];
+    double value = 0;
+    for (long i = 0; i < n; i += GATHER_BLOCK) {
+      long len = n - i < GATHER_BLOCK ? n - i : GATHER_BLOCK;
+      kt->gather(block, src + i * stride * kt->elem_size, stride, len);
+      double partial = kt->reduce(op, block, len);
+      value = i == 0 ? partial : reduce_combine(op, value, partial);
+    }
+    return value;
+}
+
+/* Row chunks of a reduction, each unit storing its partial in partials[unit] */
+typedef struct reduce_ctx {
+    const kernel_table *kt;
+    reduce_op op;
+    matrix *mat;
+    long cols;
+    long chunks;
+    double *partials;
+} reduce_ctx;
+
+static void reduce_units(void *arg, long begin, long end) {
+    reduce_ctx *ctx = arg;
+    matrix *mat = ctx->mat;
+    for (long unit = begin; unit < end; unit++) {
+      int row = unit / ctx->chunks;
+      long col = (unit % ctx->chunks) * CHUNK_SIZE;
+      long len = ctx->cols - col < CHUNK_SIZE ? ctx->cols - col : CHUNK_SIZE;
+      ctx->partials[unit] = reduce_span(ctx->kt, ctx->op, element(mat, row, col),
+                                        mat->col_stride, len);
+    }
+}
+
+/*
+ * Reduces every CHUNK_SIZE-element chunk of every row of `mat` (of all of it as one row if
+ * `flatten` is set and mat is contiguous). Sets `*partials` to a new array with the partial
+ * result of each chunk, row by row, and `*chunks` to the number of chunks per row.
+ * Return 0 upon success and -2 if allocation fails.
+ */
+static int reduce_chunks(double **partials, long *chunks, matrix *mat, reduce_op op,
+                         int flatten) {
+    long rows = mat->rows;
+    long cols = mat->cols;
+    if (flatten && is_contiguous(mat)) {
+      cols *= rows;
+      rows = 1;
+    }
+    *chunks = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    *partials = malloc(rows * *chunks * sizeof(double));
+    if (*partials == NULL) {
+      return -2;
+    }
+    reduce_ctx ctx = {kernels_for(mat->dtype), op, mat, cols, *chunks, *partials};
+    int threads = threads_for(PARALLEL_ELEMENTWISE, rows * cols, rows * *chunks);
+    matrix *operands[] = {NULL, mat};
+    stream_for(threads, rows * *chunks, reduce_units, &ctx, operands, 2, cols, *chunks);
+    return 0;
+}
+
+/*
+ * Number of row blocks a reduction along axis 0 splits `mat` into. It only depends on mat's
+ * dimensions, so the order partial results are combined in does too.
+ */
+static int row_blocks(matrix *mat, size_t partial_size) {
+    size_t fit = REDUCE_PARTIAL_BYTES / ((size_t) mat->cols * partial_size);
+    int blocks = mat->rows < REDUCE_ROW_BLOCKS ? mat->rows : REDUCE_ROW_BLOCKS;
+    return fit < (size_t) blocks ? (fit < 1 ? 1 : (int) fit) : blocks;
+}
+
+/* Column chunks x row blocks of a reduction along axis 0, each block with its own partials */
+typedef struct column_ctx {
+    const kernel_table *kt;
+    reduce_op op;
+    int largest;
+    matrix *mat;
+    long chunks;
+    int blocks;
+    double *partials;
+    long *indices;
+} column_ctx;
+
+static void column_units(void *arg, long begin, long end) {
+    column_ctx *ctx = arg;
+    const kernel_table *kt = ctx->kt;
+    matrix *mat = ctx->mat;
+    long cols = mat->cols;
+    double init = ctx->op == REDUCE_MIN ? INFINITY : ctx->op == REDUCE_MAX ? -INFINITY : 0;
+    for (long unit = begin; unit < end; unit++) {
+      int block = unit / ctx->chunks;
+      long col = (unit % ctx->chunks) * CHUNK_SIZE;
+      long len = cols - col < CHUNK_SIZE ? cols - col : CHUNK_SIZE;
+      int first = (long) block * mat->rows / ctx->blocks;
+      int last = (long) (block + 1) * mat->rows / ctx->blocks;
+      double *acc = ctx->partials + (long) block * cols + col;
+      for (long j = 0; j < len; j++) {
+        acc[j] = init;
+      }
+      for (int row = first; row < last; row++) {
+        if (mat->col_stride == 1) {
+          kt->reduce_into(ctx->op, acc, element(mat, row, col), len);
+          continue;
+        }
+        double gathered[GATHER_BLOCK];
+        for (long i = 0; i < len; i += GATHER_BLOCK) {
+          long n = len - i < GATHER_BLOCK ? len - i : GATHER_BLOCK;
+          kt->gather(gathered, element(mat, row, col + i), mat->col_stride, n);
+          kt->reduce_into(ctx->op, acc + i, gathered, n);
+        }
+      }
+    }
+}
+
+/*
+ * Stores op applied to all elements of `mat` to `value`.
+ * Return 0 upon success and -2 if allocation fails.
+ */
+int reduce_matrix(double *value, matrix *mat, reduce_op op) {
+    double *partials;
+    long chunks;
+    if (reduce_chunks(&partials, &chunks, mat, op, 1) != 0) {
+      return -2;
+    }
+    long units = is_contiguous(mat) ? chunks : mat->rows * chunks;
+    double result = partials[0];
+    for (long unit = 1; unit < units; unit++) {
+      result = reduce_combine(op, result, partials[unit]);
+    }
+    free(partials);
+    *value = result;
+    return 0;
+}
+
+/*
+ * reduce_matrix_axis along axis 0 for a file-backed matrix larger than the memory budget: its
+ * columns are reduced in blocks of rows that each fit in half the budget, prefetching the next
+ * block while one is reduced and dropping each block's pages afterwards.
+ * Return 0 upon success and -2 if allocation fails.
+ */
+static int reduce_backed_columns(double *values, matrix *mat, reduce_op op) {
+    size_t row_bytes = (size_t) mat->cols * dtype_size(mat->dtype);
+    long tile = get_memory_budget() / 2 / row_bytes;
+    int rows = tile < 1 ? 1 : tile > mat->rows ? mat->rows : tile;
+    double *partials = malloc((size_t) mat->cols * sizeof(double));
+    if (partials == NULL) {
+      return -2;
+    }
+    advise_range(mat, 0, 0, mat->rows - 1, mat->cols - 1, BACKING_SEQUENTIAL);
+    for (int first = 0; first < mat->rows; first += rows) {
+      int count = mat->rows - first < rows ? mat->rows - first : rows;
+      int next = first + count;
+      if (next < mat->rows) {
+        int next_count = mat->rows - next < rows ? mat->rows - next : rows;
+        advise_range(mat, next, 0, next + next_count - 1, mat->cols - 1, BACKING_WILLNEED);
+      }
+      matrix block = sub_block(mat, first, 0, count, mat->cols);
+      if (reduce_matrix_axis(first == 0 ? values : partials, &block, op, 0) != 0) {
+        free(partials);
+        return -2;
+      }
+      for (long col = 0; first > 0 && col < mat->cols; col++) {
+        values[col] = reduce_combine(op, values[col], partials[col]);
+      }
+      advise_range(mat, first, 0, next - 1, mat->cols - 1, BACKING_DONTNEED);
+    }
+    free(partials);
+    return 0;
+}
+
+/*
+ * Stores op applied to each column of `mat` (axis 0) or each row (axis 1) to `values`, which
+ * must have room for mat->cols or mat->rows values respectively.
+ * Return 0 upon success and -2 if allocation fails.
+ */
+int reduce_matrix_axis(double *values, matrix *mat, reduce_op op, int axis) {
+    if (axis == 1) {
+      double *partials;
+      long chunks;
+      if (reduce_chunks(&partials, &chunks, mat, op, 0) != 0) {
+        return -2;
+      }
+      for (int row = 0; row < mat->rows; row++) {
+        double *row_partials = partials + row * chunks;
+        values[row] = row_partials[0];
+        for (long chunk = 1; chunk < chunks; chunk++) {
+          values[row] = reduce_combine(op, values[row], row_partials[chunk]);
+        }
+      }
+      free(partials);
+      return 0;
+    }
+    if (mat->rows > 1 && is_backed(mat) &&
+        (size_t) mat->rows * mat->cols * dtype_size(mat->dtype) > get_memory_budget()) {
+      return reduce_backed_columns(values, mat, op);
+    }
+    long cols = mat->cols;
+    int blocks = row_blocks(mat, sizeof(double));
+    double *partials = malloc((size_t) blocks * cols * sizeof(double));
+    if (partials == NULL) {
+      return -2;
+    }
+    long chunks = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    column_ctx ctx = {kernels_for(mat->dtype), op, 0, mat, chunks, blocks, partials, NULL};
+    int threads = threads_for(PARALLEL_ELEMENTWISE, (long) mat->rows * cols, blocks * chunks);
+    parallel_for(threads, blocks * chunks, column_units, &ctx);
+    for (long col = 0; col < cols; col++) {
+      values[col] = partials[col];
+      for (int block = 1; block < blocks; block++) {
+        values[col] = reduce_combine(op, values[col], partials[(long) block * cols + col]);
+      }
+    }
+    free(partials);
+    return 0;
+}
+
+/*
+ * Returns n elements of type `type` that lie `stride` elements apart as contiguous doubles:
+ * `src` itself if it already is, else `block` after copying them there.
+ */
+static const double *load_doubles(double *block, const char *src, long stride, dtype type,
+                                  long n) {
+    if (type == DTYPE_FLOAT32) {
+      convert_span((char *) block, 1, DTYPE_FLOAT64, src, stride, n);
+      return block;
+    }
+    if (stride == 1) {
+      return (const double *) src;
+    }
+    kernels_for(DTYPE_FLOAT64)->gather(block, src, stride, n);
+    return block;
+}
+
+/*
+ * Returns 1 if `x` should replace `best` as the largest (or smallest) value so far. Only strictly
+ * better values do, so the first occurrence wins ties, and NaN beats everything but NaN.
+ */
+static inline int arg_better(double x, double best, int largest) {
+    if (x != x) {
+      return best == best;
+    }
+    return largest ? x > best : x < best;
+}
+
+/* Row chunks of an argmin/argmax, each unit storing its best value and column */
+typedef struct arg_ctx {
+    matrix *mat;
+    int largest;
+    long cols;
+    long chunks;
+    double *values;
+    long *indices;
+} arg_ctx;
+
+static void arg_units(void *arg, long begin, long end) {
+    arg_ctx *ctx = arg;
+    matrix *mat = ctx->mat;
+    double block[GATHER_BLOCK];
+    for (long unit = begin; unit < end; unit++) {
+      int row = unit / ctx->chunks;
+      long col = (unit % ctx->chunks) * CHUNK_SIZE;
+      long len = ctx->cols - col < CHUNK_SIZE ? ctx->cols - col : CHUNK_SIZE;
+      double best = 0;
+      long index = col;
+      for (long i = 0; i < len; i += GATHER_BLOCK) {
+        long n = len - i < GATHER_BLOCK ? len - i : GATHER_BLOCK;
+        const double *x = load_doubles(block, element(mat, row, col + i), mat->col_stride,
+                                       mat->dtype, n);
+        if (i == 0) {
+          best = x[0];
+        }
+        for (long j = 0; j < n; j++) {
+          if (arg_better(x[j], best, ctx->largest)) {
+            best = x[j];
+            index = col + i + j;
+          }
+        }
+      }
+      ctx->values[unit] = best;
+      ctx->indices[unit] = index;
+    }
+}
+
+/*
+ * Finds the best element of every CHUNK_SIZE-element chunk of every row of `mat` (of all of it
+ * as one row if `flatten` is set and mat is contiguous), see reduce_chunks. `*values` and
+ * `*indices` are set to new arrays with the value and column of each. Return 0 upon success and
+ * -2 if allocation fails.
+ */
+static int arg_chunks(double **values, long **indices, long *chunks, matrix *mat, int largest,
+                      int flatten) {
+    long rows = mat->rows;
+    long cols = mat->cols;
+    if (flatten && is_contiguous(mat)) {
+      cols *= rows;
+      rows = 1;
+    }
+    *chunks = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    *values = malloc(rows * *chunks * sizeof(double));
+    *indices = malloc(rows * *chunks * sizeof(long));
+    if (*values == NULL || *indices == NULL) {
+      free(*values);
+      free(*indices);
+      return -2;
+    }
+    arg_ctx ctx = {mat, largest, cols, *chunks, *values, *indices};
+    int threads = threads_for(PARALLEL_ELEMENTWISE, rows * cols, rows * *chunks);
+    parallel_for(threads, rows * *chunks, arg_units, &ctx);
+    return 0;
+}
+
+/*
+ * Stores the row-major index of the first largest (if `largest` is set, else smallest) element
+ * of `mat` to `index`. Return 0 upon success and -2 if allocation fails.
+ */
+int arg_reduce_matrix(long *index, matrix *mat, int largest) {
+    double *values;
+    long *indices;
+    long chunks;
+    if (arg_chunks(&values, &indices, &chunks, mat, largest, 1) != 0) {
+      return -2;
+    }
+    int flat = is_contiguous(mat);
+    long units = flat ? chunks : mat->rows * chunks;
+    long best = 0;
+    for (long unit = 1; unit < units; unit++) {
+      if (arg_better(values[unit], values[best], largest)) {
+        best = unit;
+      }
+    }
+    *index = flat ? indices[best] : best / chunks * mat->cols + indices[best];
+    free(values);
+    free(indices);
+    return 0;
+}
+
+/* Column chunks x row blocks of an argmin/argmax along axis 0, see column_units */
+static void arg_column_units(void *arg, long begin, long end) {
+    column_ctx *ctx = arg;
+    matrix *mat = ctx->mat;
+    long cols = mat->cols;
+    double block[GATHER_BLOCK];
+    for (long unit = begin; unit < end; unit++) {
+      int rows_block = unit / ctx->chunks;
+      long col = (unit % ctx->chunks) * CHUNK_SIZE;
+      long len = cols - col < CHUNK_SIZE ? cols - col : CHUNK_SIZE;
+      int first = (long) rows_block * mat->rows / ctx->blocks;
+      int last = (long) (rows_block + 1) * mat->rows / ctx->blocks;
+      double *best = ctx->partials + (long) rows_block * cols + col;
+      long *index = ctx->indices + (long) rows_block * cols + col;
+      for (int row = first; row < last; row++) {
+        for (long i = 0; i < len; i += GATHER_BLOCK) {
+          long n = len - i < GATHER_BLOCK ? len - i : GATHER_BLOCK;
+          const double *x = load_doubles(block, element(mat, row, col + i), mat->col_stride,
+                                         mat->dtype, n);
+          for (long j = 0; j < n; j++) {
+            if (row == first || arg_better(x[j], best[i + j], ctx->largest)) {
+              best[i + j] = x[j];
+              index[i + j] = row;
+            }
+          }
+        }
+      }
+    }
+}
+
+/*
+ * Stores the index of the first largest (if `largest` is set, else smallest) element of each
+ * column of `mat` (axis 0) or each row (axis 1) to `indices`, which must have room for
+ * mat->cols or mat->rows indices respectively. Return 0 upon success and -2 if allocation fails.
+ */
+int arg_reduce_matrix_axis(long *indices, matrix *mat, int largest, int axis) {
+    if (axis == 1) {
+      double *values;
+      long *cols;
+      long chunks;
+      if (arg_chunks(&values, &cols, &chunks, mat, largest, 0) != 0) {
+        return -2;
+      }
+      for (int row = 0; row < mat->rows; row++) {
+        long best = row * chunks;
+        for (long unit = best + 1; unit < (row + 1) * chunks; unit++) {
+          if (arg_better(values[unit], values[best], largest)) {
+            best = unit;
+          }
+        }
+        indices[row] = cols[best];
+      }
+      free(values);
+      free(cols);
+      return 0;
+    }
+    long cols = mat->cols;
+    int blocks = row_blocks(mat, sizeof(double) + sizeof(long));
+    double *values = malloc((size_t) blocks * cols * sizeof(double));
+    long *rows = malloc((size_t) blocks * cols * sizeof(long));
+    if (values == NULL || rows == NULL) {
+      free(values);
+      free(rows);
+      return -2;
+    }
+    long chunks = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    column_ctx ctx = {NULL, REDUCE_MAX, largest, mat, chunks, blocks, values, rows};
+    int threads = threads_for(PARALLEL_ELEMENTWISE, (long) mat->rows * cols, blocks * chunks);
+    parallel_for(threads, blocks * chunks, arg_column_units, &ctx);
+    for (long col = 0; col < cols; col++) {
+      long best = col;
+      for (int block = 1; block < blocks; block++) {
+        long candidate = (long) block * cols + col;
+        if (arg_better(values[candidate], values[best], largest)) {
+          best = candidate;
+        }
+      }
+      indices[col] = rows[best];
+    }
+    free(values);
+    free(rows);
+    return 0;
+}
+
+/*
+ * Scratch space for a chain of n x n products: the buffer the next product goes into when it
+ * is not the last one, and one GEMM workspace shared by every product of the chain.
+ */
+typedef struct power_scratch {
+    matrix *spare;
+    char *workspace;
+    size_t workspace_count;
+} power_scratch;
+
+static int alloc_power_scratch(power_scratch *scratch, int n, dtype type) {
+    const kernel_table *kt = kernels_for(type);
+    scratch->workspace_count = gemm_workspace_count(kt, n, n);
+    scratch->workspace = alloc_pack_buffer(kt, scratch->workspace_count);
+    scratch->spare = NULL;
+    if (scratch->workspace == NULL || allocate_matrix_typed(&scratch->spare, n, n, type) != 0) {
+      free_pack_buffer(kt, scratch->workspace, scratch->workspace_count);
+      return -2;
+    }
+    return 0;
+}
+
+static void free_power_scratch(power_scratch *scratch) {
+    free_pack_buffer(kernels_for(scratch->spare->dtype), scratch->workspace,
+                     scratch->workspace_count);
+    deallocate_matrix(scratch->spare);
+}
+
+/*
+ * Multiplies the `count` (at least 2) matrices in `factors` into `result`. The partial products
+ * alternate between result and the spare buffer, starting with whichever makes the last one
+ * land in result, so nothing is ever copied. No factor may share memory with result.
+ */
+static int multiply_chain(matrix *result, matrix **factors, int count, power_scratch *scratch) {
+    matrix *buffers[2] = {result, scratch->spare};
+    /* Products count - 1 down to 1 go to buffers[0], [1], [0], ... so product 1 is in result */
+    int target = (count - 1) % 2 == 1 ? 0 : 1;
+    matrix *partial = factors[0];
+    for (int i = 1; i < count; i++) {
+      matrix *dst = buffers[target];
+      if (product(dst, partial, factors[i], scratch->workspace, 1) != 0) {
+        return -2;
+      }
+      partial = dst;
+      target ^= 1;
+    }
+    return 0;
+}
+
+/*
+ * Makes `*base` `mat` itself, or a new copy of it when it has another type than result or
+ * shares memory with result, so the products never convert or overwrite their operands.
+ * `*copy` is the copy to free afterwards, or NULL. Return 0 upon success and -2 if allocation
+ * fails.
+ */
+static int power_base(matrix **base, matrix **copy, matrix *result, matrix *mat) {
+    *base = mat;
+    *copy = NULL;
+    if (mat->dtype == result->dtype && !views_overlap(result, mat) && result->data != mat->data) {
+      return 0;
+    }
+    if (allocate_matrix_typed(copy, mat->rows, mat->cols, result->dtype) != 0) {
+      return -2;
+    }
+    copy_matrix(*copy, mat);
+    *base = *copy;
+    return 0;
+}
+
+/*
+  * Store the result of raising mat to the (pow)th power to `result`.
+  * Return 0 upon success.
+  * Remember that pow is defined with matrix multiplication, not element-wise multiplication.
+  * You may assume `mat` is a square matrix and `pow` is a non-negative integer.
+  * Note that the matrix is in row-major order.
+  * The exponent's bits are processed from the top: each step squares the running product and
+  * multiplies it by mat for a set bit, so pow needs floor(log2(pow)) squarings plus one product
+  * per further set bit, with one spare buffer and no identity products.
+  * Return -2 if allocation fails.
+*/
+int pow_matrix(matrix *result, matrix *mat, int pow) {
+    if (pow == 0) {
+      set_to_identity_matrix(result);
+      return 0;
+    }
+    if (pow == 1) {
+      copy_matrix(result, mat);
+      return 0;
+    }
+    matrix *base, *copy;
+    if (power_base(&base, &copy, result, mat) != 0) {
+      return -2;
+    }
+    power_scratch scratch;
+    if (alloc_power_scratch(&scratch, mat->rows, result->dtype) != 0) {
+      deallocate_matrix(copy);
+      return -2;
+    }
+    int top = 31 - __builtin_clz((unsigned int) pow);
+    int products = top + __builtin_popcount((unsigned int) pow) - 1;
+    matrix *buffers[2] = {result, scratch.spare};
+    /* Same alternation as multiply_chain: the last of the products lands in result */
+    int target = products % 2 == 1 ? 0 : 1;
+    matrix *partial = base;
+    int failed = 0;
+    for (int bit = top - 1; bit >= 0 && !failed; bit--) {
+      failed |= product(buffers[target], partial, partial, scratch.workspace, 1);
+      partial = buffers[target];
+      target ^= 1;
+      if (!failed && (pow >> bit) & 1) {
+        failed |= product(buffers[target], partial, base, scratch.workspace, 1);
+        partial = buffers[target];
+        target ^= 1;
+      }
+    }
+    free_power_scratch(&scratch);
+    deallocate_matrix(copy);
+    return failed ? -2 : 0;
+}
+
+/*
+ * Stores mat raised to pows[i] in results[i] for each of the `count` exponents. The squarings
+ * mat^2, mat^4, ... are computed once, up to the largest exponent, and every power is the
+ * product of the squarings its bits select. The results must have mat's dimensions and must
+ * not share memory with mat or each other. Return 0 upon success and -2 if allocation fails.
+ */
+int pow_matrix_many(matrix **results, matrix *mat, const int *pows, int count) {
+    if (count == 0) {
+      return 0;
+    }
+    /* Every bit set in any exponent */
+    unsigned int any = 0;
+    for (int i = 0; i < count; i++) {
+      any |= (unsigned int) pows[i];
+    }
+    dtype type = results[0]->dtype;
+    int n = mat->rows;
+    int bits = any == 0 ? 0 : 32 - __builtin_clz(any);
+    /* squares[j] is mat^(2^j); squares[0] is mat, converted to the results' type if needed */
+    matrix *squares[32] = {NULL};
+    matrix *copy = NULL;
+    power_scratch scratch;
+    int failed = power_base(&squares[0], &copy, results[0], mat) != 0 ||
+                 alloc_power_scratch(&scratch, n, type) != 0;
+    if (failed) {
+      deallocate_matrix(copy);
+      return -2;
+    }
+    for (int j = 1; j < bits && !failed; j++) {
+      failed = allocate_matrix_typed(&squares[j], n, n, type) != 0 ||
+               product(squares[j], squares[j - 1], squares[j - 1], scratch.workspace, 1) != 0;
+    }
+    for (int i = 0; i < count && !failed; i++) {
+      matrix *factors[32];
+      int factor_count = 0;
+      for (int j = 0; j < bits; j++) {
+        if ((pows[i] >> j) & 1) {
+          factors[factor_count++] = squares[j];
+        }
+      }
+      if (factor_count == 0) {
+        set_to_identity_matrix(results[i]);
+      } else if (factor_count == 1) {
+        copy_matrix(results[i], factors[0]);
+      } else {
+        failed = multiply_chain(results[i], factors, factor_count, &scratch) != 0;
+      }
+    }
+    for (int j = 1; j < bits; j++) {
+      deallocate_matrix(squares[j]);
+    }
+    free_power_scratch(&scratch);
+    deallocate_matrix(copy);
+    return failed ? -2 : 0;
+}
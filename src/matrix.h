@@ -1,24 +1,75 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
 #include <Python.h>
+#include "kernels.h"
+
+/* How mul_matrix and pow_matrix compute products, see set_matmul_algorithm */
+typedef enum matmul_algorithm {
+    MATMUL_AUTO,
+    MATMUL_CLASSIC,
+    MATMUL_STRASSEN,
+} matmul_algorithm;
+
+/* Default smallest dimension Strassen-Winograd still splits, so GEMM leaves have at least 512 */
+#define STRASSEN_DEFAULT_CUTOFF 1024
 
 typedef struct matrix {
     int rows; // number of rows
     int cols; // number of columns
-    double* data; // pointer to rows * columns doubles
-    int ref_cnt; // How many slices/matrices are referring to this matrix's data
+    void* data; // pointer to the first element, a double or a float depending on dtype
+    dtype dtype; // type of the elements
+    int row_stride; // distance in elements between vertically adjacent elements
+    int col_stride; // distance in elements between horizontally adjacent elements
+    int ref_cnt; // How many slices/matrices are referring to this matrix's data, updated atomically
     struct matrix *parent; // NULL if matrix is not a slice, else the parent matrix of the slice
+    void (*release)(void *owner); // Frees data owned by someone else, NULL if data came from the pool
+    void *owner; // Passed to release
 } matrix;
 
-double rand_double(double low, double high);
+size_t dtype_size(dtype type);
+dtype promote_dtype(dtype type1, dtype type2);
 void rand_matrix(matrix *result, unsigned int seed, double low, double high);
+void randn_matrix(matrix *result, unsigned int seed, double mean, double std);
 int allocate_matrix(matrix **mat, int rows, int cols);
+int allocate_matrix_uninitialized(matrix **mat, int rows, int cols);
+int allocate_matrix_typed(matrix **mat, int rows, int cols, dtype type);
+int allocate_matrix_external(matrix **mat, void *data, dtype type, int rows, int cols,
+                             void (*release)(void *owner), void *owner);
 int allocate_matrix_ref(matrix **mat, matrix *from, int offset, int rows, int cols);
+int allocate_matrix_view(matrix **mat, matrix *from, long offset, int rows, int cols,
+                         int row_stride, int col_stride);
+int is_contiguous(matrix *mat);
+int views_overlap(matrix *dst, matrix *src);
+int broadcast_dims(int rows1, int cols1, int rows2, int cols2, int *rows, int *cols);
+int broadcast_view(matrix **view, matrix *mat, int rows, int cols);
 void deallocate_matrix(matrix *mat);
+matrix *retain_matrix(matrix *mat);
 double get(matrix *mat, int row, int col);
 void set(matrix *mat, int row, int col, double val);
 void fill_matrix(matrix *mat, double val);
+void copy_matrix(matrix *result, matrix *mat);
+int transpose_matrix(matrix *result, matrix *mat);
 int add_matrix(matrix *result, matrix *mat1, matrix *mat2);
 int sub_matrix(matrix *result, matrix *mat1, matrix *mat2);
+int multiply_matrix(matrix *result, matrix *mat1, matrix *mat2);
+int divide_matrix(matrix *result, matrix *mat1, matrix *mat2);
+int axpby_matrix(matrix *result, double alpha, matrix *x, double beta, matrix *y);
 int mul_matrix(matrix *result, matrix *mat1, matrix *mat2);
+int batch_mul_matrix(matrix **results, matrix **mats1, matrix **mats2, int count);
 int pow_matrix(matrix *result, matrix *mat, int pow);
+int pow_matrix_many(matrix **results, matrix *mat, const int *pows, int count);
+void set_matmul_algorithm(matmul_algorithm algorithm);
+matmul_algorithm get_matmul_algorithm(void);
+void set_strassen_cutoff(int cutoff);
+int get_strassen_cutoff(void);
 int neg_matrix(matrix *result, matrix *mat);
 int abs_matrix(matrix *result, matrix *mat);
+int affine_matrix(matrix *result, matrix *mat, double alpha, double beta);
+int div_scalar_matrix(matrix *result, matrix *mat, double val, int reverse);
+int reduce_matrix(double *value, matrix *mat, reduce_op op);
+int reduce_matrix_axis(double *values, matrix *mat, reduce_op op, int axis);
+int arg_reduce_matrix(long *index, matrix *mat, int largest);
+int arg_reduce_matrix_axis(long *indices, matrix *mat, int largest, int axis);
+
+#endif
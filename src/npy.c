@@ -0,0 +1,300 @@
+/* mmap and fileno are not part of strict C99 */
+#define _DEFAULT_SOURCE
+
+#include "npy.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* "\x93NUMPY" followed by the major and minor version */
+#define NPY_MAGIC "\x93NUMPY"
+#define NPY_MAGIC_LEN 6
+/* Elements written at a time for strided matrices */
+#define NPY_WRITE_BLOCK 4096
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NPY_BYTE_ORDER '>'
+#else
+#define NPY_BYTE_ORDER '<'
+#endif
+
+/* A mapped file that a loaded matrix's data lives in */
+typedef struct npy_mapping {
+    void *base;
+    size_t len;
+} npy_mapping;
+
+static void release_mapping(void *owner) {
+    npy_mapping *mapping = owner;
+    munmap(mapping->base, mapping->len);
+    free(mapping);
+}
+
+/*
+ * Writes the elements of `mat` to `file` in row-major order. Rows with unit stride are written
+ * in place, other ones are gathered a block at a time. Return 0 upon success and NPY_IO_ERROR
+ * or -2 otherwise.
+ */
+static int write_elements(FILE *file, matrix *mat) {
+    size_t size = dtype_size(mat->dtype);
+    if (is_contiguous(mat)) {
+      size_t count = (size_t) mat->rows * mat->cols;
+      return fwrite(mat->data, size, count, file) == count ? 0 : NPY_IO_ERROR;
+    }
+    const kernel_table *kt = kernels_for(mat->dtype);
+    char *block = mat->col_stride == 1 ? NULL : malloc(NPY_WRITE_BLOCK * size);
+    if (mat->col_stride != 1 && block == NULL) {
+      return -2;
+    }
+    int err = 0;
+    for (int i = 0; i < mat->rows && err == 0; i++) {
+      char *row = (char *) mat->data + (long) i * mat->row_stride * (long) size;
+      for (long j = 0; j < mat->cols && err == 0; j += NPY_WRITE_BLOCK) {
+        long len = mat->cols - j < NPY_WRITE_BLOCK ? mat->cols - j : NPY_WRITE_BLOCK;
+        const char *src = row + j * mat->col_stride * (long) size;
+        if (block != NULL) {
+          kt->gather(block, src, mat->col_stride, len);
+          src = block;
+        }
+        err = fwrite(src, size, len, file) == (size_t) len ? 0 : NPY_IO_ERROR;
+      }
+    }
+    free(block);
+    return err;
+}
+
+/*
+ * Writes `mat` to the file at `path` in the .npy (version 1.0) format, replacing the file if it
+ * exists. Return 0 upon success, NPY_IO_ERROR if the file cannot be written (errno says why) and
+ * -2 if allocation fails.
+ */
+int save_npy(const char *path, matrix *mat) {
+    char header[3 * NPY_ALIGNMENT];
+    int len = snprintf(header + NPY_MAGIC_LEN + 4, sizeof(header) - NPY_MAGIC_LEN - 4,
+                       "{'descr': '%c%c%zu', 'fortran_order': False, 'shape': (%d, %d), }",
+                       NPY_BYTE_ORDER, 'f', dtype_size(mat->dtype), mat->rows, mat->cols);
+    /* Pad with spaces and a newline so that the data starts at a multiple of NPY_ALIGNMENT */
+    int total = (NPY_MAGIC_LEN + 4 + len + 1 + NPY_ALIGNMENT - 1) / NPY_ALIGNMENT * NPY_ALIGNMENT;
+    memcpy(header, NPY_MAGIC "\x01\x00", NPY_MAGIC_LEN + 2);
+    int header_len = total - NPY_MAGIC_LEN - 4;
+    header[NPY_MAGIC_LEN + 2] = header_len & 0xff;
+    header[NPY_MAGIC_LEN + 3] = header_len >> 8;
+    memset(header + NPY_MAGIC_LEN + 4 + len, ' ', total - (NPY_MAGIC_LEN + 4 + len) - 1);
+    header[total - 1] = '\n';
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+      return NPY_IO_ERROR;
+    }
+    int err = fwrite(header, 1, total, file) == (size_t) total ? 0 : NPY_IO_ERROR;
+    if (err == 0) {
+      err = write_elements(file, mat);
+    }
+    if (fclose(file) != 0 && err == 0) {
+      err = NPY_IO_ERROR;
+    }
+    return err;
+}
+
+/* Returns the text after "'key':" and any spaces in the header dict, or NULL if key is missing */
+static const char *header_value(const char *header, const char *key) {
+    char quoted[32];
+    snprintf(quoted, sizeof(quoted), "'%s':", key);
+    const char *value = strstr(header, quoted);
+    if (value == NULL) {
+      return NULL;
+    }
+    value += strlen(quoted);
+    while (*value == ' ') {
+      value++;
+    }
+    return value;
+}
+
+/*
+ * Parses the header dict of a .npy file: the element type into *type, whether the data is in
+ * column-major order into *fortran, and the shape into *rows and *cols. Zero-dimensional arrays
+ * are read as 1 x 1 matrices and one-dimensional ones as a single row.
+ * Return 0 upon success and NPY_FORMAT_ERROR otherwise.
+ */
+static int parse_header(const char *header, dtype *type, int *fortran, int *rows, int *cols) {
+    const char *descr = header_value(header, "descr");
+    const char *order = header_value(header, "fortran_order");
+    const char *shape = header_value(header, "shape");
+    if (descr == NULL || order == NULL || shape == NULL || (*descr != '\'' && *descr != '"')) {
+      return NPY_FORMAT_ERROR;
+    }
+    char native_f8[] = {descr[0], NPY_BYTE_ORDER, 'f', '8', descr[0], '\0'};
+    char native_f4[] = {descr[0], NPY_BYTE_ORDER, 'f', '4', descr[0], '\0'};
+    if (strncmp(descr, native_f8, 5) == 0) {
+      *type = DTYPE_FLOAT64;
+    } else if (strncmp(descr, native_f4, 5) == 0) {
+      *type = DTYPE_FLOAT32;
+    } else {
+      return NPY_FORMAT_ERROR;
+    }
+    if (strncmp(order, "True", 4) == 0) {
+      *fortran = 1;
+    } else if (strncmp(order, "False", 5) == 0) {
+      *fortran = 0;
+    } else {
+      return NPY_FORMAT_ERROR;
+    }
+    if (*shape != '(') {
+      return NPY_FORMAT_ERROR;
+    }
+    long dims[2] = {1, 1};
+    int ndim = 0;
+    const char *pos = shape + 1;
+    while (1) {
+      while (*pos == ' ' || *pos == ',') {
+        pos++;
+      }
+      if (*pos == ')') {
+        break;
+      }
+      char *end;
+      errno = 0;
+      long dim = strtol(pos, &end, 10);
+      if (end == pos || errno != 0 || dim <= 0 || dim > INT_MAX || ndim == 2) {
+        return NPY_FORMAT_ERROR;
+      }
+      dims[ndim++] = dim;
+      pos = end;
+    }
+    *rows = ndim == 2 ? dims[0] : 1;
+    *cols = ndim == 2 ? dims[1] : dims[0];
+    return 0;
+}
+
+/*
+ * Reads the magic string and header of the .npy file `file` and parses it (see parse_header).
+ * Stores the position of the data to *offset. Return 0 upon success, NPY_IO_ERROR if the file
+ * cannot be read, -2 if allocation fails and NPY_FORMAT_ERROR if the header is invalid.
+ */
+static int read_header(FILE *file, dtype *type, int *fortran, int *rows, int *cols,
+                       size_t *offset) {
+    unsigned char prefix[NPY_MAGIC_LEN + 6];
+    if (fread(prefix, 1, NPY_MAGIC_LEN + 4, file) != NPY_MAGIC_LEN + 4 ||
+        memcmp(prefix, NPY_MAGIC, NPY_MAGIC_LEN) != 0 || prefix[NPY_MAGIC_LEN] < 1 ||
+        prefix[NPY_MAGIC_LEN] > 3) {
+      return ferror(file) ? NPY_IO_ERROR : NPY_FORMAT_ERROR;
+    }
+    /* Version 1.0 has a 2-byte header length, later versions a 4-byte one */
+    *offset = NPY_MAGIC_LEN + 4;
+    size_t header_len = prefix[NPY_MAGIC_LEN + 2] | (size_t) prefix[NPY_MAGIC_LEN + 3] << 8;
+    if (prefix[NPY_MAGIC_LEN] > 1) {
+      if (fread(prefix + NPY_MAGIC_LEN + 4, 1, 2, file) != 2) {
+        return ferror(file) ? NPY_IO_ERROR : NPY_FORMAT_ERROR;
+      }
+      *offset += 2;
+      header_len |= (size_t) prefix[NPY_MAGIC_LEN + 4] << 16 |
+                    (size_t) prefix[NPY_MAGIC_LEN + 5] << 24;
+    }
+    *offset += header_len;
+    char *header = malloc(header_len + 1);
+    if (header == NULL) {
+      return -2;
+    }
+    int err;
+    if (fread(header, 1, header_len, file) != header_len) {
+      err = ferror(file) ? NPY_IO_ERROR : NPY_FORMAT_ERROR;
+    } else {
+      header[header_len] = '\0';
+      err = parse_header(header, type, fortran, rows, cols);
+    }
+    free(header);
+    return err;
+}
+
+/*
+ * Makes `mat` a rows x cols matrix of the elements of type `type` that start `offset` bytes
+ * into `file`, by mapping the file if `map` is set and reading them otherwise.
+ * Return 0 upon success, NPY_IO_ERROR if the file cannot be read or mapped, -2 if allocation
+ * fails and NPY_FORMAT_ERROR if the file is too short.
+ */
+static int load_data(matrix **mat, FILE *file, dtype type, int rows, int cols, size_t offset,
+                     int map) {
+    size_t count = (size_t) rows * cols;
+    size_t data_len = count * dtype_size(type);
+    struct stat info;
+    if (fstat(fileno(file), &info) != 0) {
+      return NPY_IO_ERROR;
+    }
+    if ((size_t) info.st_size < offset + data_len) {
+      return NPY_FORMAT_ERROR;
+    }
+    if (!map) {
+      int err = allocate_matrix_typed(mat, rows, cols, type);
+      if (err != 0) {
+        return err;
+      }
+      if (fread((*mat)->data, dtype_size(type), count, file) != count) {
+        int saved_errno = errno;
+        deallocate_matrix(*mat);
+        errno = saved_errno;
+        return NPY_IO_ERROR;
+      }
+      return 0;
+    }
+    npy_mapping *mapping = malloc(sizeof(*mapping));
+    if (mapping == NULL) {
+      return -2;
+    }
+    /* The whole file is mapped, since mmap offsets must be multiples of the page size */
+    mapping->len = offset + data_len;
+    mapping->base = mmap(NULL, mapping->len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+    if (mapping->base == MAP_FAILED) {
+      free(mapping);
+      return NPY_IO_ERROR;
+    }
+    int err = allocate_matrix_external(mat, (char *) mapping->base + offset, type, rows, cols,
+                                       release_mapping, mapping);
+    if (err != 0) {
+      release_mapping(mapping);
+    }
+    return err;
+}
+
+/*
+ * Reads the .npy file at `path` into a new matrix. If `map` is set the file is mapped
+ * copy-on-write instead of read: the matrix's data stays in the page cache, shared with every
+ * process that maps the same file, and pages are only read from disk when they are touched.
+ * Writes to the matrix never reach the file. Files whose data is not aligned are read instead.
+ * Return 0 upon success, NPY_IO_ERROR if the file cannot be read (errno says why), -2 if
+ * allocation fails and NPY_FORMAT_ERROR if it is not a .npy file of float32 or float64 elements
+ * in native byte order with at most two dimensions.
+ */
+int load_npy(matrix **mat, const char *path, int map) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+      return NPY_IO_ERROR;
+    }
+    dtype type;
+    int fortran, rows, cols;
+    size_t offset;
+    matrix *new_mat = NULL;
+    int err = read_header(file, &type, &fortran, &rows, &cols, &offset);
+    if (err == 0) {
+      /* Stored in column-major order, the data is that of the cols x rows transpose */
+      err = load_data(&new_mat, file, type, fortran ? cols : rows, fortran ? rows : cols,
+                      offset, map && offset % dtype_size(type) == 0);
+    }
+    if (err == 0 && fortran) {
+      matrix *view;
+      err = allocate_matrix_view(&view, new_mat, 0, rows, cols, 1, rows);
+      deallocate_matrix(new_mat);
+      new_mat = view;
+    }
+    /* Keep the errno of a failed call through fclose */
+    int saved_errno = errno;
+    fclose(file);
+    errno = saved_errno;
+    if (err == 0) {
+      *mat = new_mat;
+    }
+    return err;
+}
@@ -0,0 +1,22 @@
+#ifndef NPY_H
+#define NPY_H
+
+#include "matrix.h"
+
+/*
+ * Reading and writing matrices as NumPy .npy files: a short text header describing the element
+ * type and shape, padded to a multiple of NPY_ALIGNMENT bytes, followed by the raw elements in
+ * row-major order. Files written here can be opened with numpy.load and vice versa.
+ */
+
+/* Header sizes are padded to a multiple of this, so the data of a mapped file is aligned */
+#define NPY_ALIGNMENT 64
+
+/* Return codes of save_npy and load_npy besides 0 (success) and -2 (allocation failure) */
+#define NPY_IO_ERROR -1 // errno says why
+#define NPY_FORMAT_ERROR -3 // not a .npy file of float32 or float64 elements in native order
+
+int save_npy(const char *path, matrix *mat);
+int load_npy(matrix **mat, const char *path, int map);
+
+#endif
@@ -1,4 +1,12 @@
 #include "numc.h"
+#include "backing.h"
+#include "kernels.h"
+#include "npy.h"
+#include "parallel.h"
+#include "pool.h"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
 #include <structmember.h>
 
 // numc.c mainly handles possible errors and unpacking the variables to then later use the functions
@@ -36,10 +44,255 @@ static int number_methods_err(const char *op, PyObject* args, Matrix61c *self, M
     return 0;
 }
 
+/*
+ * Lazy mode. When it is on, +, - (binary and unary) and abs() on matrices only record an
+ * expression (see expr.h) in the new object, and nothing is computed until the value is needed:
+ * reading elements, slicing, exporting a buffer or using the matrix in a product. Expressions read
+ * their operands when they are evaluated, so everything that writes to matrix data first
+ * evaluates all deferred matrices with flush_pending().
+ */
+static int lazy_mode = 0;
+/* Deferred matrices, most recent first */
+static Matrix61c *pending_head = NULL;
+/* Buffers exported by all matrices. Their data can change at any time, so none may be deferred. */
+static int live_exports = 0;
+
+static int rows_of(Matrix61c *self) {
+    return self->pending != NULL ? self->pending->rows : self->mat->rows;
+}
+
+static int cols_of(Matrix61c *self) {
+    return self->pending != NULL ? self->pending->cols : self->mat->cols;
+}
+
+static dtype dtype_of(Matrix61c *self) {
+    return self->pending != NULL ? self->pending->dtype : self->mat->dtype;
+}
+
+static const char *dtype_name(dtype type) {
+    return type == DTYPE_FLOAT32 ? "float32" : "float64";
+}
+
+/*
+ * Parses a dtype argument: "float64", "float32", a type with one of those names such as
+ * numpy.float32, or any object whose str() is one of them such as numpy.dtype objects.
+ * Return 0 upon success, else -1 with a ValueError set.
+ */
+static int parse_dtype(PyObject *obj, dtype *type) {
+    PyObject *str = PyType_Check(obj) ? PyObject_GetAttrString(obj, "__name__") : PyObject_Str(obj);
+    if (str == NULL) {
+        return -1;
+    }
+    const char *name = PyUnicode_AsUTF8(str);
+    int rv = 0;
+    if (name == NULL) {
+        rv = -1;
+    } else if (strcmp(name, "float64") == 0) {
+        *type = DTYPE_FLOAT64;
+    } else if (strcmp(name, "float32") == 0) {
+        *type = DTYPE_FLOAT32;
+    } else {
+        PyErr_Format(PyExc_ValueError, "Unsupported dtype '%s'", name);
+        rv = -1;
+    }
+    Py_DECREF(str);
+    return rv;
+}
+
+/*
+ * Kernels doing at least this much work (elements, or multiply-adds for products) run with the
+ * GIL released so that other Python threads can proceed. Below it, handing the GIL over costs
+ * more than the kernel itself.
+ */
+#define GIL_RELEASE_WORK 16384
+
+/* A kernel that may run without the GIL, see begin_kernel */
+typedef struct kernel_call {
+    PyThreadState *state; // NULL if the GIL was kept
+    matrix *pins[2]; // references taken on the operands' data
+} kernel_call;
+
+/*
+ * Releases the GIL before a kernel on `mat1` (and `mat2` if not NULL) that does `work` work,
+ * unless it is too small to be worth it. The operands' data is pinned with retain_matrix first,
+ * so in-place operators on other threads copy into it instead of swapping it out or freeing it.
+ * Nothing that touches Python objects or the pending list may run until end_kernel.
+ */
+static void begin_kernel(kernel_call *call, long work, matrix *mat1, matrix *mat2) {
+    call->state = NULL;
+    if (work < GIL_RELEASE_WORK) {
+        return;
+    }
+    call->pins[0] = retain_matrix(mat1);
+    call->pins[1] = mat2 == NULL ? NULL : retain_matrix(mat2);
+    call->state = PyEval_SaveThread();
+}
+
+/* Takes the GIL back after begin_kernel and unpins the operands */
+static void end_kernel(kernel_call *call) {
+    if (call->state == NULL) {
+        return;
+    }
+    PyEval_RestoreThread(call->state);
+    deallocate_matrix(call->pins[0]);
+    deallocate_matrix(call->pins[1]);
+}
+
+/* Removes a deferred matrix from the pending list and drops its expression */
+static void drop_pending(Matrix61c *self) {
+    if (self->pending_prev != NULL) {
+        self->pending_prev->pending_next = self->pending_next;
+    } else {
+        pending_head = self->pending_next;
+    }
+    if (self->pending_next != NULL) {
+        self->pending_next->pending_prev = self->pending_prev;
+    }
+    self->pending_prev = NULL;
+    self->pending_next = NULL;
+    expr_release(self->pending);
+    self->pending = NULL;
+}
+
+/*
+ * Evaluates self's deferred expression, if any, into newly allocated storage in one fused pass.
+ * Must be called before self->mat is used. Returns -1 with an exception set on failure.
+ */
+static int materialize(Matrix61c *self) {
+    if (self->pending == NULL) {
+        return 0;
+    }
+    matrix *new_mat;
+    int alloc_failed = allocate_matrix_typed(&new_mat, self->pending->rows, self->pending->cols,
+                                             self->pending->dtype);
+    if (alloc_failed != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return -1;
+    }
+    eval_expr(new_mat, self->pending);
+    self->mat = new_mat;
+    drop_pending(self);
+    return 0;
+}
+
+/* Evaluates every deferred matrix. Must be called before matrix data is written to. */
+static int flush_pending(void) {
+    while (pending_head != NULL) {
+        if (materialize(pending_head) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns a new reference to an expression node for the operand `m`, or NULL if `m` cannot be
+ * deferred: its data belongs to another object and can change behind numc's back.
+ */
+static expr *operand_expr(Matrix61c *m) {
+    if (m->pending != NULL) {
+        m->pending->ref_cnt++;
+        return m->pending;
+    }
+    matrix *root = m->mat->parent == NULL ? m->mat : m->mat->parent;
+    expr *leaf;
+    if (root->release != NULL || expr_leaf(&leaf, m->mat) != 0) {
+        return NULL;
+    }
+    return leaf;
+}
+
+/*
+ * Like operand_expr, but for `m` broadcast to rows x cols. Deferred operands of another shape
+ * cannot be broadcast, as an expression node has a single shape.
+ */
+static expr *broadcast_expr(Matrix61c *m, int rows, int cols) {
+    if (rows_of(m) == rows && cols_of(m) == cols) {
+        return operand_expr(m);
+    }
+    if (m->pending != NULL) {
+        return NULL;
+    }
+    matrix *root = m->mat->parent == NULL ? m->mat : m->mat->parent;
+    matrix *view;
+    expr *leaf = NULL;
+    if (root->release != NULL || broadcast_view(&view, m->mat, rows, cols) != 0) {
+        return NULL;
+    }
+    expr_leaf(&leaf, view);
+    deallocate_matrix(view);
+    return leaf;
+}
+
+/*
+ * Stores to *result a new deferred matrix that takes over the reference to `node` and returns
+ * 1, or returns 0 if `node` is NULL.
+ */
+static int defer_node(expr *node, PyObject **result) {
+    if (node == NULL) {
+        return 0;
+    }
+    Matrix61c* rv = (Matrix61c*) Matrix61c_new(&Matrix61cType, NULL, NULL);
+    rv->pending = node;
+    rv->shape = Py_BuildValue("(ii)", node->rows, node->cols);
+    rv->pending_next = pending_head;
+    if (pending_head != NULL) {
+        pending_head->pending_prev = rv;
+    }
+    pending_head = rv;
+    *result = (PyObject *) rv;
+    return 1;
+}
+
+/*
+ * In lazy mode, stores to *result a new deferred matrix that computes `op` applied to self (and
+ * `other` for binary operators, else NULL), broadcasting them to a common shape. The operands'
+ * dimensions must already have been checked. Returns 1 if the operation was deferred, or 0 if it has to be computed right away:
+ * lazy mode is off, an operand cannot be deferred, or the expression has grown too large, in
+ * which case evaluating the operands starts a new one.
+ */
+static int defer_op(expr_op op, Matrix61c *self, Matrix61c *other, PyObject **result) {
+    if (!lazy_mode || live_exports > 0) {
+        return 0;
+    }
+    int rows = rows_of(self), cols = cols_of(self);
+    if (other != NULL) {
+        broadcast_dims(rows_of(self), cols_of(self), rows_of(other), cols_of(other), &rows, &cols);
+    }
+    expr *lhs = broadcast_expr(self, rows, cols);
+    expr *rhs = other == NULL ? NULL : broadcast_expr(other, rows, cols);
+    expr *node = NULL;
+    if (lhs != NULL && (other == NULL || rhs != NULL)) {
+        expr_apply(&node, op, lhs, rhs);
+    }
+    expr_release(lhs);
+    expr_release(rhs);
+    return defer_node(node, result);
+}
+
+/* Like defer_op, for the scalar operations `op` of expr_apply_scalar */
+static int defer_scalar(expr_op op, Matrix61c *self, double alpha, double beta,
+                        PyObject **result) {
+    if (!lazy_mode || live_exports > 0) {
+        return 0;
+    }
+    expr *lhs = operand_expr(self);
+    expr *node = NULL;
+    if (lhs != NULL) {
+        expr_apply_scalar(&node, op, lhs, alpha, beta);
+    }
+    expr_release(lhs);
+    return defer_node(node, result);
+}
+
 /* Helper function to either create a new Matrix61C object with the given new_mat matrix if op_result is non negative */
 static PyObject *op_err(matrix *new_mat, int op_result){
     if (op_result < 0) {
         deallocate_matrix(new_mat);
+        if (!PyErr_Occurred()) {
+            /* Kernels only fail when they cannot get scratch space */
+            PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        }
         return NULL;
     } else {
         Matrix61c* rv = (Matrix61c*) Matrix61c_new(&Matrix61cType, NULL, NULL);
@@ -51,10 +304,61 @@ static PyObject *op_err(matrix *new_mat, int op_result){
 
 
 /* Helper functions for initalization of matrices and vectors */
-/* Matrix(rows, cols, low, high). Fill a matrix random double values */
-static int init_rand(PyObject *self, int rows, int cols, unsigned int seed, double low, double high) {
+/*
+ * Matrix(rows, cols, [val], backing=path). The matrix's data is a shared mapping of the file at
+ * path, or of an anonymous scratch file if path is a directory, instead of memory, so it may be
+ * larger than RAM. Operations on it run in tiles of the memory budget (see set_memory_budget),
+ * and results that do not fit in the budget get scratch files in the same directory.
+ */
+static int init_backed(PyObject *self, PyObject *args, PyObject *path, dtype type) {
+    int rows, cols;
+    double val = 0;
+    if (!PyArg_ParseTuple(args, "ii|d", &rows, &cols, &val)) {
+        PyErr_Clear();
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return -1;
+    }
+    PyObject *encoded;
+    if (!PyUnicode_FSConverter(path, &encoded)) {
+        return -1;
+    }
+    matrix *new_mat;
+    int alloc_failed = allocate_matrix_backed(&new_mat, rows, cols, type,
+                                              PyBytes_AS_STRING(encoded));
+    if (alloc_failed == -3) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+    }
+    Py_DECREF(encoded);
+    if (alloc_failed == -1){
+        PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
+        return alloc_failed;
+    }else if (alloc_failed == -2){
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return alloc_failed;
+    }else if (alloc_failed != 0){
+        return -1;
+    }
+    /* The file starts out zeroed, so only other values are written */
+    if (val != 0) {
+        kernel_call call;
+        begin_kernel(&call, (long) rows * cols, new_mat, NULL);
+        fill_matrix(new_mat, val);
+        end_kernel(&call);
+    }
+    ((Matrix61c *)self)->mat = new_mat;
+    ((Matrix61c *)self)->shape = PyTuple_Pack(2, PyLong_FromLong(rows), PyLong_FromLong(cols));
+    return 0;
+}
+
+/*
+ * Matrix(rows, cols, rand=True, low=, high=, seed=) fills a matrix with values drawn uniformly
+ * from [low, high); with randn=True, mean= and std= (passed as low and high) it draws them
+ * from a normal distribution instead. The values only depend on the seed and the shape.
+ */
+static int init_rand(PyObject *self, int rows, int cols, unsigned int seed, double low, double high,
+                     int normal, dtype type) {
     matrix *new_mat;
-    int alloc_failed = allocate_matrix(&new_mat, rows, cols);
+    int alloc_failed = allocate_matrix_typed(&new_mat, rows, cols, type);
     if (alloc_failed == -1){
         PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
         return alloc_failed;
@@ -62,16 +366,23 @@ static int init_rand(PyObject *self, int rows, int cols, unsigned int seed, doub
         PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
         return alloc_failed;
     }
-    rand_matrix(new_mat, seed, low, high);
+    kernel_call call;
+    begin_kernel(&call, (long) rows * cols, new_mat, NULL);
+    if (normal) {
+        randn_matrix(new_mat, seed, low, high);
+    } else {
+        rand_matrix(new_mat, seed, low, high);
+    }
+    end_kernel(&call);
     ((Matrix61c *)self)->mat = new_mat;
     ((Matrix61c *)self)->shape = PyTuple_Pack(2, PyLong_FromLong(rows), PyLong_FromLong(cols));
     return 0;
 }
 
 /* Matrix(rows, cols, val). Fill a matrix of dimension rows * cols with val*/
-static int init_fill(PyObject *self, int rows, int cols, double val) {
+static int init_fill(PyObject *self, int rows, int cols, double val, dtype type) {
     matrix *new_mat;
-    int alloc_failed = allocate_matrix(&new_mat, rows, cols);
+    int alloc_failed = allocate_matrix_typed(&new_mat, rows, cols, type);
     if (alloc_failed == -1){
         PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
         return alloc_failed;
@@ -87,14 +398,161 @@ static int init_fill(PyObject *self, int rows, int cols, double val) {
     return 0;
 }
 
-/* Matrix(rows, cols, 1d_list). Fill a matrix with dimension rows * cols with 1d_list values */
-static int init_1d(PyObject *self, int rows, int cols, PyObject *lst) {
-    if (rows * cols != PyList_Size(lst)) {
+/* Items one unit of fill_items converts */
+#define ITEMS_CHUNK 4096
+
+/* A new contiguous matrix being filled from rows of Python numbers, see fill_items */
+typedef struct items_ctx {
+    PyObject ***rows; // rows[i] points to the items of row i of mat
+    matrix *mat;
+    long chunks;
+    char *slow; // slow[unit] is set if the unit has items that are not exact floats
+} items_ctx;
+
+static inline void store(matrix *mat, long index, double val) {
+    if (mat->dtype == DTYPE_FLOAT32) {
+        ((float *) mat->data)[index] = val;
+    } else {
+        ((double *) mat->data)[index] = val;
+    }
+}
+
+/*
+ * Stores the exact floats of its rows and chunks. It runs on worker threads while the caller
+ * holds the GIL, so it only reads the items (which their sequences keep alive) and never calls
+ * into the interpreter.
+ */
+static void items_units(void *arg, long begin, long end) {
+    items_ctx *ctx = arg;
+    matrix *mat = ctx->mat;
+    for (long unit = begin; unit < end; unit++) {
+        int row = unit / ctx->chunks;
+        long col = (unit % ctx->chunks) * ITEMS_CHUNK;
+        long len = mat->cols - col < ITEMS_CHUNK ? mat->cols - col : ITEMS_CHUNK;
+        PyObject **items = ctx->rows[row] + col;
+        long index = (long) row * mat->cols + col;
+        for (long j = 0; j < len; j++) {
+            if (PyFloat_CheckExact(items[j])) {
+                store(mat, index + j, PyFloat_AS_DOUBLE(items[j]));
+            } else {
+                ctx->slow[unit] = 1;
+            }
+        }
+    }
+}
+
+/*
+ * Fills the new contiguous matrix `mat` with the numbers rows[i][j]. Exact floats are
+ * converted in parallel; the chunks that hold anything else (ints, numpy scalars, objects with
+ * __float__) are finished on this thread through PyFloat_AsDouble.
+ * Returns -1 with an exception set if an item is not a number.
+ */
+static int fill_items(matrix *mat, PyObject ***rows) {
+    long chunks = (mat->cols + ITEMS_CHUNK - 1) / ITEMS_CHUNK;
+    long units = mat->rows * chunks;
+    char *slow = PyMem_Calloc(units, 1);
+    if (slow == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    items_ctx ctx = {rows, mat, chunks, slow};
+    int threads = threads_for(PARALLEL_ELEMENTWISE, (long) mat->rows * mat->cols, units);
+    parallel_for(threads, units, items_units, &ctx);
+    for (long unit = 0; unit < units; unit++) {
+        if (!slow[unit]) {
+            continue;
+        }
+        int row = unit / chunks;
+        long col = (unit % chunks) * ITEMS_CHUNK;
+        long len = mat->cols - col < ITEMS_CHUNK ? mat->cols - col : ITEMS_CHUNK;
+        for (long j = col; j < col + len; j++) {
+            PyObject *item = rows[row][j];
+            if (PyFloat_CheckExact(item)) {
+                continue;
+            }
+            double val = PyFloat_AsDouble(item);
+            if (val == -1 && PyErr_Occurred()) {
+                PyMem_Free(slow);
+                return -1;
+            }
+            store(mat, (long) row * mat->cols + j, val);
+        }
+    }
+    PyMem_Free(slow);
+    return 0;
+}
+
+/*
+ * Makes *mat a new rows x cols matrix of `type` holding the `rows * cols` numbers at `items`
+ * in row-major order (see fill_items). Returns -1 with an exception set on failure.
+ */
+static int items_matrix(matrix **mat, PyObject **items, int rows, int cols, dtype type) {
+    int alloc_failed = allocate_matrix_typed(mat, rows, cols, type);
+    if (alloc_failed == -1){
+        PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
+        return -1;
+    }else if (alloc_failed == -2){
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return -1;
+    }
+    PyObject ***row_items = PyMem_Malloc(rows * sizeof(PyObject **));
+    if (row_items == NULL) {
+        deallocate_matrix(*mat);
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (int i = 0; i < rows; i++) {
+        row_items[i] = items + (long) i * cols;
+    }
+    int err = fill_items(*mat, row_items);
+    PyMem_Free(row_items);
+    if (err < 0) {
+        deallocate_matrix(*mat);
+    }
+    return err;
+}
+
+/*
+ * Matrix(rows, cols, 1d_list). Fill a matrix with dimension rows * cols with 1d_list values.
+ * The list may also be a tuple.
+ */
+static int init_1d(PyObject *self, int rows, int cols, PyObject *lst, dtype type) {
+    if ((Py_ssize_t) rows * cols != PySequence_Fast_GET_SIZE(lst)) {
         PyErr_SetString(PyExc_TypeError, "Incorrect number of elements in list");
         return -1;
     }
     matrix *new_mat;
-    int alloc_failed = allocate_matrix(&new_mat, rows, cols);
+    if (items_matrix(&new_mat, PySequence_Fast_ITEMS(lst), rows, cols, type) < 0) {
+        return -1;
+    }
+    ((Matrix61c *)self)->mat = new_mat;
+    ((Matrix61c *)self)->shape = PyTuple_Pack(2, PyLong_FromLong(rows), PyLong_FromLong(cols));
+    return 0;
+}
+
+/*
+ * Matrix(2d_list). Fill a matrix with dimension len(2d_list) * len(2d_list[0]). The outer and
+ * inner lists may also be tuples.
+ */
+static int init_2d(PyObject *self, PyObject *lst, dtype type) {
+    int rows = PySequence_Fast_GET_SIZE(lst);
+    if (rows == 0) {
+        PyErr_SetString(PyExc_TypeError, "Cannot initialize numc.Matrix with an empty list");
+        return -1;
+    }
+    PyObject **row_lists = PySequence_Fast_ITEMS(lst);
+    int cols = 0;
+    for (int i = 0; i < rows; i++) {
+        PyObject *row = row_lists[i];
+        if (!(PyList_Check(row) || PyTuple_Check(row)) ||
+            (i > 0 && PySequence_Fast_GET_SIZE(row) != cols)) {
+            PyErr_SetString(PyExc_TypeError, "List values not valid");
+            return -1;
+        }
+        cols = PySequence_Fast_GET_SIZE(row);
+    }
+    matrix *new_mat;
+    int alloc_failed = allocate_matrix_typed(&new_mat, rows, cols, type);
     if (alloc_failed == -1){
         PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
         return alloc_failed;
@@ -102,213 +560,1578 @@ static int init_1d(PyObject *self, int rows, int cols, PyObject *lst) {
         PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
         return alloc_failed;
     }
-    int count = 0;
+    PyObject ***row_items = PyMem_Malloc(rows * sizeof(PyObject **));
+    if (row_items == NULL) {
+        deallocate_matrix(new_mat);
+        PyErr_NoMemory();
+        return -1;
+    }
     for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            set(new_mat, i, j, PyFloat_AsDouble(PyList_GetItem(lst, count)));
-            count++;
+        row_items[i] = PySequence_Fast_ITEMS(row_lists[i]);
+    }
+    int err = fill_items(new_mat, row_items);
+    PyMem_Free(row_items);
+    if (err < 0) {
+        deallocate_matrix(new_mat);
+        return -1;
+    }
+    ((Matrix61c *)self)->mat = new_mat;
+    ((Matrix61c *)self)->shape = PyTuple_Pack(2, PyLong_FromLong(rows), PyLong_FromLong(cols));
+    return 0;
+}
+
+/* Releases a Py_buffer wrapped by init_buffer once no matrix refers to its memory anymore */
+static void release_buffer(void *owner) {
+    Py_buffer *view = (Py_buffer *) owner;
+    PyBuffer_Release(view);
+    PyMem_Free(view);
+}
+
+/*
+ * Stores the type of the buffer's elements to *type. Returns -1 if they are neither native
+ * doubles nor native floats.
+ */
+static int buffer_dtype(Py_buffer *view, dtype *type) {
+    const char *format = view->format;
+    if (format == NULL) {
+        return -1;
+    }
+    /* '@' and '=' are native; '<' is native on the little-endian hosts numc targets */
+    if (format[0] == '@' || format[0] == '=' || format[0] == '<') {
+        format++;
+    }
+    if (format[1] != '\0') {
+        return -1;
+    }
+    if (format[0] == 'd' && view->itemsize == sizeof(double)) {
+        *type = DTYPE_FLOAT64;
+        return 0;
+    } else if (format[0] == 'f' && view->itemsize == sizeof(float)) {
+        *type = DTYPE_FLOAT32;
+        return 0;
+    }
+    return -1;
+}
+
+/* Returns 1 if the buffer holds plain bytes (bytes, bytearray, mmap...) rather than numbers */
+static int buffer_is_raw(Py_buffer *view) {
+    const char *format = view->format;
+    return format == NULL || ((format[0] == 'B' || format[0] == 'b' || format[0] == 'c') &&
+                              format[1] == '\0');
+}
+
+/*
+ * Makes *mat a rows x cols matrix of `type` from elements of type `data_type` stored back to
+ * back at `data`, inside the C-contiguous buffer `view`. If the buffer is writable, `data` is
+ * aligned and no conversion is needed, the matrix shares the buffer's memory and releases
+ * `view` once it is gone. Otherwise the elements are copied over threads, without the GIL,
+ * and `view` is released right away. `view` is also released on failure, in which case -1 is
+ * returned with an exception set.
+ */
+static int buffer_matrix(matrix **mat, Py_buffer *view, char *data, dtype data_type, int rows,
+                         int cols, dtype type) {
+    matrix *src;
+    int alloc_failed = allocate_matrix_external(&src, data, data_type, rows, cols,
+                                                release_buffer, view);
+    if (alloc_failed == -1){
+        PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
+        release_buffer(view);
+        return -1;
+    }else if (alloc_failed == -2){
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        release_buffer(view);
+        return -1;
+    }
+    if (!view->readonly && ((uintptr_t) data) % dtype_size(data_type) == 0 && data_type == type) {
+        *mat = src;
+        return 0;
+    }
+    if (allocate_matrix_typed(mat, rows, cols, type) != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        deallocate_matrix(src);
+        return -1;
+    }
+    kernel_call call;
+    begin_kernel(&call, (long) rows * cols, src, NULL);
+    copy_matrix(*mat, src);
+    end_kernel(&call);
+    deallocate_matrix(src);
+    return 0;
+}
+
+/*
+ * Matrix(buffer) or Matrix(rows, cols, buffer). Builds a matrix from any object that exports
+ * float64 or float32 values through the buffer protocol (numpy arrays, memoryviews,
+ * array.array('d')...). Buffers of plain bytes (bytes, bytearray...) are read as raw float64
+ * data, or raw data of the requested `type`. Pass rows = cols = -1 to take the shape from the
+ * buffer, where a 1-D buffer becomes a single row. The matrix has the buffer's element type
+ * unless `type` points to another one. Writable, C-contiguous, aligned buffers of the matrix's
+ * type are shared without copying, so changes are seen on both sides; anything else is copied.
+ */
+static int init_buffer(PyObject *self, int rows, int cols, PyObject *obj, const dtype *type) {
+    Py_buffer *view = PyMem_Malloc(sizeof(Py_buffer));
+    if (view == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (PyObject_GetBuffer(obj, view, PyBUF_RECORDS_RO) < 0) {
+        PyMem_Free(view);
+        return -1;
+    }
+    dtype buffer_type;
+    Py_ssize_t count;
+    int raw = buffer_is_raw(view);
+    if (raw) {
+        buffer_type = type != NULL ? *type : DTYPE_FLOAT64;
+        count = view->len / dtype_size(buffer_type);
+        if (view->len % dtype_size(buffer_type) != 0 || !PyBuffer_IsContiguous(view, 'C')) {
+            PyErr_SetString(PyExc_TypeError, "Byte buffer must be contiguous and hold whole elements");
+            release_buffer(view);
+            return -1;
+        }
+    } else if (buffer_dtype(view, &buffer_type) < 0) {
+        PyErr_SetString(PyExc_TypeError, "Buffer must contain float64 or float32 values");
+        release_buffer(view);
+        return -1;
+    } else {
+        count = view->len / view->itemsize;
+    }
+    if (rows == -1 && cols == -1) {
+        if (raw || view->ndim == 1) {
+            rows = 1;
+            cols = count;
+        } else if (view->ndim == 2) {
+            rows = view->shape[0];
+            cols = view->shape[1];
+        } else {
+            PyErr_SetString(PyExc_TypeError, "Buffer must be 1 or 2 dimensional");
+            release_buffer(view);
+            return -1;
         }
+    } else if ((Py_ssize_t) rows * cols != count) {
+        PyErr_SetString(PyExc_TypeError, "Incorrect number of elements in buffer");
+        release_buffer(view);
+        return -1;
+    }
+    matrix *new_mat;
+    if (PyBuffer_IsContiguous(view, 'C')) {
+        if (buffer_matrix(&new_mat, view, view->buf, buffer_type, rows, cols,
+                          type != NULL ? *type : buffer_type) < 0) {
+            return -1;
+        }
+    } else {
+        /* Strided buffers are gathered by Python first */
+        int alloc_failed = allocate_matrix_typed(&new_mat, rows, cols, buffer_type);
+        if (alloc_failed == -1){
+            PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
+            release_buffer(view);
+            return alloc_failed;
+        }else if (alloc_failed == -2){
+            PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+            release_buffer(view);
+            return alloc_failed;
+        }
+        if (PyBuffer_ToContiguous(new_mat->data, view, view->len, 'C') < 0) {
+            deallocate_matrix(new_mat);
+            release_buffer(view);
+            return -1;
+        }
+        release_buffer(view);
+        if (type != NULL && *type != buffer_type) {
+            matrix *converted;
+            if (allocate_matrix_typed(&converted, rows, cols, *type) != 0) {
+                PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+                deallocate_matrix(new_mat);
+                return -2;
+            }
+            copy_matrix(converted, new_mat);
+            deallocate_matrix(new_mat);
+            new_mat = converted;
+        }
+    }
+    ((Matrix61c *)self)->mat = new_mat;
+    ((Matrix61c *)self)->shape = PyTuple_Pack(2, PyLong_FromLong(rows), PyLong_FromLong(cols));
+    return 0;
+}
+
+/*
+ * Parses the `shape` argument of the Matrix.from* constructors into *rows and *cols, which
+ * stay -1 if it is None. Returns -1 with an exception set if it is not a pair of ints.
+ */
+static int parse_shape(PyObject *shape, int *rows, int *cols) {
+    *rows = *cols = -1;
+    if (shape == NULL || shape == Py_None) {
+        return 0;
+    }
+    if (!PyTuple_Check(shape) || !PyArg_ParseTuple(shape, "ii", rows, cols)) {
+        PyErr_SetString(PyExc_TypeError, "Shape must be a (rows, cols) tuple");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Resolves the shape of a Matrix.from* result holding `count` elements: a single row if no
+ * shape was given (*rows = -1), else rows * cols must equal count. Returns -1 with a value
+ * error set otherwise, including when there are no elements.
+ */
+static int shape_for_count(Py_ssize_t count, int *rows, int *cols) {
+    if (count == 0) {
+        PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
+        return -1;
+    }
+    if (*rows == -1 && *cols == -1) {
+        if (count > INT32_MAX) {
+            PyErr_SetString(PyExc_ValueError, "Too many elements for a single row");
+            return -1;
+        }
+        *rows = 1;
+        *cols = count;
+    } else if (*rows <= 0 || *cols <= 0 || (Py_ssize_t) *rows * *cols != count) {
+        PyErr_SetString(PyExc_ValueError, "Shape does not match the number of elements");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Matrix.frombuffer(buffer, dtype="float64", count=-1, offset=0, shape=None). Reads the raw
+ * bytes of any contiguous buffer, starting `offset` bytes in, as `count` elements of `dtype`
+ * (all that fit if count is -1). The result is a single row unless `shape` is given. Like
+ * Matrix(buffer), it shares writable, aligned memory and copies anything else in parallel.
+ */
+static PyObject *Matrix61c_frombuffer(PyObject *cls, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"buffer", "dtype", "count", "offset", "shape", NULL};
+    PyObject *obj, *dtype_arg = NULL, *shape = NULL;
+    Py_ssize_t count = -1, offset = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OnnO", kwlist, &obj, &dtype_arg, &count,
+                                     &offset, &shape)) {
+        return NULL;
+    }
+    dtype type = DTYPE_FLOAT64;
+    int rows, cols;
+    if ((dtype_arg != NULL && parse_dtype(dtype_arg, &type) < 0) ||
+        parse_shape(shape, &rows, &cols) < 0) {
+        return NULL;
+    }
+    Py_buffer *view = PyMem_Malloc(sizeof(Py_buffer));
+    if (view == NULL) {
+        return PyErr_NoMemory();
+    }
+    if (PyObject_GetBuffer(obj, view, PyBUF_SIMPLE) < 0) {
+        PyMem_Free(view);
+        return NULL;
+    }
+    Py_ssize_t size = dtype_size(type);
+    const char *err = NULL;
+    if (offset < 0 || offset > view->len) {
+        err = "Offset must be within the buffer";
+    } else if (count < 0 && rows != -1) {
+        count = (Py_ssize_t) rows * cols;
+    } else if (count < 0 && (view->len - offset) % size != 0) {
+        err = "Buffer size must be a multiple of the element size";
+    } else if (count < 0) {
+        count = (view->len - offset) / size;
+    }
+    if (err == NULL && count > (view->len - offset) / size) {
+        err = "Buffer is smaller than the requested number of elements";
+    }
+    if (err != NULL) {
+        PyErr_SetString(PyExc_ValueError, err);
+        release_buffer(view);
+        return NULL;
+    }
+    if (shape_for_count(count, &rows, &cols) < 0) {
+        release_buffer(view);
+        return NULL;
+    }
+    matrix *new_mat;
+    if (buffer_matrix(&new_mat, view, (char *) view->buf + offset, type, rows, cols, type) < 0) {
+        return NULL;
+    }
+    return op_err(new_mat, 0);
+}
+
+/* Releases the element array fromiter collects values of unknown count in */
+static void release_values(void *owner) {
+    PyMem_RawFree(owner);
+}
+
+/*
+ * Matrix.fromiter(iterable, dtype="float64", count=-1, shape=None). Builds a matrix from the
+ * first `count` numbers of any iterable (all of them if count is -1), as a single row unless
+ * `shape` is given. Lists and tuples take the fast path of Matrix(list); other iterables are
+ * consumed one item at a time and copied into the matrix at the end.
+ */
+static PyObject *Matrix61c_fromiter(PyObject *cls, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"iterable", "dtype", "count", "shape", NULL};
+    PyObject *iterable, *dtype_arg = NULL, *shape = NULL;
+    Py_ssize_t count = -1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OnO", kwlist, &iterable, &dtype_arg, &count,
+                                     &shape)) {
+        return NULL;
+    }
+    dtype type = DTYPE_FLOAT64;
+    int rows, cols;
+    if ((dtype_arg != NULL && parse_dtype(dtype_arg, &type) < 0) ||
+        parse_shape(shape, &rows, &cols) < 0) {
+        return NULL;
+    }
+    if (count < 0 && rows != -1) {
+        count = (Py_ssize_t) rows * cols;
+    }
+    matrix *new_mat;
+    if (PyList_Check(iterable) || PyTuple_Check(iterable)) {
+        Py_ssize_t length = PySequence_Fast_GET_SIZE(iterable);
+        if (count > length) {
+            PyErr_SetString(PyExc_ValueError, "Iterable is shorter than count");
+            return NULL;
+        }
+        if (shape_for_count(count < 0 ? length : count, &rows, &cols) < 0 ||
+            items_matrix(&new_mat, PySequence_Fast_ITEMS(iterable), rows, cols, type) < 0) {
+            return NULL;
+        }
+        return op_err(new_mat, 0);
+    }
+    PyObject *iter = PyObject_GetIter(iterable);
+    if (iter == NULL) {
+        return NULL;
+    }
+    Py_ssize_t capacity = count >= 0 ? count : PyObject_LengthHint(iterable, 1024);
+    capacity = capacity < 16 ? 16 : capacity;
+    double *values = PyMem_RawMalloc(capacity * sizeof(double));
+    Py_ssize_t length = 0;
+    PyObject *item = NULL;
+    while (values != NULL && (count < 0 || length < count) && (item = PyIter_Next(iter)) != NULL) {
+        double val = PyFloat_CheckExact(item) ? PyFloat_AS_DOUBLE(item) : PyFloat_AsDouble(item);
+        Py_DECREF(item);
+        if (val == -1 && PyErr_Occurred()) {
+            break;
+        }
+        if (length == capacity) {
+            capacity *= 2;
+            double *grown = PyMem_RawRealloc(values, capacity * sizeof(double));
+            if (grown == NULL) {
+                PyMem_RawFree(values);
+                values = NULL;
+                break;
+            }
+            values = grown;
+        }
+        values[length++] = val;
+    }
+    Py_DECREF(iter);
+    if (values == NULL) {
+        return PyErr_Occurred() ? NULL : PyErr_NoMemory();
+    }
+    if (PyErr_Occurred() || (count >= 0 && length < count &&
+                             (PyErr_SetString(PyExc_ValueError, "Iterable is shorter than count"), 1)) ||
+        shape_for_count(length, &rows, &cols) < 0) {
+        PyMem_RawFree(values);
+        return NULL;
+    }
+    matrix *src;
+    if (allocate_matrix_external(&src, values, DTYPE_FLOAT64, rows, cols, release_values,
+                                 values) != 0) {
+        PyMem_RawFree(values);
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return NULL;
+    }
+    if (type == DTYPE_FLOAT64) {
+        return op_err(src, 0);
+    }
+    if (allocate_matrix_typed(&new_mat, rows, cols, type) != 0) {
+        deallocate_matrix(src);
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return NULL;
+    }
+    copy_matrix(new_mat, src);
+    deallocate_matrix(src);
+    return op_err(new_mat, 0);
+}
+
+/* This deallocation function is called when reference count is 0*/
+static void Matrix61c_dealloc(Matrix61c *self) {
+    if (self->pending != NULL) {
+        drop_pending(self);
+    }
+    deallocate_matrix(self->mat);
+    Py_TYPE(self)->tp_free(self);
+}
+
+/* For immutable types all initializations should take place in tp_new */
+static PyObject *Matrix61c_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    /* size of allocated memory is tp_basicsize + nitems*tp_itemsize*/
+    Matrix61c *self = (Matrix61c *)type->tp_alloc(type, 0);
+    return (PyObject *)self;
+}
+
+/* This matrix61c type is mutable, so needs init function. Return 0 on success otherwise -1 */
+static int Matrix61c_init(PyObject *self, PyObject *args, PyObject *kwds) {
+    /* Every constructor takes an optional dtype="float64" or dtype="float32" */
+    dtype type = DTYPE_FLOAT64;
+    PyObject *dtype_arg = kwds != NULL ? PyDict_GetItemString(kwds, "dtype") : NULL;
+    if (dtype_arg != NULL && parse_dtype(dtype_arg, &type) < 0) {
+        return -1;
+    }
+    /* Matrix(rows, cols, [val], backing=path) takes no other keywords */
+    PyObject *backing_arg = kwds != NULL ? PyDict_GetItemString(kwds, "backing") : NULL;
+    if (backing_arg != NULL) {
+        if (PyDict_Size(kwds) > 1 + (dtype_arg != NULL)) {
+            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+            return -1;
+        }
+        return init_backed(self, args, backing_arg, type);
+    }
+    /* Generate random matrices: rand=True draws from [low, high), randn=True from N(mean, std) */
+    if (kwds != NULL && PyDict_Size(kwds) > (dtype_arg != NULL)) {
+        PyObject *randn = PyDict_GetItemString(kwds, "randn");
+        int normal = randn != NULL;
+        PyObject *rand = normal ? randn : PyDict_GetItemString(kwds, "rand");
+        if (!rand || (normal && PyDict_GetItemString(kwds, "rand"))) {
+            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+            return -1;
+        }
+        if (!PyBool_Check(rand)) {
+            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+            return -1;
+        }
+        if (rand != Py_True) {
+            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+            return -1;
+        }
+
+        PyObject *low = PyDict_GetItemString(kwds, normal ? "mean" : "low");
+        PyObject *high = PyDict_GetItemString(kwds, normal ? "std" : "high");
+        PyObject *seed = PyDict_GetItemString(kwds, "seed");
+        double double_low = 0;
+        double double_high = 1;
+        unsigned int unsigned_seed = 0;
+
+        if (low) {
+            if (PyFloat_Check(low)) {
+                double_low = PyFloat_AsDouble(low);
+            } else if (PyLong_Check(low)) {
+                double_low = PyLong_AsLong(low);
+            }
+        }
+
+        if (high) {
+            if (PyFloat_Check(high)) {
+                double_high = PyFloat_AsDouble(high);
+            } else if (PyLong_Check(high)) {
+                double_high = PyLong_AsLong(high);
+            }
+        }
+
+        if (normal ? double_high < 0 : double_low >= double_high) {
+            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+            return -1;
+        }
+
+        // Set seed if argument exists
+        if (seed) {
+            if (PyLong_Check(seed)) {
+                unsigned_seed = PyLong_AsUnsignedLong(seed);
+            }
+        }
+
+        PyObject *rows = NULL;
+        PyObject *cols = NULL;
+        if (PyArg_UnpackTuple(args, "args", 2, 2, &rows, &cols)) {
+            if (rows && cols && PyLong_Check(rows) && PyLong_Check(cols)) {
+                return init_rand(self, PyLong_AsLong(rows), PyLong_AsLong(cols), unsigned_seed, double_low, double_high, normal, type);
+            }
+        } else {
+            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+            return -1;
+        }
+    }
+    PyObject *arg1 = NULL;
+    PyObject *arg2 = NULL;
+    PyObject *arg3 = NULL;
+    if (PyArg_UnpackTuple(args, "args", 1, 3, &arg1, &arg2, &arg3)) {
+        /* arguments are (rows, cols, val) */
+        if (arg1 && arg2 && arg3 && PyLong_Check(arg1) && PyLong_Check(arg2) && (PyLong_Check(arg3) || PyFloat_Check(arg3))) {
+            if (PyLong_Check(arg3)) {
+                return init_fill(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), PyLong_AsLong(arg3), type);
+            }
+            else
+                return init_fill(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), PyFloat_AsDouble(arg3), type);
+        } else if (arg1 && arg2 && arg3 && PyLong_Check(arg1) && PyLong_Check(arg2) && (PyList_Check(arg3) || PyTuple_Check(arg3))) {
+            /* Matrix(rows, cols, 1D list) */
+            return init_1d(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), arg3, type);
+        } else if (arg1 && (PyList_Check(arg1) || PyTuple_Check(arg1)) && arg2 == NULL && arg3 == NULL) {
+            /* Matrix(2D list) */
+            return init_2d(self, arg1, type);
+        } else if (arg1 && arg2 && PyLong_Check(arg1) && PyLong_Check(arg2) && arg3 == NULL) {
+            /* Matrix(rows, cols, 1D list) */
+            return init_fill(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), 0, type);
+        } else if (arg1 && arg2 && arg3 && PyLong_Check(arg1) && PyLong_Check(arg2) && PyObject_CheckBuffer(arg3)) {
+            /* Matrix(rows, cols, buffer) */
+            return init_buffer(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), arg3,
+                               dtype_arg != NULL ? &type : NULL);
+        } else if (arg1 && PyObject_CheckBuffer(arg1) && arg2 == NULL && arg3 == NULL) {
+            /* Matrix(buffer) */
+            return init_buffer(self, -1, -1, arg1, dtype_arg != NULL ? &type : NULL);
+        } else {
+            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+            return -1;
+        }
+    } else {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return -1;
+    }
+}
+
+/* Value of element `index` (in elements from the start of mat->data) as a double */
+static inline double load(matrix *mat, long index) {
+    if (mat->dtype == DTYPE_FLOAT32) {
+        return ((float *) mat->data)[index];
+    }
+    return ((double *) mat->data)[index];
+}
+
+/* List of lists representations for matrices */
+static PyObject *Matrix61c_to_list(Matrix61c *self) {
+    if (materialize(self) < 0) {
+        return NULL;
+    }
+    matrix *mat = self->mat;
+    PyObject *py_lst = PyList_New(mat->rows);
+    if (py_lst == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < mat->rows; i++) {
+        PyObject *curr_row = PyList_New(mat->cols);
+        if (curr_row == NULL) {
+            Py_DECREF(py_lst);
+            return NULL;
+        }
+        /* New lists are fully built before anything can see them, so SET_ITEM is safe */
+        PyList_SET_ITEM(py_lst, i, curr_row);
+        long index = (long) i * mat->row_stride;
+        for (int j = 0; j < mat->cols; j++, index += mat->col_stride) {
+            PyObject *val = PyFloat_FromDouble(load(mat, index));
+            if (val == NULL) {
+                Py_DECREF(py_lst);
+                return NULL;
+            }
+            PyList_SET_ITEM(curr_row, j, val);
+        }
+    }
+    return py_lst;
+}
+
+/* Class function which acts as a helper function to Matrix61c_to_list */
+static PyObject *Matrix61c_class_to_list(Matrix61c *self, PyObject *args) {
+    PyObject *mat = NULL;
+    if (PyArg_UnpackTuple(args, "args", 1, 1, &mat)) {
+        if (!PyObject_TypeCheck(mat, &Matrix61cType)) {
+            PyErr_SetString(PyExc_TypeError, "Argument must of type numc.Matrix!");
+            return NULL;
+        }
+        Matrix61c* mat61c = (Matrix61c*)mat;
+        return Matrix61c_to_list(mat61c);
+    } else {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+}
+
+/*
+ * numc.set_isa(name). Switches all kernels to the given instruction set ("scalar", "sse2",
+ * "avx2" or "avx512"). Throws a value error for unknown names and a runtime error if this CPU
+ * cannot run the instruction set.
+ */
+static PyObject *Matrix61c_set_isa(PyObject *self, PyObject *args) {
+    const char *name = NULL;
+    if (!PyArg_ParseTuple(args, "s", &name)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    int select_failed = select_kernels(name);
+    if (select_failed == -1) {
+        PyErr_Format(PyExc_ValueError, "Unknown instruction set '%s'", name);
+        return NULL;
+    } else if (select_failed == -2) {
+        PyErr_Format(PyExc_RuntimeError, "Instruction set '%s' is not supported by this CPU", name);
+        return NULL;
+    }
+    return Py_BuildValue("");
+}
+
+/* numc.get_isa(). Returns the name of the instruction set the kernels currently use. */
+static PyObject *Matrix61c_get_isa(PyObject *self, PyObject *args) {
+    return PyUnicode_FromString(kernels->name);
+}
+
+/*
+ * numc.trim_pool(). Returns every idle block held by the matrix memory pool to the system and
+ * returns the number of bytes released.
+ */
+static PyObject *Matrix61c_trim_pool(PyObject *self, PyObject *args) {
+    return PyLong_FromSize_t(pool_trim());
+}
+
+/*
+ * numc.set_pool_limit(bytes). Sets how many bytes of freed matrix data the pool may keep for
+ * reuse. 0 disables pooling.
+ */
+static PyObject *Matrix61c_set_pool_limit(PyObject *self, PyObject *args) {
+    PyObject *limit = NULL;
+    if (!PyArg_UnpackTuple(args, "args", 1, 1, &limit) || !PyLong_Check(limit)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    size_t bytes = PyLong_AsSize_t(limit);
+    if (bytes == (size_t) -1 && PyErr_Occurred()) {
+        PyErr_Clear();
+        PyErr_SetString(PyExc_ValueError, "Pool limit must be a non-negative number of bytes");
+        return NULL;
+    }
+    pool_set_limit(bytes);
+    return Py_BuildValue("");
+}
+
+/* numc.get_pool_limit(). Returns how many bytes of freed matrix data the pool may keep. */
+static PyObject *Matrix61c_get_pool_limit(PyObject *self, PyObject *args) {
+    return PyLong_FromSize_t(pool_get_limit());
+}
+
+/*
+ * numc.set_memory_budget(bytes). Sets how many bytes of file-backed matrices an operation may
+ * keep in memory at a time (see Matrix(rows, cols, backing=path)).
+ */
+static PyObject *Matrix61c_set_memory_budget(PyObject *self, PyObject *args) {
+    PyObject *budget = NULL;
+    if (!PyArg_UnpackTuple(args, "args", 1, 1, &budget) || !PyLong_Check(budget)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    size_t bytes = PyLong_AsSize_t(budget);
+    if ((bytes == (size_t) -1 && PyErr_Occurred()) || bytes == 0) {
+        PyErr_Clear();
+        PyErr_SetString(PyExc_ValueError, "Memory budget must be a positive number of bytes");
+        return NULL;
+    }
+    set_memory_budget(bytes);
+    return Py_BuildValue("");
+}
+
+/* numc.get_memory_budget(). Returns how many bytes of file-backed matrices an operation keeps. */
+static PyObject *Matrix61c_get_memory_budget(PyObject *self, PyObject *args) {
+    return PyLong_FromSize_t(get_memory_budget());
+}
+
+/*
+ * numc.set_lazy(on). Turns lazy mode on or off. In lazy mode chains of +, -, /, abs(),
+ * numc.multiply and numc.divide (also with numbers) are evaluated in a single pass when their
+ * result is first used. Turning it off evaluates everything that is still deferred.
+ */
+static PyObject *Matrix61c_set_lazy(PyObject *self, PyObject *args) {
+    int on;
+    if (!PyArg_ParseTuple(args, "p", &on)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    lazy_mode = on;
+    if (!on && flush_pending() < 0) {
+        return NULL;
+    }
+    return Py_BuildValue("");
+}
+
+/* numc.get_lazy(). Returns whether lazy mode is on. */
+static PyObject *Matrix61c_get_lazy(PyObject *self, PyObject *args) {
+    return PyBool_FromLong(lazy_mode);
+}
+
+/*
+ * Print options. A matrix with more than print_threshold elements is summarized by repr(): only
+ * the first and last print_edgeitems rows and columns are shown, with "..." in between.
+ */
+static long print_threshold = 1000;
+static int print_edgeitems = 3;
+
+/*
+ * numc.set_printoptions(threshold=None, edgeitems=None). Sets the print options that are given.
+ * Throws a value error if threshold is negative or edgeitems is less than 1.
+ */
+static PyObject *Matrix61c_set_printoptions(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"threshold", "edgeitems", NULL};
+    PyObject *threshold = Py_None, *edgeitems = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OO", kwlist, &threshold, &edgeitems)) {
+        return NULL;
+    }
+    long new_threshold = print_threshold;
+    long new_edgeitems = print_edgeitems;
+    if (threshold != Py_None && (new_threshold = PyLong_AsLong(threshold)) == -1 &&
+        PyErr_Occurred()) {
+        return NULL;
+    }
+    if (edgeitems != Py_None && (new_edgeitems = PyLong_AsLong(edgeitems)) == -1 &&
+        PyErr_Occurred()) {
+        return NULL;
+    }
+    if (new_threshold < 0 || new_edgeitems < 1 || new_edgeitems > INT32_MAX) {
+        PyErr_SetString(PyExc_ValueError,
+                        "threshold must be non-negative and edgeitems at least 1");
+        return NULL;
+    }
+    print_threshold = new_threshold;
+    print_edgeitems = new_edgeitems;
+    return Py_BuildValue("");
+}
+
+/* numc.get_printoptions(). Returns the print options as a dict. */
+static PyObject *Matrix61c_get_printoptions(PyObject *self, PyObject *args) {
+    return Py_BuildValue("{s:l,s:i}", "threshold", print_threshold, "edgeitems", print_edgeitems);
+}
+
+/*
+ * numc.set_num_threads(n). Caps the number of threads any kernel uses, and so how many pool
+ * workers are active; 1 makes every kernel serial. Throws a value error if n < 1 or n is more
+ * than PARALLEL_MAX_THREADS.
+ */
+static PyObject *Matrix61c_set_num_threads(PyObject *self, PyObject *args) {
+    int threads;
+    if (!PyArg_ParseTuple(args, "i", &threads)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    if (threads < 1 || threads > PARALLEL_MAX_THREADS) {
+        PyErr_Format(PyExc_ValueError, "Number of threads must be between 1 and %d",
+                     PARALLEL_MAX_THREADS);
+        return NULL;
+    }
+    set_num_threads(threads);
+    return Py_BuildValue("");
+}
+
+/* numc.get_num_threads(). Returns the most threads a kernel may use. */
+static PyObject *Matrix61c_get_num_threads(PyObject *self, PyObject *args) {
+    return PyLong_FromLong(get_num_threads());
+}
+
+static const char *parallel_kind_names[PARALLEL_KINDS] = {"elementwise", "gemm", "random"};
+
+/* Returns the parallel_kind named `name`, or -1 with a value error set */
+static int parse_parallel_kind(const char *name) {
+    for (int kind = 0; kind < PARALLEL_KINDS; kind++) {
+        if (strcmp(name, parallel_kind_names[kind]) == 0) {
+            return kind;
+        }
+    }
+    PyErr_Format(PyExc_ValueError, "Unknown kind of kernel '%s'", name);
+    return -1;
+}
+
+/* Returns a dict mapping each kind of kernel to its parallel threshold */
+static PyObject *parallel_thresholds(void) {
+    PyObject *dict = PyDict_New();
+    if (dict == NULL) {
+        return NULL;
+    }
+    for (int kind = 0; kind < PARALLEL_KINDS; kind++) {
+        PyObject *work = PyLong_FromLong(get_parallel_threshold(kind));
+        if (work == NULL || PyDict_SetItemString(dict, parallel_kind_names[kind], work) < 0) {
+            Py_XDECREF(work);
+            Py_DECREF(dict);
+            return NULL;
+        }
+        Py_DECREF(work);
+    }
+    return dict;
+}
+
+/*
+ * numc.set_parallel_threshold(kind, work). Sets how much work ("elementwise" and "random":
+ * elements, "gemm": multiply-adds) a thread must get before a kernel of that kind uses another
+ * one. Use it to restore thresholds saved from numc.calibrate().
+ */
+static PyObject *Matrix61c_set_parallel_threshold(PyObject *self, PyObject *args) {
+    const char *name;
+    long work;
+    if (!PyArg_ParseTuple(args, "sl", &name, &work)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    int kind = parse_parallel_kind(name);
+    if (kind < 0) {
+        return NULL;
+    }
+    if (work < 1) {
+        PyErr_SetString(PyExc_ValueError, "Threshold must be positive");
+        return NULL;
+    }
+    set_parallel_threshold(kind, work);
+    return Py_BuildValue("");
+}
+
+/* numc.get_parallel_threshold(kind). Returns the threshold of the given kind of kernel. */
+static PyObject *Matrix61c_get_parallel_threshold(PyObject *self, PyObject *args) {
+    const char *name;
+    if (!PyArg_ParseTuple(args, "s", &name)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    int kind = parse_parallel_kind(name);
+    if (kind < 0) {
+        return NULL;
+    }
+    return PyLong_FromLong(get_parallel_threshold(kind));
+}
+
+/*
+ * numc.calibrate(). Times every kind of kernel serially and on all threads to find the sizes
+ * where threading starts to pay off on this machine, keeps them as the parallel thresholds and
+ * returns them as a dict, e.g. to save and restore with set_parallel_threshold.
+ */
+static PyObject *Matrix61c_calibrate(PyObject *self, PyObject *args) {
+    Py_BEGIN_ALLOW_THREADS
+    calibrate_parallel();
+    Py_END_ALLOW_THREADS
+    return parallel_thresholds();
+}
+
+/*
+ * Collects the `count` matrices of one side of numc.batch_matmul into `mats`. `obj` is a
+ * sequence of numc.Matrix of one shape, or a single numc.Matrix that takes part in every product.
+ * Returns a new reference that keeps the matrices alive until the products are done, or NULL
+ * with an exception set if `obj` is neither, if its shapes differ or its length is not `count`.
+ */
+static PyObject *batch_operand(PyObject *obj, matrix **mats, Py_ssize_t count) {
+    if (PyObject_TypeCheck(obj, &Matrix61cType)) {
+        if (materialize((Matrix61c *) obj) < 0) {
+            return NULL;
+        }
+        for (Py_ssize_t i = 0; i < count; i++) {
+            mats[i] = ((Matrix61c *) obj)->mat;
+        }
+        Py_INCREF(obj);
+        return obj;
+    }
+    PyObject *seq = PySequence_Fast(obj, "Operands must be numc.Matrix or sequences of them");
+    if (seq == NULL) {
+        return NULL;
+    }
+    if (PySequence_Fast_GET_SIZE(seq) != count) {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "Batches must have the same length");
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyObject_TypeCheck(item, &Matrix61cType)) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_TypeError, "Batches must only hold numc.Matrix");
+            return NULL;
+        }
+        if (materialize((Matrix61c *) item) < 0) {
+            Py_DECREF(seq);
+            return NULL;
+        }
+        mats[i] = ((Matrix61c *) item)->mat;
+        if (mats[i]->rows != mats[0]->rows || mats[i]->cols != mats[0]->cols) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_ValueError, "Matrices of a batch must have the same shape");
+            return NULL;
+        }
+    }
+    return seq;
+}
+
+/* Returns the length of a batch_matmul operand, or 1 if it is a single numc.Matrix */
+static Py_ssize_t batch_length(PyObject *obj) {
+    if (PyObject_TypeCheck(obj, &Matrix61cType)) {
+        return 1;
+    }
+    Py_ssize_t length = PySequence_Check(obj) ? PySequence_Size(obj) : -1;
+    if (length < 0) {
+        PyErr_Clear();
+        PyErr_SetString(PyExc_TypeError, "Operands must be numc.Matrix or sequences of them");
+    }
+    return length;
+}
+
+/*
+ * numc.batch_matmul(a, b). Returns the list of products a[i] * b[i]. Either side may be a
+ * single numc.Matrix instead, which then multiplies every matrix of the other side. The
+ * products are computed in one call, spread over the batch rather than within each product,
+ * and stored back to back in one allocation that all returned matrices share.
+ * Throws a type error if an operand is not a numc.Matrix or a sequence of them, and a value
+ * error if the batches differ in length or the shapes do not match.
+ */
+static PyObject *Matrix61c_batch_matmul(PyObject *self, PyObject *args) {
+    PyObject *lhs, *rhs;
+    if (!PyArg_ParseTuple(args, "OO", &lhs, &rhs)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    Py_ssize_t lhs_count = batch_length(lhs);
+    Py_ssize_t rhs_count = lhs_count < 0 ? -1 : batch_length(rhs);
+    if (rhs_count < 0) {
+        return NULL;
+    }
+    int lhs_single = PyObject_TypeCheck(lhs, &Matrix61cType);
+    Py_ssize_t count = lhs_single ? rhs_count : lhs_count;
+    if (count == 0) {
+        return PyList_New(0);
+    }
+    matrix **mats = PyMem_Calloc(5 * count, sizeof(matrix *));
+    if (mats == NULL) {
+        return PyErr_NoMemory();
+    }
+    matrix **mats1 = mats, **mats2 = mats + count, **results = mats + 2 * count;
+    matrix **pins = mats + 3 * count;
+    PyObject *lhs_ref = batch_operand(lhs, mats1, count);
+    PyObject *rhs_ref = lhs_ref == NULL ? NULL : batch_operand(rhs, mats2, count);
+    int valid = rhs_ref != NULL;
+    if (valid && mats1[0]->cols != mats2[0]->rows) {
+        PyErr_SetString(PyExc_ValueError, "Dimensions do not match for multiplication");
+        valid = 0;
+    } else if (valid && count > INT32_MAX / mats1[0]->rows) {
+        PyErr_SetString(PyExc_ValueError, "Batch is too large");
+        valid = 0;
+    }
+    if (!valid) {
+        Py_XDECREF(lhs_ref);
+        Py_XDECREF(rhs_ref);
+        PyMem_Free(mats);
+        return NULL;
+    }
+    int rows = mats1[0]->rows, inner = mats1[0]->cols, cols = mats2[0]->cols;
+    dtype type = promote_dtype(mats1[0]->dtype, mats2[0]->dtype);
+    for (Py_ssize_t i = 1; i < count; i++) {
+        type = promote_dtype(type, promote_dtype(mats1[i]->dtype, mats2[i]->dtype));
+    }
+    /* Every product is a view into one block of count x rows x cols elements */
+    matrix *block = NULL;
+    int failed = allocate_matrix_typed(&block, (int) count * rows, cols, type);
+    for (Py_ssize_t i = 0; i < count && !failed; i++) {
+        failed = allocate_matrix_view(&results[i], block, (long) i * rows * cols, rows, cols,
+                                      cols, 1);
+    }
+    if (!failed) {
+        long work = (long) count * rows * inner * cols;
+        /* Like begin_kernel, but every operand of the batch is pinned */
+        PyThreadState *state = NULL;
+        if (work >= GIL_RELEASE_WORK) {
+            for (Py_ssize_t i = 0; i < count; i++) {
+                pins[2 * i] = retain_matrix(mats1[i]);
+                pins[2 * i + 1] = retain_matrix(mats2[i]);
+            }
+            state = PyEval_SaveThread();
+        }
+        failed = batch_mul_matrix(results, mats1, mats2, (int) count);
+        if (state != NULL) {
+            PyEval_RestoreThread(state);
+            for (Py_ssize_t i = 0; i < 2 * count; i++) {
+                deallocate_matrix(pins[i]);
+            }
+        }
+    }
+    deallocate_matrix(block);
+    Py_DECREF(lhs_ref);
+    Py_DECREF(rhs_ref);
+    PyObject *list = failed ? NULL : PyList_New(count);
+    for (Py_ssize_t i = 0; list != NULL && i < count; i++) {
+        PyList_SET_ITEM(list, i, op_err(results[i], 0));
+        results[i] = NULL;
+    }
+    for (Py_ssize_t i = 0; i < count; i++) {
+        deallocate_matrix(results[i]);
+    }
+    PyMem_Free(mats);
+    if (failed && !PyErr_Occurred()) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+    }
+    return list;
+}
+
+static const char *matmul_algorithm_names[] = {"auto", "classic", "strassen"};
+
+/*
+ * numc.set_matmul_algorithm(name). Selects how products are computed: "classic" always uses the
+ * blocked GEMM, "strassen" uses Strassen-Winograd for products whose dimensions all reach the
+ * Strassen cutoff, and "auto" uses it only for the squarings of matrix powers. Strassen-Winograd
+ * only bounds the error relative to the largest entries, see strassen() in matrix.c.
+ * Throws a value error for any other name.
+ */
+static PyObject *Matrix61c_set_matmul_algorithm(PyObject *self, PyObject *args) {
+    const char *name;
+    if (!PyArg_ParseTuple(args, "s", &name)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    for (int algorithm = MATMUL_AUTO; algorithm <= MATMUL_STRASSEN; algorithm++) {
+        if (strcmp(name, matmul_algorithm_names[algorithm]) == 0) {
+            set_matmul_algorithm(algorithm);
+            return Py_BuildValue("");
+        }
+    }
+    PyErr_Format(PyExc_ValueError, "Unknown matmul algorithm '%s'", name);
+    return NULL;
+}
+
+/* numc.get_matmul_algorithm(). Returns the name of the selected product algorithm. */
+static PyObject *Matrix61c_get_matmul_algorithm(PyObject *self, PyObject *args) {
+    return PyUnicode_FromString(matmul_algorithm_names[get_matmul_algorithm()]);
+}
+
+/*
+ * numc.set_strassen_cutoff(n). Products with a dimension below n are not split any further by
+ * Strassen-Winograd. Throws a value error if n < 2.
+ */
+static PyObject *Matrix61c_set_strassen_cutoff(PyObject *self, PyObject *args) {
+    int cutoff;
+    if (!PyArg_ParseTuple(args, "i", &cutoff)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    if (cutoff < 2) {
+        PyErr_SetString(PyExc_ValueError, "Strassen cutoff must be at least 2");
+        return NULL;
+    }
+    set_strassen_cutoff(cutoff);
+    return Py_BuildValue("");
+}
+
+static PyObject *Matrix61c_get_strassen_cutoff(PyObject *self, PyObject *args) {
+    return PyLong_FromLong(get_strassen_cutoff());
+}
+
+/*
+ * Reads the `count` exponents of the fast sequence `seq` into `pows`. Returns -1 with a type or
+ * value error set if one is not a non-negative integer that fits an int.
+ */
+static int parse_exponents(PyObject *seq, int *pows, Py_ssize_t count) {
+    for (Py_ssize_t i = 0; i < count; i++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyLong_Check(item)) {
+            PyErr_SetString(PyExc_TypeError, "Exponent must be of type integer");
+            return -1;
+        }
+        long pow = PyLong_AsLong(item);
+        if (pow == -1 && PyErr_Occurred()) {
+            return -1;
+        }
+        if (pow < 0) {
+            PyErr_SetString(PyExc_ValueError, "Exponent must be positive");
+            return -1;
+        }
+        if (pow > INT32_MAX) {
+            PyErr_SetString(PyExc_ValueError, "Exponent is too large");
+            return -1;
+        }
+        pows[i] = (int) pow;
+    }
+    return 0;
+}
+
+/*
+ * numc.matrix_power_many(m, exponents). Returns a list holding the square numc.Matrix m raised
+ * to each exponent in the sequence `exponents`. The squarings of m are shared by all of them.
+ * Throws a type error if m is not a numc.Matrix or an exponent is not an integer, and a value
+ * error if m is not square or an exponent is negative.
+ */
+static PyObject *Matrix61c_matrix_power_many(PyObject *self, PyObject *args) {
+    Matrix61c *base;
+    PyObject *exponents;
+    if (!PyArg_ParseTuple(args, "O!O", &Matrix61cType, &base, &exponents)) {
+        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        return NULL;
+    }
+    if (materialize(base) < 0) {
+        return NULL;
+    }
+    matrix *mat = base->mat;
+    if (mat->rows != mat->cols) {
+        PyErr_SetString(PyExc_ValueError, "Matrix must be square");
+        return NULL;
+    }
+    PyObject *seq = PySequence_Fast(exponents, "Exponents must be a sequence of integers");
+    if (seq == NULL) {
+        return NULL;
+    }
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    int *pows = PyMem_Calloc(count + 1, sizeof(int));
+    matrix **results = PyMem_Calloc(count + 1, sizeof(matrix *));
+    if (pows == NULL || results == NULL) {
+        PyMem_Free(pows);
+        PyMem_Free(results);
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+    int failed = parse_exponents(seq, pows, count);
+    Py_DECREF(seq);
+    int any_product = 0;
+    for (Py_ssize_t i = 0; i < count && !failed; i++) {
+        any_product |= pows[i] > 1;
+        if (allocate_matrix_typed(&results[i], mat->rows, mat->cols, mat->dtype) != 0) {
+            PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+            failed = -1;
+        }
+    }
+    if (!failed) {
+        kernel_call call;
+        long n = mat->rows;
+        begin_kernel(&call, any_product ? n * n * n : n * n, mat, NULL);
+        failed = pow_matrix_many(results, mat, pows, count);
+        end_kernel(&call);
+        if (failed) {
+            PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        }
+    }
+    PyObject *list = failed ? NULL : PyList_New(count);
+    for (Py_ssize_t i = 0; list != NULL && i < count; i++) {
+        PyList_SET_ITEM(list, i, op_err(results[i], 0));
+        results[i] = NULL;
+    }
+    for (Py_ssize_t i = 0; i < count; i++) {
+        deallocate_matrix(results[i]);
+    }
+    PyMem_Free(pows);
+    PyMem_Free(results);
+    return list;
+}
+
+/* Operations of the element-wise module functions below */
+typedef enum elementwise_op {
+    ELEMENTWISE_MULTIPLY,
+    ELEMENTWISE_DIVIDE,
+    ELEMENTWISE_AXPBY, // alpha * x + beta * y
+} elementwise_op;
+
+static int elementwise_matrix(matrix *result, elementwise_op op, matrix *x, matrix *y,
+                              double alpha, double beta) {
+    switch (op) {
+        case ELEMENTWISE_MULTIPLY:
+            return multiply_matrix(result, x, y);
+        case ELEMENTWISE_DIVIDE:
+            return divide_matrix(result, x, y);
+        default:
+            return axpby_matrix(result, alpha, x, beta, y);
+    }
+}
+
+/*
+ * Shared by the element-wise module functions and the / operator: stores `op` applied to the
+ * numc.Matrix operands x and y, broadcast to a common shape, to `out_obj` and returns a new
+ * reference to it. If `out_obj` is NULL or None the result goes to a new matrix instead, which
+ * is deferred in lazy mode. `out_obj` may be one of the operands; if it only partly overlaps
+ * one, the result goes through a temporary. Throws a type error if an argument is not a
+ * numc.Matrix and a value error if the shapes do not match.
+ */
+static PyObject *elementwise(elementwise_op op, PyObject *x_obj, PyObject *y_obj, double alpha,
+                             double beta, PyObject *out_obj) {
+    if (out_obj == Py_None) {
+        out_obj = NULL;
+    }
+    if (!PyObject_TypeCheck(x_obj, &Matrix61cType) || !PyObject_TypeCheck(y_obj, &Matrix61cType) ||
+        (out_obj != NULL && !PyObject_TypeCheck(out_obj, &Matrix61cType))) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be of type numc.Matrix");
+        return NULL;
+    }
+    Matrix61c *x = (Matrix61c *) x_obj, *y = (Matrix61c *) y_obj;
+    int rows, cols;
+    if (broadcast_dims(rows_of(x), cols_of(x), rows_of(y), cols_of(y), &rows, &cols) != 0) {
+        PyErr_SetString(PyExc_ValueError, "Arguments' dimensions invalid");
+        return NULL;
+    }
+    if (out_obj == NULL) {
+        PyObject *deferred;
+        if (op != ELEMENTWISE_AXPBY &&
+            defer_op(op == ELEMENTWISE_MULTIPLY ? EXPR_MUL : EXPR_DIV, x, y, &deferred)) {
+            return deferred;
+        }
+        if (materialize(x) < 0 || materialize(y) < 0) {
+            return NULL;
+        }
+        matrix *new_mat;
+        if (allocate_matrix_typed(&new_mat, rows, cols,
+                                  promote_dtype(x->mat->dtype, y->mat->dtype)) != 0) {
+            PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+            return NULL;
+        }
+        kernel_call call;
+        begin_kernel(&call, (long) rows * cols, x->mat, y->mat);
+        int op_result = elementwise_matrix(new_mat, op, x->mat, y->mat, alpha, beta);
+        end_kernel(&call);
+        return op_err(new_mat, op_result);
+    }
+    Matrix61c *out = (Matrix61c *) out_obj;
+    if (rows_of(out) != rows || cols_of(out) != cols) {
+        PyErr_SetString(PyExc_ValueError, "Output dimensions invalid");
+        return NULL;
+    }
+    if (flush_pending() < 0) {
+        return NULL;
+    }
+    matrix *target = out->mat, *temp = NULL;
+    if (views_overlap(target, x->mat) || views_overlap(target, y->mat)) {
+        if (allocate_matrix_typed(&temp, rows, cols, target->dtype) != 0) {
+            PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+            return NULL;
+        }
+        target = temp;
+    }
+    /* begin_kernel pins the operands; out's storage needs a pin of its own */
+    matrix *pin = retain_matrix(out->mat);
+    kernel_call call;
+    begin_kernel(&call, (long) rows * cols, x->mat, y->mat);
+    int op_result = elementwise_matrix(target, op, x->mat, y->mat, alpha, beta);
+    if (op_result == 0 && temp != NULL) {
+        copy_matrix(out->mat, temp);
+    }
+    end_kernel(&call);
+    deallocate_matrix(pin);
+    deallocate_matrix(temp);
+    if (op_result < 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return NULL;
+    }
+    Py_INCREF(out);
+    return out_obj;
+}
+
+/*
+ * numc.multiply(x, y, out=None). Returns the element-wise product of x and y, which are
+ * broadcast like the operands of +. With `out` the product is stored there instead, which may
+ * be x or y itself.
+ */
+static PyObject *Matrix61c_elementwise_multiply(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"x", "y", "out", NULL};
+    PyObject *x, *y, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|O", kwlist, &x, &y, &out)) {
+        return NULL;
+    }
+    return elementwise(ELEMENTWISE_MULTIPLY, x, y, 0, 0, out);
+}
+
+/* numc.divide(x, y, out=None). Element-wise x / y; see numc.multiply. */
+static PyObject *Matrix61c_elementwise_divide(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"x", "y", "out", NULL};
+    PyObject *x, *y, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|O", kwlist, &x, &y, &out)) {
+        return NULL;
+    }
+    return elementwise(ELEMENTWISE_DIVIDE, x, y, 0, 0, out);
+}
+
+/*
+ * numc.axpy(alpha, x, y, out=None). Returns alpha * x + y, computed in a single pass with one
+ * fused multiply-add per element. numc.axpy(alpha, x, y, out=y) updates y in place.
+ */
+static PyObject *Matrix61c_axpy(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"alpha", "x", "y", "out", NULL};
+    double alpha;
+    PyObject *x, *y, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "dOO|O", kwlist, &alpha, &x, &y, &out)) {
+        return NULL;
     }
-    ((Matrix61c *)self)->mat = new_mat;
-    ((Matrix61c *)self)->shape = PyTuple_Pack(2, PyLong_FromLong(rows), PyLong_FromLong(cols));
-    return 0;
+    return elementwise(ELEMENTWISE_AXPBY, x, y, alpha, 1, out);
 }
 
-/* Matrix(2d_list). Fill a matrix with dimension len(2d_list) * len(2d_list[0]) */
-static int init_2d(PyObject *self, PyObject *lst) {
-    int rows = PyList_Size(lst);
-    if (rows == 0) {
-        PyErr_SetString(PyExc_TypeError, "Cannot initialize numc.Matrix with an empty list");
-        return -1;
+/* numc.axpby(alpha, x, beta, y, out=None). Returns alpha * x + beta * y; see numc.axpy. */
+static PyObject *Matrix61c_axpby(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"alpha", "x", "beta", "y", "out", NULL};
+    double alpha, beta;
+    PyObject *x, *y, *out = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "dOdO|O", kwlist, &alpha, &x, &beta, &y,
+                                     &out)) {
+        return NULL;
     }
-    int cols;
-    if (!PyList_Check(PyList_GetItem(lst, 0))) {
-        PyErr_SetString(PyExc_TypeError, "List values not valid");
-        return -1;
+    return elementwise(ELEMENTWISE_AXPBY, x, y, alpha, beta, out);
+}
+
+/* Sets the exception for a failed save_npy or load_npy on the file at `path` */
+static void npy_error(int err, PyObject *path) {
+    if (err == NPY_IO_ERROR) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+    } else if (err == NPY_FORMAT_ERROR) {
+        PyErr_Format(PyExc_ValueError, "%R is not a .npy file of float32 or float64 values with "
+                     "at most 2 dimensions", path);
     } else {
-        cols = PyList_Size(PyList_GetItem(lst, 0));
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
     }
-    for (int i = 0; i < rows; i++) {
-        if (!PyList_Check(PyList_GetItem(lst, i)) || PyList_Size(PyList_GetItem(lst, i)) != cols) {
-            PyErr_SetString(PyExc_TypeError, "List values not valid");
-            return -1;
-        }
+}
+
+/*
+ * numc.save(path, mat). Writes mat to the file at path in NumPy's .npy format, which
+ * numpy.load and numc.load read back.
+ */
+static PyObject *Matrix61c_save(PyObject *self, PyObject *args) {
+    PyObject *path, *encoded, *mat;
+    if (!PyArg_ParseTuple(args, "OO!", &path, &Matrix61cType, &mat) ||
+        !PyUnicode_FSConverter(path, &encoded)) {
+        return NULL;
     }
-    matrix *new_mat;
-    int alloc_failed = allocate_matrix(&new_mat, rows, cols);
-    if (alloc_failed == -1){
-        PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
-        return alloc_failed;
-    }else if (alloc_failed == -2){
-        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
-        return alloc_failed;
+    Matrix61c *mat61c = (Matrix61c *)mat;
+    if (materialize(mat61c) < 0) {
+        Py_DECREF(encoded);
+        return NULL;
     }
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            set(new_mat, i, j, PyFloat_AsDouble(PyList_GetItem(PyList_GetItem(lst, i), j)));
-        }
+    kernel_call call;
+    begin_kernel(&call, (long) mat61c->mat->rows * mat61c->mat->cols, mat61c->mat, NULL);
+    int err = save_npy(PyBytes_AS_STRING(encoded), mat61c->mat);
+    end_kernel(&call);
+    Py_DECREF(encoded);
+    if (err != 0) {
+        npy_error(err, path);
+        return NULL;
     }
-    ((Matrix61c *)self)->mat = new_mat;
-    ((Matrix61c *)self)->shape = PyTuple_Pack(2, PyLong_FromLong(rows), PyLong_FromLong(cols));
-    return 0;
+    return Py_BuildValue("");
 }
 
-/* This deallocation function is called when reference count is 0*/
-static void Matrix61c_dealloc(Matrix61c *self) {
-    deallocate_matrix(self->mat);
-    Py_TYPE(self)->tp_free(self);
+/*
+ * numc.load(path, mmap=True). Reads a .npy file of float32 or float64 values with at most 2
+ * dimensions. With mmap the file is mapped copy-on-write rather than read, so even very large
+ * files open at once, pages are only read when used and the page cache is shared with other
+ * processes loading the same file. Writing to the matrix never changes the file.
+ */
+static PyObject *Matrix61c_load(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"path", "mmap", NULL};
+    PyObject *path, *encoded;
+    int map = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|p", kwlist, &path, &map) ||
+        !PyUnicode_FSConverter(path, &encoded)) {
+        return NULL;
+    }
+    matrix *new_mat;
+    PyThreadState *state = PyEval_SaveThread();
+    int err = load_npy(&new_mat, PyBytes_AS_STRING(encoded), map);
+    PyEval_RestoreThread(state);
+    Py_DECREF(encoded);
+    if (err != 0) {
+        npy_error(err, path);
+        return NULL;
+    }
+    return op_err(new_mat, 0);
 }
 
-/* For immutable types all initializations should take place in tp_new */
-static PyObject *Matrix61c_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
-    /* size of allocated memory is tp_basicsize + nitems*tp_itemsize*/
-    Matrix61c *self = (Matrix61c *)type->tp_alloc(type, 0);
-    return (PyObject *)self;
-}
+/* Add class methods */
+static PyMethodDef Matrix61c_class_methods[] = {
+    {"to_list", (PyCFunction)Matrix61c_class_to_list, METH_VARARGS, "Returns a list representation of numc.Matrix"},
+    {"set_isa", (PyCFunction)Matrix61c_set_isa, METH_VARARGS, "Selects the instruction set used by the kernels"},
+    {"get_isa", (PyCFunction)Matrix61c_get_isa, METH_NOARGS, "Returns the instruction set used by the kernels"},
+    {"trim_pool", (PyCFunction)Matrix61c_trim_pool, METH_NOARGS, "Releases idle pooled matrix memory"},
+    {"set_pool_limit", (PyCFunction)Matrix61c_set_pool_limit, METH_VARARGS, "Sets the number of idle bytes the matrix memory pool may keep"},
+    {"get_pool_limit", (PyCFunction)Matrix61c_get_pool_limit, METH_NOARGS, "Returns the number of idle bytes the matrix memory pool may keep"},
+    {"set_memory_budget", (PyCFunction)Matrix61c_set_memory_budget, METH_VARARGS, "Sets how many bytes of file-backed matrices an operation keeps in memory"},
+    {"get_memory_budget", (PyCFunction)Matrix61c_get_memory_budget, METH_NOARGS, "Returns how many bytes of file-backed matrices an operation keeps in memory"},
+    {"set_lazy", (PyCFunction)Matrix61c_set_lazy, METH_VARARGS, "Turns deferred evaluation of element-wise expressions on or off"},
+    {"get_lazy", (PyCFunction)Matrix61c_get_lazy, METH_NOARGS, "Returns whether element-wise expressions are deferred"},
+    {"set_printoptions", (PyCFunction)Matrix61c_set_printoptions, METH_VARARGS | METH_KEYWORDS, "Sets when and how repr() summarizes large matrices"},
+    {"get_printoptions", (PyCFunction)Matrix61c_get_printoptions, METH_NOARGS, "Returns the options repr() uses to summarize large matrices"},
+    {"set_num_threads", (PyCFunction)Matrix61c_set_num_threads, METH_VARARGS, "Sets the most threads a kernel may use"},
+    {"get_num_threads", (PyCFunction)Matrix61c_get_num_threads, METH_NOARGS, "Returns the most threads a kernel may use"},
+    {"set_parallel_threshold", (PyCFunction)Matrix61c_set_parallel_threshold, METH_VARARGS, "Sets the work per thread below which a kind of kernel runs serially"},
+    {"get_parallel_threshold", (PyCFunction)Matrix61c_get_parallel_threshold, METH_VARARGS, "Returns the work per thread below which a kind of kernel runs serially"},
+    {"calibrate", (PyCFunction)Matrix61c_calibrate, METH_NOARGS, "Measures and sets the parallel thresholds for this machine"},
+    {"set_matmul_algorithm", (PyCFunction)Matrix61c_set_matmul_algorithm, METH_VARARGS, "Selects how matrix products are computed"},
+    {"get_matmul_algorithm", (PyCFunction)Matrix61c_get_matmul_algorithm, METH_NOARGS, "Returns how matrix products are computed"},
+    {"set_strassen_cutoff", (PyCFunction)Matrix61c_set_strassen_cutoff, METH_VARARGS, "Sets the smallest dimension Strassen-Winograd still splits"},
+    {"get_strassen_cutoff", (PyCFunction)Matrix61c_get_strassen_cutoff, METH_NOARGS, "Returns the smallest dimension Strassen-Winograd still splits"},
+    {"batch_matmul", (PyCFunction)Matrix61c_batch_matmul, METH_VARARGS, "Multiplies batches of numc.Matrix pairwise"},
+    {"matrix_power_many", (PyCFunction)Matrix61c_matrix_power_many, METH_VARARGS, "Raises a square numc.Matrix to several integer powers at once"},
+    {"multiply", (PyCFunction)Matrix61c_elementwise_multiply, METH_VARARGS | METH_KEYWORDS, "Multiplies two numc.Matrix element-wise"},
+    {"divide", (PyCFunction)Matrix61c_elementwise_divide, METH_VARARGS | METH_KEYWORDS, "Divides two numc.Matrix element-wise"},
+    {"axpy", (PyCFunction)Matrix61c_axpy, METH_VARARGS | METH_KEYWORDS, "Computes alpha * x + y in one pass"},
+    {"axpby", (PyCFunction)Matrix61c_axpby, METH_VARARGS | METH_KEYWORDS, "Computes alpha * x + beta * y in one pass"},
+    {"save", (PyCFunction)Matrix61c_save, METH_VARARGS, "Writes a numc.Matrix to a .npy file"},
+    {"load", (PyCFunction)Matrix61c_load, METH_VARARGS | METH_KEYWORDS, "Reads or maps a numc.Matrix from a .npy file"},
+    {NULL, NULL, 0, NULL}
+};
 
-/* This matrix61c type is mutable, so needs init function. Return 0 on success otherwise -1 */
-static int Matrix61c_init(PyObject *self, PyObject *args, PyObject *kwds) {
-    /* Generate random matrices */
-    if (kwds != NULL) {
-        PyObject *rand = PyDict_GetItemString(kwds, "rand");
-        if (!rand) {
-            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+
+/* Growable character buffer repr() is written into */
+typedef struct repr_buffer {
+    char *data;
+    size_t len;
+    size_t capacity;
+} repr_buffer;
+
+/* Appends `len` characters to `buf`. Returns -1 with an exception set if it cannot grow. */
+static int repr_append(repr_buffer *buf, const char *str, size_t len) {
+    if (buf->len + len > buf->capacity) {
+        size_t capacity = buf->capacity * 2 > buf->len + len ? buf->capacity * 2 : buf->len + len;
+        char *data = PyMem_Realloc(buf->data, capacity);
+        if (data == NULL) {
+            PyErr_NoMemory();
             return -1;
         }
-        if (!PyBool_Check(rand)) {
-            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        buf->data = data;
+        buf->capacity = capacity;
+    }
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    return 0;
+}
+
+/* Appends row `row` of `mat` to `buf`, showing only `edge` columns at each end if `summarize` */
+static int repr_row(repr_buffer *buf, matrix *mat, int row, int summarize, int edge) {
+    if (repr_append(buf, "[", 1) < 0) {
+        return -1;
+    }
+    for (int j = 0; j < mat->cols; j++) {
+        if (summarize && j == edge && mat->cols > 2 * edge) {
+            if (repr_append(buf, "..., ", 5) < 0) {
+                return -1;
+            }
+            j = mat->cols - edge;
+        }
+        /* Formats like float.__repr__, so small matrices look exactly like their to_list() */
+        char *str = PyOS_double_to_string(
+            load(mat, (long) row * mat->row_stride + (long) j * mat->col_stride), 'r', 0,
+            Py_DTSF_ADD_DOT_0, NULL);
+        if (str == NULL) {
             return -1;
         }
-        if (rand != Py_True) {
-            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        int err = repr_append(buf, str, strlen(str));
+        PyMem_Free(str);
+        if (err < 0 || (j < mat->cols - 1 && repr_append(buf, ", ", 2) < 0)) {
             return -1;
         }
+    }
+    return repr_append(buf, "]", 1);
+}
 
-        PyObject *low = PyDict_GetItemString(kwds, "low");
-        PyObject *high = PyDict_GetItemString(kwds, "high");
-        PyObject *seed = PyDict_GetItemString(kwds, "seed");
-        double double_low = 0;
-        double double_high = 1;
-        unsigned int unsigned_seed = 0;
-
-        if (low) {
-            if (PyFloat_Check(low)) {
-                double_low = PyFloat_AsDouble(low);
-            } else if (PyLong_Check(low)) {
-                double_low = PyLong_AsLong(low);
-            }
+/*
+ * Matrix61c string representation. For printing purposes. Small matrices print as their nested
+ * list; ones with more than print_threshold elements are summarized (see set_printoptions).
+ * Values are formatted straight from the matrix data without building any Python objects.
+ */
+static PyObject *Matrix61c_repr(PyObject *self) {
+    if (materialize((Matrix61c *)self) < 0) {
+        return NULL;
+    }
+    matrix *mat = ((Matrix61c *)self)->mat;
+    int summarize = (long) mat->rows * mat->cols > print_threshold;
+    int edge = print_edgeitems;
+    repr_buffer buf = {NULL, 0, 0};
+    int err = repr_append(&buf, "[", 1);
+    for (int i = 0; i < mat->rows && err == 0; i++) {
+        if (summarize && i == edge && mat->rows > 2 * edge) {
+            err = repr_append(&buf, "..., ", 5);
+            i = mat->rows - edge;
         }
-
-        if (high) {
-            if (PyFloat_Check(high)) {
-                double_high = PyFloat_AsDouble(high);
-            } else if (PyLong_Check(high)) {
-                double_high = PyLong_AsLong(high);
-            }
+        if (err == 0) {
+            err = repr_row(&buf, mat, i, summarize, edge);
+        }
+        if (err == 0 && i < mat->rows - 1) {
+            err = repr_append(&buf, ", ", 2);
         }
+    }
+    if (err == 0) {
+        err = repr_append(&buf, "]", 1);
+    }
+    PyObject *rv = err == 0 ? PyUnicode_FromStringAndSize(buf.data, buf.len) : NULL;
+    PyMem_Free(buf.data);
+    return rv;
+}
 
-        if (double_low >= double_high) {
-            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+/*
+ * Resolves one component of a subscript key against a dimension of the given length. Integers
+ * (negative ones count from the end) give a single index with *step = 0, slices give
+ * start/step/count. Returns -1 with an exception set if the key is invalid or out of range.
+ */
+static int parse_index(PyObject *key, int length, Py_ssize_t *start, Py_ssize_t *step,
+                       Py_ssize_t *count) {
+    if (PyLong_Check(key)) {
+        Py_ssize_t index = PyLong_AsSsize_t(key);
+        if (index == -1 && PyErr_Occurred()) {
             return -1;
         }
-
-        // Set seed if argument exists
-        if (seed) {
-            if (PyLong_Check(seed)) {
-                unsigned_seed = PyLong_AsUnsignedLong(seed);
-            }
+        if (index < 0) {
+            index += length;
         }
-
-        PyObject *rows = NULL;
-        PyObject *cols = NULL;
-        if (PyArg_UnpackTuple(args, "args", 2, 2, &rows, &cols)) {
-            if (rows && cols && PyLong_Check(rows) && PyLong_Check(cols)) {
-                return init_rand(self, PyLong_AsLong(rows), PyLong_AsLong(cols), unsigned_seed, double_low, double_high);
-            }
-        } else {
-            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        if (index >= length || index < 0) {
+            PyErr_SetString(PyExc_IndexError, "Index out of range");
             return -1;
         }
-    }
-    PyObject *arg1 = NULL;
-    PyObject *arg2 = NULL;
-    PyObject *arg3 = NULL;
-    if (PyArg_UnpackTuple(args, "args", 1, 3, &arg1, &arg2, &arg3)) {
-        /* arguments are (rows, cols, val) */
-        if (arg1 && arg2 && arg3 && PyLong_Check(arg1) && PyLong_Check(arg2) && (PyLong_Check(arg3) || PyFloat_Check(arg3))) {
-            if (PyLong_Check(arg3)) {
-                return init_fill(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), PyLong_AsLong(arg3));
-            }
-            else
-                return init_fill(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), PyFloat_AsDouble(arg3));
-        } else if (arg1 && arg2 && arg3 && PyLong_Check(arg1) && PyLong_Check(arg2) && PyList_Check(arg3)) {
-            /* Matrix(rows, cols, 1D list) */
-            return init_1d(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), arg3);
-        } else if (arg1 && PyList_Check(arg1) && arg2 == NULL && arg3 == NULL) {
-            /* Matrix(rows, cols, 1D list) */
-            return init_2d(self, arg1);
-        } else if (arg1 && arg2 && PyLong_Check(arg1) && PyLong_Check(arg2) && arg3 == NULL) {
-            /* Matrix(rows, cols, 1D list) */
-            return init_fill(self, PyLong_AsLong(arg1), PyLong_AsLong(arg2), 0);
-        } else {
-            PyErr_SetString(PyExc_TypeError, "Invalid arguments");
+        *start = index;
+        *step = 0;
+        *count = 1;
+        return 0;
+    } else if (PySlice_Check(key)) {
+        Py_ssize_t stop;
+        if (PySlice_GetIndicesEx(key, length, start, &stop, step, count) < 0) {
             return -1;
         }
-    } else {
-        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
-        return -1;
-    }
-}
-
-/* List of lists representations for matrices */
-static PyObject *Matrix61c_to_list(Matrix61c *self) {
-    int rows = self->mat->rows;
-    int cols = self->mat->cols;
-    PyObject *py_lst = PyList_New(rows);
-    for (int i = 0; i < rows; i++) {
-        PyList_SetItem(py_lst, i, PyList_New(cols));
-        PyObject *curr_row = PyList_GetItem(py_lst, i);
-        for (int j = 0; j < cols; j++) {
-            PyList_SetItem(curr_row, j, PyFloat_FromDouble(get(self->mat, i, j)));
+        if (*count <= 0) {
+            PyErr_SetString(PyExc_ValueError, "Slice info not valid");
+            return -1;
         }
+        return 0;
     }
-    return py_lst;
+    PyErr_SetString(PyExc_TypeError, "Key is not valid");
+    return -1;
 }
 
-/* Class function which acts as a helper function to Matrix61c_to_list */
-static PyObject *Matrix61c_class_to_list(Matrix61c *self, PyObject *args) {
-    PyObject *mat = NULL;
-    if (PyArg_UnpackTuple(args, "args", 1, 1, &mat)) {
-        if (!PyObject_TypeCheck(mat, &Matrix61cType)) {
-            PyErr_SetString(PyExc_TypeError, "Argument must of type numc.Matrix!");
-            return NULL;
+/*
+ * Turns a slice/tuple key into the strided view of self->mat it selects. A single key selects
+ * rows, except on single-row matrices where it selects columns. Integer components keep their
+ * dimension with length 1. Returns -1 with an exception set on failure.
+ */
+static int subscript_view(Matrix61c *self, PyObject *key, matrix **view) {
+    matrix *mat = self->mat;
+    PyObject *row_key = key;
+    PyObject *col_key = NULL;
+    if (PyTuple_Check(key)) {
+        if (PyTuple_Size(key) != 2) {
+            PyErr_SetString(PyExc_TypeError, "Key is not valid");
+            return -1;
         }
-        Matrix61c* mat61c = (Matrix61c*)mat;
-        return Matrix61c_to_list(mat61c);
-    } else {
-        PyErr_SetString(PyExc_TypeError, "Invalid arguments");
-        return NULL;
+        row_key = PyTuple_GetItem(key, 0);
+        col_key = PyTuple_GetItem(key, 1);
+    } else if (mat->rows == 1) {
+        row_key = NULL;
+        col_key = key;
     }
-}
-
-
-/* Add class methods */
-static PyMethodDef Matrix61c_class_methods[] = {
-    {"to_list", (PyCFunction)Matrix61c_class_to_list, METH_VARARGS, "Returns a list representation of numc.Matrix"},
-    {NULL, NULL, 0, NULL}
-};
-
-
-/* Matrix61c string representation. For printing purposes. */
-static PyObject *Matrix61c_repr(PyObject *self) {
-    PyObject *py_lst = Matrix61c_to_list((Matrix61c *)self);
-    return PyObject_Repr(py_lst);
+    Py_ssize_t row_start = 0, row_step = 1, rows = mat->rows;
+    Py_ssize_t col_start = 0, col_step = 1, cols = mat->cols;
+    if (row_key != NULL && parse_index(row_key, mat->rows, &row_start, &row_step, &rows) < 0) {
+        return -1;
+    }
+    if (col_key != NULL && parse_index(col_key, mat->cols, &col_start, &col_step, &cols) < 0) {
+        return -1;
+    }
+    long offset = row_start * mat->row_stride + col_start * mat->col_stride;
+    int ref_failed = allocate_matrix_view(view, mat, offset, rows, cols,
+                                          row_step * mat->row_stride, col_step * mat->col_stride);
+    if (ref_failed == -1){
+        PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
+        return -1;
+    }else if (ref_failed == -2){
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return -1;
+    }
+    return 0;
 }
 
 /* For __getitem__. (e.g. mat[0])
-Uses allocate_matrix_ref to return a new matrix from the original as a slice if we are dealing with multiple dimension matrix
+Uses allocate_matrix_ref to return a new matrix from the original as a slice if we are dealing with multiple dimension matrix.
+Slices and (row, col) tuples such as mat[1:3, ::2] return strided views that share self's data;
+a view with a single element is returned as a float.
 */
 static PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
+	if (materialize(self) < 0) {
+		return NULL;
+	}
+	if (PySlice_Check(key) || PyTuple_Check(key) || (PyLong_Check(key) && self->mat->rows == 1)) {
+		matrix *view;
+		if (subscript_view(self, key, &view) < 0) {
+			return NULL;
+		}
+		if (view->rows == 1 && view->cols == 1) {
+			double val = get(view, 0, 0);
+			deallocate_matrix(view);
+			return PyFloat_FromDouble(val);
+		}
+		return op_err(view, 0);
+	}
 	if (!PyLong_Check(key)) {
 		PyErr_SetString(PyExc_TypeError, "Key is not valid");
         return NULL;
@@ -319,7 +2142,8 @@ static PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
         return NULL;
 	}
 	matrix *new_mat;
-    int ref_failed = allocate_matrix_ref(&new_mat, self->mat, index * self->mat->cols, self->mat->cols, 1);
+    int ref_failed = allocate_matrix_view(&new_mat, self->mat, (long) index * self->mat->row_stride,
+                                          self->mat->cols, 1, self->mat->col_stride, 1);
     if (ref_failed == -1){
         PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
         return NULL;
@@ -327,17 +2151,107 @@ static PyObject *Matrix61c_subscript(Matrix61c* self, PyObject* key) {
         PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
         return NULL;
     }
-    Matrix61c* rv = (Matrix61c*) Matrix61c_new(&Matrix61cType, NULL, NULL);
-    rv->mat = new_mat;
-    rv->shape = PyTuple_Pack(2, PyLong_FromLong(new_mat->rows), PyLong_FromLong(1));
     if (new_mat->rows == 1) { // if one single number, unwrap from list
-    	return PyFloat_FromDouble(new_mat->data[0]);
+        double val = get(new_mat, 0, 0);
+        deallocate_matrix(new_mat);
+    	return PyFloat_FromDouble(val);
     }
-    return (PyObject*)rv;
+    return op_err(new_mat, 0);
+}
+
+/*
+ * Assigns `v` to every element of the view for __setitem__ with slice/tuple keys. `v` can be a
+ * number, a numc.Matrix of the same shape, or a (nested) list with one value per element.
+ */
+static int assign_view(matrix *view, PyObject *v) {
+	if (PyFloat_Check(v) || PyLong_Check(v)) {
+		double val = PyFloat_AsDouble(v);
+		if (val == -1 && PyErr_Occurred()) {
+			return -1;
+		}
+		fill_matrix(view, val);
+		return 0;
+	}
+	if (PyObject_TypeCheck(v, &Matrix61cType)) {
+		matrix *src = ((Matrix61c *) v)->mat;
+		if (src->rows != view->rows || src->cols != view->cols) {
+			PyErr_SetString(PyExc_ValueError, "Value has the wrong dimensions");
+			return -1;
+		}
+		/* Go through a copy if the two share memory, so no element is read after it was written */
+		if (views_overlap(view, src)) {
+			matrix *copy;
+			if (allocate_matrix_typed(&copy, src->rows, src->cols, src->dtype) != 0) {
+				PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+				return -1;
+			}
+			copy_matrix(copy, src);
+			copy_matrix(view, copy);
+			deallocate_matrix(copy);
+		} else {
+			copy_matrix(view, src);
+		}
+		return 0;
+	}
+	if (!PyList_Check(v)) {
+		PyErr_SetString(PyExc_TypeError, "Value is not valid");
+		return -1;
+	}
+	/* A flat list fills a single row or column, a nested list fills rows */
+	int nested = view->rows > 1 && view->cols > 1;
+	int outer = nested ? view->rows : view->rows * view->cols;
+	if (PyList_Size(v) != outer) {
+		PyErr_SetString(PyExc_ValueError, "Value has the wrong dimensions");
+		return -1;
+	}
+	for (int i = 0; i < outer; i++) {
+		PyObject *item = PyList_GetItem(v, i);
+		int inner = nested ? view->cols : 1;
+		if (nested && (!PyList_Check(item) || PyList_Size(item) != inner)) {
+			PyErr_SetString(PyExc_ValueError, "Value has the wrong dimensions");
+			return -1;
+		}
+		for (int j = 0; j < inner; j++) {
+			PyObject *value = nested ? PyList_GetItem(item, j) : item;
+			if (!PyFloat_Check(value) && !PyLong_Check(value)) {
+				PyErr_SetString(PyExc_TypeError, "Value is not valid");
+				return -1;
+			}
+		}
+	}
+	for (int i = 0; i < outer; i++) {
+		PyObject *item = PyList_GetItem(v, i);
+		if (nested) {
+			for (int j = 0; j < view->cols; j++) {
+				set(view, i, j, PyFloat_AsDouble(PyList_GetItem(item, j)));
+			}
+		} else if (view->rows == 1) {
+			set(view, 0, i, PyFloat_AsDouble(item));
+		} else {
+			set(view, i, 0, PyFloat_AsDouble(item));
+		}
+	}
+	return 0;
 }
 
 /* For __setitem__ (e.g. mat[0] = 1) */
 static int Matrix61c_set_subscript(Matrix61c* self, PyObject *key, PyObject *v) {
+	if (v == NULL) {
+		PyErr_SetString(PyExc_TypeError, "Cannot delete matrix elements");
+		return -1;
+	}
+	if (flush_pending() < 0) {
+		return -1;
+	}
+	if (PySlice_Check(key) || PyTuple_Check(key) || (PyLong_Check(key) && self->mat->rows == 1)) {
+		matrix *view;
+		if (subscript_view(self, key, &view) < 0) {
+			return -1;
+		}
+		int assign_failed = assign_view(view, v);
+		deallocate_matrix(view);
+		return assign_failed;
+	}
 	if (!PyLong_Check(key)) {
 		PyErr_SetString(PyExc_TypeError, "Key is not valid");
         return -1;
@@ -373,18 +2287,191 @@ static int Matrix61c_set_subscript(Matrix61c* self, PyObject *key, PyObject *v)
 	return -1;
 }
 
-static PyMappingMethods Matrix61c_mapping = {
-	NULL,
-	(binaryfunc) Matrix61c_subscript,
-	(objobjargproc) Matrix61c_set_subscript,
-};
+/*
+ * Buffer protocol (PEP 3118). Exposes mat->data directly as a writable rows x cols array of
+ * doubles, so memoryview(m) and numpy.asarray(m) share memory with the matrix. Strided views
+ * are exported with their strides and refused to consumers that need contiguous memory.
+ */
+static int Matrix61c_getbuffer(Matrix61c *self, Py_buffer *view, int flags) {
+    if (flush_pending() < 0) {
+        view->obj = NULL;
+        return -1;
+    }
+    matrix *mat = self->mat;
+    if (mat == NULL) {
+        PyErr_SetString(PyExc_BufferError, "Matrix is not initialized");
+        view->obj = NULL;
+        return -1;
+    }
+    if ((flags & PyBUF_STRIDES) != PyBUF_STRIDES && !is_contiguous(mat)) {
+        PyErr_SetString(PyExc_BufferError, "Matrix is a strided view and not contiguous");
+        view->obj = NULL;
+        return -1;
+    }
+    self->buffer_shape[0] = mat->rows;
+    self->buffer_shape[1] = mat->cols;
+    Py_ssize_t itemsize = dtype_size(mat->dtype);
+    self->buffer_strides[0] = (Py_ssize_t) mat->row_stride * itemsize;
+    self->buffer_strides[1] = (Py_ssize_t) mat->col_stride * itemsize;
+    view->buf = mat->data;
+    view->obj = (PyObject *) self;
+    Py_INCREF(self);
+    view->len = (Py_ssize_t) mat->rows * mat->cols * itemsize;
+    view->readonly = 0;
+    view->itemsize = itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? (mat->dtype == DTYPE_FLOAT32 ? "f" : "d") : NULL;
+    view->ndim = 2;
+    view->shape = (flags & PyBUF_ND) ? self->buffer_shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->buffer_strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    self->exports++;
+    live_exports++;
+    return 0;
+}
+
+static void Matrix61c_releasebuffer(Matrix61c *self, Py_buffer *view) {
+    self->exports--;
+    live_exports--;
+}
+
+static PyBufferProcs Matrix61c_as_buffer = {
+    (getbufferproc) Matrix61c_getbuffer,
+    (releasebufferproc) Matrix61c_releasebuffer,
+};
+
+static PyMappingMethods Matrix61c_mapping = {
+	NULL,
+	(binaryfunc) Matrix61c_subscript,
+	(objobjargproc) Matrix61c_set_subscript,
+};
+
+
+/*
+ * Checks whether `a` and `b` are a numc.Matrix and a Python int or float, in either order. If
+ * so, stores the matrix to *mat, the number to *value and whether the number is the left
+ * operand to *reversed, and returns 1. Returns 0 for any other operands and -1 if the number
+ * does not fit in a double.
+ */
+static int scalar_operands(PyObject *a, PyObject *b, Matrix61c **mat, double *value,
+                           int *reversed) {
+    int reverse = !PyObject_TypeCheck(a, &Matrix61cType);
+    PyObject *matrix_arg = reverse ? b : a;
+    PyObject *number = reverse ? a : b;
+    if (!PyObject_TypeCheck(matrix_arg, &Matrix61cType) ||
+        !(PyFloat_Check(number) || PyLong_Check(number))) {
+        return 0;
+    }
+    double v = PyFloat_AsDouble(number);
+    if (v == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    *mat = (Matrix61c *) matrix_arg;
+    *value = v;
+    *reversed = reverse;
+    return 1;
+}
+
+/* Stores the scalar operation `op` (see expr_apply_scalar) applied to `mat` to `result` */
+static int scalar_matrix(matrix *result, matrix *mat, expr_op op, double alpha, double beta) {
+    if (op == EXPR_AFFINE) {
+        return affine_matrix(result, mat, alpha, beta);
+    }
+    return div_scalar_matrix(result, mat, alpha, op == EXPR_RDIV_SCALAR);
+}
+
+/*
+ * Returns a new numc.Matrix of self's type holding the scalar operation `op` applied to self.
+ * Only self is read: the scalars go straight to the kernel rather than into a filled matrix.
+ */
+static PyObject *scalar_result(Matrix61c *self, expr_op op, double alpha, double beta) {
+    PyObject *deferred;
+    if (defer_scalar(op, self, alpha, beta, &deferred)) {
+        return deferred;
+    }
+    if (materialize(self) < 0) {
+        return NULL;
+    }
+    matrix *mat = self->mat;
+    matrix *new_mat;
+    if (allocate_matrix_typed(&new_mat, mat->rows, mat->cols, mat->dtype) != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return NULL;
+    }
+    kernel_call call;
+    begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+    int op_result = scalar_matrix(new_mat, mat, op, alpha, beta);
+    end_kernel(&call);
+    return op_err(new_mat, op_result);
+}
+
+/* Applies the scalar operation `op` to self's storage for the in-place operators */
+static PyObject *inplace_scalar(Matrix61c *self, expr_op op, double alpha, double beta) {
+    if (flush_pending() < 0) {
+        return NULL;
+    }
+    matrix *mat = self->mat;
+    kernel_call call;
+    begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+    scalar_matrix(mat, mat, op, alpha, beta);
+    end_kernel(&call);
+    Py_INCREF(self);
+    return (PyObject *) self;
+}
 
+/*
+ * Handles the arithmetic operator `op` ('+', '-', '*' or '/') when one of `a` and `b` is a
+ * number: stores the result (NULL on error) to *result and returns 1. Returns 0, leaving the
+ * operands to the matrix operator, if neither is a number. `inplace` applies the operator to
+ * `a`'s storage.
+ */
+static int scalar_arithmetic(char op, PyObject *a, PyObject *b, int inplace, PyObject **result) {
+    Matrix61c *self;
+    double value;
+    int reversed;
+    int found = scalar_operands(a, b, &self, &value, &reversed);
+    if (found == 0) {
+        return 0;
+    }
+    *result = NULL;
+    if (found < 0) {
+        return 1;
+    }
+    expr_op node = EXPR_AFFINE;
+    double alpha = 1, beta = 0;
+    switch (op) {
+        case '+':
+            beta = value;
+            break;
+        case '-':
+            /* s - m is -m + s */
+            alpha = reversed ? -1 : 1;
+            beta = reversed ? value : -value;
+            break;
+        case '*':
+            alpha = value;
+            break;
+        default:
+            node = reversed ? EXPR_RDIV_SCALAR : EXPR_DIV_SCALAR;
+            alpha = value;
+            break;
+    }
+    *result = inplace ? inplace_scalar(self, node, alpha, beta) :
+                        scalar_result(self, node, alpha, beta);
+    return 1;
+}
 
 /*
  * Adds two numc.Matrix (Matrix61c) objects together. The first operand is self, and
- * the second operand can be obtained by casting `args`.
+ * the second operand can be obtained by casting `args`. A 1 x N or M x 1 operand is broadcast
+ * across the other one's rows or columns, NumPy style, without being copied. Either operand
+ * may instead be an int or float, which is added to every element.
  */
 static PyObject *Matrix61c_add(Matrix61c* self, PyObject* args) {
+    PyObject *rv;
+    if (scalar_arithmetic('+', (PyObject *) self, args, 0, &rv)) {
+        return rv;
+    }
     Matrix61c* other = NULL;
     int args_invalid = number_methods_err("+", args, self, other);
     if (args_invalid)
@@ -392,31 +2479,53 @@ static PyObject *Matrix61c_add(Matrix61c* self, PyObject* args) {
     else {
         other = (Matrix61c*)args;
     }
-    matrix *new_mat;
-    matrix *mat1 = self->mat;
-    matrix *mat2 = other->mat;
-    if (mat1->rows != mat2->rows || mat1->cols != mat2->cols) {
+    int rows, cols;
+    if (broadcast_dims(rows_of(self), cols_of(self), rows_of(other), cols_of(other), &rows,
+                       &cols) != 0) {
         PyErr_SetString(PyExc_ValueError, "Arguments' dimensions invalid");
         return NULL;
     }
-    int alloc_failed = allocate_matrix(&new_mat, self->mat->rows, self->mat->cols);
+    PyObject *deferred;
+    if (defer_op(EXPR_ADD, self, other, &deferred)) {
+        return deferred;
+    }
+    if (materialize(self) < 0 || materialize(other) < 0) {
+        return NULL;
+    }
+    matrix *new_mat;
+    int alloc_failed = allocate_matrix_like(&new_mat, rows, cols,
+                                            promote_dtype(self->mat->dtype, other->mat->dtype),
+                                            self->mat, other->mat);
     if (alloc_failed == -1){
         PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
         return NULL;
     }else if (alloc_failed == -2){
         PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
         return NULL;
+    }else if (alloc_failed == -3){
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
     }
 
-    int add_result = add_matrix(new_mat, self->mat, other->mat);
+    matrix *mat1 = self->mat;
+    matrix *mat2 = other->mat;
+    kernel_call call;
+    begin_kernel(&call, (long) rows * cols, mat1, mat2);
+    int add_result = add_matrix(new_mat, mat1, mat2);
+    end_kernel(&call);
     return op_err(new_mat, add_result);
 }
 
 /*
  * Subtracts the second numc.Matrix (Matrix61c) object from the first one. The first operand is
- * self, and the second operand can be obtained by casting `args`.
+ * self, and the second operand can be obtained by casting `args`. Operands are broadcast and
+ * numbers accepted as with +.
  */
 static PyObject *Matrix61c_sub(Matrix61c* self, PyObject* args) {
+    PyObject *rv;
+    if (scalar_arithmetic('-', (PyObject *) self, args, 0, &rv)) {
+        return rv;
+    }
     Matrix61c* other = NULL;
     int args_invalid = number_methods_err("-", args, self, other);
     if (args_invalid)
@@ -425,30 +2534,52 @@ static PyObject *Matrix61c_sub(Matrix61c* self, PyObject* args) {
         other = (Matrix61c*)args;
     }
 
-    matrix *new_mat;
-    matrix *mat1 = self->mat;
-    matrix *mat2 = other->mat;
-    if (mat1->rows != mat2->rows || mat1->cols != mat2->cols) {
+    int rows, cols;
+    if (broadcast_dims(rows_of(self), cols_of(self), rows_of(other), cols_of(other), &rows,
+                       &cols) != 0) {
         PyErr_SetString(PyExc_ValueError, "Arguments' dimensions invalid");
         return NULL;
     }
-    int alloc_failed = allocate_matrix(&new_mat, self->mat->rows, self->mat->cols);
+    PyObject *deferred;
+    if (defer_op(EXPR_SUB, self, other, &deferred)) {
+        return deferred;
+    }
+    if (materialize(self) < 0 || materialize(other) < 0) {
+        return NULL;
+    }
+    matrix *new_mat;
+    int alloc_failed = allocate_matrix_like(&new_mat, rows, cols,
+                                            promote_dtype(self->mat->dtype, other->mat->dtype),
+                                            self->mat, other->mat);
     if (alloc_failed == -1){
         PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
         return NULL;
     }else if (alloc_failed == -2){
         PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
         return NULL;
+    }else if (alloc_failed == -3){
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
     }
-    int sub_result = sub_matrix(new_mat, self->mat, other->mat);
+    matrix *mat1 = self->mat;
+    matrix *mat2 = other->mat;
+    kernel_call call;
+    begin_kernel(&call, (long) rows * cols, mat1, mat2);
+    int sub_result = sub_matrix(new_mat, mat1, mat2);
+    end_kernel(&call);
     return op_err(new_mat, sub_result);
 }
 
 /*
  * Multiplies two numc.Matrix (Matrix61c) objects together. The first operand is self, and
- * the second operand can be obtained by casting `args`.
+ * the second operand can be obtained by casting `args`. If either operand is an int or float,
+ * the matrix is scaled by it instead.
  */
 static PyObject *Matrix61c_multiply(Matrix61c* self, PyObject *args) {
+    PyObject *rv;
+    if (scalar_arithmetic('*', (PyObject *) self, args, 0, &rv)) {
+        return rv;
+    }
     Matrix61c* other = NULL;
     int args_invalid = number_methods_err("*", args, self, other);
     if (args_invalid)
@@ -457,6 +2588,9 @@ static PyObject *Matrix61c_multiply(Matrix61c* self, PyObject *args) {
         other = (Matrix61c*)args;
     }
 
+    if (materialize(self) < 0 || materialize(other) < 0) {
+        return NULL;
+    }
     matrix *new_mat;
     matrix *mat1 = self->mat;
     matrix *mat2 = other->mat;
@@ -464,24 +2598,55 @@ static PyObject *Matrix61c_multiply(Matrix61c* self, PyObject *args) {
         PyErr_SetString(PyExc_ValueError, "Arguments' dimensions invalid");
         return NULL;
     }
-    int alloc_failed = allocate_matrix(&new_mat, self->mat->rows, other->mat->cols);
+    int alloc_failed = allocate_matrix_like(&new_mat, self->mat->rows, other->mat->cols,
+                                            promote_dtype(mat1->dtype, mat2->dtype), mat1, mat2);
     if (alloc_failed == -1){
         PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
         return NULL;
     }else if (alloc_failed == -2){
         PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
         return NULL;
+    }else if (alloc_failed == -3){
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
     }
-    int mul_result = mul_matrix(new_mat, self->mat, other->mat);
+    kernel_call call;
+    begin_kernel(&call, (long) mat1->rows * mat1->cols * mat2->cols, mat1, mat2);
+    int mul_result = mul_matrix(new_mat, mat1, mat2);
+    end_kernel(&call);
     return op_err(new_mat, mul_result);
 }
 
+/*
+ * Divides two numc.Matrix element-wise, broadcasting them like +. Either operand may instead
+ * be an int or float, which every element is divided by or divides.
+ */
+static PyObject *Matrix61c_true_divide(PyObject *self, PyObject *args) {
+    PyObject *rv;
+    if (scalar_arithmetic('/', self, args, 0, &rv)) {
+        return rv;
+    }
+    if (!PyObject_TypeCheck(self, &Matrix61cType) || !PyObject_TypeCheck(args, &Matrix61cType)) {
+        PyErr_SetString(PyExc_TypeError, "numc.matrix does not support / with other types");
+        return NULL;
+    }
+    return elementwise(ELEMENTWISE_DIVIDE, self, args, 0, 0, NULL);
+}
+
 /*
  * Negates the given numc.Matrix (Matrix61c).
  */
 static PyObject *Matrix61c_neg(Matrix61c* self) {
+    PyObject *deferred;
+    if (defer_op(EXPR_NEG, self, NULL, &deferred)) {
+        return deferred;
+    }
+    if (materialize(self) < 0) {
+        return NULL;
+    }
     matrix *new_mat;
-    int alloc_failed = allocate_matrix(&new_mat, self->mat->rows, self->mat->cols);
+    int alloc_failed = allocate_matrix_typed(&new_mat, self->mat->rows, self->mat->cols,
+                                             self->mat->dtype);
     if (alloc_failed == -1){
         PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
         return NULL;
@@ -489,7 +2654,11 @@ static PyObject *Matrix61c_neg(Matrix61c* self) {
         PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
         return NULL;
     }
-    int neg_result = neg_matrix(new_mat, self->mat);
+    matrix *mat = self->mat;
+    kernel_call call;
+    begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+    int neg_result = neg_matrix(new_mat, mat);
+    end_kernel(&call);
     return op_err(new_mat, neg_result);
 }
 
@@ -497,8 +2666,16 @@ static PyObject *Matrix61c_neg(Matrix61c* self) {
  * Take the element-wise absolute value of this numc.Matrix (Matrix61c).
  */
 static PyObject *Matrix61c_abs(Matrix61c *self) {
+    PyObject *deferred;
+    if (defer_op(EXPR_ABS, self, NULL, &deferred)) {
+        return deferred;
+    }
+    if (materialize(self) < 0) {
+        return NULL;
+    }
     matrix *new_mat;
-    int alloc_failed = allocate_matrix(&new_mat, self->mat->rows, self->mat->cols);
+    int alloc_failed = allocate_matrix_typed(&new_mat, self->mat->rows, self->mat->cols,
+                                             self->mat->dtype);
     if (alloc_failed == -1){
         PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
         return NULL;
@@ -506,7 +2683,11 @@ static PyObject *Matrix61c_abs(Matrix61c *self) {
         PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
         return NULL;
     }
-    int abs_result = abs_matrix(new_mat, self->mat);
+    matrix *mat = self->mat;
+    kernel_call call;
+    begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+    int abs_result = abs_matrix(new_mat, mat);
+    end_kernel(&call);
     return op_err(new_mat, abs_result);
 }
 
@@ -514,6 +2695,9 @@ static PyObject *Matrix61c_abs(Matrix61c *self) {
  * Raise numc.Matrix (Matrix61c) to the `pow`th power. You can ignore the argument `optional`.
  */
 static PyObject *Matrix61c_pow(Matrix61c *self, PyObject *pow, PyObject *optional) {
+    if (materialize(self) < 0) {
+        return NULL;
+    }
     if (self->mat->rows != self->mat->cols) {
         PyErr_SetString(PyExc_ValueError, "Matrix must be square");
         return NULL;
@@ -528,7 +2712,8 @@ static PyObject *Matrix61c_pow(Matrix61c *self, PyObject *pow, PyObject *optiona
             return NULL;
         }
         matrix *new_mat;
-        int alloc_failed = allocate_matrix(&new_mat, self->mat->rows, self->mat->cols);
+        int alloc_failed = allocate_matrix_typed(&new_mat, self->mat->rows, self->mat->cols,
+                                                 self->mat->dtype);
         if (alloc_failed == -1){
             PyErr_SetString(PyExc_ValueError, "Dimensions must be positive");
             return NULL;
@@ -536,11 +2721,147 @@ static PyObject *Matrix61c_pow(Matrix61c *self, PyObject *pow, PyObject *optiona
             PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
             return NULL;
         }
-        int pow_result = pow_matrix(new_mat, self->mat, pow_c);
+        matrix *mat = self->mat;
+        kernel_call call;
+        long n = mat->rows;
+        begin_kernel(&call, pow_c > 1 ? n * n * n : n * n, mat, NULL);
+        int pow_result = pow_matrix(new_mat, mat, pow_c);
+        end_kernel(&call);
         return op_err(new_mat, pow_result);
     }
 }
 
+/*
+ * Stores the matrix of `result` (a new numc.Matrix computed from self) into self for the
+ * in-place operators. If no slice, buffer export or other owner can see self's data, self
+ * simply takes over result's storage and its old storage goes back to the pool. Otherwise
+ * result is copied into self's storage so that slices stay in sync and self keeps its element
+ * type. If that is impossible
+ * because the shape changed, result itself is returned, as for the non in-place operator.
+ */
+static PyObject *inplace_result(Matrix61c *self, PyObject *result) {
+    if (result == NULL) {
+        return NULL;
+    }
+    if (flush_pending() < 0) {
+        Py_DECREF(result);
+        return NULL;
+    }
+    Matrix61c *rv = (Matrix61c *) result;
+    matrix *mat = self->mat;
+    /* A kernel on another thread may hold a reference (see begin_kernel) */
+    int shared = __atomic_load_n(&mat->ref_cnt, __ATOMIC_ACQUIRE) != 1;
+    if (mat->parent == NULL && !shared && mat->release == NULL && self->exports == 0 &&
+        mat->dtype == rv->mat->dtype) {
+        PyObject *shape = self->shape;
+        self->mat = rv->mat;
+        self->shape = rv->shape;
+        rv->mat = mat;
+        rv->shape = shape;
+    } else if (mat->rows == rv->mat->rows && mat->cols == rv->mat->cols) {
+        kernel_call call;
+        begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+        copy_matrix(mat, rv->mat);
+        end_kernel(&call);
+    } else {
+        return result;
+    }
+    Py_DECREF(result);
+    Py_INCREF(self);
+    return (PyObject *) self;
+}
+
+/*
+ * Shared by the element-wise in-place operators: checks `args` and applies `op` to self's
+ * storage, going through a temporary only if the operands partially overlap.
+ */
+static PyObject *inplace_elementwise(Matrix61c *self, PyObject *args, const char *op_name,
+                                     int (*op)(matrix *, matrix *, matrix *)) {
+    Matrix61c* other = NULL;
+    int args_invalid = number_methods_err(op_name, args, self, other);
+    if (args_invalid)
+        return NULL;
+    else {
+        other = (Matrix61c*)args;
+    }
+    if (flush_pending() < 0) {
+        return NULL;
+    }
+    matrix *mat1 = self->mat;
+    matrix *mat2 = other->mat;
+    /* The other operand may be broadcast to self's shape, but not the other way around */
+    int rows, cols;
+    if (broadcast_dims(mat1->rows, mat1->cols, mat2->rows, mat2->cols, &rows, &cols) != 0 ||
+        rows != mat1->rows || cols != mat1->cols) {
+        PyErr_SetString(PyExc_ValueError, "Arguments' dimensions invalid");
+        return NULL;
+    }
+    if (views_overlap(mat1, mat2)) {
+        matrix *new_mat;
+        int alloc_failed = allocate_matrix_typed(&new_mat, mat1->rows, mat1->cols, mat1->dtype);
+        if (alloc_failed == -2){
+            PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+            return NULL;
+        }
+        kernel_call call;
+        begin_kernel(&call, (long) mat1->rows * mat1->cols, mat1, mat2);
+        int op_result = op(new_mat, mat1, mat2);
+        end_kernel(&call);
+        return inplace_result(self, op_err(new_mat, op_result));
+    }
+    kernel_call call;
+    begin_kernel(&call, (long) mat1->rows * mat1->cols, mat1, mat2);
+    op(mat1, mat1, mat2);
+    end_kernel(&call);
+    Py_INCREF(self);
+    return (PyObject *) self;
+}
+
+/* a += b. Adds the second numc.Matrix, or a number, into self's storage without allocating. */
+static PyObject *Matrix61c_inplace_add(Matrix61c* self, PyObject* args) {
+    PyObject *rv;
+    if (scalar_arithmetic('+', (PyObject *) self, args, 1, &rv)) {
+        return rv;
+    }
+    return inplace_elementwise(self, args, "+=", add_matrix);
+}
+
+/* a -= b. Subtracts the second numc.Matrix from self's storage without allocating. */
+static PyObject *Matrix61c_inplace_sub(Matrix61c* self, PyObject* args) {
+    PyObject *rv;
+    if (scalar_arithmetic('-', (PyObject *) self, args, 1, &rv)) {
+        return rv;
+    }
+    return inplace_elementwise(self, args, "-=", sub_matrix);
+}
+
+/*
+ * a *= b. The product is computed into a scratch matrix from the pool which then becomes
+ * self's storage (or is copied into it if self has slices), so nothing is allocated from the
+ * system in steady state. A number scales self's storage directly.
+ */
+static PyObject *Matrix61c_inplace_multiply(Matrix61c* self, PyObject *args) {
+    PyObject *rv;
+    if (scalar_arithmetic('*', (PyObject *) self, args, 1, &rv)) {
+        return rv;
+    }
+    return inplace_result(self, Matrix61c_multiply(self, args));
+}
+
+/* a /= b. Divides self's storage element-wise by a numc.Matrix or a number. */
+static PyObject *Matrix61c_inplace_true_divide(Matrix61c *self, PyObject *args) {
+    PyObject *rv;
+    if (scalar_arithmetic('/', (PyObject *) self, args, 1, &rv)) {
+        return rv;
+    }
+    return inplace_elementwise(self, args, "/=", divide_matrix);
+}
+
+/* a **= n. Same storage handling as a *= b. */
+static PyObject *Matrix61c_inplace_pow(Matrix61c *self, PyObject *pow, PyObject *optional) {
+    return inplace_result(self, Matrix61c_pow(self, pow, optional));
+}
+
 /*
  * Create a PyNumberMethods struct for overloading operators with all the number methods
  * defined as above.
@@ -553,9 +2874,329 @@ static PyNumberMethods Matrix61c_as_number = {
    .nb_power = (ternaryfunc)Matrix61c_pow, // ternaryfunc nb_power;
    .nb_negative = (unaryfunc)Matrix61c_neg, // unaryfunc nb_negative;
    .nb_absolute = (unaryfunc)Matrix61c_abs, // unaryfunc nb_absolute;
+   .nb_inplace_add = (binaryfunc)Matrix61c_inplace_add, // binaryfunc nb_inplace_add;
+   .nb_inplace_subtract = (binaryfunc)Matrix61c_inplace_sub, // binaryfunc nb_inplace_subtract;
+   .nb_inplace_multiply = (binaryfunc)Matrix61c_inplace_multiply, // binaryfunc nb_inplace_multiply;
+   .nb_inplace_power = (ternaryfunc)Matrix61c_inplace_pow, // ternaryfunc nb_inplace_power;
+   .nb_true_divide = (binaryfunc)Matrix61c_true_divide, // binaryfunc nb_true_divide;
+   .nb_inplace_true_divide = (binaryfunc)Matrix61c_inplace_true_divide, // binaryfunc nb_inplace_true_divide;
 };
 
 
+/* REDUCTIONS */
+/*
+ * Parses the axis argument of the reductions: None (stored as -1), 0 for one value per column or
+ * 1 for one value per row. Returns -1 with a ValueError set for anything else.
+ */
+static int parse_axis(PyObject *obj, int *axis) {
+    if (obj == NULL || obj == Py_None) {
+        *axis = -1;
+        return 0;
+    }
+    long value = PyLong_Check(obj) ? PyLong_AsLong(obj) : -2;
+    if (value != 0 && value != 1) {
+        PyErr_Clear();
+        PyErr_SetString(PyExc_ValueError, "axis must be None, 0 or 1");
+        return -1;
+    }
+    *axis = value;
+    return 0;
+}
+
+/* Number of values a reduction of `mat` along `axis` (0 or 1) produces */
+static int axis_length(matrix *mat, int axis) {
+    return axis == 0 ? mat->cols : mat->rows;
+}
+
+/*
+ * Returns a new 1 x cols (axis 0) or rows x 1 (axis 1) numc.Matrix of type `type` holding
+ * `values`, each multiplied by `scale` and replaced by its square root if `root` is set.
+ */
+static PyObject *axis_result(const double *values, int count, int axis, dtype type, double scale,
+                             int root) {
+    matrix *new_mat;
+    if (allocate_matrix_typed(&new_mat, axis == 0 ? 1 : count, axis == 0 ? count : 1, type) != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        double value = values[i] * scale;
+        set(new_mat, axis == 0 ? 0 : i, axis == 0 ? i : 0, root ? sqrt(value) : value);
+    }
+    return op_err(new_mat, 0);
+}
+
+/*
+ * Applies `op` to all of self (axis -1), returning a Python float, or along `axis`, returning a
+ * numc.Matrix of self's type. Every value is multiplied by `scale` and replaced by its square
+ * root if `root` is set. Large matrices are reduced with the GIL released.
+ */
+static PyObject *reduction(Matrix61c *self, reduce_op op, int axis, double scale, int root) {
+    if (materialize(self) < 0) {
+        return NULL;
+    }
+    matrix *mat = self->mat;
+    if (axis < 0) {
+        double value;
+        kernel_call call;
+        begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+        int reduce_result = reduce_matrix(&value, mat, op);
+        end_kernel(&call);
+        if (reduce_result != 0) {
+            PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+            return NULL;
+        }
+        value *= scale;
+        return PyFloat_FromDouble(root ? sqrt(value) : value);
+    }
+    int count = axis_length(mat, axis);
+    double *values = malloc(count * sizeof(double));
+    if (values == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return NULL;
+    }
+    kernel_call call;
+    begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+    int reduce_result = reduce_matrix_axis(values, mat, op, axis);
+    end_kernel(&call);
+    PyObject *result = NULL;
+    if (reduce_result != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+    } else {
+        result = axis_result(values, count, axis, mat->dtype, scale, root);
+    }
+    free(values);
+    return result;
+}
+
+/* Parses the single optional axis argument of sum, mean, min, max, argmin and argmax */
+static int parse_reduction_args(PyObject *args, PyObject *kwds, int *axis) {
+    static char *kwlist[] = {"axis", NULL};
+    PyObject *axis_obj = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &axis_obj)) {
+        return -1;
+    }
+    return parse_axis(axis_obj, axis);
+}
+
+/* Sum of all elements, or a numc.Matrix of the sums of each column (axis=0) or row (axis=1) */
+static PyObject *Matrix61c_sum(Matrix61c *self, PyObject *args, PyObject *kwds) {
+    int axis;
+    if (parse_reduction_args(args, kwds, &axis) < 0) {
+        return NULL;
+    }
+    return reduction(self, REDUCE_SUM, axis, 1, 0);
+}
+
+/* Mean of all elements, or of each column (axis=0) or row (axis=1) */
+static PyObject *Matrix61c_mean(Matrix61c *self, PyObject *args, PyObject *kwds) {
+    int axis;
+    if (parse_reduction_args(args, kwds, &axis) < 0) {
+        return NULL;
+    }
+    long count = (long) rows_of(self) * cols_of(self);
+    if (axis >= 0) {
+        count = axis == 0 ? rows_of(self) : cols_of(self);
+    }
+    return reduction(self, REDUCE_SUM, axis, 1.0 / count, 0);
+}
+
+/* Smallest element, or the smallest of each column (axis=0) or row (axis=1) */
+static PyObject *Matrix61c_min(Matrix61c *self, PyObject *args, PyObject *kwds) {
+    int axis;
+    if (parse_reduction_args(args, kwds, &axis) < 0) {
+        return NULL;
+    }
+    return reduction(self, REDUCE_MIN, axis, 1, 0);
+}
+
+/* Largest element, or the largest of each column (axis=0) or row (axis=1) */
+static PyObject *Matrix61c_max(Matrix61c *self, PyObject *args, PyObject *kwds) {
+    int axis;
+    if (parse_reduction_args(args, kwds, &axis) < 0) {
+        return NULL;
+    }
+    return reduction(self, REDUCE_MAX, axis, 1, 0);
+}
+
+/*
+ * Row-major index of the first largest (or smallest) element as a Python int, or a float64
+ * numc.Matrix of the row index within each column (axis=0) or column index within each row
+ * (axis=1).
+ */
+static PyObject *arg_reduction(Matrix61c *self, PyObject *args, PyObject *kwds, int largest) {
+    int axis;
+    if (parse_reduction_args(args, kwds, &axis) < 0 || materialize(self) < 0) {
+        return NULL;
+    }
+    matrix *mat = self->mat;
+    if (axis < 0) {
+        long index;
+        kernel_call call;
+        begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+        int arg_result = arg_reduce_matrix(&index, mat, largest);
+        end_kernel(&call);
+        if (arg_result != 0) {
+            PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+            return NULL;
+        }
+        return PyLong_FromLong(index);
+    }
+    int count = axis_length(mat, axis);
+    long *indices = malloc(count * sizeof(long));
+    double *values = malloc(count * sizeof(double));
+    if (indices == NULL || values == NULL) {
+        free(indices);
+        free(values);
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return NULL;
+    }
+    kernel_call call;
+    begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+    int arg_result = arg_reduce_matrix_axis(indices, mat, largest, axis);
+    end_kernel(&call);
+    PyObject *result = NULL;
+    if (arg_result != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+    } else {
+        for (int i = 0; i < count; i++) {
+            values[i] = indices[i];
+        }
+        result = axis_result(values, count, axis, DTYPE_FLOAT64, 1, 0);
+    }
+    free(indices);
+    free(values);
+    return result;
+}
+
+static PyObject *Matrix61c_argmin(Matrix61c *self, PyObject *args, PyObject *kwds) {
+    return arg_reduction(self, args, kwds, 0);
+}
+
+static PyObject *Matrix61c_argmax(Matrix61c *self, PyObject *args, PyObject *kwds) {
+    return arg_reduction(self, args, kwds, 1);
+}
+
+/* Orders of norm() */
+typedef enum norm_ord {
+    NORM_FRO,
+    NORM_ONE,
+    NORM_TWO,
+    NORM_INF,
+} norm_ord;
+
+/* Parses the ord argument of norm(): None, 'fro', 1, 2 or inf. Returns -1 with a ValueError otherwise. */
+static int parse_norm_ord(PyObject *obj, norm_ord *ord) {
+    if (obj == NULL || obj == Py_None) {
+        *ord = NORM_FRO;
+        return 0;
+    }
+    if (PyUnicode_Check(obj)) {
+        if (PyUnicode_CompareWithASCIIString(obj, "fro") == 0) {
+            *ord = NORM_FRO;
+            return 0;
+        }
+    } else if (PyLong_Check(obj) || PyFloat_Check(obj)) {
+        double value = PyFloat_AsDouble(obj);
+        if (value == 1 || value == 2 || value == INFINITY) {
+            *ord = value == 1 ? NORM_ONE : value == 2 ? NORM_TWO : NORM_INF;
+            return 0;
+        }
+    }
+    PyErr_Clear();
+    PyErr_SetString(PyExc_ValueError, "ord must be None, 'fro', 1, 2 or inf");
+    return -1;
+}
+
+/*
+ * norm(ord=None, axis=None). Without an axis this is a matrix norm: the Frobenius norm for None
+ * or 'fro', the largest column sum of absolute values for 1 and the largest row sum for inf.
+ * With an axis it is the vector norm of each column (axis=0) or row (axis=1): Euclidean for
+ * None or 2, the sum of absolute values for 1 and the largest absolute value for inf.
+ */
+static PyObject *Matrix61c_norm(Matrix61c *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"ord", "axis", NULL};
+    PyObject *ord_obj = NULL;
+    PyObject *axis_obj = NULL;
+    norm_ord ord;
+    int axis;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OO", kwlist, &ord_obj, &axis_obj) ||
+        parse_norm_ord(ord_obj, &ord) < 0 || parse_axis(axis_obj, &axis) < 0) {
+        return NULL;
+    }
+    if (axis >= 0) {
+        if (ord == NORM_FRO && ord_obj != NULL && ord_obj != Py_None) {
+            PyErr_SetString(PyExc_ValueError, "'fro' is not a vector norm");
+            return NULL;
+        }
+        if (ord == NORM_ONE || ord == NORM_INF) {
+            return reduction(self, ord == NORM_ONE ? REDUCE_SUM_ABS : REDUCE_MAX_ABS, axis, 1, 0);
+        }
+        return reduction(self, REDUCE_SUM_SQ, axis, 1, 1);
+    }
+    if (ord == NORM_TWO) {
+        PyErr_SetString(PyExc_ValueError, "The spectral norm is not supported");
+        return NULL;
+    }
+    if (ord == NORM_FRO) {
+        return reduction(self, REDUCE_SUM_SQ, -1, 1, 1);
+    }
+    /* The 1-norm is the largest column sum, the inf-norm the largest row sum */
+    PyObject *sums = reduction(self, REDUCE_SUM_ABS, ord == NORM_ONE ? 0 : 1, 1, 0);
+    if (sums == NULL) {
+        return NULL;
+    }
+    PyObject *result = reduction((Matrix61c *) sums, REDUCE_MAX, -1, 1, 0);
+    Py_DECREF(sums);
+    return result;
+}
+
+/*
+ * transpose(inplace=False) returns a new contiguous matrix holding the transpose of self. With
+ * inplace=True a square self is transposed in its own storage instead, which slices see, and
+ * None is returned.
+ */
+static PyObject *Matrix61c_transpose(Matrix61c *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"inplace", NULL};
+    int inplace = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p", kwlist, &inplace)) {
+        return NULL;
+    }
+    if (inplace) {
+        if (flush_pending() < 0) {
+            return NULL;
+        }
+        matrix *mat = self->mat;
+        if (mat->rows != mat->cols) {
+            PyErr_SetString(PyExc_ValueError, "Matrix must be square");
+            return NULL;
+        }
+        kernel_call call;
+        begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+        int transpose_result = transpose_matrix(mat, mat);
+        end_kernel(&call);
+        if (transpose_result != 0) {
+            PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+            return NULL;
+        }
+        return Py_BuildValue("");
+    }
+    if (materialize(self) < 0) {
+        return NULL;
+    }
+    matrix *mat = self->mat;
+    matrix *new_mat;
+    if (allocate_matrix_typed(&new_mat, mat->cols, mat->rows, mat->dtype) != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return NULL;
+    }
+    kernel_call call;
+    begin_kernel(&call, (long) mat->rows * mat->cols, mat, NULL);
+    int transpose_result = transpose_matrix(new_mat, mat);
+    end_kernel(&call);
+    return op_err(new_mat, transpose_result);
+}
+
 /* INSTANCE METHODS */
 /*
  * Given a numc.Matrix self, parse `args` to (int) row, (int) col, and (double) val.
@@ -570,6 +3211,9 @@ static PyObject *Matrix61c_set_value(Matrix61c *self, PyObject* args) {
         PyErr_SetString(PyExc_TypeError, "Invalid arguments");
         return NULL;
     }
+    if (flush_pending() < 0) {
+        return NULL;
+    }
     if (row < 0 || col < 0 || row >= self->mat->rows || col >= self->mat->cols) {
         PyErr_SetString(PyExc_IndexError, "row or column index out of range");
         return NULL;
@@ -592,6 +3236,9 @@ static PyObject *Matrix61c_get_value(Matrix61c *self, PyObject* args) {
         PyErr_SetString(PyExc_TypeError, "Invalid arguments");
         return NULL;
     }
+    if (materialize(self) < 0) {
+        return NULL;
+    }
     if (row < 0 || col < 0 || row >= self->mat->rows || col >= self->mat->cols) {
         PyErr_SetString(PyExc_IndexError, "row or column index out of range");
         return NULL;
@@ -606,10 +3253,30 @@ static PyObject *Matrix61c_get_value(Matrix61c *self, PyObject* args) {
  * You might find this link helpful: https://docs.python.org/3.6/c-api/structures.html
  */
 static PyMethodDef Matrix61c_methods[] = {
+    {"frombuffer", (PyCFunction)Matrix61c_frombuffer, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+    "Builds a numc.Matrix from the raw bytes of a buffer, sharing its memory where possible"},
+    {"fromiter", (PyCFunction)Matrix61c_fromiter, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+    "Builds a numc.Matrix from the numbers of an iterable"},
     {"set", (PyCFunction)Matrix61c_set_value, METH_VARARGS,
     "Change the value at a specific row and column index"},
     {"get", (PyCFunction)Matrix61c_get_value, METH_VARARGS,
     "Get the value at a specific row and column index"},
+    {"sum", (PyCFunction)Matrix61c_sum, METH_VARARGS | METH_KEYWORDS,
+    "Sum of the elements, or of each column (axis=0) or row (axis=1)"},
+    {"mean", (PyCFunction)Matrix61c_mean, METH_VARARGS | METH_KEYWORDS,
+    "Mean of the elements, or of each column (axis=0) or row (axis=1)"},
+    {"min", (PyCFunction)Matrix61c_min, METH_VARARGS | METH_KEYWORDS,
+    "Smallest element, or the smallest of each column (axis=0) or row (axis=1)"},
+    {"max", (PyCFunction)Matrix61c_max, METH_VARARGS | METH_KEYWORDS,
+    "Largest element, or the largest of each column (axis=0) or row (axis=1)"},
+    {"argmin", (PyCFunction)Matrix61c_argmin, METH_VARARGS | METH_KEYWORDS,
+    "Index of the first smallest element, or of the smallest of each column (axis=0) or row (axis=1)"},
+    {"argmax", (PyCFunction)Matrix61c_argmax, METH_VARARGS | METH_KEYWORDS,
+    "Index of the first largest element, or of the largest of each column (axis=0) or row (axis=1)"},
+    {"transpose", (PyCFunction)Matrix61c_transpose, METH_VARARGS | METH_KEYWORDS,
+    "Returns a contiguous transposed copy, or transposes a square matrix in place with inplace=True"},
+    {"norm", (PyCFunction)Matrix61c_norm, METH_VARARGS | METH_KEYWORDS,
+    "Matrix norm ('fro', 1 or inf), or vector norm (2, 1 or inf) of each column (axis=0) or row (axis=1)"},
     {NULL}  /* Sentinel */
 };
 
@@ -619,6 +3286,34 @@ static PyMemberDef Matrix61c_members[] = {
      "(rows, cols)"},
     {NULL}  /* Sentinel */
 };
+/* Type of the elements, "float64" or "float32" */
+static PyObject *Matrix61c_get_dtype(Matrix61c *self, void *closure) {
+    return PyUnicode_FromString(dtype_name(dtype_of(self)));
+}
+
+/*
+ * The transpose of self as a strided view: no data is copied, and writes through it change self
+ * like those through slices. transpose() makes a contiguous copy instead.
+ */
+static PyObject *Matrix61c_get_T(Matrix61c *self, void *closure) {
+    if (materialize(self) < 0) {
+        return NULL;
+    }
+    matrix *mat = self->mat;
+    matrix *view;
+    if (allocate_matrix_view(&view, mat, 0, mat->cols, mat->rows, mat->col_stride,
+                             mat->row_stride) != 0) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to allocate matrix");
+        return NULL;
+    }
+    return op_err(view, 0);
+}
+
+static PyGetSetDef Matrix61c_getset[] = {
+    {"dtype", (getter) Matrix61c_get_dtype, NULL, "Element type, 'float64' or 'float32'", NULL},
+    {"T", (getter) Matrix61c_get_T, NULL, "Transposed view sharing this matrix's data", NULL},
+    {NULL}  /* Sentinel */
+};
 /* INSTANCE ATTRIBUTES */
 static PyTypeObject Matrix61cType = {
     PyVarObject_HEAD_INIT(NULL, 0)
@@ -632,7 +3327,9 @@ static PyTypeObject Matrix61cType = {
     .tp_doc = "numc.Matrix objects",
     .tp_methods = Matrix61c_methods,
     .tp_members = Matrix61c_members,
+    .tp_getset = Matrix61c_getset,
     .tp_as_mapping = &Matrix61c_mapping,
+    .tp_as_buffer = &Matrix61c_as_buffer,
     .tp_init = (initproc)Matrix61c_init,
     .tp_new = Matrix61c_new
 };
@@ -659,6 +3356,14 @@ PyMODINIT_FUNC PyInit_numc(void) {
 
     Py_INCREF(&Matrix61cType);
     PyModule_AddObject(m, "Matrix", (PyObject *)&Matrix61cType);
+    /* Pick the kernels for this CPU. A bad NUMC_ISA only warns, since the default still works. */
+    if (init_kernels() != 0) {
+        if (PyErr_WarnFormat(PyExc_RuntimeWarning, 1, "Ignoring NUMC_ISA=%s, using %s",
+                             getenv("NUMC_ISA"), kernels->name) < 0) {
+            Py_DECREF(m);
+            return NULL;
+        }
+    }
     printf("CS61C Project 4: numc imported!\n");
     fflush(stdout);
     return m;
@@ -1,4 +1,5 @@
 #include "matrix.h"
+#include "expr.h"
 
 /*
  * Defines the struct that represents the object
@@ -6,17 +7,25 @@
  * It also has the matrix that is being wrapped
  * is of type PyObject
  */
-typedef struct {
+typedef struct Matrix61c {
     PyObject_HEAD
-    matrix* mat;
+    matrix* mat; // NULL while the matrix is deferred
+    expr *pending; // In lazy mode, the expression that computes this matrix until it is needed
+    struct Matrix61c *pending_prev; // Neighbours in the list of deferred matrices
+    struct Matrix61c *pending_next;
     PyObject *shape;
+    Py_ssize_t buffer_shape[2]; // shape handed out through the buffer protocol
+    Py_ssize_t buffer_strides[2]; // strides handed out through the buffer protocol
+    int exports; // number of live buffer views of mat->data
 } Matrix61c;
 
 /* Function definitions */
-static int init_rand(PyObject *self, int rows, int cols, unsigned int seed, double low, double high);
-static int init_fill(PyObject *self, int rows, int cols, double val);
-static int init_1d(PyObject *self, int rows, int cols, PyObject *lst);
-static int init_2d(PyObject *self, PyObject *lst);
+static int init_rand(PyObject *self, int rows, int cols, unsigned int seed, double low, double high,
+                     int normal, dtype type);
+static int init_fill(PyObject *self, int rows, int cols, double val, dtype type);
+static int init_1d(PyObject *self, int rows, int cols, PyObject *lst, dtype type);
+static int init_2d(PyObject *self, PyObject *lst, dtype type);
+static int init_buffer(PyObject *self, int rows, int cols, PyObject *obj, const dtype *type);
 static void Matrix61c_dealloc(Matrix61c *self);
 static PyObject *Matrix61c_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
 static int Matrix61c_init(PyObject *self, PyObject *args, PyObject *kwds);
@@ -30,3 +39,9 @@ static PyObject *Matrix61c_multiply(Matrix61c* self, PyObject *args);
 static PyObject *Matrix61c_neg(Matrix61c* self);
 static PyObject *Matrix61c_abs(Matrix61c *self);
 static PyObject *Matrix61c_pow(Matrix61c *self, PyObject *pow, PyObject *optional);
+static PyObject *Matrix61c_inplace_add(Matrix61c* self, PyObject* args);
+static PyObject *Matrix61c_inplace_sub(Matrix61c* self, PyObject* args);
+static PyObject *Matrix61c_inplace_multiply(Matrix61c* self, PyObject *args);
+static PyObject *Matrix61c_inplace_pow(Matrix61c *self, PyObject *pow, PyObject *optional);
+static int Matrix61c_getbuffer(Matrix61c *self, Py_buffer *view, int flags);
+static void Matrix61c_releasebuffer(Matrix61c *self, Py_buffer *view);
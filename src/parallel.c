@@ -0,0 +1,368 @@
+/* pthread_atfork, sysconf and clock_gettime are not part of strict C99 */
+#define _DEFAULT_SOURCE
+
+#include "parallel.h"
+#include "matrix.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+/* 0 until set_num_threads is called: one thread per online CPU */
+static int max_threads = 0;
+static long thresholds[PARALLEL_KINDS] = {
+    PARALLEL_DEFAULT_ELEMENTWISE,
+    PARALLEL_DEFAULT_GEMM,
+    PARALLEL_DEFAULT_RANDOM,
+};
+
+/* Guards starting workers and sleeping; pool_cond is signalled when tiles are queued or done */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+
+/*
+ * Caps the number of threads any kernel uses, counting the caller, at most PARALLEL_MAX_THREADS.
+ * 1 makes everything serial. Workers above the new limit park until it is raised again.
+ */
+void set_num_threads(int threads) {
+    threads = threads < 1 ? 1 : threads;
+    threads = threads > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : threads;
+    pthread_mutex_lock(&pool_lock);
+    max_threads = threads;
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+int get_num_threads(void) {
+    int threads = max_threads;
+    if (threads == 0) {
+      long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      threads = cpus < 1 ? 1 : cpus > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : (int) cpus;
+    }
+    return threads;
+}
+
+/* Sets the work per thread below which kernels of the given kind run serially */
+void set_parallel_threshold(parallel_kind kind, long work) {
+    thresholds[kind] = work < 1 ? 1 : work;
+}
+
+long get_parallel_threshold(parallel_kind kind) {
+    return thresholds[kind];
+}
+
+/*
+ * Returns the number of threads for a kernel of the given kind doing `work` work in `units`
+ * independent pieces: one per threshold's worth of work, at most one per piece and at most the
+ * thread limit, and at least 1.
+ */
+int threads_for(parallel_kind kind, long work, long units) {
+    long threads = work / thresholds[kind];
+    int limit = get_num_threads();
+    if (threads > limit) {
+      threads = limit;
+    }
+    if (threads > units) {
+      threads = units;
+    }
+    return threads < 1 ? 1 : (int) threads;
+}
+
+/* Tiles each worker's deque can hold; a tile that does not fit is run by its caller */
+#define DEQUE_SIZE 64
+
+/* One parallel_for call */
+typedef struct parallel_job {
+    void (*body)(void *ctx, long begin, long end);
+    void *ctx;
+    int pending; // tiles not finished yet, updated atomically
+} parallel_job;
+
+/* Units [begin, end) of a job */
+typedef struct tile {
+    parallel_job *job;
+    long begin;
+    long end;
+} tile;
+
+/*
+ * A worker's tiles. The owner pushes and pops at the bottom (newest first), thieves take from
+ * the top (oldest first). `top` and `bottom` only grow; slots are used modulo DEQUE_SIZE.
+ */
+typedef struct worker_deque {
+    pthread_mutex_t lock;
+    long top;
+    long bottom;
+    tile tiles[DEQUE_SIZE];
+} worker_deque;
+
+static worker_deque deques[PARALLEL_MAX_THREADS];
+/* Worker threads started so far; they are never stopped, only parked */
+static int started_workers = 0;
+/* Tiles in all deques, updated atomically */
+static long queued_tiles = 0;
+/* Deque the next tile from a thread outside the pool goes to */
+static unsigned int next_deque = 0;
+/* Index of the worker running on this thread, -1 on application threads */
+static __thread int current_worker = -1;
+
+/* Workers that may take tiles: the thread limit minus the calling thread */
+static int active_workers(void) {
+    int workers = get_num_threads() - 1;
+    return workers < started_workers ? workers : started_workers;
+}
+
+static int deque_push(worker_deque *deque, tile *t) {
+    pthread_mutex_lock(&deque->lock);
+    int pushed = deque->bottom - deque->top < DEQUE_SIZE;
+    if (pushed) {
+      deque->tiles[deque->bottom % DEQUE_SIZE] = *t;
+      deque->bottom++;
+      __atomic_add_fetch(&queued_tiles, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return pushed;
+}
+
+/* Takes the newest tile if `own`, else the oldest. Returns 0 if the deque is empty. */
+static int deque_take(worker_deque *deque, int own, tile *t) {
+    pthread_mutex_lock(&deque->lock);
+    int taken = deque->bottom > deque->top;
+    if (taken && own) {
+      deque->bottom--;
+      *t = deque->tiles[deque->bottom % DEQUE_SIZE];
+    } else if (taken) {
+      *t = deque->tiles[deque->top % DEQUE_SIZE];
+      deque->top++;
+    }
+    if (taken) {
+      __atomic_sub_fetch(&queued_tiles, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return taken;
+}
+
+/* Finds a tile for the calling thread: from its own deque if it is a worker, else stolen */
+static int find_tile(tile *t) {
+    int self = current_worker;
+    if (self >= 0 && deque_take(&deques[self], 1, t)) {
+      return 1;
+    }
+    int workers = started_workers;
+    for (int i = 1; i <= workers; i++) {
+      int victim = (self + i + workers) % workers;
+      if (victim != self && deque_take(&deques[victim], 0, t)) {
+        return 1;
+      }
+    }
+    return 0;
+}
+
+static void run_tile(tile *t) {
+    parallel_job *job = t->job;
+    job->body(job->ctx, t->begin, t->end);
+    if (__atomic_sub_fetch(&job->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+      pthread_mutex_lock(&pool_lock);
+      pthread_cond_broadcast(&pool_cond);
+      pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+static void *worker_main(void *arg) {
+    current_worker = (int) (intptr_t) arg;
+    for (;;) {
+      tile t;
+      if (current_worker < active_workers() && find_tile(&t)) {
+        run_tile(&t);
+        continue;
+      }
+      pthread_mutex_lock(&pool_lock);
+      while (current_worker >= active_workers() ||
+             __atomic_load_n(&queued_tiles, __ATOMIC_ACQUIRE) == 0) {
+        pthread_cond_wait(&pool_cond, &pool_lock);
+      }
+      pthread_mutex_unlock(&pool_lock);
+    }
+    return NULL;
+}
+
+/* In a child process the workers are gone: start over with an empty pool */
+static void reset_pool_after_fork(void) {
+    pthread_mutex_init(&pool_lock, NULL);
+    pthread_cond_init(&pool_cond, NULL);
+    for (int i = 0; i < started_workers; i++) {
+      pthread_mutex_init(&deques[i].lock, NULL);
+      deques[i].top = 0;
+      deques[i].bottom = 0;
+    }
+    started_workers = 0;
+    queued_tiles = 0;
+}
+
+/* Starts workers until there are `workers` of them. Returns how many there are. */
+static int start_workers(int workers) {
+    static int registered = 0;
+    pthread_mutex_lock(&pool_lock);
+    if (!registered) {
+      pthread_atfork(NULL, NULL, reset_pool_after_fork);
+      registered = 1;
+    }
+    while (started_workers < workers) {
+      int id = started_workers;
+      pthread_mutex_init(&deques[id].lock, NULL);
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, worker_main, (void *) (intptr_t) id) != 0) {
+        break;
+      }
+      pthread_detach(thread);
+      __atomic_store_n(&started_workers, id + 1, __ATOMIC_RELEASE);
+    }
+    int started = started_workers;
+    pthread_mutex_unlock(&pool_lock);
+    return started;
+}
+
+/*
+ * Calls body(ctx, begin, end) on disjoint ranges covering units [0, units), using up to
+ * `threads` threads including the caller, and returns once all of them are done. Each range is
+ * a tile of roughly units / threads units. Tiles run in any order and on any thread, so `body`
+ * may only write to data no other tile touches. Runs everything on the caller if `threads` is
+ * at most 1 or no worker could be started.
+ */
+void parallel_for(int threads, long units, void (*body)(void *ctx, long begin, long end),
+                  void *ctx) {
+    int limit = get_num_threads();
+    if (threads > limit) {
+      threads = limit;
+    }
+    if (threads > units) {
+      threads = (int) units;
+    }
+    if (threads > 1 && start_workers(limit - 1) == 0) {
+      threads = 1;
+    }
+    if (threads <= 1) {
+      if (units > 0) {
+        body(ctx, 0, units);
+      }
+      return;
+    }
+    int workers = active_workers();
+    if (workers < 1) {
+      /* The limit was lowered to 1 meanwhile */
+      body(ctx, 0, units);
+      return;
+    }
+    parallel_job job = {body, ctx, threads};
+    for (int i = 1; i < threads; i++) {
+      tile t = {&job, units * i / threads, units * (i + 1) / threads};
+      /* Nested calls keep their tiles on the worker's own deque, others spread them out */
+      int target = current_worker >= 0 ? current_worker
+                                       : (int) (__atomic_fetch_add(&next_deque, 1,
+                                                                   __ATOMIC_RELAXED) % workers);
+      if (!deque_push(&deques[target], &t)) {
+        run_tile(&t);
+      }
+    }
+    pthread_mutex_lock(&pool_lock);
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+    tile first = {&job, 0, units / threads};
+    run_tile(&first);
+    /* Help with queued tiles, of this call or any other, until every tile of this call is done */
+    while (__atomic_load_n(&job.pending, __ATOMIC_ACQUIRE) > 0) {
+      tile t;
+      if (find_tile(&t)) {
+        run_tile(&t);
+        continue;
+      }
+      pthread_mutex_lock(&pool_lock);
+      while (__atomic_load_n(&job.pending, __ATOMIC_ACQUIRE) > 0 &&
+             __atomic_load_n(&queued_tiles, __ATOMIC_ACQUIRE) == 0) {
+        pthread_cond_wait(&pool_cond, &pool_lock);
+      }
+      pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+/* Runs one kernel of the given kind on the calibration operands */
+static void run_kernel(parallel_kind kind, matrix *result, matrix *mat1, matrix *mat2) {
+    switch (kind) {
+      case PARALLEL_ELEMENTWISE:
+        add_matrix(result, mat1, mat2);
+        break;
+      case PARALLEL_GEMM:
+        mul_matrix(result, mat1, mat2);
+        break;
+      default:
+        rand_matrix(result, 0, 0, 1);
+        break;
+    }
+}
+
+/* Best of a few runs, so a single interruption does not skew the result */
+static double time_kernel(parallel_kind kind, matrix *result, matrix *mat1, matrix *mat2) {
+    double best = 0;
+    for (int run = 0; run < 5; run++) {
+      struct timespec start, end;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      run_kernel(kind, result, mat1, mat2);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+      if (run == 0 || elapsed < best) {
+        best = elapsed;
+      }
+    }
+    return best;
+}
+
+/*
+ * Measures the smallest problem of the given kind that runs at least 10% faster on all threads
+ * than on one, doubling the size each step, and returns half its work: at that size the kernel
+ * should get 2 threads. Returns the largest size tried if no size was faster. Returns -1 if the
+ * operands could not be allocated.
+ */
+static long measure_threshold(parallel_kind kind) {
+    int threads = get_num_threads();
+    /* Square matrices of side n: n^2 elements, or n^3 multiply-adds for products */
+    int max_side = kind == PARALLEL_GEMM ? 512 : 1024;
+    long work = 0;
+    for (int n = 16; n <= max_side; n *= 2) {
+      matrix *result = NULL, *mat1 = NULL, *mat2 = NULL;
+      if (allocate_matrix(&result, n, n) != 0 || allocate_matrix(&mat1, n, n) != 0 ||
+          allocate_matrix(&mat2, n, n) != 0) {
+        deallocate_matrix(result);
+        deallocate_matrix(mat1);
+        deallocate_matrix(mat2);
+        return -1;
+      }
+      work = kind == PARALLEL_GEMM ? (long) n * n * n : (long) n * n;
+      set_parallel_threshold(kind, work + 1);
+      double serial = time_kernel(kind, result, mat1, mat2);
+      set_parallel_threshold(kind, work / threads);
+      double parallel = time_kernel(kind, result, mat1, mat2);
+      deallocate_matrix(result);
+      deallocate_matrix(mat1);
+      deallocate_matrix(mat2);
+      if (parallel < 0.9 * serial) {
+        return work / 2;
+      }
+    }
+    return work;
+}
+
+/*
+ * Measures the threshold of every kind of kernel on this machine with the current thread limit
+ * and keeps the results. Takes about a second. Kinds whose operands cannot be allocated keep
+ * their threshold. Nothing changes if only one thread is available.
+ */
+void calibrate_parallel(void) {
+    if (get_num_threads() < 2) {
+      return;
+    }
+    for (int kind = 0; kind < PARALLEL_KINDS; kind++) {
+      long previous = thresholds[kind];
+      long measured = measure_threshold(kind);
+      thresholds[kind] = measured > 0 ? measured : previous;
+    }
+}
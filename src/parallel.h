@@ -0,0 +1,42 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/*
+ * numc's own worker pool and how many threads each kernel runs on.
+ *
+ * Kernels split their work into tiles with parallel_for. The tiles are queued on the deques of a
+ * persistent pool of worker threads; idle workers steal tiles from the others, and the calling
+ * thread works on its own tiles too while it waits. Calls from several application threads, and
+ * parallel_for calls made from inside a tile, all share the same workers instead of each
+ * starting a team of their own.
+ *
+ * Every kind of kernel has a threshold: the work (elements, or multiply-adds for products) one
+ * thread must get before another thread is worth using. Kernels below it run serially; above it
+ * they use one thread per threshold's worth of work, up to the thread limit.
+ */
+
+typedef enum parallel_kind {
+    PARALLEL_ELEMENTWISE, // element-wise operations, fills and copies
+    PARALLEL_GEMM, // matrix products
+    PARALLEL_RANDOM, // random fills
+    PARALLEL_KINDS,
+} parallel_kind;
+
+/* Most threads the pool can use, counting the caller */
+#define PARALLEL_MAX_THREADS 128
+
+/* Default thresholds, meant for a few microseconds of work per thread on a current core */
+#define PARALLEL_DEFAULT_ELEMENTWISE 32768
+#define PARALLEL_DEFAULT_GEMM (1L << 21)
+#define PARALLEL_DEFAULT_RANDOM 8192
+
+void set_num_threads(int threads);
+int get_num_threads(void);
+void set_parallel_threshold(parallel_kind kind, long work);
+long get_parallel_threshold(parallel_kind kind);
+int threads_for(parallel_kind kind, long work, long units);
+void calibrate_parallel(void);
+void parallel_for(int threads, long units, void (*body)(void *ctx, long begin, long end),
+                  void *ctx);
+
+#endif
@@ -0,0 +1,171 @@
+/* mmap flags and posix_memalign are not part of strict C99 */
+#define _DEFAULT_SOURCE
+
+#include "pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* Blocks of at least this many bytes come straight from mmap, so fresh ones are already zero */
+#define POOL_MMAP_THRESHOLD ((size_t) 1 << 18)
+/* Smallest class is 2^POOL_MIN_SHIFT bytes; each power of two is split into 4 classes */
+#define POOL_MIN_SHIFT 6
+#define POOL_STEPS 4
+#define POOL_NUM_CLASSES ((64 - POOL_MIN_SHIFT) * POOL_STEPS + 1)
+
+/* A free block. The link lives in the block's own (unused) memory. */
+typedef struct pool_block {
+    struct pool_block *next;
+} pool_block;
+
+static pool_block *free_lists[POOL_NUM_CLASSES];
+static size_t cached_bytes = 0;
+static size_t cache_limit = POOL_DEFAULT_LIMIT;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Returns the index of the smallest class that fits `bytes` and stores its size in `class_bytes` */
+static int size_class(size_t bytes, size_t *class_bytes) {
+    size_t min_bytes = (size_t) 1 << POOL_MIN_SHIFT;
+    if (bytes <= min_bytes) {
+      *class_bytes = min_bytes;
+      return 0;
+    }
+    /* 2^shift < bytes <= 2^(shift + 1) */
+    int shift = 63 - __builtin_clzll((unsigned long long) (bytes - 1));
+    size_t base = (size_t) 1 << shift;
+    size_t step = base / POOL_STEPS;
+    size_t steps = (bytes - base + step - 1) / step;
+    *class_bytes = base + steps * step;
+    return (shift - POOL_MIN_SHIFT) * POOL_STEPS + (int) steps;
+}
+
+/* Returns the size in bytes of the blocks in class `index` */
+static size_t class_size(int index) {
+    size_t base = (size_t) 1 << (POOL_MIN_SHIFT + index / POOL_STEPS);
+    return base + (index % POOL_STEPS) * (base / POOL_STEPS);
+}
+
+/* Gets a new block from the system. Sets *zeroed if its memory is known to be zero. */
+static void *system_alloc(size_t class_bytes, int *zeroed) {
+    if (class_bytes >= POOL_MMAP_THRESHOLD) {
+      void *ptr = mmap(NULL, class_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0);
+      *zeroed = 1;
+      return ptr == MAP_FAILED ? NULL : ptr;
+    }
+    void *ptr = NULL;
+    *zeroed = 0;
+    if (posix_memalign(&ptr, POOL_ALIGNMENT, class_bytes) != 0) {
+      return NULL;
+    }
+    return ptr;
+}
+
+static void system_free(void *ptr, size_t class_bytes) {
+    if (class_bytes >= POOL_MMAP_THRESHOLD) {
+      munmap(ptr, class_bytes);
+    } else {
+      free(ptr);
+    }
+}
+
+/*
+ * Returns a POOL_ALIGNMENT-aligned block of at least `bytes` bytes, reusing a freed block of
+ * the same size class when there is one. The block is zeroed if `zero` is set. Returns NULL
+ * if the system is out of memory.
+ */
+void *pool_alloc(size_t bytes, int zero) {
+    size_t class_bytes;
+    int index = size_class(bytes, &class_bytes);
+    pthread_mutex_lock(&pool_lock);
+    pool_block *block = free_lists[index];
+    if (block != NULL) {
+      free_lists[index] = block->next;
+      cached_bytes -= class_bytes;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    int zeroed = 0;
+    if (block == NULL) {
+      block = system_alloc(class_bytes, &zeroed);
+      if (block == NULL) {
+        /* Memory may be tied up in other classes; give it back and retry once */
+        pool_trim();
+        block = system_alloc(class_bytes, &zeroed);
+        if (block == NULL) {
+          return NULL;
+        }
+      }
+    }
+    if (zero && !zeroed) {
+      memset(block, 0, bytes);
+    }
+    return block;
+}
+
+/*
+ * Returns a block obtained from pool_alloc(bytes, ...) to the pool. It is released to the
+ * system instead if keeping it would put the pool over its limit.
+ */
+void pool_free(void *ptr, size_t bytes) {
+    if (ptr == NULL) {
+      return;
+    }
+    size_t class_bytes;
+    int index = size_class(bytes, &class_bytes);
+    pthread_mutex_lock(&pool_lock);
+    if (cached_bytes + class_bytes <= cache_limit) {
+      pool_block *block = ptr;
+      block->next = free_lists[index];
+      free_lists[index] = block;
+      cached_bytes += class_bytes;
+      ptr = NULL;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    if (ptr != NULL) {
+      system_free(ptr, class_bytes);
+    }
+}
+
+/* Releases every idle block to the system. Returns the number of bytes released. */
+size_t pool_trim(void) {
+    pool_block *lists[POOL_NUM_CLASSES];
+    pthread_mutex_lock(&pool_lock);
+    memcpy(lists, free_lists, sizeof(lists));
+    memset(free_lists, 0, sizeof(free_lists));
+    size_t released = cached_bytes;
+    cached_bytes = 0;
+    pthread_mutex_unlock(&pool_lock);
+    for (int i = 0; i < POOL_NUM_CLASSES; i++) {
+      pool_block *block = lists[i];
+      while (block != NULL) {
+        pool_block *next = block->next;
+        system_free(block, class_size(i));
+        block = next;
+      }
+    }
+    return released;
+}
+
+/* Sets how many idle bytes the pool may hold, trimming it if it currently holds more */
+void pool_set_limit(size_t bytes) {
+    pthread_mutex_lock(&pool_lock);
+    cache_limit = bytes;
+    int over = cached_bytes > cache_limit;
+    pthread_mutex_unlock(&pool_lock);
+    if (over) {
+      pool_trim();
+    }
+}
+
+size_t pool_get_limit(void) {
+    return cache_limit;
+}
+
+/* Returns the number of bytes currently held in free lists */
+size_t pool_cached_bytes(void) {
+    pthread_mutex_lock(&pool_lock);
+    size_t bytes = cached_bytes;
+    pthread_mutex_unlock(&pool_lock);
+    return bytes;
+}
@@ -0,0 +1,24 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/*
+ * Recycling allocator for matrix data. Blocks are 64-byte aligned and grouped into size
+ * classes (four per power of two); freed blocks go onto their class's free list until the
+ * pool holds `pool_get_limit()` bytes, after which they are returned to the system.
+ */
+
+/* Alignment of every block handed out by the pool */
+#define POOL_ALIGNMENT 64
+/* Default number of idle bytes the pool keeps around */
+#define POOL_DEFAULT_LIMIT ((size_t) 1 << 30)
+
+void *pool_alloc(size_t bytes, int zero);
+void pool_free(void *ptr, size_t bytes);
+size_t pool_trim(void);
+void pool_set_limit(size_t bytes);
+size_t pool_get_limit(void);
+size_t pool_cached_bytes(void);
+
+#endif
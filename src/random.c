@@ -0,0 +1,75 @@
+#include "random.h"
+#include "kernels.h"
+#include <math.h>
+
+/* One Philox4x32-10 evaluation, mainly for checking against the published test vectors */
+void philox4x32_10(uint32_t out[4], const uint32_t ctr[4], const uint32_t key[2]) {
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    philox_rounds(&c0, &c1, &c2, &c3, key[0], key[1]);
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+/*
+ * Stores values start, ..., start + n - 1 of the uniform stream for `seed` to `out`, scaled to
+ * [low, high). Value i comes from block i / 2, which gives two values; whole blocks are
+ * generated by the vectorized kernel and a half block at either end is handled here.
+ */
+void random_uniform(double *out, uint64_t seed, uint64_t start, long n, double low, double high) {
+    uint32_t k0 = (uint32_t) seed;
+    uint32_t k1 = (uint32_t) (seed >> 32);
+    double range = high - low;
+    double u0, u1;
+    long i = 0;
+    if (n > 0 && (start & 1)) {
+      uniform_pair(start >> 1, k0, k1, &u0, &u1);
+      out[i++] = low + range * u1;
+    }
+    uint64_t first = (start + i) >> 1;
+    long pairs = (n - i) / 2;
+    kernels->uniform(out + i, first, pairs, k0, k1, low, range);
+    i += 2 * pairs;
+    if (i < n) {
+      uniform_pair((start + i) >> 1, k0, k1, &u0, &u1);
+      out[i] = low + range * u0;
+    }
+}
+
+/* Both values of one Box-Muller transform of block `block`, with mean 0 and deviation 1 */
+static inline void normal_pair(uint64_t block, uint32_t k0, uint32_t k1, double *z0, double *z1) {
+    const double two_pi = 6.283185307179586;
+    double u0, u1;
+    uniform_pair(block, k0, k1, &u0, &u1);
+    /* 1 - u0 lies in (0, 1], so the logarithm is finite */
+    double radius = sqrt(-2.0 * log(1.0 - u0));
+    *z0 = radius * cos(two_pi * u1);
+    *z1 = radius * sin(two_pi * u1);
+}
+
+/*
+ * Stores values start, ..., start + n - 1 of the normal stream for `seed` to `out`, with the
+ * given mean and standard deviation. Block i / 2 gives the pair of values 2 * (i / 2) and
+ * 2 * (i / 2) + 1 through one Box-Muller transform.
+ */
+void random_normal(double *out, uint64_t seed, uint64_t start, long n, double mean, double std) {
+    /* A different key than the uniform stream, so the two are unrelated for the same seed */
+    uint32_t k0 = (uint32_t) seed ^ PHILOX_W1;
+    uint32_t k1 = (uint32_t) (seed >> 32) ^ PHILOX_W0;
+    double z0, z1;
+    long i = 0;
+    if (n > 0 && (start & 1)) {
+      normal_pair(start >> 1, k0, k1, &z0, &z1);
+      out[i++] = mean + std * z1;
+    }
+    for (; i + 1 < n; i += 2) {
+      normal_pair((start + i) >> 1, k0, k1, &z0, &z1);
+      out[i] = mean + std * z0;
+      out[i + 1] = mean + std * z1;
+    }
+    if (i < n) {
+      normal_pair((start + i) >> 1, k0, k1, &z0, &z1);
+      out[i] = mean + std * z0;
+    }
+}
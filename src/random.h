@@ -0,0 +1,61 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+/*
+ * Counter-based random numbers. Value i of a stream is computed from (seed, i) alone with
+ * Philox4x32-10, so any range of a stream can be generated independently, in any order and on
+ * any number of threads, and always comes out the same. The helpers below are shared with the
+ * per-ISA uniform kernels.
+ */
+
+/* Philox4x32 multipliers and key increments, from "Parallel random numbers: as easy as 1, 2, 3" */
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+/* 2^-53, the spacing of doubles just below 1 */
+#define DOUBLE_UNIT (1.0 / 9007199254740992.0)
+
+/*
+ * Applies the Philox4x32-10 rounds to the counter words c0..c3 in place. Written out on
+ * scalars so that loops running it for consecutive counters are vectorized.
+ */
+static inline void philox_rounds(uint32_t *c0, uint32_t *c1, uint32_t *c2, uint32_t *c3,
+                                 uint32_t k0, uint32_t k1) {
+    for (int r = 0; r < PHILOX_ROUNDS; r++) {
+      uint64_t p0 = (uint64_t) PHILOX_M0 * *c0;
+      uint64_t p1 = (uint64_t) PHILOX_M1 * *c2;
+      *c0 = (uint32_t) (p1 >> 32) ^ *c1 ^ k0;
+      *c2 = (uint32_t) (p0 >> 32) ^ *c3 ^ k1;
+      *c1 = (uint32_t) p1;
+      *c3 = (uint32_t) p0;
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+}
+
+/*
+ * Turns the top 27 bits of `hi` and 26 bits of `lo` into a double in [0, 1). Both parts fit in
+ * a signed int, whose conversion to double vectorizes without 64-bit integer support.
+ */
+static inline double to_unit(uint32_t hi, uint32_t lo) {
+    return ((int32_t) (hi >> 5) * 67108864.0 + (int32_t) (lo >> 6)) * DOUBLE_UNIT;
+}
+
+/* Both values of block `block` of the uniform stream for key (k0, k1), in [0, 1) */
+static inline void uniform_pair(uint64_t block, uint32_t k0, uint32_t k1, double *u0, double *u1) {
+    uint32_t w0 = (uint32_t) block, w1 = (uint32_t) (block >> 32), w2 = 0, w3 = 0;
+    philox_rounds(&w0, &w1, &w2, &w3, k0, k1);
+    *u0 = to_unit(w0, w1);
+    *u1 = to_unit(w2, w3);
+}
+
+void philox4x32_10(uint32_t out[4], const uint32_t ctr[4], const uint32_t key[2]);
+void random_uniform(double *out, uint64_t seed, uint64_t start, long n, double low, double high);
+void random_normal(double *out, uint64_t seed, uint64_t start, long n, double mean, double std);
+
+#endif
@@ -0,0 +1,53 @@
+"""
+Memory bandwidth of numc's matrix-vector, vector-matrix and outer products compared with
+STREAM-style copy and add loops. All four stream their matrix operand through memory once, so
+a product close to the STREAM figures is limited by memory, not by the kernels.
+
+Run after `make install`: python tests/benchmarks/gemv_bandwidth.py [n] [repeats]
+"""
+import sys
+import time
+
+import numc as nc
+import numpy as np
+
+
+def best_time(func, repeats):
+    func()
+    best = float("inf")
+    for _ in range(repeats):
+        start = time.perf_counter()
+        func()
+        best = min(best, time.perf_counter() - start)
+    return best
+
+
+def report(name, bytes_moved, seconds):
+    print(f"{name:<24} {seconds * 1e3:9.2f} ms {bytes_moved / seconds / 1e9:8.2f} GB/s")
+
+
+def main():
+    n = int(sys.argv[1]) if len(sys.argv) > 1 else 8000
+    repeats = int(sys.argv[2]) if len(sys.argv) > 2 else 10
+    print(f"n = {n}, {nc.get_num_threads()} threads, best of {repeats}")
+
+    # STREAM copy (a = b) and add (a = b + c) over arrays as large as the matrix
+    a = np.zeros(n * n)
+    b = np.random.rand(n * n)
+    c = np.random.rand(n * n)
+    elem = a.itemsize
+    report("STREAM copy", 2 * n * n * elem, best_time(lambda: np.copyto(a, b), repeats))
+    report("STREAM add", 3 * n * n * elem, best_time(lambda: np.add(b, c, out=a), repeats))
+    del a, b, c
+
+    mat = nc.Matrix(n, n, rand=True, seed=1)
+    col = nc.Matrix(n, 1, rand=True, seed=2)
+    row = nc.Matrix(1, n, rand=True, seed=3)
+    # GEMV and GEVM read the matrix once; GER writes one
+    report("GEMV  A x   (n x n)", n * n * elem, best_time(lambda: mat * col, repeats))
+    report("GEVM  x^T A (n x n)", n * n * elem, best_time(lambda: row * mat, repeats))
+    report("GER   x y^T (n x n)", n * n * elem, best_time(lambda: col * row, repeats))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,7 +1,17 @@
 #include "CUnit/CUnit.h"
 #include "CUnit/Basic.h"
 #include "../src/matrix.h"
+#include "../src/kernels.h"
+#include "../src/pool.h"
+#include "../src/expr.h"
+#include "../src/random.h"
+#include "../src/parallel.h"
+#include "../src/npy.h"
+#include "../src/backing.h"
+#include <omp.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 /* Test Suite setup and cleanup functions: */
 int init_suite(void) { return 0; }
@@ -80,7 +90,7 @@ void alloc_ref_success_test(void) {
     }
   }
   CU_ASSERT_EQUAL(allocate_matrix_ref(&mat, from, 2, 2, 2), 0);
-  CU_ASSERT_PTR_EQUAL(mat->data, from->data + 2);
+  CU_ASSERT_PTR_EQUAL(mat->data, (double *) from->data + 2);
   CU_ASSERT_PTR_EQUAL(mat->parent, from);
   CU_ASSERT_EQUAL(mat->parent->ref_cnt, 2);
   CU_ASSERT_EQUAL(mat->rows, 2);
@@ -89,6 +99,329 @@ void alloc_ref_success_test(void) {
   deallocate_matrix(mat);
 }
 
+void alloc_pool_test(void) {
+  matrix *mat = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix(&mat, 5, 7), 0);
+  CU_ASSERT_EQUAL((uintptr_t) mat->data % POOL_ALIGNMENT, 0);
+  double *data = mat->data;
+  set(mat, 4, 6, 3);
+  deallocate_matrix(mat);
+  /* A freed block is handed out again for the same size, zeroed by allocate_matrix */
+  CU_ASSERT_EQUAL(allocate_matrix(&mat, 7, 5), 0);
+  CU_ASSERT_PTR_EQUAL(mat->data, data);
+  CU_ASSERT_EQUAL(get(mat, 6, 4), 0);
+  deallocate_matrix(mat);
+  CU_ASSERT_NOT_EQUAL(pool_cached_bytes(), 0);
+  CU_ASSERT_NOT_EQUAL(pool_trim(), 0);
+  CU_ASSERT_EQUAL(pool_cached_bytes(), 0);
+  /* Nothing is kept once the limit is 0 */
+  size_t limit = pool_get_limit();
+  pool_set_limit(0);
+  CU_ASSERT_EQUAL(allocate_matrix_uninitialized(&mat, 5, 7), 0);
+  deallocate_matrix(mat);
+  CU_ASSERT_EQUAL(pool_cached_bytes(), 0);
+  pool_set_limit(limit);
+}
+
+static int released = 0;
+
+static void count_release(void *owner) {
+  released++;
+  CU_ASSERT_PTR_EQUAL(owner, &released);
+}
+
+void alloc_external_test(void) {
+  double data[6] = {1, 2, 3, 4, 5, 6};
+  matrix *mat = NULL;
+  matrix *slice = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix_external(&mat, data, DTYPE_FLOAT64, 0, 3, count_release, &released), -1);
+  CU_ASSERT_EQUAL(allocate_matrix_external(&mat, data, DTYPE_FLOAT64, 2, 3, count_release, &released), 0);
+  CU_ASSERT_PTR_EQUAL(mat->data, data);
+  CU_ASSERT_EQUAL(get(mat, 1, 2), 6);
+  CU_ASSERT_EQUAL(allocate_matrix_ref(&slice, mat, 3, 3, 1), 0);
+  deallocate_matrix(mat);
+  CU_ASSERT_EQUAL(released, 0);
+  deallocate_matrix(slice);
+  CU_ASSERT_EQUAL(released, 1);
+}
+
+void alloc_view_test(void) {
+  matrix *from = NULL;
+  matrix *view = NULL;
+  matrix *view_of_view = NULL;
+  allocate_matrix(&from, 4, 6);
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 6; j++) {
+      set(from, i, j, i * 6 + j);
+    }
+  }
+  /* Rows 1 and 3, columns 5, 3 and 1 */
+  CU_ASSERT_EQUAL(allocate_matrix_view(&view, from, 6 + 5, 2, 3, 12, -2), 0);
+  CU_ASSERT_PTR_EQUAL(view->parent, from);
+  CU_ASSERT_EQUAL(from->ref_cnt, 2);
+  CU_ASSERT_FALSE(is_contiguous(view));
+  CU_ASSERT_EQUAL(get(view, 0, 0), 11);
+  CU_ASSERT_EQUAL(get(view, 0, 2), 7);
+  CU_ASSERT_EQUAL(get(view, 1, 1), 21);
+  /* Slices of slices hang off the matrix that owns the data */
+  CU_ASSERT_EQUAL(allocate_matrix_view(&view_of_view, view, -5, 2, 1, 6, 1), 0);
+  CU_ASSERT_PTR_EQUAL(view_of_view->parent, from);
+  CU_ASSERT_EQUAL(from->ref_cnt, 3);
+  CU_ASSERT_EQUAL(get(view_of_view, 1, 0), 12);
+  set(view, 1, 2, -1);
+  CU_ASSERT_EQUAL(get(from, 3, 1), -1);
+  deallocate_matrix(view);
+  deallocate_matrix(from);
+  CU_ASSERT_EQUAL(get(view_of_view, 0, 0), 6);
+  deallocate_matrix(view_of_view);
+}
+
+void retain_threads_test(void) {
+  matrix *parent = NULL;
+  matrix *slice = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix(&parent, 4, 4), 0);
+  CU_ASSERT_EQUAL(allocate_matrix_ref(&slice, parent, 4, 2, 4), 0);
+  /* Slices and pins are taken and dropped concurrently without losing counts */
+  #pragma omp parallel for num_threads(4)
+  for (int i = 0; i < 100000; i++) {
+    matrix *view = NULL;
+    allocate_matrix_view(&view, slice, i % 4, 1, 1, 4, 1);
+    matrix *root = retain_matrix(view);
+    deallocate_matrix(view);
+    deallocate_matrix(root);
+  }
+  CU_ASSERT_EQUAL(parent->ref_cnt, 2);
+  /* A pin keeps the data alive after every slice is gone */
+  matrix *root = retain_matrix(slice);
+  CU_ASSERT_PTR_EQUAL(root, parent);
+  deallocate_matrix(slice);
+  deallocate_matrix(parent);
+  CU_ASSERT_EQUAL(root->ref_cnt, 1);
+  deallocate_matrix(root);
+}
+
+void parallel_test(void) {
+  int threads = get_num_threads();
+  long threshold = get_parallel_threshold(PARALLEL_ELEMENTWISE);
+  set_num_threads(4);
+  set_parallel_threshold(PARALLEL_ELEMENTWISE, 1000);
+  CU_ASSERT_EQUAL(threads_for(PARALLEL_ELEMENTWISE, 999, 100), 1);
+  CU_ASSERT_EQUAL(threads_for(PARALLEL_ELEMENTWISE, 2500, 100), 2);
+  CU_ASSERT_EQUAL(threads_for(PARALLEL_ELEMENTWISE, 1000000, 100), 4);
+  CU_ASSERT_EQUAL(threads_for(PARALLEL_ELEMENTWISE, 1000000, 3), 3);
+  set_num_threads(0);
+  CU_ASSERT_EQUAL(get_num_threads(), 1);
+  /* Results do not depend on how many threads computed them */
+  matrix *mat = NULL;
+  matrix *serial = NULL;
+  matrix *parallel = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix(&mat, 70, 90), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&serial, 70, 70), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&parallel, 70, 70), 0);
+  rand_matrix(mat, 3, -1, 1);
+  matrix *transposed = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix_view(&transposed, mat, 0, 90, 70, 1, 90), 0);
+  mul_matrix(serial, mat, transposed);
+  set_num_threads(4);
+  set_parallel_threshold(PARALLEL_GEMM, 1);
+  mul_matrix(parallel, mat, transposed);
+  for (int i = 0; i < 70; i++) {
+    for (int j = 0; j < 70; j++) {
+      CU_ASSERT_EQUAL(get(serial, i, j), get(parallel, i, j));
+    }
+  }
+  set_parallel_threshold(PARALLEL_GEMM, PARALLEL_DEFAULT_GEMM);
+  set_parallel_threshold(PARALLEL_ELEMENTWISE, threshold);
+  set_num_threads(threads);
+  deallocate_matrix(transposed);
+  deallocate_matrix(mat);
+  deallocate_matrix(serial);
+  deallocate_matrix(parallel);
+}
+
+/* Adds 1 to counts[begin, end), and to a nested range of 8 counts per unit when ctx is nested */
+typedef struct pool_ctx {
+  int *counts;
+  int nested;
+} pool_ctx;
+
+static void count_units(void *arg, long begin, long end) {
+  pool_ctx *ctx = arg;
+  for (long unit = begin; unit < end; unit++) {
+    if (ctx->nested) {
+      pool_ctx inner = {ctx->counts + unit * 8, 0};
+      parallel_for(4, 8, count_units, &inner);
+    } else {
+      __atomic_add_fetch(&ctx->counts[unit], 1, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+void pool_test(void) {
+  int threads = get_num_threads();
+  set_num_threads(4);
+  /* Every unit runs exactly once, also when tiles start parallel loops of their own */
+  int counts[64 * 8] = {0};
+  pool_ctx flat = {counts, 0};
+  parallel_for(4, 64 * 8, count_units, &flat);
+  pool_ctx nested = {counts, 1};
+  parallel_for(4, 64, count_units, &nested);
+  for (int i = 0; i < 64 * 8; i++) {
+    CU_ASSERT_EQUAL(counts[i], 2);
+  }
+  /* Callers on several threads share the workers */
+  int shared[1000] = {0};
+  #pragma omp parallel for num_threads(4)
+  for (int i = 0; i < 8; i++) {
+    pool_ctx ctx = {shared, 0};
+    parallel_for(4, 1000, count_units, &ctx);
+  }
+  for (int i = 0; i < 1000; i++) {
+    CU_ASSERT_EQUAL(shared[i], 8);
+  }
+  /* One thread runs everything inline */
+  set_num_threads(1);
+  pool_ctx serial = {shared, 0};
+  parallel_for(4, 1000, count_units, &serial);
+  CU_ASSERT_EQUAL(shared[999], 9);
+  set_num_threads(threads);
+}
+
+void views_overlap_test(void) {
+  matrix *mat = NULL;
+  matrix *other = NULL;
+  matrix *top = NULL;
+  matrix *bottom = NULL;
+  matrix *middle = NULL;
+  matrix *cols = NULL;
+  allocate_matrix(&mat, 4, 4);
+  allocate_matrix(&other, 4, 4);
+  allocate_matrix_view(&top, mat, 0, 2, 4, 4, 1);
+  allocate_matrix_view(&bottom, mat, 8, 2, 4, 4, 1);
+  allocate_matrix_view(&middle, mat, 4, 2, 4, 4, 1);
+  /* Every other column, walked backwards */
+  allocate_matrix_view(&cols, mat, 3, 4, 2, 4, -2);
+  CU_ASSERT_FALSE(views_overlap(mat, mat));
+  CU_ASSERT_FALSE(views_overlap(mat, other));
+  CU_ASSERT_FALSE(views_overlap(top, bottom));
+  CU_ASSERT_TRUE(views_overlap(top, middle));
+  CU_ASSERT_TRUE(views_overlap(middle, bottom));
+  CU_ASSERT_TRUE(views_overlap(mat, top));
+  CU_ASSERT_TRUE(views_overlap(cols, bottom));
+  deallocate_matrix(cols);
+  deallocate_matrix(middle);
+  deallocate_matrix(bottom);
+  deallocate_matrix(top);
+  deallocate_matrix(other);
+  deallocate_matrix(mat);
+}
+
+void expr_test(void) {
+  matrix *a = NULL;
+  matrix *b = NULL;
+  matrix *cols = NULL;
+  matrix *result = NULL;
+  allocate_matrix(&a, 3, 1000);
+  allocate_matrix(&b, 3, 1000);
+  allocate_matrix(&result, 3, 1000);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 1000; j++) {
+      set(a, i, j, i - j);
+      set(b, i, j, j % 7);
+    }
+  }
+  /* abs(-(a - b)) + (a - b), with a - b shared */
+  expr *leaf_a, *leaf_b, *diff, *neg, *absolute, *sum;
+  CU_ASSERT_EQUAL(expr_leaf(&leaf_a, a), 0);
+  CU_ASSERT_EQUAL(expr_leaf(&leaf_b, b), 0);
+  CU_ASSERT_EQUAL(a->ref_cnt, 2);
+  CU_ASSERT_EQUAL(expr_apply(&diff, EXPR_SUB, leaf_a, leaf_b), 0);
+  CU_ASSERT_EQUAL(expr_apply(&neg, EXPR_NEG, diff, NULL), 0);
+  CU_ASSERT_EQUAL(expr_apply(&absolute, EXPR_ABS, neg, NULL), 0);
+  CU_ASSERT_EQUAL(expr_apply(&sum, EXPR_ADD, absolute, diff), 0);
+  CU_ASSERT_EQUAL(sum->size, 9);
+  expr_release(leaf_a);
+  expr_release(leaf_b);
+  expr_release(diff);
+  expr_release(neg);
+  expr_release(absolute);
+  CU_ASSERT_EQUAL(eval_expr(result, sum), 0);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 1000; j++) {
+      double d = (i - j) - (j % 7);
+      CU_ASSERT_EQUAL(get(result, i, j), fabs(d) + d);
+    }
+  }
+  /* Strided leaves are gathered: every other column of b, walked backwards */
+  allocate_matrix_view(&cols, b, 999, 3, 500, 1000, -2);
+  expr *leaf_cols, *twice;
+  CU_ASSERT_EQUAL(expr_leaf(&leaf_cols, cols), 0);
+  CU_ASSERT_EQUAL(expr_apply(&twice, EXPR_ADD, leaf_cols, leaf_cols), 0);
+  matrix *small = NULL;
+  allocate_matrix(&small, 3, 500);
+  CU_ASSERT_EQUAL(eval_expr(small, twice), 0);
+  CU_ASSERT_EQUAL(get(small, 2, 0), 2 * (999 % 7));
+  CU_ASSERT_EQUAL(get(small, 1, 499), 2 * (1 % 7));
+  /* Trees may not grow past EXPR_MAX_NODES */
+  expr *four, *eight, *sixteen;
+  CU_ASSERT_EQUAL(expr_apply(&four, EXPR_ADD, twice, twice), 0);
+  CU_ASSERT_EQUAL(expr_apply(&eight, EXPR_ADD, four, four), 0);
+  CU_ASSERT_EQUAL(expr_apply(&sixteen, EXPR_ADD, eight, eight), -1);
+  CU_ASSERT_EQUAL(expr_apply(&sixteen, EXPR_ADD, eight, leaf_cols), -1);
+  expr_release(eight);
+  expr_release(four);
+  expr_release(twice);
+  expr_release(leaf_cols);
+  deallocate_matrix(cols);
+  CU_ASSERT_EQUAL(b->ref_cnt, 2);
+  expr_release(sum);
+  CU_ASSERT_EQUAL(a->ref_cnt, 1);
+  CU_ASSERT_EQUAL(b->ref_cnt, 1);
+  deallocate_matrix(small);
+  deallocate_matrix(result);
+  deallocate_matrix(b);
+  deallocate_matrix(a);
+}
+
+void strided_ops_test(void) {
+  matrix *mat = NULL;
+  matrix *result = NULL;
+  matrix *cols = NULL;
+  matrix *rows = NULL;
+  allocate_matrix(&mat, 3, 3);
+  allocate_matrix(&result, 3, 3);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      set(mat, i, j, i * 3 + j + 1);
+    }
+  }
+  /* The transpose of mat as a view: rows of `cols` are columns of mat */
+  allocate_matrix_view(&cols, mat, 0, 3, 3, 1, 3);
+  /* mat upside down */
+  allocate_matrix_view(&rows, mat, 6, 3, 3, -3, 1);
+  add_matrix(result, cols, rows);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      CU_ASSERT_EQUAL(get(result, i, j), get(mat, j, i) + get(mat, 2 - i, j));
+    }
+  }
+  /* mat^T * mat */
+  mul_matrix(result, cols, mat);
+  CU_ASSERT_EQUAL(get(result, 0, 0), 66);
+  CU_ASSERT_EQUAL(get(result, 1, 2), 108);
+  CU_ASSERT_EQUAL(get(result, 2, 1), 108);
+  deallocate_matrix(cols);
+  /* A strided result: writing -mat through a transposed view of result */
+  allocate_matrix_view(&cols, result, 0, 3, 3, 1, 3);
+  neg_matrix(cols, mat);
+  CU_ASSERT_EQUAL(get(result, 0, 1), -4);
+  CU_ASSERT_EQUAL(get(result, 1, 0), -2);
+  deallocate_matrix(cols);
+  deallocate_matrix(rows);
+  deallocate_matrix(result);
+  deallocate_matrix(mat);
+}
+
 void dealloc_null_test(void) {
   matrix *mat = NULL;
   deallocate_matrix(mat); // Test the null case doesn't crash
@@ -248,6 +581,40 @@ void mul_non_square_test(void) {
   deallocate_matrix(mat2);
 }
 
+void mul_blocked_test(void) {
+  matrix *result = NULL;
+  matrix *mat1 = NULL;
+  matrix *mat2 = NULL;
+  /* Dimensions that are not multiples of any of the GEMM block sizes */
+  int rows = 131, inner = 263, cols = 19;
+  CU_ASSERT_EQUAL(allocate_matrix(&result, rows, cols), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&mat1, rows, inner), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&mat2, inner, cols), 0);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < inner; j++) {
+      set(mat1, i, j, (i + j) % 7 - 3);
+    }
+  }
+  for (int i = 0; i < inner; i++) {
+    for (int j = 0; j < cols; j++) {
+      set(mat2, i, j, (i * j) % 5 - 2);
+    }
+  }
+  mul_matrix(result, mat1, mat2);
+  for (int i = 0; i < rows; i++) {
+    for (int j = 0; j < cols; j++) {
+      double expected = 0;
+      for (int k = 0; k < inner; k++) {
+        expected += get(mat1, i, k) * get(mat2, k, j);
+      }
+      CU_ASSERT_EQUAL(get(result, i, j), expected);
+    }
+  }
+  deallocate_matrix(result);
+  deallocate_matrix(mat1);
+  deallocate_matrix(mat2);
+}
+
 void pow_test(void) {
   matrix *result = NULL;
   matrix *mat = NULL;
@@ -267,15 +634,712 @@ void pow_test(void) {
   CU_ASSERT_EQUAL(get(result, 0, 1), 55);
   CU_ASSERT_EQUAL(get(result, 1, 0), 55);
   CU_ASSERT_EQUAL(get(result, 1, 1), 34);
+  /* Powers 0 and 1 only write result; 2 is a single product */
+  pow_matrix(result, mat, 0);
+  CU_ASSERT_EQUAL(get(result, 0, 0), 1);
+  CU_ASSERT_EQUAL(get(result, 0, 1), 0);
+  pow_matrix(result, mat, 1);
+  CU_ASSERT_EQUAL(get(result, 0, 0), 1);
+  CU_ASSERT_EQUAL(get(result, 1, 1), 0);
+  pow_matrix(result, mat, 2);
+  CU_ASSERT_EQUAL(get(result, 0, 0), 2);
+  CU_ASSERT_EQUAL(get(result, 1, 1), 1);
+  /* Squarings are shared between exponents; fib(n + 1) ends up at (0, 0) */
+  int pows[5] = {0, 1, 7, 10, 30};
+  double fib[5] = {1, 1, 21, 89, 1346269};
+  matrix *results[5];
+  for (int i = 0; i < 5; i++) {
+    CU_ASSERT_EQUAL(allocate_matrix(&results[i], 2, 2), 0);
+  }
+  CU_ASSERT_EQUAL(pow_matrix_many(results, mat, pows, 5), 0);
+  for (int i = 0; i < 5; i++) {
+    CU_ASSERT_EQUAL(get(results[i], 0, 0), fib[i]);
+    deallocate_matrix(results[i]);
+  }
+  /* A result that is the base itself still gets the right power */
+  pow_matrix(mat, mat, 5);
+  CU_ASSERT_EQUAL(get(mat, 0, 0), 8);
+  CU_ASSERT_EQUAL(get(mat, 1, 1), 3);
+  deallocate_matrix(result);
+  deallocate_matrix(mat);
+}
+
+void strassen_test(void) {
+  int dims[3][3] = {{32, 32, 32}, {37, 29, 41}, {64, 17, 50}};
+  set_strassen_cutoff(8);
+  for (int t = 0; t < 3; t++) {
+    int m = dims[t][0], k = dims[t][1], n = dims[t][2];
+    matrix *mat1 = NULL, *mat2 = NULL, *classic = NULL, *fast = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix(&mat1, m, k), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&mat2, k, n), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&classic, m, n), 0);
+    CU_ASSERT_EQUAL(allocate_matrix(&fast, m, n), 0);
+    rand_matrix(mat1, t, -1, 1);
+    rand_matrix(mat2, t + 10, -1, 1);
+    set_matmul_algorithm(MATMUL_CLASSIC);
+    CU_ASSERT_EQUAL(mul_matrix(classic, mat1, mat2), 0);
+    /* Odd dimensions are peeled off at every level of the recursion */
+    set_matmul_algorithm(MATMUL_STRASSEN);
+    CU_ASSERT_EQUAL(mul_matrix(fast, mat1, mat2), 0);
+    for (int i = 0; i < m; i++) {
+      for (int j = 0; j < n; j++) {
+        CU_ASSERT_DOUBLE_EQUAL(get(fast, i, j), get(classic, i, j), 1e-12);
+      }
+    }
+    deallocate_matrix(mat1);
+    deallocate_matrix(mat2);
+    deallocate_matrix(classic);
+    deallocate_matrix(fast);
+  }
+  /* In auto mode only pow_matrix uses it */
+  matrix *mat = NULL, *power = NULL, *expected = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix(&mat, 20, 20), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&power, 20, 20), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&expected, 20, 20), 0);
+  rand_matrix(mat, 5, 0, 0.1);
+  set_matmul_algorithm(MATMUL_CLASSIC);
+  pow_matrix(expected, mat, 6);
+  set_matmul_algorithm(MATMUL_AUTO);
+  pow_matrix(power, mat, 6);
+  for (int i = 0; i < 20; i++) {
+    for (int j = 0; j < 20; j++) {
+      CU_ASSERT_DOUBLE_EQUAL(get(power, i, j), get(expected, i, j), 1e-12);
+    }
+  }
+  set_strassen_cutoff(STRASSEN_DEFAULT_CUTOFF);
+  deallocate_matrix(mat);
+  deallocate_matrix(power);
+  deallocate_matrix(expected);
+}
+
+void kernels_test(void) {
+  const char *names[] = {"scalar", "sse2", "avx2", "avx512"};
+  matrix *result = NULL;
+  matrix *mat1 = NULL;
+  matrix *mat2 = NULL;
+  matrix *result32 = NULL;
+  matrix *mat1_32 = NULL;
+  CU_ASSERT_EQUAL(select_kernels("no_such_isa"), -1);
+  CU_ASSERT_EQUAL(allocate_matrix(&result, 9, 9), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&mat1, 9, 7), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&mat2, 7, 9), 0);
+  for (int i = 0; i < 9; i++) {
+    for (int j = 0; j < 7; j++) {
+      set(mat1, i, j, i - j);
+      set(mat2, j, i, i + j);
+    }
+  }
+  CU_ASSERT_EQUAL(allocate_matrix_typed(&result32, 9, 9, DTYPE_FLOAT32), 0);
+  CU_ASSERT_EQUAL(allocate_matrix_typed(&mat1_32, 9, 7, DTYPE_FLOAT32), 0);
+  copy_matrix(mat1_32, mat1);
+  const kernel_table *default_kernels = kernels;
+  const kernel_table *default_kernels_f32 = kernels_f32;
+  for (int n = 0; n < 4; n++) {
+    if (kernels_supported(names[n]) != 1) {
+      continue;
+    }
+    CU_ASSERT_EQUAL(select_kernels(names[n]), 0);
+    mul_matrix(result, mat1, mat2);
+    for (int i = 0; i < 9; i++) {
+      for (int j = 0; j < 9; j++) {
+        double expected = 0;
+        for (int k = 0; k < 7; k++) {
+          expected += (i - k) * (k + j);
+        }
+        CU_ASSERT_EQUAL(get(result, i, j), expected);
+      }
+    }
+    neg_matrix(result, result);
+    abs_matrix(result, result);
+    add_matrix(result, result, result);
+    CU_ASSERT_EQUAL(get(result, 8, 8), 2 * fabs(get(mat1, 8, 0) * get(mat2, 0, 8) +
+                                                get(mat1, 8, 1) * get(mat2, 1, 8) +
+                                                get(mat1, 8, 2) * get(mat2, 2, 8) +
+                                                get(mat1, 8, 3) * get(mat2, 3, 8) +
+                                                get(mat1, 8, 4) * get(mat2, 4, 8) +
+                                                get(mat1, 8, 5) * get(mat2, 5, 8) +
+                                                get(mat1, 8, 6) * get(mat2, 6, 8)));
+    /* float32 result: the float64 operand is converted, and small integers stay exact */
+    CU_ASSERT_EQUAL(mul_matrix(result32, mat1_32, mat2), 0);
+    add_matrix(result32, result32, result32);
+    neg_matrix(result32, result32);
+    for (int i = 0; i < 9; i++) {
+      for (int j = 0; j < 9; j++) {
+        double expected = 0;
+        for (int k = 0; k < 7; k++) {
+          expected += (i - k) * (k + j);
+        }
+        CU_ASSERT_EQUAL(get(result32, i, j), -2 * expected);
+      }
+    }
+  }
+  kernels = default_kernels;
+  kernels_f32 = default_kernels_f32;
+  deallocate_matrix(result);
+  deallocate_matrix(mat1);
+  deallocate_matrix(mat2);
+  deallocate_matrix(result32);
+  deallocate_matrix(mat1_32);
+}
+
+void batch_mul_test(void) {
+  const char *names[] = {"scalar", "sse2", "avx2", "avx512"};
+  const kernel_table *default_kernels = kernels;
+  const kernel_table *default_kernels_f32 = kernels_f32;
+  /* Shapes cover full 4-row tiles, double-width strips, single vectors and scalar tails */
+  int dims[3][3] = {{8, 8, 8}, {9, 7, 19}, {5, 33, 3}};
+  for (int n = 0; n < 4; n++) {
+    if (kernels_supported(names[n]) != 1) {
+      continue;
+    }
+    CU_ASSERT_EQUAL(select_kernels(names[n]), 0);
+    for (int d = 0; d < 3; d++) {
+      int rows = dims[d][0], inner = dims[d][1], cols = dims[d][2];
+      for (int t = 0; t < 2; t++) {
+        dtype type = t == 0 ? DTYPE_FLOAT64 : DTYPE_FLOAT32;
+        matrix *block = NULL, *mats1[3], *mats2[3], *results[3], *expected = NULL;
+        CU_ASSERT_EQUAL(allocate_matrix_typed(&block, 3 * rows, cols, type), 0);
+        CU_ASSERT_EQUAL(allocate_matrix_typed(&expected, rows, cols, type), 0);
+        for (int i = 0; i < 3; i++) {
+          CU_ASSERT_EQUAL(allocate_matrix_typed(&mats1[i], rows, inner, type), 0);
+          CU_ASSERT_EQUAL(allocate_matrix_typed(&mats2[i], inner, cols, type), 0);
+          CU_ASSERT_EQUAL(allocate_matrix_view(&results[i], block, (long) i * rows * cols, rows,
+                                               cols, cols, 1), 0);
+          rand_matrix(mats1[i], 3 * i, -2, 2);
+          rand_matrix(mats2[i], 3 * i + 1, -2, 2);
+        }
+        CU_ASSERT_EQUAL(batch_mul_matrix(results, mats1, mats2, 3), 0);
+        for (int i = 0; i < 3; i++) {
+          mul_matrix(expected, mats1[i], mats2[i]);
+          for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < cols; c++) {
+              CU_ASSERT_DOUBLE_EQUAL(get(results[i], r, c), get(expected, r, c), 1e-4);
+            }
+          }
+          deallocate_matrix(mats1[i]);
+          deallocate_matrix(mats2[i]);
+          deallocate_matrix(results[i]);
+        }
+        deallocate_matrix(expected);
+        deallocate_matrix(block);
+      }
+    }
+  }
+  kernels = default_kernels;
+  kernels_f32 = default_kernels_f32;
+}
+
+/* Checks the reductions of `mat` against plain loops over its elements */
+static void check_reductions(matrix *mat) {
+  double values[20000];
+  long indices[20000];
+  double total = 0, biggest = get(mat, 0, 0);
+  long biggest_at = 0;
+  for (int i = 0; i < mat->rows; i++) {
+    for (int j = 0; j < mat->cols; j++) {
+      total += get(mat, i, j);
+      if (get(mat, i, j) > biggest) {
+        biggest = get(mat, i, j);
+        biggest_at = (long) i * mat->cols + j;
+      }
+    }
+  }
+  double value;
+  long index;
+  CU_ASSERT_EQUAL(reduce_matrix(&value, mat, REDUCE_SUM), 0);
+  CU_ASSERT_DOUBLE_EQUAL(value, total, 1e-6 * mat->rows * mat->cols);
+  CU_ASSERT_EQUAL(reduce_matrix(&value, mat, REDUCE_MAX), 0);
+  CU_ASSERT_EQUAL(value, biggest);
+  CU_ASSERT_EQUAL(arg_reduce_matrix(&index, mat, 1), 0);
+  CU_ASSERT_EQUAL(index, biggest_at);
+  CU_ASSERT_EQUAL(reduce_matrix_axis(values, mat, REDUCE_SUM_SQ, 1), 0);
+  for (int i = 0; i < mat->rows; i++) {
+    double sum_sq = 0;
+    for (int j = 0; j < mat->cols; j++) {
+      sum_sq += get(mat, i, j) * get(mat, i, j);
+    }
+    CU_ASSERT_DOUBLE_EQUAL(values[i], sum_sq, 1e-6 * mat->cols);
+  }
+  CU_ASSERT_EQUAL(reduce_matrix_axis(values, mat, REDUCE_MIN, 0), 0);
+  CU_ASSERT_EQUAL(arg_reduce_matrix_axis(indices, mat, 0, 0), 0);
+  for (int j = 0; j < mat->cols; j++) {
+    int smallest_at = 0;
+    for (int i = 1; i < mat->rows; i++) {
+      if (get(mat, i, j) < get(mat, smallest_at, j)) {
+        smallest_at = i;
+      }
+    }
+    CU_ASSERT_EQUAL(values[j], get(mat, smallest_at, j));
+    CU_ASSERT_EQUAL(indices[j], smallest_at);
+  }
+}
+
+void reduce_test(void) {
+  const char *names[] = {"scalar", "sse2", "avx2", "avx512"};
+  const kernel_table *default_kernels = kernels;
+  const kernel_table *default_kernels_f32 = kernels_f32;
+  for (int n = 0; n < 4; n++) {
+    if (kernels_supported(names[n]) != 1) {
+      continue;
+    }
+    CU_ASSERT_EQUAL(select_kernels(names[n]), 0);
+    for (int t = 0; t < 2; t++) {
+      dtype type = t == 0 ? DTYPE_FLOAT64 : DTYPE_FLOAT32;
+      /* Rows longer than a chunk, and a strided view that has to be gathered */
+      matrix *mat = NULL, *view = NULL;
+      CU_ASSERT_EQUAL(allocate_matrix_typed(&mat, 37, 20000, type), 0);
+      rand_matrix(mat, n, -1, 1);
+      set(mat, 30, 19999, 5);
+      set(mat, 2, 7, 5);
+      CU_ASSERT_EQUAL(allocate_matrix_view(&view, mat, 1, 12, 6663, 3 * 20000, 3), 0);
+      check_reductions(mat);
+      check_reductions(view);
+      deallocate_matrix(view);
+      deallocate_matrix(mat);
+    }
+  }
+  kernels = default_kernels;
+  kernels_f32 = default_kernels_f32;
+  /* Partial results are combined in the same order for any number of threads */
+  int threads = get_num_threads();
+  long threshold = get_parallel_threshold(PARALLEL_ELEMENTWISE);
+  matrix *mat = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix(&mat, 300, 10000), 0);
+  rand_matrix(mat, 5, -1, 1);
+  double serial, parallel, serial_cols[10000], parallel_cols[10000];
+  set_num_threads(1);
+  reduce_matrix(&serial, mat, REDUCE_SUM);
+  reduce_matrix_axis(serial_cols, mat, REDUCE_SUM, 0);
+  set_num_threads(4);
+  set_parallel_threshold(PARALLEL_ELEMENTWISE, 1);
+  reduce_matrix(&parallel, mat, REDUCE_SUM);
+  reduce_matrix_axis(parallel_cols, mat, REDUCE_SUM, 0);
+  CU_ASSERT_EQUAL(serial, parallel);
+  CU_ASSERT_EQUAL(memcmp(serial_cols, parallel_cols, sizeof(serial_cols)), 0);
+  set_parallel_threshold(PARALLEL_ELEMENTWISE, threshold);
+  set_num_threads(threads);
+  deallocate_matrix(mat);
+}
+
+void transpose_test(void) {
+  const char *names[] = {"scalar", "sse2", "avx2", "avx512"};
+  const kernel_table *default_kernels = kernels;
+  const kernel_table *default_kernels_f32 = kernels_f32;
+  /* Shapes with full 4 x 4 tiles, ragged edges, several tiles and a recursion below a tile */
+  int dims[4][2] = {{4, 8}, {7, 5}, {300, 517}, {130, 130}};
+  for (int n = 0; n < 4; n++) {
+    if (kernels_supported(names[n]) != 1) {
+      continue;
+    }
+    CU_ASSERT_EQUAL(select_kernels(names[n]), 0);
+    for (int d = 0; d < 4; d++) {
+      int rows = dims[d][0], cols = dims[d][1];
+      for (int t = 0; t < 2; t++) {
+        dtype type = t == 0 ? DTYPE_FLOAT64 : DTYPE_FLOAT32;
+        matrix *mat = NULL, *result = NULL, *copy = NULL;
+        CU_ASSERT_EQUAL(allocate_matrix_typed(&mat, rows, cols, type), 0);
+        CU_ASSERT_EQUAL(allocate_matrix_typed(&result, cols, rows, type), 0);
+        CU_ASSERT_EQUAL(allocate_matrix_typed(&copy, rows, cols, type), 0);
+        rand_matrix(mat, d, -1, 1);
+        copy_matrix(copy, mat);
+        CU_ASSERT_EQUAL(transpose_matrix(result, mat), 0);
+        for (int i = 0; i < rows; i++) {
+          for (int j = 0; j < cols; j++) {
+            CU_ASSERT_EQUAL(get(result, j, i), get(mat, i, j));
+          }
+        }
+        if (rows == cols) {
+          CU_ASSERT_EQUAL(transpose_matrix(mat, mat), 0);
+          for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+              CU_ASSERT_EQUAL(get(mat, j, i), get(copy, i, j));
+            }
+          }
+        }
+        deallocate_matrix(mat);
+        deallocate_matrix(result);
+        deallocate_matrix(copy);
+      }
+    }
+  }
+  kernels = default_kernels;
+  kernels_f32 = default_kernels_f32;
+  /* Copying a transposed view takes the blocked path too */
+  matrix *mat = NULL, *view = NULL, *result = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix(&mat, 50, 60), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&result, 60, 50), 0);
+  rand_matrix(mat, 1, -1, 1);
+  CU_ASSERT_EQUAL(allocate_matrix_view(&view, mat, 0, 60, 50, 1, 60), 0);
+  copy_matrix(result, view);
+  for (int i = 0; i < 60; i++) {
+    for (int j = 0; j < 50; j++) {
+      CU_ASSERT_EQUAL(get(result, i, j), get(mat, j, i));
+    }
+  }
+  deallocate_matrix(view);
   deallocate_matrix(result);
   deallocate_matrix(mat);
 }
 
+void vector_product_test(void) {
+  /* GEMV, GEVM (also through a transposed matrix), GER and a dot product against plain loops */
+  int dims[5][3] = {{300, 200, 1}, {1, 600, 300}, {70, 1, 90}, {1, 999, 1}, {1, 3, 5}};
+  for (int d = 0; d < 5; d++) {
+    int rows = dims[d][0], inner = dims[d][1], cols = dims[d][2];
+    for (int t = 0; t < 2; t++) {
+      dtype type = t == 0 ? DTYPE_FLOAT64 : DTYPE_FLOAT32;
+      matrix *mat1 = NULL, *mat2 = NULL, *result = NULL, *stored = NULL, *transposed = NULL;
+      CU_ASSERT_EQUAL(allocate_matrix_typed(&mat1, rows, inner, type), 0);
+      CU_ASSERT_EQUAL(allocate_matrix_typed(&mat2, inner, cols, type), 0);
+      CU_ASSERT_EQUAL(allocate_matrix_typed(&result, rows, cols, type), 0);
+      CU_ASSERT_EQUAL(allocate_matrix_typed(&stored, inner, rows, type), 0);
+      rand_matrix(mat1, d, -1, 1);
+      rand_matrix(mat2, d + 10, -1, 1);
+      transpose_matrix(stored, mat1);
+      CU_ASSERT_EQUAL(allocate_matrix_view(&transposed, stored, 0, rows, inner, 1, rows), 0);
+      for (int pass = 0; pass < 2; pass++) {
+        CU_ASSERT_EQUAL(mul_matrix(result, pass == 0 ? mat1 : transposed, mat2), 0);
+        for (int i = 0; i < rows; i++) {
+          for (int j = 0; j < cols; j++) {
+            double expected = 0;
+            for (int p = 0; p < inner; p++) {
+              expected += get(mat1, i, p) * get(mat2, p, j);
+            }
+            CU_ASSERT_DOUBLE_EQUAL(get(result, i, j), expected, 1e-4);
+          }
+        }
+      }
+      deallocate_matrix(transposed);
+      deallocate_matrix(stored);
+      deallocate_matrix(mat1);
+      deallocate_matrix(mat2);
+      deallocate_matrix(result);
+    }
+  }
+}
+
+void scalar_test(void) {
+  /* affine_matrix and div_scalar_matrix on contiguous matrices and a strided view */
+  for (int t = 0; t < 2; t++) {
+    dtype type = t == 0 ? DTYPE_FLOAT64 : DTYPE_FLOAT32;
+    matrix *mat = NULL, *result = NULL, *view = NULL, *view_result = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix_typed(&mat, 5, 301, type), 0);
+    CU_ASSERT_EQUAL(allocate_matrix_typed(&result, 5, 301, type), 0);
+    CU_ASSERT_EQUAL(allocate_matrix_typed(&view_result, 5, 100, type), 0);
+    for (int i = 0; i < 5; i++) {
+      for (int j = 0; j < 301; j++) {
+        set(mat, i, j, i * 301 + j + 1);
+      }
+    }
+    CU_ASSERT_EQUAL(affine_matrix(result, mat, 2, 0), 0);
+    CU_ASSERT_EQUAL(get(result, 4, 300), 2 * 1505);
+    CU_ASSERT_EQUAL(affine_matrix(result, mat, 1, -0.5), 0);
+    CU_ASSERT_EQUAL(get(result, 2, 7), 610 - 0.5);
+    CU_ASSERT_EQUAL(affine_matrix(result, mat, -1, 4), 0);
+    CU_ASSERT_EQUAL(get(result, 0, 0), 3);
+    CU_ASSERT_EQUAL(div_scalar_matrix(result, mat, 4, 0), 0);
+    CU_ASSERT_EQUAL(get(result, 1, 1), 303 / 4.0);
+    CU_ASSERT_EQUAL(div_scalar_matrix(result, mat, 2, 1), 0);
+    CU_ASSERT_EQUAL(get(result, 0, 3), 0.5);
+    /* Every third column, in place and out of place */
+    CU_ASSERT_EQUAL(allocate_matrix_view(&view, mat, 0, 5, 100, 301, 3), 0);
+    CU_ASSERT_EQUAL(affine_matrix(view_result, view, 3, 1), 0);
+    CU_ASSERT_EQUAL(affine_matrix(view, view, 0, 7), 0);
+    for (int i = 0; i < 5; i++) {
+      for (int j = 0; j < 100; j++) {
+        CU_ASSERT_EQUAL(get(view_result, i, j), 3 * (i * 301 + 3 * j + 1) + 1);
+        CU_ASSERT_EQUAL(get(mat, i, 3 * j), 7);
+        CU_ASSERT_EQUAL(get(mat, i, 3 * j + 1), i * 301 + 3 * j + 2);
+      }
+    }
+    deallocate_matrix(view);
+    deallocate_matrix(view_result);
+    deallocate_matrix(result);
+    deallocate_matrix(mat);
+  }
+}
+
+void broadcast_test(void) {
+  int rows, cols;
+  CU_ASSERT_EQUAL(broadcast_dims(4, 5, 1, 5, &rows, &cols), 0);
+  CU_ASSERT(rows == 4 && cols == 5);
+  CU_ASSERT_EQUAL(broadcast_dims(1, 5, 4, 1, &rows, &cols), 0);
+  CU_ASSERT(rows == 4 && cols == 5);
+  CU_ASSERT_EQUAL(broadcast_dims(4, 5, 2, 5, &rows, &cols), -1);
+  CU_ASSERT_EQUAL(broadcast_dims(4, 5, 4, 3, &rows, &cols), -1);
+  /* A row and a column against a strided view, for both operand orders and both types */
+  for (int t = 0; t < 2; t++) {
+    dtype type = t == 0 ? DTYPE_FLOAT64 : DTYPE_FLOAT32;
+    matrix *mat = NULL, *view = NULL, *row = NULL, *col = NULL, *result = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix_typed(&mat, 7, 1200, type), 0);
+    CU_ASSERT_EQUAL(allocate_matrix_view(&view, mat, 0, 7, 600, 1200, 2), 0);
+    CU_ASSERT_EQUAL(allocate_matrix_typed(&row, 1, 600, type), 0);
+    CU_ASSERT_EQUAL(allocate_matrix_typed(&col, 7, 1, type), 0);
+    CU_ASSERT_EQUAL(allocate_matrix_typed(&result, 7, 600, type), 0);
+    for (int i = 0; i < 7; i++) {
+      for (int j = 0; j < 1200; j++) {
+        set(mat, i, j, i * 1200 + j);
+      }
+      set(col, i, 0, 1000 * i);
+    }
+    for (int j = 0; j < 600; j++) {
+      set(row, 0, j, -j);
+    }
+    CU_ASSERT_EQUAL(add_matrix(result, view, row), 0);
+    CU_ASSERT_EQUAL(get(result, 6, 599), 6 * 1200 + 2 * 599 - 599);
+    CU_ASSERT_EQUAL(sub_matrix(result, row, view), 0);
+    CU_ASSERT_EQUAL(get(result, 3, 10), -10 - (3 * 1200 + 20));
+    CU_ASSERT_EQUAL(sub_matrix(result, view, col), 0);
+    CU_ASSERT_EQUAL(get(result, 5, 7), 5 * 1200 + 14 - 5000);
+    CU_ASSERT_EQUAL(sub_matrix(result, col, view), 0);
+    CU_ASSERT_EQUAL(get(result, 5, 7), 5000 - (5 * 1200 + 14));
+    CU_ASSERT_EQUAL(add_matrix(result, col, row), 0);
+    for (int i = 0; i < 7; i++) {
+      for (int j = 0; j < 600; j++) {
+        CU_ASSERT_EQUAL(get(result, i, j), 1000 * i - j);
+      }
+    }
+    CU_ASSERT_EQUAL(add_matrix(result, view, mat), -1);
+    deallocate_matrix(result);
+    deallocate_matrix(col);
+    deallocate_matrix(row);
+    deallocate_matrix(view);
+    deallocate_matrix(mat);
+  }
+}
+
+void elementwise_test(void) {
+  /* multiply, divide and axpby against plain loops, in place and on a strided view */
+  for (int t = 0; t < 2; t++) {
+    dtype type = t == 0 ? DTYPE_FLOAT64 : DTYPE_FLOAT32;
+    matrix *x = NULL, *y = NULL, *result = NULL, *view = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix_typed(&x, 9, 1001, type), 0);
+    CU_ASSERT_EQUAL(allocate_matrix_typed(&y, 9, 1001, type), 0);
+    CU_ASSERT_EQUAL(allocate_matrix_typed(&result, 9, 1001, type), 0);
+    rand_matrix(x, 1, 1, 2);
+    rand_matrix(y, 2, -1, 1);
+    CU_ASSERT_EQUAL(multiply_matrix(result, x, y), 0);
+    CU_ASSERT_DOUBLE_EQUAL(get(result, 8, 1000), get(x, 8, 1000) * get(y, 8, 1000), 1e-6);
+    CU_ASSERT_EQUAL(divide_matrix(result, y, x), 0);
+    CU_ASSERT_DOUBLE_EQUAL(get(result, 3, 17), get(y, 3, 17) / get(x, 3, 17), 1e-6);
+    CU_ASSERT_EQUAL(axpby_matrix(result, 2, x, -0.5, y), 0);
+    for (int i = 0; i < 9; i++) {
+      for (int j = 0; j < 1001; j++) {
+        CU_ASSERT_DOUBLE_EQUAL(get(result, i, j), 2 * get(x, i, j) - 0.5 * get(y, i, j), 1e-6);
+      }
+    }
+    /* y = 3 x + y over every other column, in place */
+    copy_matrix(result, y);
+    CU_ASSERT_EQUAL(allocate_matrix_view(&view, y, 0, 9, 501, 1001, 2), 0);
+    matrix *x_view = NULL;
+    CU_ASSERT_EQUAL(allocate_matrix_view(&x_view, x, 0, 9, 501, 1001, 2), 0);
+    CU_ASSERT_EQUAL(axpby_matrix(view, 3, x_view, 1, view), 0);
+    for (int i = 0; i < 9; i++) {
+      for (int j = 0; j < 1001; j++) {
+        double expected = get(result, i, j) + (j % 2 == 0 ? 3 * get(x, i, j) : 0);
+        CU_ASSERT_DOUBLE_EQUAL(get(y, i, j), expected, 1e-6);
+      }
+    }
+    deallocate_matrix(x_view);
+    deallocate_matrix(view);
+    deallocate_matrix(result);
+    deallocate_matrix(y);
+    deallocate_matrix(x);
+  }
+}
+
+void npy_test(void) {
+  /* Round trip through a .npy file, read and mapped, from a strided float32 view */
+  const char *path = "npy_test.npy";
+  matrix *mat = NULL, *view = NULL, *loaded = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix_typed(&mat, 7, 301, DTYPE_FLOAT32), 0);
+  rand_matrix(mat, 3, -1, 1);
+  CU_ASSERT_EQUAL(allocate_matrix_view(&view, mat, 1, 4, 100, 602, 3), 0);
+  CU_ASSERT_EQUAL(save_npy(path, view), 0);
+  for (int map = 0; map < 2; map++) {
+    CU_ASSERT_EQUAL(load_npy(&loaded, path, map), 0);
+    CU_ASSERT_EQUAL(loaded->dtype, DTYPE_FLOAT32);
+    CU_ASSERT_EQUAL(loaded->rows, 4);
+    CU_ASSERT_EQUAL(loaded->cols, 100);
+    for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 100; j++) {
+        CU_ASSERT_EQUAL(get(loaded, i, j), get(view, i, j));
+      }
+    }
+    /* Mapped files are copy-on-write */
+    set(loaded, 0, 0, 42);
+    deallocate_matrix(loaded);
+  }
+  CU_ASSERT_EQUAL(load_npy(&loaded, path, 1), 0);
+  CU_ASSERT_EQUAL(get(loaded, 0, 0), get(view, 0, 0));
+  deallocate_matrix(loaded);
+  /* A file that is cut short or is not a .npy file at all */
+  char head[200];
+  FILE *file = fopen(path, "rb");
+  CU_ASSERT_EQUAL(fread(head, 1, sizeof(head), file), sizeof(head));
+  fclose(file);
+  file = fopen(path, "wb");
+  fwrite(head, 1, sizeof(head), file);
+  fclose(file);
+  CU_ASSERT_EQUAL(load_npy(&loaded, path, 0), NPY_FORMAT_ERROR);
+  CU_ASSERT_EQUAL(load_npy(&loaded, path, 1), NPY_FORMAT_ERROR);
+  file = fopen(path, "wb");
+  fputs("{'descr': '<f8', 'fortran_order': False, 'shape': (2, 2), }\n", file);
+  fclose(file);
+  CU_ASSERT_EQUAL(load_npy(&loaded, path, 0), NPY_FORMAT_ERROR);
+  CU_ASSERT_EQUAL(load_npy(&loaded, "no_such_file.npy", 0), NPY_IO_ERROR);
+  remove(path);
+  deallocate_matrix(view);
+  deallocate_matrix(mat);
+}
+
+void backing_test(void) {
+  /* Tiled operations on file-backed matrices agree with the same operations in memory */
+  size_t budget = get_memory_budget();
+  set_memory_budget(64 * 1024);
+  matrix *a = NULL, *b = NULL, *mem_a = NULL, *mem_b = NULL, *result = NULL, *expected = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix_backed(&a, 300, 200, DTYPE_FLOAT64, "."), 0);
+  CU_ASSERT_EQUAL(allocate_matrix_backed(&b, 200, 250, DTYPE_FLOAT64, "."), 0);
+  CU_ASSERT(is_backed(a) && is_backed(b));
+  CU_ASSERT_EQUAL(get(a, 299, 199), 0);
+  CU_ASSERT_EQUAL(allocate_matrix_typed(&mem_a, 300, 200, DTYPE_FLOAT64), 0);
+  CU_ASSERT_EQUAL(allocate_matrix_typed(&mem_b, 200, 250, DTYPE_FLOAT64), 0);
+  CU_ASSERT(!is_backed(mem_a));
+  rand_matrix(mem_a, 4, -1, 1);
+  rand_matrix(mem_b, 5, -1, 1);
+  copy_matrix(a, mem_a);
+  copy_matrix(b, mem_b);
+  /* Results too large for the budget get scratch files of their own */
+  CU_ASSERT_EQUAL(allocate_matrix_like(&result, 300, 250, DTYPE_FLOAT64, mem_a, b), 0);
+  CU_ASSERT(is_backed(result));
+  CU_ASSERT_EQUAL(allocate_matrix_typed(&expected, 300, 250, DTYPE_FLOAT64), 0);
+  CU_ASSERT_EQUAL(mul_matrix(result, a, b), 0);
+  CU_ASSERT_EQUAL(mul_matrix(expected, mem_a, mem_b), 0);
+  for (int i = 0; i < 300; i++) {
+    for (int j = 0; j < 250; j++) {
+      CU_ASSERT_DOUBLE_EQUAL(get(result, i, j), get(expected, i, j), 1e-12);
+    }
+  }
+  CU_ASSERT_EQUAL(add_matrix(a, a, mem_a), 0);
+  CU_ASSERT_EQUAL(get(a, 123, 45), 2 * get(mem_a, 123, 45));
+  double values[200], mem_values[200];
+  CU_ASSERT_EQUAL(reduce_matrix_axis(values, a, REDUCE_MAX, 0), 0);
+  CU_ASSERT_EQUAL(reduce_matrix_axis(mem_values, mem_a, REDUCE_MAX, 0), 0);
+  for (int j = 0; j < 200; j++) {
+    CU_ASSERT_EQUAL(values[j], 2 * mem_values[j]);
+  }
+  double sum, mem_sum;
+  CU_ASSERT_EQUAL(reduce_matrix(&sum, b, REDUCE_SUM), 0);
+  CU_ASSERT_EQUAL(reduce_matrix(&mem_sum, mem_b, REDUCE_SUM), 0);
+  CU_ASSERT_EQUAL(sum, mem_sum);
+  matrix *bad = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix_backed(&bad, 0, 5, DTYPE_FLOAT64, "."), -1);
+  CU_ASSERT_EQUAL(allocate_matrix_backed(&bad, 2, 2, DTYPE_FLOAT64, "no_such_dir/x"), -3);
+  deallocate_matrix(expected);
+  deallocate_matrix(result);
+  deallocate_matrix(mem_b);
+  deallocate_matrix(mem_a);
+  deallocate_matrix(b);
+  deallocate_matrix(a);
+  set_memory_budget(budget);
+}
+
+void random_test(void) {
+  /* Known-answer vectors from the Random123 distribution */
+  uint32_t ctrs[3][4] = {{0, 0, 0, 0},
+                         {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                         {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}};
+  uint32_t keys[3][2] = {{0, 0}, {0xffffffff, 0xffffffff}, {0xa4093822, 0x299f31d0}};
+  uint32_t expected[3][4] = {{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8},
+                             {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd},
+                             {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}};
+  for (int t = 0; t < 3; t++) {
+    uint32_t out[4];
+    philox4x32_10(out, ctrs[t], keys[t]);
+    for (int w = 0; w < 4; w++) {
+      CU_ASSERT_EQUAL(out[w], expected[t][w]);
+    }
+  }
+  /* Any range of a stream can be generated on its own */
+  double whole[100];
+  double part[10];
+  random_uniform(whole, 7, 0, 100, -1, 1);
+  random_uniform(part, 7, 45, 10, -1, 1);
+  for (int i = 0; i < 10; i++) {
+    CU_ASSERT_EQUAL(part[i], whole[45 + i]);
+  }
+  /* Every instruction set generates the same values */
+  const char *names[] = {"scalar", "sse2", "avx2", "avx512"};
+  const kernel_table *default_kernels = kernels;
+  const kernel_table *default_kernels_f32 = kernels_f32;
+  for (int n = 0; n < 4; n++) {
+    if (kernels_supported(names[n]) == 1) {
+      CU_ASSERT_EQUAL(select_kernels(names[n]), 0);
+      random_uniform(part, 7, 45, 10, -1, 1);
+      CU_ASSERT_EQUAL(memcmp(part, whole + 45, sizeof(part)), 0);
+    }
+  }
+  kernels = default_kernels;
+  kernels_f32 = default_kernels_f32;
+  random_normal(whole, 7, 0, 100, 0, 1);
+  random_normal(part, 7, 45, 10, 0, 1);
+  for (int i = 0; i < 10; i++) {
+    CU_ASSERT_EQUAL(part[i], whole[45 + i]);
+  }
+  /* Matrices are the same for any number of threads, and views get the same values */
+  matrix *mat1 = NULL;
+  matrix *mat2 = NULL;
+  matrix *parent = NULL;
+  matrix *view = NULL;
+  CU_ASSERT_EQUAL(allocate_matrix(&mat1, 300, 301), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&mat2, 300, 301), 0);
+  CU_ASSERT_EQUAL(allocate_matrix(&parent, 300, 602), 0);
+  CU_ASSERT_EQUAL(allocate_matrix_view(&view, parent, 1, 300, 301, 602, 2), 0);
+  int threads = get_num_threads();
+  long threshold = get_parallel_threshold(PARALLEL_RANDOM);
+  set_num_threads(1);
+  rand_matrix(mat1, 42, 2, 5);
+  set_num_threads(4);
+  set_parallel_threshold(PARALLEL_RANDOM, 1);
+  rand_matrix(mat2, 42, 2, 5);
+  rand_matrix(view, 42, 2, 5);
+  set_parallel_threshold(PARALLEL_RANDOM, threshold);
+  set_num_threads(threads);
+  double sum = 0;
+  for (int i = 0; i < 300; i++) {
+    for (int j = 0; j < 301; j++) {
+      CU_ASSERT_EQUAL(get(mat1, i, j), get(mat2, i, j));
+      CU_ASSERT_EQUAL(get(mat1, i, j), get(view, i, j));
+      CU_ASSERT(get(mat1, i, j) >= 2 && get(mat1, i, j) < 5);
+      sum += get(mat1, i, j);
+    }
+  }
+  CU_ASSERT(fabs(sum / (300 * 301) - 3.5) < 0.01);
+  /* Normal values have the requested mean and deviation */
+  randn_matrix(mat1, 42, 3, 2);
+  double sum_sq = 0;
+  sum = 0;
+  for (int i = 0; i < 300; i++) {
+    for (int j = 0; j < 301; j++) {
+      sum += get(mat1, i, j);
+      sum_sq += get(mat1, i, j) * get(mat1, i, j);
+    }
+  }
+  double mean = sum / (300 * 301);
+  CU_ASSERT(fabs(mean - 3) < 0.02);
+  CU_ASSERT(fabs(sqrt(sum_sq / (300 * 301) - mean * mean) - 2) < 0.02);
+  deallocate_matrix(mat1);
+  deallocate_matrix(mat2);
+  deallocate_matrix(view);
+  deallocate_matrix(parent);
+}
+
 /************* Test Runner Code goes here **************/
 
 int main (void)
 {
   Py_Initialize(); // Need to call this so that Python.h functions won't segfault
+  init_kernels();
   CU_pSuite pSuite = NULL;
 
   /* initialize the CUnit test registry */
@@ -297,15 +1361,37 @@ int main (void)
         */
         (CU_add_test(pSuite, "mul_square_test", mul_square_test) == NULL) ||
         (CU_add_test(pSuite, "mul_non_square_test", mul_non_square_test) == NULL) ||
+        (CU_add_test(pSuite, "mul_blocked_test", mul_blocked_test) == NULL) ||
         (CU_add_test(pSuite, "abs_test", abs_test) == NULL) ||
         (CU_add_test(pSuite, "pow_test", pow_test) == NULL) ||
+        (CU_add_test(pSuite, "strassen_test", strassen_test) == NULL) ||
         (CU_add_test(pSuite, "alloc_fail_test", alloc_fail_test) == NULL) ||
         (CU_add_test(pSuite, "alloc_success_test", alloc_success_test) == NULL) ||
+        (CU_add_test(pSuite, "alloc_pool_test", alloc_pool_test) == NULL) ||
         (CU_add_test(pSuite, "alloc_ref_fail_test", alloc_ref_fail_test) == NULL) ||
         (CU_add_test(pSuite, "alloc_ref_success_test", alloc_ref_success_test) == NULL) ||
+        (CU_add_test(pSuite, "alloc_external_test", alloc_external_test) == NULL) ||
+        (CU_add_test(pSuite, "alloc_view_test", alloc_view_test) == NULL) ||
+        (CU_add_test(pSuite, "strided_ops_test", strided_ops_test) == NULL) ||
+        (CU_add_test(pSuite, "views_overlap_test", views_overlap_test) == NULL) ||
+        (CU_add_test(pSuite, "expr_test", expr_test) == NULL) ||
         (CU_add_test(pSuite, "dealloc_null_test", dealloc_null_test) == NULL) ||
         (CU_add_test(pSuite, "get_test", get_test) == NULL) ||
-        (CU_add_test(pSuite, "set_test", set_test) == NULL)
+        (CU_add_test(pSuite, "set_test", set_test) == NULL) ||
+        (CU_add_test(pSuite, "kernels_test", kernels_test) == NULL) ||
+        (CU_add_test(pSuite, "batch_mul_test", batch_mul_test) == NULL) ||
+        (CU_add_test(pSuite, "reduce_test", reduce_test) == NULL) ||
+        (CU_add_test(pSuite, "transpose_test", transpose_test) == NULL) ||
+        (CU_add_test(pSuite, "vector_product_test", vector_product_test) == NULL) ||
+        (CU_add_test(pSuite, "scalar_test", scalar_test) == NULL) ||
+        (CU_add_test(pSuite, "broadcast_test", broadcast_test) == NULL) ||
+        (CU_add_test(pSuite, "elementwise_test", elementwise_test) == NULL) ||
+        (CU_add_test(pSuite, "npy_test", npy_test) == NULL) ||
+        (CU_add_test(pSuite, "backing_test", backing_test) == NULL) ||
+        (CU_add_test(pSuite, "random_test", random_test) == NULL) ||
+        (CU_add_test(pSuite, "retain_threads_test", retain_threads_test) == NULL) ||
+        (CU_add_test(pSuite, "parallel_test", parallel_test) == NULL) ||
+        (CU_add_test(pSuite, "pool_test", pool_test) == NULL)
      )
    {
       CU_cleanup_registry();
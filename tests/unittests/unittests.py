@@ -1,5 +1,9 @@
 from utils import *
 from unittest import TestCase
+import array
+import os
+import tempfile
+import threading
 
 """
 - For each operation, you should write tests to test  on matrices of different sizes.
@@ -135,6 +139,229 @@ class TestPow(TestCase):
         self.assertTrue(is_correct)
         print_speedup(speed_up)
 
+    def test_pow_edge_cases(self):
+        dp_mat, nc_mat = rand_dp_nc_matrix(9, 9, seed=3)
+        for exponent in (0, 1, 2, 3, 64):
+            self.assertTrue(cmp_dp_nc_matrix(dp_mat ** exponent, nc_mat ** exponent))
+        nc_copy = nc.Matrix(9, 9)
+        nc_copy[:, :] = nc_mat
+        nc_copy **= 5
+        self.assertTrue(cmp_dp_nc_matrix(dp_mat ** 5, nc_copy))
+
+    def test_matrix_power_many(self):
+        dp_mat, nc_mat = rand_dp_nc_matrix(20, 20, seed=1)
+        exponents = [7, 0, 1, 12, 31, 12]
+        powers = nc.matrix_power_many(nc_mat, exponents)
+        self.assertEqual(len(powers), len(exponents))
+        for exponent, power in zip(exponents, powers):
+            self.assertTrue(cmp_dp_nc_matrix(dp_mat ** exponent, power))
+        self.assertEqual(nc.matrix_power_many(nc_mat, []), [])
+        with self.assertRaises(ValueError):
+            nc.matrix_power_many(nc.Matrix(2, 3), [2])
+        with self.assertRaises(ValueError):
+            nc.matrix_power_many(nc_mat, [2, -1])
+        with self.assertRaises(TypeError):
+            nc.matrix_power_many(nc_mat, [2.0])
+        with self.assertRaises(TypeError):
+            nc.matrix_power_many([[1]], [2])
+
+class TestMatmulAlgorithm(TestCase):
+    def test_strassen_matches_classic(self):
+        cutoff = nc.get_strassen_cutoff()
+        self.assertEqual(nc.get_matmul_algorithm(), "auto")
+        nc.set_strassen_cutoff(16)
+        for m, k, n in ((64, 64, 64), (75, 33, 51)):
+            _, nc_mat1 = rand_dp_nc_matrix(m, k, -1, 1, seed=m)
+            _, nc_mat2 = rand_dp_nc_matrix(k, n, -1, 1, seed=n)
+            nc.set_matmul_algorithm("classic")
+            classic = nc.to_list(nc_mat1 * nc_mat2)
+            nc.set_matmul_algorithm("strassen")
+            self.assertEqual(nc.get_matmul_algorithm(), "strassen")
+            fast = nc.to_list(nc_mat1 * nc_mat2)
+            for row1, row2 in zip(classic, fast):
+                for val1, val2 in zip(row1, row2):
+                    self.assertAlmostEqual(val1, val2, places=10)
+        nc.set_matmul_algorithm("auto")
+        dp_mat, nc_mat = rand_dp_nc_matrix(40, 40, 0, 0.05, seed=4)
+        self.assertTrue(cmp_dp_nc_matrix(dp_mat ** 9, nc_mat ** 9))
+        with self.assertRaises(ValueError):
+            nc.set_matmul_algorithm("fastest")
+        with self.assertRaises(ValueError):
+            nc.set_strassen_cutoff(1)
+        nc.set_strassen_cutoff(cutoff)
+
+class TestReductions(TestCase):
+    def test_reductions(self):
+        nc_mat = nc.Matrix(40, 9000, rand=True, low=-1, high=1, seed=3)
+        for mat in (nc_mat, nc_mat[1::3, ::2]):
+            np_mat = np.array(nc.to_list(mat))
+            self.assertAlmostEqual(mat.sum(), np_mat.sum(), places=6)
+            self.assertAlmostEqual(mat.mean(), np_mat.mean(), places=decimal_places)
+            self.assertEqual(mat.min(), np_mat.min())
+            self.assertEqual(mat.max(), np_mat.max())
+            self.assertEqual(mat.argmin(), np_mat.argmin())
+            self.assertEqual(mat.argmax(), np_mat.argmax())
+            for axis in (0, 1):
+                for name in ("sum", "mean", "min", "max", "argmin", "argmax"):
+                    result = getattr(mat, name)(axis=axis)
+                    expected = getattr(np_mat, name)(axis=axis)
+                    self.assertEqual(result.shape, (1, len(expected)) if axis == 0 else (len(expected), 1))
+                    self.assertTrue(np.allclose(np.array(nc.to_list(result)).ravel(), expected))
+
+    def test_nan(self):
+        # A NaN anywhere makes min and max NaN and is where argmin and argmax point, as in numpy
+        nan = float("nan")
+        rows = ([[nan] + list(range(1, 64))], [[1, nan, 3]], [list(range(1, 70)) + [nan]],
+                [[1, 2], [nan, 0]], [[1, -5, 4], [-3, 2, nan]])
+        default_isa = nc.get_isa()
+        try:
+            for isa in ["scalar", "sse2", "avx2", "avx512"]:
+                try:
+                    nc.set_isa(isa)
+                except RuntimeError:
+                    continue
+                for dtype in ("float64", "float32"):
+                    for values in rows:
+                        np_mat = np.array(values, dtype=dtype)
+                        mat = nc.Matrix(np_mat.copy())
+                        for name in ("min", "max", "argmin", "argmax"):
+                            result, expected = getattr(mat, name)(), getattr(np_mat, name)()
+                            self.assertTrue(np.allclose(result, expected, equal_nan=True),
+                                            (isa, dtype, values, name))
+                            for axis in (0, 1):
+                                result = np.array(nc.to_list(getattr(mat, name)(axis=axis)))
+                                expected = getattr(np_mat, name)(axis=axis)
+                                self.assertTrue(np.allclose(result.ravel(), expected, equal_nan=True),
+                                                (isa, dtype, values, name, axis))
+        finally:
+            nc.set_isa(default_isa)
+
+    def test_norms(self):
+        nc_mat = nc.Matrix(30, 50, rand=True, low=-1, high=1, seed=4, dtype="float32")
+        np_mat = np.array(nc.to_list(nc_mat))
+        for ord in (None, "fro", 1, float("inf")):
+            self.assertAlmostEqual(nc_mat.norm(ord), np.linalg.norm(np_mat, ord), places=3)
+        for axis in (0, 1):
+            for ord in (None, 1, 2, float("inf")):
+                result = nc_mat.norm(ord, axis=axis)
+                self.assertEqual(result.dtype, "float32")
+                self.assertTrue(np.allclose(np.array(nc.to_list(result)).ravel(),
+                                            np.linalg.norm(np_mat, ord, axis=axis), rtol=1e-5))
+        with self.assertRaises(ValueError):
+            nc_mat.norm(2)
+        with self.assertRaises(ValueError):
+            nc_mat.norm(3)
+        with self.assertRaises(ValueError):
+            nc_mat.norm("fro", axis=0)
+        with self.assertRaises(ValueError):
+            nc_mat.sum(axis=2)
+
+    def test_deterministic(self):
+        # Partial sums are combined in a fixed order, whatever the number of threads
+        nc_mat = nc.Matrix(500, 2000, rand=True, seed=5)
+        threads = nc.get_num_threads()
+        saved = nc.get_parallel_threshold("elementwise")
+        nc.set_parallel_threshold("elementwise", 1)
+        try:
+            results = []
+            for count in (1, 2, 3, 4):
+                nc.set_num_threads(count)
+                results.append((nc_mat.sum(), nc.to_list(nc_mat.sum(axis=0)), nc.to_list(nc_mat.sum(axis=1))))
+            self.assertTrue(all(result == results[0] for result in results))
+        finally:
+            nc.set_parallel_threshold("elementwise", saved)
+            nc.set_num_threads(threads)
+
+class TestTranspose(TestCase):
+    def test_transpose(self):
+        for rows, cols in ((1, 1), (3, 7), (300, 517)):
+            nc_mat = nc.Matrix(rows, cols, rand=True, seed=rows)
+            expected = [list(col) for col in zip(*nc.to_list(nc_mat))]
+            self.assertEqual(nc_mat.T.shape, (cols, rows))
+            self.assertEqual(nc.to_list(nc_mat.T), expected)
+            self.assertEqual(nc.to_list(nc_mat.transpose()), expected)
+
+    def test_transpose_view(self):
+        nc_mat = nc.Matrix(3, 4)
+        # T shares self's data; transpose() copies it
+        view = nc_mat.T
+        copy = nc_mat.transpose()
+        view[0, 2] = 5
+        self.assertEqual(nc_mat[2, 0], 5)
+        self.assertEqual(copy[0, 2], 0)
+        self.assertEqual(nc.to_list(nc_mat.T.T), nc.to_list(nc_mat))
+
+    def test_transpose_inplace(self):
+        nc_mat = nc.Matrix(200, 200, rand=True, seed=1, dtype="float32")
+        expected = [list(col) for col in zip(*nc.to_list(nc_mat))]
+        self.assertIsNone(nc_mat.transpose(inplace=True))
+        self.assertEqual(nc.to_list(nc_mat), expected)
+        with self.assertRaises(ValueError):
+            nc.Matrix(3, 4).transpose(inplace=True)
+
+class TestVectorProducts(TestCase):
+    def test_vector_shapes(self):
+        # Matrix-vector, vector-matrix, outer and dot products take dedicated paths
+        for rows, inner, cols in ((40, 30, 1), (1, 30, 40), (40, 1, 30), (1, 30, 1)):
+            dp_mat1, nc_mat1 = rand_dp_nc_matrix(rows, inner, seed=1)
+            dp_mat2, nc_mat2 = rand_dp_nc_matrix(inner, cols, seed=2)
+            is_correct, speed_up = compute([dp_mat1, dp_mat2], [nc_mat1, nc_mat2], "mul")
+            self.assertTrue(is_correct)
+
+    def test_strided_vectors(self):
+        nc_mat = nc.Matrix(50, 60, rand=True, seed=3)
+        nc_vec = nc.Matrix(120, 3, rand=True, seed=4)[::2, 1:2]
+        expected = nc_mat * nc.Matrix(nc.to_list(nc_vec))
+        for result in (nc_mat * nc_vec, nc_mat.T.transpose() * nc_vec):
+            for row1, row2 in zip(nc.to_list(result), nc.to_list(expected)):
+                self.assertAlmostEqual(row1[0], row2[0], places=decimal_places)
+        # A transposed matrix times a vector is a vector-matrix product of the original
+        result = nc_mat.T * nc.Matrix(50, 1, rand=True, seed=5)
+        self.assertEqual(result.shape, (60, 1))
+
+class TestBatchMatmul(TestCase):
+    def test_batch_matmul(self):
+        pairs = [(rand_dp_nc_matrix(12, 9, seed=i), rand_dp_nc_matrix(9, 7, seed=i + 50))
+                 for i in range(20)]
+        nc_results = nc.batch_matmul([lhs[1] for lhs, _ in pairs], [rhs[1] for _, rhs in pairs])
+        self.assertEqual(len(nc_results), 20)
+        for ((dp_lhs, _), (dp_rhs, _)), nc_result in zip(pairs, nc_results):
+            self.assertEqual(nc_result.shape, (12, 7))
+            self.assertTrue(cmp_dp_nc_matrix(dp_lhs * dp_rhs, nc_result))
+        # A single matrix on either side multiplies every matrix of the other
+        dp_rhs, nc_rhs = pairs[0][1]
+        nc_results = nc.batch_matmul(tuple(lhs[1] for lhs, _ in pairs), nc_rhs)
+        for ((dp_lhs, _), _), nc_result in zip(pairs, nc_results):
+            self.assertTrue(cmp_dp_nc_matrix(dp_lhs * dp_rhs, nc_result))
+        self.assertEqual(nc.batch_matmul([], nc_rhs), [])
+        # Results share one allocation but are independent matrices
+        nc_results[0][0, 0] = 123
+        self.assertEqual(nc_results[0][0, 0], 123)
+        self.assertTrue(cmp_dp_nc_matrix(pairs[1][0][0] * dp_rhs, nc_results[1]))
+
+    def test_batch_matmul_errors(self):
+        nc_mat = nc.Matrix(3, 4)
+        with self.assertRaises(ValueError):
+            nc.batch_matmul([nc_mat, nc_mat], [nc_mat])
+        with self.assertRaises(ValueError):
+            nc.batch_matmul([nc_mat], [nc_mat])
+        with self.assertRaises(ValueError):
+            nc.batch_matmul([nc_mat, nc.Matrix(4, 3)], nc.Matrix(4, 3))
+        with self.assertRaises(TypeError):
+            nc.batch_matmul([nc_mat, 1], nc.Matrix(4, 3))
+        with self.assertRaises(TypeError):
+            nc.batch_matmul(5, nc_mat)
+
+    def test_batch_matmul_float32(self):
+        lhs = [nc.Matrix(8, 8, rand=True, seed=i, dtype="float32") for i in range(4)]
+        rhs = nc.Matrix(8, 8, rand=True, seed=9)
+        for single, product in zip(lhs, nc.batch_matmul(lhs, rhs)):
+            self.assertEqual(product.dtype, "float64")
+            expected = nc.to_list(single * rhs)
+            for row1, row2 in zip(expected, nc.to_list(product)):
+                for val1, val2 in zip(row1, row2):
+                    self.assertAlmostEqual(val1, val2, places=9)
+
 class TestGet(TestCase):
     def test_get(self):
         dp_mat, nc_mat = rand_dp_nc_matrix(2, 2, seed=0)
@@ -157,6 +384,33 @@ class TestShape(TestCase):
         dp_mat, nc_mat = rand_dp_nc_matrix(2, 2, seed=0)
         self.assertTrue(dp_mat.shape == nc_mat.shape)
 
+class TestRepr(TestCase):
+    def test_small(self):
+        arr = np.array([[1.5, -0.0, 1 / 3], [1e300, float("inf"), 7]])
+        nc_mat = nc.Matrix(arr.copy())
+        self.assertEqual(repr(nc_mat), repr(arr.tolist()))
+        self.assertEqual(repr(nc_mat[:, ::2]), repr(arr[:, ::2].tolist()))
+        self.assertEqual(nc.to_list(nc_mat.T), arr.T.tolist())
+
+    def test_summarized(self):
+        options = nc.get_printoptions()
+        try:
+            nc_mat = nc.Matrix(np.arange(30.0).reshape(5, 6))
+            nc.set_printoptions(threshold=10, edgeitems=1)
+            self.assertEqual(nc.get_printoptions(), {"threshold": 10, "edgeitems": 1})
+            self.assertEqual(repr(nc_mat), "[[0.0, ..., 5.0], ..., [24.0, ..., 29.0]]")
+            nc.set_printoptions(edgeitems=2)
+            self.assertEqual(repr(nc_mat[:3, :]), "[[0.0, 1.0, ..., 4.0, 5.0], [6.0, 7.0, ..., 10.0, 11.0], "
+                                                  "[12.0, 13.0, ..., 16.0, 17.0]]")
+            nc.set_printoptions(threshold=30)
+            self.assertEqual(repr(nc_mat), repr(nc.to_list(nc_mat)))
+            self.assertLess(len(repr(nc.Matrix(10000, 10000))), 300)
+            with self.assertRaises(ValueError):
+                nc.set_printoptions(edgeitems=0)
+        finally:
+            nc.set_printoptions(**options)
+
+
 class TestIndexGet(TestCase):
     def test_index_get(self):
         dp_mat, nc_mat = rand_dp_nc_matrix(2, 2, seed=0)
@@ -180,3 +434,665 @@ class TestSlice(TestCase):
         dp_mat, nc_mat = rand_dp_nc_matrix(2, 2, seed=0)
         self.assertTrue(cmp_dp_nc_matrix(dp_mat[0], nc_mat[0]))
         self.assertTrue(cmp_dp_nc_matrix(dp_mat[1], nc_mat[1]))
+
+    def test_2d_slice(self):
+        arr = np.arange(1.0, 1.0 + 20 * 30).reshape(20, 30)
+        nc_mat = nc.Matrix(arr.copy())
+        view = nc_mat[2:15, 5:25]
+        self.assertEqual(view.shape, (13, 20))
+        self.assertEqual(nc.to_list(view), arr[2:15, 5:25].tolist())
+        self.assertEqual(nc.to_list(nc_mat[3, 4:8]), [arr[3, 4:8].tolist()])
+        self.assertEqual(nc.to_list(nc_mat[4:6, 3]), arr[4:6, 3:4].tolist())
+        self.assertEqual(nc_mat[7, 9], arr[7, 9])
+        # Views share memory with the matrix they come from
+        view.set(0, 0, -1)
+        self.assertEqual(nc_mat.get(2, 5), -1)
+
+    def test_step_slice(self):
+        arr = np.arange(1.0, 1.0 + 20 * 30).reshape(20, 30)
+        nc_mat = nc.Matrix(arr.copy())
+        view = nc_mat[::3, ::-2]
+        self.assertEqual(nc.to_list(view), arr[::3, ::-2].tolist())
+        self.assertEqual(nc.to_list(view[1:, ::4]), arr[::3, ::-2][1:, ::4].tolist())
+        self.assertEqual(nc.to_list(view + view), (2 * arr[::3, ::-2]).tolist())
+        self.assertEqual(nc.to_list(-view), (-arr[::3, ::-2]).tolist())
+        self.assertTrue(np.allclose(np.array(nc.to_list(nc_mat[::2, 1:11] * nc_mat[5:15, ::3])),
+                                    arr[::2, 1:11] @ arr[5:15, ::3]))
+        self.assertEqual(np.asarray(view).tolist(), arr[::3, ::-2].tolist())
+        with self.assertRaises(ValueError):
+            nc_mat[5:5, :]
+
+    def test_slice_set(self):
+        arr = np.zeros((6, 8))
+        nc_mat = nc.Matrix(6, 8)
+        nc_mat[1:3, 2:5] = 0.5
+        arr[1:3, 2:5] = 0.5
+        nc_mat[::5, 0] = [1, 2]
+        arr[::5, 0] = [1, 2]
+        nc_mat[4:6, 6:8] = [[1, 2], [3, 4]]
+        arr[4:6, 6:8] = [[1, 2], [3, 4]]
+        nc_mat[:, 4:] = nc_mat[:, :4]
+        arr[:, 4:] = arr[:, :4].copy()
+        self.assertEqual(nc.to_list(nc_mat), arr.tolist())
+        with self.assertRaises(ValueError):
+            nc_mat[0:2, 0:2] = [1, 2, 3]
+
+class TestIsa(TestCase):
+    def test_set_isa(self):
+        default_isa = nc.get_isa()
+        dp_mat1, nc_mat1 = rand_dp_nc_matrix(37, 41, seed=1)
+        dp_mat2, nc_mat2 = rand_dp_nc_matrix(41, 23, seed=2)
+        for isa in ["scalar", "sse2", "avx2", "avx512"]:
+            try:
+                nc.set_isa(isa)
+            except RuntimeError:
+                continue
+            self.assertEqual(nc.get_isa(), isa)
+            is_correct, speed_up = compute([dp_mat1, dp_mat2], [nc_mat1, nc_mat2], "mul")
+            self.assertTrue(is_correct)
+            is_correct, speed_up = compute([dp_mat1, dp_mat1], [nc_mat1, nc_mat1], "sub")
+            self.assertTrue(is_correct)
+            is_correct, speed_up = compute([dp_mat1], [nc_mat1], "neg")
+            self.assertTrue(is_correct)
+        nc.set_isa(default_isa)
+        with self.assertRaises(ValueError):
+            nc.set_isa("no_such_isa")
+
+class TestPool(TestCase):
+    def test_pool_reuse(self):
+        dp_mat1, nc_mat1 = rand_dp_nc_matrix(300, 300, seed=1)
+        dp_mat2, nc_mat2 = rand_dp_nc_matrix(300, 300, seed=2)
+        for _ in range(5):
+            is_correct, speed_up = compute([dp_mat1, dp_mat2, dp_mat1], [nc_mat1, nc_mat2, nc_mat1], "add")
+            self.assertTrue(is_correct)
+        self.assertEqual(nc.Matrix(300, 300).get(299, 299), 0)
+        nc.trim_pool()
+        self.assertEqual(nc.trim_pool(), 0)
+
+    def test_pool_limit(self):
+        limit = nc.get_pool_limit()
+        nc.set_pool_limit(0)
+        self.assertEqual(nc.get_pool_limit(), 0)
+        dp_mat, nc_mat = rand_dp_nc_matrix(100, 100, seed=3)
+        is_correct, speed_up = compute([dp_mat], [nc_mat], "abs")
+        self.assertTrue(is_correct)
+        self.assertEqual(nc.trim_pool(), 0)
+        nc.set_pool_limit(limit)
+        with self.assertRaises(ValueError):
+            nc.set_pool_limit(-1)
+
+class TestBuffer(TestCase):
+    def test_export(self):
+        dp_mat, nc_mat = rand_dp_nc_matrix(3, 4, seed=0)
+        view = memoryview(nc_mat)
+        self.assertEqual(view.shape, (3, 4))
+        self.assertEqual(view.format, "d")
+        arr = np.asarray(nc_mat)
+        self.assertEqual(arr.shape, (3, 4))
+        arr[1, 2] = 42
+        self.assertEqual(nc_mat.get(1, 2), 42)
+        self.assertEqual(round(arr[2, 3], decimal_places), round(dp_mat.get(2, 3), decimal_places))
+
+    def test_import_shared(self):
+        arr = np.arange(12.0).reshape(3, 4)
+        nc_mat = nc.Matrix(arr)
+        self.assertEqual(nc_mat.shape, (3, 4))
+        arr[2, 1] = -5
+        self.assertEqual(nc_mat.get(2, 1), -5)
+        nc_mat.set(0, 0, 7)
+        self.assertEqual(arr[0, 0], 7)
+        del arr
+        self.assertEqual(nc_mat.get(2, 3), 11)
+
+    def test_import_copied(self):
+        arr = np.arange(12.0)[::2]
+        nc_mat = nc.Matrix(2, 3, arr)
+        arr[0] = 99
+        self.assertEqual(nc.to_list(nc_mat), [[0, 2, 4], [6, 8, 10]])
+        self.assertEqual(nc.Matrix(memoryview(bytes(nc_mat)).cast("d")).shape, (1, 6))
+        with self.assertRaises(TypeError):
+            nc.Matrix(np.arange(4))
+        with self.assertRaises(TypeError):
+            nc.Matrix(3, 3, np.arange(4.0))
+
+    def test_sequences_and_bytes(self):
+        self.assertEqual(nc.to_list(nc.Matrix(((1, 2.5), [3, 4]))), [[1, 2.5], [3, 4]])
+        self.assertEqual(nc.to_list(nc.Matrix(2, 2, (1.5, 2, 3, 4))), [[1.5, 2], [3, 4]])
+        self.assertEqual(nc.to_list(nc.Matrix(1, 3, array.array("d", [1, 2, 3]))), [[1, 2, 3]])
+        nc_mat = nc.Matrix(2, 2, np.arange(4.0).tobytes())
+        self.assertEqual(nc.to_list(nc_mat), [[0, 1], [2, 3]])
+        with self.assertRaises(TypeError):
+            nc.Matrix(2, 2, [1, 2, "3", 4])
+        with self.assertRaises(TypeError):
+            nc.Matrix(b"abc")
+
+    def test_frombuffer(self):
+        data = bytearray(np.arange(10.0).tobytes())
+        nc_mat = nc.Matrix.frombuffer(data, offset=16, count=4)
+        self.assertEqual(nc.to_list(nc_mat), [[2, 3, 4, 5]])
+        nc_mat[0] = 99
+        self.assertEqual(np.frombuffer(data)[2], 99)
+        self.assertEqual(nc.Matrix.frombuffer(data, shape=(2, 5)).shape, (2, 5))
+        nc_mat = nc.Matrix.frombuffer(np.arange(6, dtype=np.float32).tobytes(), dtype="float32")
+        self.assertEqual(np.asarray(nc_mat).dtype, np.float32)
+        self.assertEqual(nc.to_list(nc_mat), [[0, 1, 2, 3, 4, 5]])
+        with self.assertRaises(ValueError):
+            nc.Matrix.frombuffer(data, offset=100)
+        with self.assertRaises(ValueError):
+            nc.Matrix.frombuffer(b"abc")
+        with self.assertRaises(ValueError):
+            nc.Matrix.frombuffer(data, shape=(3, 5))
+
+    def test_fromiter(self):
+        nc_mat = nc.Matrix.fromiter((i / 2 for i in range(6)), shape=(2, 3))
+        self.assertEqual(nc.to_list(nc_mat), [[0, 0.5, 1], [1.5, 2, 2.5]])
+        self.assertEqual(nc.to_list(nc.Matrix.fromiter(range(100), count=3)), [[0, 1, 2]])
+        self.assertEqual(nc.to_list(nc.Matrix.fromiter([1, 2.5, 3], count=2)), [[1, 2.5]])
+        nc_mat = nc.Matrix.fromiter(iter([1, 2, 3, 4]), dtype="float32", shape=(2, 2))
+        self.assertEqual(np.asarray(nc_mat).dtype, np.float32)
+        with self.assertRaises(ValueError):
+            nc.Matrix.fromiter(range(3), count=5)
+        with self.assertRaises(ValueError):
+            nc.Matrix.fromiter([1, 2], shape=(2, 2))
+        with self.assertRaises(TypeError):
+            nc.Matrix.fromiter(x for x in [1, "2"])
+
+    def test_fromiter_empty(self):
+        # Empty iterables are rejected the same way, whether they are sequences or not
+        for empty in ([], (), iter([]), (x for x in []), range(0)):
+            with self.assertRaises(ValueError):
+                nc.Matrix.fromiter(empty)
+        with self.assertRaises(ValueError):
+            nc.Matrix.fromiter(range(5), count=0)
+        with self.assertRaises(ValueError):
+            nc.Matrix.frombuffer(b"")
+
+
+class TestSaveLoad(TestCase):
+    def setUp(self):
+        self.tmpdir = tempfile.TemporaryDirectory()
+        self.path = os.path.join(self.tmpdir.name, "mat.npy")
+
+    def tearDown(self):
+        self.tmpdir.cleanup()
+
+    def test_round_trip(self):
+        arr = np.arange(30.0).reshape(5, 6) / 7
+        nc_mat = nc.Matrix(arr.copy())
+        nc.save(self.path, nc_mat[1:, ::2])
+        self.assertTrue(np.array_equal(np.load(self.path), arr[1:, ::2]))
+        for mmap in (True, False):
+            nc_loaded = nc.load(self.path, mmap=mmap)
+            self.assertEqual(nc.to_list(nc_loaded), arr[1:, ::2].tolist())
+            nc_loaded[0, 0] = 100
+        self.assertEqual(np.load(self.path)[0, 0], arr[1, 0])
+
+    def test_numpy_files(self):
+        arr = np.arange(12, dtype=np.float32).reshape(3, 4)
+        np.save(self.path, np.asfortranarray(arr))
+        nc_mat = nc.load(self.path)
+        self.assertEqual(np.asarray(nc_mat).dtype, np.float32)
+        self.assertEqual(nc.to_list(nc_mat), arr.tolist())
+        np.save(self.path, np.arange(4.0))
+        self.assertEqual(nc.load(self.path, mmap=False).shape, (1, 4))
+        np.save(self.path, np.arange(4))
+        with self.assertRaises(ValueError):
+            nc.load(self.path)
+        with self.assertRaises(FileNotFoundError):
+            nc.load(os.path.join(self.tmpdir.name, "missing.npy"))
+
+
+class TestBacked(TestCase):
+    def setUp(self):
+        self.tmpdir = tempfile.TemporaryDirectory()
+        self.budget = nc.get_memory_budget()
+        nc.set_memory_budget(64 * 1024)
+
+    def tearDown(self):
+        nc.set_memory_budget(self.budget)
+        self.tmpdir.cleanup()
+
+    def test_file_backed(self):
+        path = os.path.join(self.tmpdir.name, "mat.dat")
+        nc_mat = nc.Matrix(40, 30, 2.5, backing=path)
+        self.assertEqual(os.path.getsize(path), 40 * 30 * 8)
+        nc_mat[0, 1] = -1
+        del nc_mat
+        data = np.fromfile(path).reshape(40, 30)
+        self.assertEqual(data[0, 1], -1)
+        self.assertEqual(data[39, 29], 2.5)
+        with self.assertRaises(OSError):
+            nc.Matrix(2, 2, backing=os.path.join(path, "x"))
+        with self.assertRaises(TypeError):
+            nc.Matrix(2, 2, rand=True, backing=self.tmpdir.name)
+
+    def test_tiled_operations(self):
+        arr1 = np.linspace(-1, 1, 300 * 200).reshape(300, 200)
+        arr2 = np.linspace(2, 3, 200 * 250).reshape(200, 250)
+        nc_mat1 = nc.Matrix(300, 200, backing=self.tmpdir.name)
+        nc_mat2 = nc.Matrix(200, 250, backing=self.tmpdir.name)
+        nc_mat1[:, :] = nc.Matrix(arr1.copy())
+        nc_mat2[:, :] = nc.Matrix(arr2.copy())
+        self.assertEqual(os.listdir(self.tmpdir.name), [])
+        self.assertTrue(np.allclose(np.asarray(nc_mat1 * nc_mat2), arr1 @ arr2))
+        self.assertTrue(np.allclose(np.asarray(nc_mat1 + nc_mat1), 2 * arr1))
+        self.assertTrue(np.allclose(np.asarray(nc_mat1 - nc_mat1[0:1, :]), arr1 - arr1[0]))
+        self.assertAlmostEqual(nc_mat2.sum(), arr2.sum(), places=6)
+        self.assertTrue(np.allclose(np.asarray(nc_mat1.sum(axis=0)).ravel(), arr1.sum(axis=0)))
+        self.assertTrue(np.array_equal(np.asarray(nc_mat2.max(axis=1)).ravel(), arr2.max(axis=1)))
+        with self.assertRaises(ValueError):
+            nc.set_memory_budget(0)
+
+
+class TestInplace(TestCase):
+    def test_inplace_add_sub(self):
+        dp_mat1, nc_mat1 = rand_dp_nc_matrix(30, 40, seed=0)
+        dp_mat2, nc_mat2 = rand_dp_nc_matrix(30, 40, seed=1)
+        before = id(nc_mat1)
+        nc_mat1 += nc_mat2
+        self.assertEqual(id(nc_mat1), before)
+        self.assertTrue(cmp_dp_nc_matrix(dp_mat1 + dp_mat2, nc_mat1))
+        nc_mat1 -= nc_mat2
+        nc_mat1 -= nc_mat2
+        self.assertTrue(cmp_dp_nc_matrix(dp_mat1 - dp_mat2, nc_mat1))
+        with self.assertRaises(ValueError):
+            nc_mat1 += nc.Matrix(2, 2)
+        with self.assertRaises(TypeError):
+            nc_mat1 += "1"
+
+    def test_inplace_mul_pow(self):
+        dp_mat1, nc_mat1 = rand_dp_nc_matrix(20, 20, seed=0)
+        dp_mat2, nc_mat2 = rand_dp_nc_matrix(20, 20, seed=1)
+        before = id(nc_mat1)
+        nc_mat1 *= nc_mat2
+        self.assertEqual(id(nc_mat1), before)
+        self.assertTrue(cmp_dp_nc_matrix(dp_mat1 * dp_mat2, nc_mat1))
+        nc_mat2 **= 3
+        self.assertTrue(cmp_dp_nc_matrix(dp_mat2 ** 3, nc_mat2))
+        # A product of a different shape becomes a new matrix
+        nc_mat3 = nc.Matrix(20, 5, 1)
+        nc_mat1 *= nc_mat3
+        self.assertEqual(nc_mat1.shape, (20, 5))
+
+    def test_inplace_shared(self):
+        arr = np.arange(16.0).reshape(4, 4)
+        nc_mat = nc.Matrix(arr)
+        rows = nc_mat[0:2]
+        nc_mat *= nc.Matrix(4, 4, 1)
+        self.assertEqual(arr[0, 0], 6)
+        self.assertEqual(nc.to_list(rows)[1], [22, 22, 22, 22])
+        # Overlapping slices are read before they are written
+        nc_mat = nc.Matrix(np.arange(16.0).reshape(4, 4))
+        nc_mat[0:3] += nc_mat[1:4]
+        self.assertEqual(nc.to_list(nc_mat)[:3], [[4, 6, 8, 10], [12, 14, 16, 18], [20, 22, 24, 26]])
+
+
+class TestScalarOperands(TestCase):
+    def test_scalar_operators(self):
+        arr = np.arange(-6.0, 6.0).reshape(3, 4) + 0.5
+        nc_mat = nc.Matrix(arr)
+        pairs = [(nc_mat + 2, arr + 2), (2 + nc_mat, 2 + arr), (nc_mat - 1.5, arr - 1.5),
+                 (3 - nc_mat, 3 - arr), (nc_mat * -2, arr * -2), (0.5 * nc_mat, 0.5 * arr),
+                 (nc_mat / 4, arr / 4), (7 / nc_mat, 7 / arr)]
+        for nc_result, expected in pairs:
+            self.assertEqual(nc_result.shape, (3, 4))
+            self.assertTrue(np.array_equal(np.asarray(nc_result), expected))
+        # Strided views are read in place, and float32 stays float32
+        self.assertTrue(np.array_equal(np.asarray(nc_mat[::2, 1::2] * 3), arr[::2, 1::2] * 3))
+        nc_single = nc.Matrix(arr.tolist(), dtype="float32")
+        self.assertEqual((nc_single / 3).dtype, "float32")
+        self.assertTrue(np.allclose(np.asarray(1 - nc_single), 1 - arr))
+        with self.assertRaises(TypeError):
+            nc_mat + "1"
+        with self.assertRaises(TypeError):
+            [1] / nc_mat
+
+    def test_scalar_inplace(self):
+        arr = np.arange(16.0).reshape(4, 4)
+        nc_mat = nc.Matrix(arr.copy())
+        before = id(nc_mat)
+        rows = nc_mat[1:3]
+        nc_mat += 1
+        nc_mat *= 2
+        nc_mat -= 3
+        nc_mat /= 4
+        self.assertEqual(id(nc_mat), before)
+        expected = ((arr + 1) * 2 - 3) / 4
+        self.assertTrue(np.array_equal(np.asarray(nc_mat), expected))
+        self.assertTrue(np.array_equal(np.asarray(rows), expected[1:3]))
+        cols = nc_mat[:, ::3]
+        cols *= 0
+        self.assertEqual(nc.to_list(nc_mat)[0], [0, expected[0, 1], expected[0, 2], 0])
+
+    def test_scalar_lazy(self):
+        dp_mat1, nc_mat1 = rand_dp_nc_matrix(40, 30, seed=0)
+        dp_mat2, nc_mat2 = rand_dp_nc_matrix(40, 30, seed=1)
+        arr1, arr2 = np.asarray(nc_mat1), np.asarray(nc_mat2)
+        nc.set_lazy(True)
+        try:
+            nc_result = (nc_mat1 * 2 + 1) / 3 - (1 - nc_mat2)
+            expected = (arr1 * 2 + 1) / 3 - (1 - arr2)
+            self.assertTrue(np.allclose(np.asarray(nc_result), expected))
+        finally:
+            nc.set_lazy(False)
+
+
+class TestBroadcast(TestCase):
+    def test_broadcast_add_sub(self):
+        arr = np.arange(60.0).reshape(6, 10) - 25.5
+        row = np.arange(10.0).reshape(1, 10) * 3
+        col = np.arange(6.0).reshape(6, 1) - 2
+        nc_mat, nc_row, nc_col = nc.Matrix(arr.copy()), nc.Matrix(row.copy()), nc.Matrix(col.copy())
+        pairs = [(nc_mat + nc_row, arr + row), (nc_row + nc_mat, row + arr),
+                 (nc_mat - nc_col, arr - col), (nc_col - nc_mat, col - arr),
+                 (nc_row - nc_col, row - col), (nc.Matrix([[2.0]]) - nc_mat, 2 - arr),
+                 (nc_mat[::2, ::-1] + nc_row, arr[::2, ::-1] + row)]
+        for nc_result, expected in pairs:
+            self.assertTrue(np.array_equal(np.asarray(nc_result), expected))
+        nc_single = nc.Matrix(col.tolist(), dtype="float32")
+        self.assertTrue(np.array_equal(np.asarray(nc_mat + nc_single), arr + col))
+        with self.assertRaises(ValueError):
+            nc_mat + nc.Matrix(3, 10)
+        with self.assertRaises(ValueError):
+            nc_mat - nc.Matrix(6, 2)
+
+    def test_broadcast_inplace(self):
+        arr = np.arange(20.0).reshape(4, 5)
+        nc_mat = nc.Matrix(arr.copy())
+        nc_mat += nc.Matrix([[1.0, 2, 3, 4, 5]])
+        nc_mat -= nc.Matrix([[1.0], [2], [3], [4]])
+        self.assertTrue(np.array_equal(np.asarray(nc_mat), arr + np.arange(1, 6) - np.arange(1, 5)[:, None]))
+        # Broadcasting an overlapping row of self goes through a temporary
+        nc_mat = nc.Matrix(arr.copy())
+        nc_mat += nc_mat[0:1]
+        self.assertTrue(np.array_equal(np.asarray(nc_mat), arr + arr[0]))
+        nc_row = nc.Matrix(1, 5)
+        with self.assertRaises(ValueError):
+            nc_row += nc_mat
+
+    def test_broadcast_lazy(self):
+        arr = np.arange(12.0).reshape(3, 4)
+        nc_mat, nc_row = nc.Matrix(arr.copy()), nc.Matrix([[1.0, -1, 2, -2]])
+        nc.set_lazy(True)
+        try:
+            nc_result = abs(nc_mat - nc_row) + nc_mat
+            self.assertTrue(np.array_equal(np.asarray(nc_result), abs(arr - [1, -1, 2, -2]) + arr))
+        finally:
+            nc.set_lazy(False)
+
+
+class TestElementwise(TestCase):
+    def test_multiply_divide(self):
+        arr1 = np.arange(1.0, 31.0).reshape(5, 6)
+        arr2 = np.linspace(-3, 3, 30).reshape(5, 6)
+        row = np.arange(1.0, 7.0).reshape(1, 6)
+        nc_mat1, nc_mat2, nc_row = nc.Matrix(arr1.copy()), nc.Matrix(arr2.copy()), nc.Matrix(row.copy())
+        pairs = [(nc.multiply(nc_mat1, nc_mat2), arr1 * arr2), (nc.divide(nc_mat2, nc_mat1), arr2 / arr1),
+                 (nc_mat2 / nc_mat1, arr2 / arr1), (nc.multiply(nc_row, nc_mat1), row * arr1),
+                 (nc.divide(nc_mat1[::2, 1:4], nc_row[:, :3]), arr1[::2, 1:4] / row[:, :3])]
+        for nc_result, expected in pairs:
+            self.assertTrue(np.array_equal(np.asarray(nc_result), expected))
+        nc_out = nc.Matrix(5, 6)
+        self.assertIs(nc.multiply(nc_mat1, nc_mat2, out=nc_out), nc_out)
+        self.assertTrue(np.array_equal(np.asarray(nc_out), arr1 * arr2))
+        nc_mat1 /= nc_row
+        self.assertTrue(np.array_equal(np.asarray(nc_mat1), arr1 / row))
+        with self.assertRaises(TypeError):
+            nc.multiply(nc_mat1, 2)
+        with self.assertRaises(ValueError):
+            nc.divide(nc_mat1, nc.Matrix(2, 6))
+        with self.assertRaises(ValueError):
+            nc.multiply(nc_mat1, nc_mat2, out=nc.Matrix(6, 5))
+
+    def test_axpy_axpby(self):
+        arr_x = np.arange(24.0).reshape(4, 6) - 7
+        arr_y = np.linspace(0, 1, 24).reshape(4, 6)
+        nc_x, nc_y = nc.Matrix(arr_x.copy()), nc.Matrix(arr_y.copy())
+        self.assertTrue(np.allclose(np.asarray(nc.axpy(2.5, nc_x, nc_y)), 2.5 * arr_x + arr_y))
+        self.assertTrue(np.allclose(np.asarray(nc.axpby(2.5, nc_x, -4, nc_y)), 2.5 * arr_x - 4 * arr_y))
+        self.assertTrue(np.array_equal(np.asarray(nc.axpby(3, nc_x, 0, nc_y)), 3 * arr_x))
+        # In place, and through overlapping rows of one matrix
+        self.assertIs(nc.axpy(-1, nc_x, nc_y, out=nc_y), nc_y)
+        self.assertTrue(np.allclose(np.asarray(nc_y), arr_y - arr_x))
+        nc.axpy(1, nc_x[0:3], nc_x[1:4], out=nc_x[1:4])
+        expected = arr_x.copy()
+        expected[1:4] += arr_x[0:3]
+        self.assertTrue(np.array_equal(np.asarray(nc_x), expected))
+        with self.assertRaises(TypeError):
+            nc.axpy("2", nc_x, nc_y)
+
+    def test_elementwise_lazy(self):
+        arr1, arr2 = np.arange(1.0, 13.0).reshape(3, 4), np.arange(12.0, 0, -1).reshape(3, 4)
+        nc_mat1, nc_mat2 = nc.Matrix(arr1.copy()), nc.Matrix(arr2.copy())
+        nc.set_lazy(True)
+        try:
+            nc_result = nc.multiply(nc_mat1 - nc_mat2, nc_mat1) + nc_mat1 / nc_mat2
+            self.assertTrue(np.allclose(np.asarray(nc_result), (arr1 - arr2) * arr1 + arr1 / arr2))
+        finally:
+            nc.set_lazy(False)
+
+
+class TestLazy(TestCase):
+    def setUp(self):
+        nc.set_lazy(True)
+
+    def tearDown(self):
+        nc.set_lazy(False)
+
+    def test_lazy_fused(self):
+        dp_mat1, nc_mat1 = rand_dp_nc_matrix(50, 60, seed=0)
+        dp_mat2, nc_mat2 = rand_dp_nc_matrix(50, 60, seed=1)
+        dp_mat3, nc_mat3 = rand_dp_nc_matrix(50, 60, seed=2)
+        self.assertTrue(nc.get_lazy())
+        nc_result = abs(-(nc_mat1 + nc_mat2 - nc_mat3))
+        self.assertEqual(nc_result.shape, (50, 60))
+        self.assertTrue(cmp_dp_nc_matrix(abs(-(dp_mat1 + dp_mat2 - dp_mat3)), nc_result))
+        # Long chains are evaluated in steps
+        nc_sum, dp_sum = nc_mat1, dp_mat1
+        for _ in range(30):
+            nc_sum, dp_sum = nc_sum + nc_mat2, dp_sum + dp_mat2
+        self.assertTrue(cmp_dp_nc_matrix(dp_sum, nc_sum))
+        dp_mat4, nc_mat4 = rand_dp_nc_matrix(60, 10, seed=3)
+        self.assertTrue(cmp_dp_nc_matrix((dp_mat1 - dp_mat2) * dp_mat4, (nc_mat1 - nc_mat2) * nc_mat4))
+
+    def test_lazy_reads_operands_at_creation(self):
+        nc_mat1 = nc.Matrix(3, 3, 1)
+        nc_mat2 = nc.Matrix(3, 3, 2)
+        nc_sum = nc_mat1 + nc_mat2
+        nc_mat1[0] = [5, 5, 5]
+        nc_mat2.set(2, 2, 10)
+        self.assertEqual(nc.to_list(nc_sum), [[3, 3, 3], [3, 3, 3], [3, 3, 3]])
+        arr = np.ones((2, 2))
+        nc_mat3 = nc.Matrix(arr)
+        nc_neg = -nc_mat3
+        arr[0, 0] = 7
+        self.assertEqual(nc_neg.get(0, 0), -1)
+        self.assertEqual(np.asarray(nc_mat1 - nc_mat1).sum(), 0)
+
+
+class TestDtype(TestCase):
+    def test_float32_ops(self):
+        arr1 = np.random.RandomState(0).rand(70, 50).astype(np.float32)
+        arr2 = np.random.RandomState(1).rand(50, 90).astype(np.float32)
+        arr3 = np.random.RandomState(2).rand(70, 50).astype(np.float32)
+        nc_mat1, nc_mat2, nc_mat3 = nc.Matrix(arr1), nc.Matrix(arr2), nc.Matrix(arr3)
+        self.assertEqual(nc_mat1.dtype, "float32")
+        self.assertEqual(nc.Matrix(2, 2).dtype, "float64")
+        self.assertEqual(nc.Matrix(2, 3, 1.5, dtype="float32").dtype, "float32")
+        self.assertEqual(nc.Matrix([[1, 2], [3, 4]], dtype=np.float32).dtype, "float32")
+        self.assertEqual(nc.Matrix(3, 3, rand=True, seed=4, dtype="float32").dtype, "float32")
+        for nc_result, np_result in [(nc_mat1 * nc_mat2, arr1 @ arr2),
+                                     (nc_mat1 + nc_mat3, arr1 + arr3),
+                                     (abs(-(nc_mat1 - nc_mat3)), abs(arr1 - arr3))]:
+            self.assertEqual(nc_result.dtype, "float32")
+            self.assertTrue(np.allclose(np.asarray(nc_result), np_result, rtol=1e-5, atol=1e-5))
+        with self.assertRaises(ValueError):
+            nc.Matrix(2, 2, dtype="int8")
+
+    def test_mixed_promotes(self):
+        arr1 = np.random.RandomState(0).rand(20, 30)
+        arr2 = np.random.RandomState(1).rand(30, 10).astype(np.float32)
+        nc_mat1, nc_mat2 = nc.Matrix(arr1), nc.Matrix(arr2)
+        nc_result = nc_mat1 * nc_mat2
+        self.assertEqual(nc_result.dtype, "float64")
+        self.assertTrue(np.allclose(np.asarray(nc_result), arr1 @ arr2.astype(np.float64)))
+        nc_result = nc.Matrix(arr2) + nc.Matrix(arr2.astype(np.float64))
+        self.assertEqual(nc_result.dtype, "float64")
+        # In-place operators keep the left operand's type
+        nc_mat3 = nc.Matrix(arr2.copy())
+        nc_mat3 += nc.Matrix(arr2.astype(np.float64))
+        self.assertEqual(nc_mat3.dtype, "float32")
+        self.assertTrue(np.allclose(np.asarray(nc_mat3), 2 * arr2))
+
+    def test_float32_buffer(self):
+        arr = np.arange(12, dtype=np.float32).reshape(3, 4)
+        nc_mat = nc.Matrix(arr)
+        arr[1, 1] = -3
+        self.assertEqual(nc_mat.get(1, 1), -3)
+        view = memoryview(nc_mat)
+        self.assertEqual(view.format, "f")
+        self.assertEqual(view.itemsize, 4)
+        self.assertEqual(np.asarray(nc_mat).dtype, np.float32)
+        self.assertEqual(np.asarray(nc_mat[:, 1:3]).tolist(), [[1, 2], [-3, 6], [9, 10]])
+        nc_copy = nc.Matrix(arr, dtype="float64")
+        self.assertEqual(nc_copy.dtype, "float64")
+        arr[0, 0] = 8
+        self.assertEqual(nc_copy.get(0, 0), 0)
+
+
+class TestRandom(TestCase):
+    def test_rand_reproducible(self):
+        nc_mat1 = nc.Matrix(200, 300, rand=True, seed=5, low=-2, high=3)
+        nc_mat2 = nc.Matrix(200, 300, rand=True, seed=5, low=-2, high=3)
+        arr = np.asarray(nc_mat1)
+        self.assertTrue(np.array_equal(arr, np.asarray(nc_mat2)))
+        self.assertTrue(arr.min() >= -2 and arr.max() < 3)
+        self.assertAlmostEqual(arr.mean(), 0.5, places=1)
+        self.assertFalse(np.array_equal(arr, np.asarray(nc.Matrix(200, 300, rand=True, seed=6))))
+        nc_mat3 = nc.Matrix(200, 300, rand=True, seed=5, low=-2, high=3, dtype="float32")
+        self.assertTrue(np.array_equal(np.asarray(nc_mat3), arr.astype(np.float32)))
+
+    def test_randn(self):
+        arr = np.asarray(nc.Matrix(400, 500, randn=True, seed=1, mean=2, std=3))
+        self.assertAlmostEqual(arr.mean(), 2, places=1)
+        self.assertAlmostEqual(arr.std(), 3, places=1)
+        self.assertTrue(np.array_equal(arr, np.asarray(nc.Matrix(400, 500, randn=True, seed=1,
+                                                                 mean=2, std=3))))
+        with self.assertRaises(TypeError):
+            nc.Matrix(2, 2, randn=True, std=-1)
+        with self.assertRaises(TypeError):
+            nc.Matrix(2, 2, randn=True, rand=True)
+
+
+class TestThreads(TestCase):
+    def test_concurrent_shared_parents(self):
+        arr = np.random.RandomState(0).rand(256, 256)
+        parent = nc.Matrix(arr.copy())
+        other = nc.Matrix(256, 256, rand=True, seed=1)
+        other_arr = np.asarray(other).copy()
+        errors = []
+
+        def work(t):
+            try:
+                for i in range(20):
+                    # Slices of the shared parent are created and dropped on every thread
+                    rows = parent[t * 32:(t + 1) * 32, :]
+                    product = rows * other
+                    expected = arr[t * 32:(t + 1) * 32, :] @ other_arr
+                    if not np.allclose(np.asarray(product), expected):
+                        errors.append("product")
+                    total = nc.Matrix(256, 256)
+                    total += parent
+                    total -= other
+                    if not np.allclose(np.asarray(total), arr - other_arr):
+                        errors.append("inplace")
+                    del rows
+            except Exception as e:
+                errors.append(repr(e))
+
+        threads = [threading.Thread(target=work, args=(t,)) for t in range(8)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors, [])
+        self.assertTrue(np.array_equal(np.asarray(parent), arr))
+
+    def test_gil_released(self):
+        nc_mat = nc.Matrix(1200, 1200, rand=True, seed=0)
+        done = threading.Event()
+        thread = threading.Thread(target=lambda: (nc_mat * nc_mat, done.set()))
+        ticks = 0
+        thread.start()
+        while not done.is_set():
+            ticks += 1
+            time.sleep(0.001)
+        thread.join()
+        self.assertGreater(ticks, 5)
+
+
+class TestParallel(TestCase):
+    def test_num_threads(self):
+        threads = nc.get_num_threads()
+        nc.set_num_threads(3)
+        self.assertEqual(nc.get_num_threads(), 3)
+        with self.assertRaises(ValueError):
+            nc.set_num_threads(0)
+        with self.assertRaises(ValueError):
+            nc.set_num_threads(100000)
+        nc.set_num_threads(threads)
+
+    def test_shared_pool(self):
+        # Python threads running kernels at once share one pool of workers
+        saved = nc.get_parallel_threshold("elementwise")
+        threads = nc.get_num_threads()
+        nc.set_num_threads(4)
+        nc.set_parallel_threshold("elementwise", 1)
+        dp_mat, nc_mat = rand_dp_nc_matrix(300, 300, seed=2)
+        results = [None] * 8
+
+        def work(index):
+            total = nc_mat
+            for _ in range(20):
+                total = total + nc_mat
+            results[index] = total
+
+        workers = [threading.Thread(target=work, args=(i,)) for i in range(8)]
+        for worker in workers:
+            worker.start()
+        for worker in workers:
+            worker.join()
+        expected = dp_mat
+        for _ in range(20):
+            expected = expected + dp_mat
+        self.assertTrue(all(cmp_dp_nc_matrix(expected, result) for result in results))
+        # Lowering the limit parks workers; kernels keep working with fewer threads
+        nc.set_num_threads(2)
+        self.assertTrue(cmp_dp_nc_matrix(dp_mat + dp_mat, nc_mat + nc_mat))
+        nc.set_parallel_threshold("elementwise", saved)
+        nc.set_num_threads(threads)
+
+    def test_thresholds(self):
+        saved = {kind: nc.get_parallel_threshold(kind) for kind in ("elementwise", "gemm", "random")}
+        dp_mat1, nc_mat1 = rand_dp_nc_matrix(40, 50, seed=0)
+        dp_mat2, nc_mat2 = rand_dp_nc_matrix(50, 30, seed=1)
+        nc_serial = nc_mat1 * nc_mat2
+        # Threshold 1 makes even tiny kernels run on every thread; the results stay the same
+        threads = nc.get_num_threads()
+        nc.set_num_threads(4)
+        for kind in saved:
+            nc.set_parallel_threshold(kind, 1)
+        self.assertEqual(nc.get_parallel_threshold("gemm"), 1)
+        self.assertEqual(nc.to_list(nc_mat1 * nc_mat2), nc.to_list(nc_serial))
+        self.assertTrue(cmp_dp_nc_matrix(dp_mat1 + dp_mat1, nc_mat1 + nc_mat1))
+        with self.assertRaises(ValueError):
+            nc.set_parallel_threshold("nothing", 5)
+        with self.assertRaises(ValueError):
+            nc.set_parallel_threshold("gemm", 0)
+        thresholds = nc.calibrate()
+        self.assertEqual(set(thresholds), set(saved))
+        self.assertTrue(all(work > 0 for work in thresholds.values()))
+        self.assertEqual(thresholds["gemm"], nc.get_parallel_threshold("gemm"))
+        for kind, work in saved.items():
+            nc.set_parallel_threshold(kind, work)
+        nc.set_num_threads(threads)
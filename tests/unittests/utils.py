@@ -38,7 +38,9 @@ Returns a random dumbpy matrix and a random numc matrix with the same data
 seed, low, and high are optional
 """
 def rand_dp_nc_matrix(rows, cols, low=0, high=1, seed=0):
-    return dp.Matrix(rows, cols, low=low, high=high,rand=True, seed=seed), nc.Matrix(rows, cols, low=low, high=high, rand=True, seed=seed)
+    # numc's generator is not libc's rand(), so the dumbpy matrix is built from numc's values
+    nc_mat = nc.Matrix(rows, cols, low=low, high=high, rand=True, seed=seed)
+    return dp.Matrix(rows, cols, [val for row in nc.to_list(nc_mat) for val in row]), nc_mat
 
 
 """